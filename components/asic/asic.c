@@ -161,3 +161,16 @@ double ASIC_get_asic_job_frequency_ms(GlobalState * GLOBAL_STATE)
     }
     return 500;
 }
+
+job_format ASIC_get_job_format(GlobalState * GLOBAL_STATE)
+{
+    switch (GLOBAL_STATE->DEVICE_CONFIG.family.asic.id) {
+        case BM1397:
+            return JOB_FORMAT_MIDSTATE;
+        case BM1366:
+        case BM1368:
+        case BM1370:
+            return JOB_FORMAT_HEADER;
+    }
+    return JOB_FORMAT_HEADER;
+}
@@ -0,0 +1,81 @@
+#include <math.h>
+
+#include "difficulty_controller.h"
+
+// hashes per share at difficulty 1
+#define HASHES_PER_DIFF_1 4294967296.0
+
+void difficulty_controller_init(difficulty_controller *controller, double shares_per_minute)
+{
+    controller->shares_per_minute = shares_per_minute > 0 ? shares_per_minute : 0;
+    controller->suggested = 0;
+    controller->suggested_us = 0;
+}
+
+static double ideal_difficulty(double hashrate_ghs, double shares_per_minute)
+{
+    return hashrate_ghs * 1e9 * 60 / (HASHES_PER_DIFF_1 * shares_per_minute);
+}
+
+uint32_t difficulty_for_share_rate(double hashrate_ghs, double shares_per_minute)
+{
+    if (hashrate_ghs <= 0 || shares_per_minute <= 0)
+    {
+        return 0;
+    }
+
+    double difficulty = ideal_difficulty(hashrate_ghs, shares_per_minute);
+    if (difficulty <= 1)
+    {
+        return 1;
+    }
+    // powers of two keep small hashrate swings from changing the suggestion
+    double exponent = round(log2(difficulty));
+    if (exponent >= 31)
+    {
+        return 1u << 31;
+    }
+    return 1u << (int)exponent;
+}
+
+uint32_t difficulty_controller_start(difficulty_controller *controller, uint32_t configured, double hashrate_ghs,
+                                     int64_t now_us)
+{
+    uint32_t difficulty = difficulty_for_share_rate(hashrate_ghs, controller->shares_per_minute);
+    if (difficulty == 0)
+    {
+        difficulty = configured;
+    }
+    controller->suggested = difficulty;
+    controller->suggested_us = now_us;
+    return difficulty;
+}
+
+uint32_t difficulty_controller_update(difficulty_controller *controller, double hashrate_ghs, int64_t now_us)
+{
+    if (controller->shares_per_minute <= 0 || hashrate_ghs <= 0)
+    {
+        return 0;
+    }
+    if (controller->suggested > 0)
+    {
+        if (now_us - controller->suggested_us < (int64_t)DIFFICULTY_CONTROLLER_MIN_INTERVAL_S * 1000000)
+        {
+            return 0;
+        }
+        double ideal = ideal_difficulty(hashrate_ghs, controller->shares_per_minute);
+        if (ideal >= controller->suggested / DIFFICULTY_CONTROLLER_TOLERANCE &&
+            ideal <= controller->suggested * DIFFICULTY_CONTROLLER_TOLERANCE) {
+            return 0;
+        }
+    }
+
+    uint32_t difficulty = difficulty_for_share_rate(hashrate_ghs, controller->shares_per_minute);
+    if (difficulty == controller->suggested)
+    {
+        return 0;
+    }
+    controller->suggested = difficulty;
+    controller->suggested_us = now_us;
+    return difficulty;
+}
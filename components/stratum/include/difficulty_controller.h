@@ -0,0 +1,32 @@
+#ifndef DIFFICULTY_CONTROLLER_H_
+#define DIFFICULTY_CONTROLLER_H_
+
+#include <stdint.h>
+
+// minimum time between two suggestions on the same connection
+#define DIFFICULTY_CONTROLLER_MIN_INTERVAL_S 300
+// the share rate may drift by this factor before a new difficulty is suggested
+#define DIFFICULTY_CONTROLLER_TOLERANCE 2.0
+
+// Picks the difficulty to suggest to the pool so shares come in at a target rate for the measured hashrate.
+typedef struct
+{
+    double shares_per_minute; // 0 keeps the configured difficulty
+    uint32_t suggested; // last difficulty suggested on the connection
+    int64_t suggested_us;
+} difficulty_controller;
+
+void difficulty_controller_init(difficulty_controller *controller, double shares_per_minute);
+
+// difficulty giving shares_per_minute at hashrate_ghs, rounded to the nearest power of two
+uint32_t difficulty_for_share_rate(double hashrate_ghs, double shares_per_minute);
+
+// Difficulty to suggest right after authorize: the configured one until there is a hashrate to go by.
+uint32_t difficulty_controller_start(difficulty_controller *controller, uint32_t configured, double hashrate_ghs,
+                                     int64_t now_us);
+
+// Difficulty to suggest now, 0 while the last suggestion still gives a share rate within the tolerance
+// or was made less than DIFFICULTY_CONTROLLER_MIN_INTERVAL_S ago.
+uint32_t difficulty_controller_update(difficulty_controller *controller, double hashrate_ghs, int64_t now_us);
+
+#endif /* DIFFICULTY_CONTROLLER_H_ */
@@ -0,0 +1,38 @@
+#ifndef LINE_READER_H_
+#define LINE_READER_H_
+
+#include <stddef.h>
+
+// Fixed size ring buffer that splits a byte stream into newline terminated lines.
+// Received bytes are written straight into the ring and only bytes not seen before are
+// searched for a newline. Lines are handed out in place as NUL terminated views, only a
+// line that wraps around the end of the ring is copied out to keep it contiguous.
+typedef struct
+{
+    char *buffer;
+    size_t size;
+    size_t start;   // offset of the first unread byte
+    size_t count;   // unread bytes from start, wrapping at size
+    size_t scanned; // unread bytes already searched for a newline
+    char *wrapped_line;
+    size_t wrapped_line_capacity;
+} line_reader;
+
+int line_reader_init(line_reader *reader, size_t size);
+
+void line_reader_free(line_reader *reader);
+
+// drop everything buffered, e.g. after reconnecting
+void line_reader_reset(line_reader *reader);
+
+// next complete non-empty line without its line ending, or NULL when there is none yet.
+// The view stays valid until the next call to any line_reader function.
+char *line_reader_next(line_reader *reader, size_t *line_len);
+
+// contiguous free space to receive into, 0 bytes when the ring is full
+char *line_reader_write_ptr(line_reader *reader, size_t *space);
+
+// mark bytes written at line_reader_write_ptr() as received
+void line_reader_commit(line_reader *reader, size_t len);
+
+#endif /* LINE_READER_H_ */
@@ -2,11 +2,41 @@
 #define MINING_H_
 
 #include "stratum_api.h"
+#include "mbedtls/sha256.h"
+
+#define MAX_JOB_ID_LEN 64
+#define MAX_EXTRANONCE_2_LEN 32
+
+// create_jobs_task only generates work while the ASIC job queue holds fewer jobs than this
+#define BM_JOB_QUEUE_LOW_WATER_MARK 10
+
+// bm_jobs come from a fixed pool sized for the most distinct ASIC job ids in use at once (32 on the BM1397),
+// the ASIC job queue filled up to its low water mark, its front slot and one job in flight on each side of it
+#define BM_JOB_POOL_SIZE (32 + BM_JOB_QUEUE_LOW_WATER_MARK + 1 + 2)
+
+// first block sha256 states cached per job for nonce validation, one per BM1397 midstate
+#define NONCE_MIDSTATE_CACHE_SIZE 4
+
+// top bits of the pool version mask kept back from the ASIC and rolled on the host,
+// so one merkle root yields 1 << JOB_HOST_VERSION_BITS jobs
+#define JOB_HOST_VERSION_BITS 2
+// host rolling only when the ASIC is still left with at least this many version bits
+#define JOB_MIN_ASIC_VERSION_BITS 8
+// without spare version bits ntime can be stepped forward instead, by at most JOB_NTIME_ROLLS - 1 seconds
+#define JOB_NTIME_ROLLS 4
+
+// which fields of a bm_job the ASIC job packet is built from
+typedef enum
+{
+    JOB_FORMAT_MIDSTATE, // BM1397: midstates + last 4 bytes of the merkle root
+    JOB_FORMAT_HEADER,   // BM1366/BM1368/BM1370: merkle_root_be + prev_block_hash_be, the chip rolls the version itself
+} job_format;
 
 typedef struct
 {
     uint32_t version;
     uint32_t version_mask;
+    uint32_t notify_version; // version from mining.notify, submitted version bits are relative to it
     uint8_t prev_block_hash[32];
     uint8_t prev_block_hash_be[32];
     uint8_t merkle_root[32];
@@ -21,23 +51,98 @@ typedef struct
     uint8_t midstate2[32];
     uint8_t midstate3[32];
     uint32_t pool_diff;
-    char *jobid;
-    char *extranonce2;
+    // 256 bit little endian targets, a hash meets a target when hash <= target
+    uint8_t pool_target[32];
+    uint8_t network_target[32];
+    char jobid[MAX_JOB_ID_LEN];
+    char extranonce2[MAX_EXTRANONCE_2_LEN * 2 + 1];
+    // receive time of the clean_jobs notify on the first job built from it, 0 on every other job
+    int64_t notify_received_us;
+
+    // written by test_nonce_value(), keyed by rolled version
+    uint8_t nonce_midstate_count;
+    uint8_t nonce_midstate_next;
+    uint32_t nonce_midstate_versions[NONCE_MIDSTATE_CACHE_SIZE];
+    uint32_t nonce_midstates[NONCE_MIDSTATE_CACHE_SIZE][8];
 } bm_job;
 
+// Binary coinbase transaction assembled once per notify:
+// coinbase_1 + extranonce + extranonce_2 + coinbase_2, with extranonce_2 patched in place per job.
+// The SHA-256 state over the fixed coinbase_1 + extranonce prefix is cached so each job only
+// hashes extranonce_2 + coinbase_2.
+typedef struct
+{
+    uint8_t *coinbase_tx;
+    size_t coinbase_tx_len;
+    size_t capacity;
+    size_t extranonce_2_offset;
+    size_t extranonce_2_len;
+    mbedtls_sha256_context prefix_ctx;
+} coinbase_builder;
+
+bm_job *alloc_bm_job(void);
+
+// Fields shared by every job of one notify, built once when the notify is dequeued.
+// Per job only the merkle root (and the midstates on JOB_FORMAT_MIDSTATE) are stamped into a copy.
+// Each merkle root can be stamped into `rolls` jobs that differ in host rolled version bits or ntime.
+typedef struct
+{
+    bm_job job;
+    job_format format;
+    uint8_t num_midstates;
+    uint32_t host_version_mask;
+    uint8_t rolls;
+} job_template;
+
 void free_bm_job(bm_job *job);
 
-char *construct_coinbase_tx(const char *coinbase_1, const char *coinbase_2,
-                            const char *extranonce, const char *extranonce_2);
+int coinbase_builder_init(coinbase_builder *builder, const mining_notify *params, const char *extranonce, int extranonce_2_len);
+
+void coinbase_builder_set_extranonce_2(coinbase_builder *builder, uint32_t extranonce_2);
 
-char *calculate_merkle_root_hash(const char *coinbase_tx, const uint8_t merkle_branches[][32], const int num_merkle_branches);
+void coinbase_builder_hash(coinbase_builder *builder, uint8_t coinbase_hash[32]);
 
-bm_job construct_bm_job(mining_notify *params, const char *merkle_root, const uint32_t version_mask, uint32_t difficulty);
+void coinbase_builder_free(coinbase_builder *builder);
 
-double test_nonce_value(const bm_job *job, const uint32_t nonce, const uint32_t rolled_version);
+void calculate_merkle_root_hash(const uint8_t *coinbase_tx, size_t coinbase_tx_len, const uint8_t merkle_branches[][32],
+                                const int num_merkle_branches, uint8_t merkle_root[32]);
+
+void calculate_merkle_root_from_coinbase_hash(const uint8_t coinbase_hash[32], const uint8_t merkle_branches[][32],
+                                              const int num_merkle_branches, uint8_t merkle_root[32]);
+
+void job_template_init(job_template *tmpl, const mining_notify *params, const uint32_t version_mask, uint32_t difficulty, job_format format);
+
+void job_template_set_rolling(job_template *tmpl, uint32_t host_version_mask, uint8_t ntime_rolls);
+
+void construct_bm_job_from_template(const job_template *tmpl, const uint8_t merkle_root[32], uint8_t roll, bm_job *job);
+
+uint32_t host_version_bits(uint32_t version_mask);
+
+bm_job construct_bm_job(mining_notify *params, const uint8_t merkle_root[32], const uint32_t version_mask, uint32_t difficulty, job_format format);
+
+void nonce_hash(bm_job *job, const uint32_t nonce, const uint32_t rolled_version, uint8_t hash[32]);
+
+// the 80 byte block header nonce_hash() hashes, in serialized block order
+void block_header(const bm_job *job, const uint32_t nonce, const uint32_t rolled_version, uint8_t header[80]);
+
+double test_nonce_value(bm_job *job, const uint32_t nonce, const uint32_t rolled_version);
+
+void difficulty_to_target(uint32_t difficulty, uint8_t target[32]);
+
+void nbits_to_target(uint32_t nbits, uint8_t target[32]);
+
+bool hash_meets_target(const uint8_t hash[32], const uint8_t target[32]);
+
+int hash_leading_zero_bits(const uint8_t hash[32]);
+
+int difficulty_leading_zero_bits(uint64_t difficulty);
+
+double hash_to_difficulty(const uint8_t hash[32]);
 
 char *extranonce_2_generate(uint32_t extranonce_2, uint32_t length);
 
+void extranonce_2_to_hex(uint32_t extranonce_2, uint32_t length, char *extranonce_2_str);
+
 uint32_t increment_bitmask(const uint32_t value, const uint32_t mask);
 
 #endif /* MINING_H_ */
\ No newline at end of file
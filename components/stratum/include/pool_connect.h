@@ -0,0 +1,75 @@
+#ifndef POOL_CONNECT_H_
+#define POOL_CONNECT_H_
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "lwip/sockets.h"
+#include "pool_selector.h"
+
+// pools the cache remembers: every configured pool, which the prober, the standby and the main connection
+// all go through, plus one spare so a lookup of a pool just reconfigured doesn't evict a live one
+#define POOL_DNS_CACHE_SIZE (STRATUM_MAX_POOLS + 1)
+// A and AAAA records kept per pool
+#define POOL_DNS_MAX_ADDRESSES 4
+#define POOL_DNS_MAX_HOST_LEN 64
+// lwip doesn't hand out record TTLs, resolved addresses are trusted this long
+#define POOL_DNS_TTL_S 300
+// head start of each connect attempt before the next address is tried in parallel (RFC 8305 suggests 250 ms)
+#define POOL_CONNECT_ATTEMPT_DELAY_MS 250
+#define POOL_CONNECT_TIMEOUT_MS 10000
+// TCP keepalive on pool connections: first probe after this much idle time, then every interval,
+// the connection is dropped after POOL_KEEPALIVE_COUNT unanswered probes
+#define POOL_KEEPALIVE_IDLE_S 30
+#define POOL_KEEPALIVE_INTERVAL_S 10
+#define POOL_KEEPALIVE_COUNT 3
+
+#define POOL_CONNECT_ERR_DNS -1
+#define POOL_CONNECT_ERR_SOCKET -2
+#define POOL_CONNECT_ERR_CONNECT -3
+
+typedef struct
+{
+    char host[POOL_DNS_MAX_HOST_LEN];
+    uint16_t port;
+    struct sockaddr_storage addresses[POOL_DNS_MAX_ADDRESSES];
+    int address_count;
+    // address of the last connection that went through, tried first next time
+    int preferred;
+    int64_t expires_us;
+    int64_t last_used_us;
+} pool_dns_entry;
+
+// Resolved pool addresses, shared by every task that connects to a pool
+typedef struct
+{
+    pool_dns_entry entries[POOL_DNS_CACHE_SIZE];
+    pthread_mutex_t lock;
+} pool_dns_cache;
+
+void pool_dns_cache_init(pool_dns_cache *cache);
+
+// copies the unexpired addresses of host:port, preferred first, returns how many (0 on a miss)
+int pool_dns_cache_lookup(pool_dns_cache *cache, const char *host, uint16_t port, int64_t now_us,
+                          struct sockaddr_storage *addresses, int max_addresses);
+
+// replaces the entry of host:port, evicting the least recently used pool when full
+void pool_dns_cache_store(pool_dns_cache *cache, const char *host, uint16_t port, const struct sockaddr_storage *addresses,
+                          int address_count, int64_t now_us);
+
+void pool_dns_cache_set_preferred(pool_dns_cache *cache, const char *host, uint16_t port, const struct sockaddr_storage *address);
+
+// forget host:port, e.g. when none of its addresses answer anymore
+void pool_dns_cache_invalidate(pool_dns_cache *cache, const char *host, uint16_t port);
+
+// reorder addresses in place so the address families alternate, keeping the first address first (RFC 8305)
+void pool_connect_interleave_families(struct sockaddr_storage *addresses, int address_count);
+
+// Connected (blocking) TCP socket to host:port or one of the POOL_CONNECT_ERR codes. Addresses come from the
+// shared cache when possible and are raced with non-blocking connects, each attempt getting a short head start.
+// The winning address is written to ip (optional) and tried first on the next call, connect_us (optional)
+// gets the time from the first connect attempt to the connection, without the time spent resolving.
+int pool_connect(const char *host, uint16_t port, char *ip, size_t ip_len, int64_t *connect_us);
+
+#endif /* POOL_CONNECT_H_ */
@@ -0,0 +1,71 @@
+#ifndef POOL_LIVENESS_H_
+#define POOL_LIVENESS_H_
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// a pool silent for this many smoothed notify gaps gets probed
+#define LIVENESS_NOTIFY_FACTOR 4
+// bounds on that silence, the upper one is the receive timeout used before notify cadence was tracked
+#define LIVENESS_MIN_SILENCE_S 90
+#define LIVENESS_MAX_SILENCE_S 600
+// notify gaps seen on a connection before its cadence is trusted
+#define LIVENESS_MIN_GAPS 3
+// weight of the newest gap in the smoothed one
+#define LIVENESS_GAP_SMOOTHING 0.2
+// a share unanswered for this many p99 share latencies gets the pool probed, twice that and it is dead
+#define LIVENESS_RESPONSE_FACTOR 4
+#define LIVENESS_MIN_RESPONSE_S 15
+#define LIVENESS_MAX_RESPONSE_S 60
+// a probe of a silent pool has to be answered within this, an unanswered probe for an overdue share
+// only ends the wait for it since some pools never answer the probe request
+#define LIVENESS_PROBE_TIMEOUT_S 10
+
+typedef enum
+{
+    POOL_LIVENESS_OK,
+    POOL_LIVENESS_PROBE, // send the pool a request that gets an answer
+    POOL_LIVENESS_DEAD,  // give up on the connection
+} pool_liveness_state;
+
+// Watches the connection being mined on for a pool that went quiet and keeps count of the time spent
+// mining without fresh work.
+typedef struct
+{
+    pthread_mutex_t lock;
+    int64_t last_rx_us;
+    int64_t last_notify_us;
+    double notify_gap_us; // smoothed gap between notifies
+    int gaps;
+    int64_t probe_sent_us; // 0 when no probe is outstanding
+    bool probe_for_silence; // the outstanding probe was sent because the pool went silent
+    int64_t probed_us; // last probe
+    int64_t stale_since_us; // last line of a connection that was lost, 0 while work is fresh
+    int64_t stale_us; // total time without fresh work after a lost connection
+} pool_liveness;
+
+void pool_liveness_init(pool_liveness *liveness);
+
+// a new connection starts with its own cadence
+void pool_liveness_connected(pool_liveness *liveness, int64_t now_us);
+
+// any line from the pool, fresh work when notify is set
+void pool_liveness_received(pool_liveness *liveness, bool notify, int64_t now_us);
+
+// the connection went down, work is stale from its last line on until the next notify
+void pool_liveness_lost(pool_liveness *liveness);
+
+// silence after which the pool gets probed
+int64_t pool_liveness_silence_limit_us(pool_liveness *liveness);
+
+// time a share may go unanswered before the pool gets probed, p99_ms below 0 without latency samples
+int64_t pool_liveness_response_limit_us(double p99_ms);
+
+// what to do about the connection, oldest_share_us 0 when no share is waiting on an answer
+pool_liveness_state pool_liveness_check(pool_liveness *liveness, int64_t oldest_share_us, double p99_ms, int64_t now_us);
+
+// time spent without fresh work after lost connections, including the current stretch
+double pool_liveness_stale_s(pool_liveness *liveness, int64_t now_us);
+
+#endif /* POOL_LIVENESS_H_ */
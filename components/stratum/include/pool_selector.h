@@ -0,0 +1,67 @@
+#ifndef POOL_SELECTOR_H_
+#define POOL_SELECTOR_H_
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// primary, fallback and the additional pools
+#define STRATUM_MAX_POOLS 6
+
+#define POOL_SELECTION_PRIORITY 0
+#define POOL_SELECTION_LATENCY 1
+
+// weight of the newest probe in the smoothed latencies
+#define POOL_LATENCY_SMOOTHING 0.3
+// failed probes in a row before a pool counts as down
+#define POOL_MAX_PROBE_FAILURES 2
+// a faster pool has to win this many probe rounds in a row ...
+#define POOL_SWITCH_ROUNDS 3
+// ... by this fraction of the current pool's latency and at least POOL_SWITCH_MIN_GAIN_MS
+#define POOL_SWITCH_MARGIN 0.2
+#define POOL_SWITCH_MIN_GAIN_MS 5.0
+// minimum time on a pool before latency alone moves the miner again
+#define POOL_SWITCH_HOLD_S 600
+
+typedef struct
+{
+    bool probed;
+    bool healthy;
+    int failures; // failed probes in a row
+    double connect_ms; // smoothed TCP connect time
+    double rtt_ms; // smoothed mining.subscribe round trip
+} pool_health;
+
+// Probe results of every configured pool and the pick of the pool to mine on.
+// Shared by the prober and the stratum task.
+typedef struct
+{
+    pthread_mutex_t lock;
+    pool_health pools[STRATUM_MAX_POOLS];
+    int pool_count;
+    int candidate; // pool beating the current one in the last rounds, -1 for none
+    int candidate_rounds;
+    int64_t switched_us;
+} pool_selector;
+
+void pool_selector_init(pool_selector *selector, int pool_count);
+
+void pool_selector_report(pool_selector *selector, int pool, bool ok, double connect_ms, double rtt_ms);
+
+// pool to mine on after a probe round: in priority mode the first healthy pool before the current one,
+// in latency mode the healthy pool with the lowest latency once it kept its lead long enough
+int pool_selector_choose(pool_selector *selector, int current, int mode, int64_t now_us);
+
+// remember when the miner moved to another pool, it stays there for POOL_SWITCH_HOLD_S
+void pool_selector_switched(pool_selector *selector, int64_t now_us);
+
+// pool to fail over to: the next pool in order not known to be down, wrapping around
+int pool_selector_next(pool_selector *selector, int current);
+
+// best healthy pool other than current, -1 when there is none
+int pool_selector_best_alternative(pool_selector *selector, int current, int mode);
+
+// connect time plus subscribe round trip in ms, -1 while the pool is unprobed or down
+double pool_selector_latency_ms(pool_selector *selector, int pool);
+
+#endif /* POOL_SELECTOR_H_ */
@@ -0,0 +1,72 @@
+#ifndef REQUEST_TRACKER_H_
+#define REQUEST_TRACKER_H_
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "mining.h"
+#include "pool_selector.h"
+
+// requests waiting on a response, must be a power of two
+// stratum ids are handed out in order, so slot id % size only collides once this many are outstanding
+#define REQUEST_TRACKER_SIZE 64
+
+// statistics per configured pool
+#define REQUEST_TRACKER_POOLS STRATUM_MAX_POOLS
+
+// latency histogram with four log spaced buckets per doubling of microseconds, covering up to ~67 s
+#define LATENCY_SUB_BUCKETS 4
+#define LATENCY_BUCKETS (27 * LATENCY_SUB_BUCKETS)
+
+typedef struct
+{
+    int id; // stratum id, -1 when the slot is free
+    char jobid[MAX_JOB_ID_LEN]; // empty for setup requests
+    uint32_t difficulty; // pool difficulty the share is credited at, 0 for setup requests
+    int64_t sent_us;
+    uint8_t pool;
+} tracked_request;
+
+typedef struct
+{
+    uint32_t latency_buckets[LATENCY_BUCKETS];
+    uint32_t samples;
+    uint64_t submitted;
+    uint64_t accepted;
+    uint64_t rejected;
+    uint64_t lost; // evicted or dropped on reconnect before the pool answered
+    double accepted_difficulty;
+    int64_t first_submit_us;
+} share_latency_stats;
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    tracked_request in_flight[REQUEST_TRACKER_SIZE];
+    share_latency_stats stats[REQUEST_TRACKER_POOLS];
+} request_tracker;
+
+void request_tracker_init(request_tracker *tracker);
+
+// forget everything in flight, the ids are reused by the next connection
+void request_tracker_reset(request_tracker *tracker);
+
+// remember a request before it is written, jobid NULL for anything that is not a share
+void request_tracker_add(request_tracker *tracker, int id, const char *jobid, uint32_t difficulty, uint8_t pool,
+                         int64_t sent_us);
+
+// match a response to its request, shares also update the latency and accepted work statistics
+// false when the id is not in flight
+bool request_tracker_complete(request_tracker *tracker, int id, bool accepted, int64_t received_us,
+                              tracked_request *request);
+
+// when the oldest share still waiting on the pool was sent, 0 when every share is answered
+int64_t request_tracker_oldest_share_us(request_tracker *tracker);
+
+// share round trip time in milliseconds at the given percentile (0-100), -1 with no samples yet
+double request_tracker_latency_percentile_ms(request_tracker *tracker, uint8_t pool, double percentile);
+
+// hashrate in GH/s implied by the difficulty the pool accepted since the first share was submitted
+double request_tracker_accepted_hashrate(request_tracker *tracker, uint8_t pool, int64_t now_us);
+
+#endif /* REQUEST_TRACKER_H_ */
@@ -0,0 +1,34 @@
+#ifndef SHA256D_H_
+#define SHA256D_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Software SHA-256 with kernels specialised for the fixed input lengths used in mining:
+// 32 bytes (second hash of a double sha256), 64 bytes (merkle nodes, midstates) and
+// 80 bytes (block headers). Their padding is known in advance, so no length tracking,
+// buffering or finalisation is needed. Digests are written in the usual byte order.
+
+void sha256_state_init(uint32_t state[8]);
+
+// compress one 64 byte block into state
+void sha256_transform(uint32_t state[8], const uint8_t block[64]);
+
+// write state words as a big endian digest
+void sha256_state_to_digest(const uint32_t state[8], uint8_t digest[32]);
+
+void sha256_32(const uint8_t data[32], uint8_t digest[32]);
+void sha256_64(const uint8_t data[64], uint8_t digest[32]);
+void sha256_80(const uint8_t data[80], uint8_t digest[32]);
+
+// generic fallback for any length
+void sha256_generic(const uint8_t *data, size_t len, uint8_t digest[32]);
+
+// finish an 80 byte message from the state after its first 64 bytes and the remaining 16 bytes
+void sha256_80_from_midstate(const uint32_t midstate[8], const uint8_t tail[16], uint8_t digest[32]);
+
+// double sha256 for the fixed lengths
+void sha256d_64(const uint8_t data[64], uint8_t digest[32]);
+void sha256d_80(const uint8_t data[80], uint8_t digest[32]);
+
+#endif /* SHA256D_H_ */
@@ -0,0 +1,49 @@
+#ifndef SHARE_QUEUE_H_
+#define SHARE_QUEUE_H_
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "mining.h"
+
+// must be a power of two
+#define SHARE_QUEUE_SIZE 32
+
+// everything mining.submit needs, copied out of the bm_job so the job can be recycled
+typedef struct
+{
+    char jobid[MAX_JOB_ID_LEN];
+    char extranonce2[MAX_EXTRANONCE_2_LEN * 2 + 1];
+    uint32_t ntime;
+    uint32_t nonce;
+    uint32_t version; // rolled version, mining.submit only sends the bits that differ from notify_version
+    uint32_t notify_version;
+    uint32_t pool_diff;
+    // kept for resending after a reconnect, in notify byte order
+    uint8_t prev_block_hash[32];
+    bool block_candidate; // meets the network target
+} share_submission;
+
+// Lock free single producer / single consumer ring of shares waiting to be sent.
+// The ASIC result task pushes, the share submit task reads and releases.
+typedef struct
+{
+    share_submission entries[SHARE_QUEUE_SIZE];
+    atomic_uint head; // next entry to read, only advanced by the consumer
+    atomic_uint tail; // next entry to write, only advanced by the producer
+    atomic_uint dropped;
+} share_queue;
+
+void share_queue_init(share_queue *queue);
+
+// producer side, false (and the share counted as dropped) when the ring is full
+bool share_queue_push(share_queue *queue, const share_submission *share);
+
+// consumer side, oldest share or NULL when empty, valid until share_queue_release()
+const share_submission *share_queue_front(share_queue *queue);
+
+void share_queue_release(share_queue *queue);
+
+unsigned share_queue_count(share_queue *queue);
+
+#endif /* SHARE_QUEUE_H_ */
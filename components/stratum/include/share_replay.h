@@ -0,0 +1,76 @@
+#ifndef SHARE_REPLAY_H_
+#define SHARE_REPLAY_H_
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "share_queue.h"
+
+#define SHARE_REPLAY_SIZE 16
+// block candidates are never pushed out by ordinary shares, at most this many of them are kept
+#define SHARE_REPLAY_MAX_CANDIDATES 4
+// ordinary shares older than this are stale by the time the connection is back
+#define SHARE_REPLAY_MAX_AGE_S 120
+// extranonce1 as hex, pools hand out 4 to 16 bytes
+#define SHARE_REPLAY_EXTRANONCE_LEN 65
+
+// a share that could not be sent, with the session it was found for
+typedef struct
+{
+    share_submission share;
+    char extranonce1[SHARE_REPLAY_EXTRANONCE_LEN];
+    int32_t pool;
+    int64_t buffered_us;
+    bool resend;
+    int32_t sent_id; // a block candidate sent on the live connection, -1 once the pool answered or the connection is gone
+} replay_share;
+
+// Shares found while the connection to the pool is down, resent once the same session is back.
+// The share submit task buffers and resends, the stratum task suspends and resumes.
+typedef struct
+{
+    pthread_mutex_t lock;
+    replay_share entries[SHARE_REPLAY_SIZE];
+    int count;
+    bool suspended;
+    // session the shares buffered from now on belong to
+    char extranonce1[SHARE_REPLAY_EXTRANONCE_LEN];
+    int32_t pool;
+    bool candidates_changed;
+} share_replay;
+
+void share_replay_init(share_replay *replay);
+
+// the connection of this session is gone, shares are buffered for it until share_replay_resume()
+void share_replay_suspend(share_replay *replay, int pool, const char *extranonce1);
+
+bool share_replay_suspended(share_replay *replay);
+
+// false when an older share had to make room, the oldest ordinary share or past SHARE_REPLAY_MAX_CANDIDATES the oldest candidate
+bool share_replay_add(share_replay *replay, const share_submission *share, int64_t now_us);
+
+// a block candidate just found, it goes out ahead of the shares waiting in the share queue,
+// or after share_replay_resume() when the connection is down
+void share_replay_add_candidate(share_replay *replay, const share_submission *share, int64_t now_us);
+
+// keeps a block candidate that went out as mining.submit id until share_replay_answered()
+void share_replay_sent(share_replay *replay, const share_submission *share, int id, int64_t now_us);
+
+void share_replay_answered(share_replay *replay, int id);
+
+// First work of the new connection is in: drops what is stale for prev_block_hash and marks the shares
+// of a resumed session for resending, shares buffered from now on belong to the new session. Block candidates stay for a later reconnect while the block is current.
+// Returns the number of shares to resend.
+int share_replay_resume(share_replay *replay, int pool, const char *extranonce1, const uint8_t *prev_block_hash,
+                        int64_t now_us);
+
+// oldest share marked for resending, false when there is none
+bool share_replay_pop(share_replay *replay, share_submission *share);
+
+// true once after the set of block candidates changed, they are copied to out for persisting
+bool share_replay_take_candidates(share_replay *replay, replay_share *out, int *count);
+
+// block candidates persisted before a reboot, they wait for share_replay_resume()
+void share_replay_restore(share_replay *replay, const replay_share *candidates, int count);
+
+#endif /* SHARE_REPLAY_H_ */
@@ -2,6 +2,7 @@
 #define STRATUM_API_H
 
 #include "cJSON.h"
+#include "line_reader.h"
 #include <stdint.h>
 #include <stdbool.h>
 #include <sys/time.h>
@@ -11,7 +12,10 @@
 #define HASH_SIZE 32
 #define COINBASE_SIZE 100
 #define COINBASE2_SIZE 128
-#define MAX_REQUEST_IDS 1024
+// longest JSON-RPC line the receive buffer holds, notifies with big coinbases need the most
+#define STRATUM_LINE_BUFFER_SIZE 16384
+// longest subscription id taken from a pool, anything longer isn't offered back for resuming
+#define MAX_SESSION_ID_LEN 64
 
 typedef enum
 {
@@ -33,20 +37,36 @@ static const int  STRATUM_ID_SUBSCRIBE    = 2;
 typedef struct
 {
     char *job_id;
-    char *prev_block_hash;
-    char *coinbase_1;
-    char *coinbase_2;
+    // notify params decoded from hex once, as received
+    uint8_t prev_block_hash[HASH_SIZE];
+    uint8_t *coinbase_1;
+    size_t coinbase_1_len;
+    uint8_t *coinbase_2;
+    size_t coinbase_2_len;
     uint8_t *merkle_branches;
     size_t n_merkle_branches;
     uint32_t version;
     uint32_t target;
     uint32_t ntime;
+    bool clean_jobs;
+    // Stratum V2 header-only jobs come with the merkle root instead of a coinbase and merkle branches
+    bool has_merkle_root;
+    uint8_t merkle_root[HASH_SIZE];
+    // esp_timer time the notify was received, for new work latency
+    int64_t received_us;
+    // allocated buffer sizes, pooled records keep their buffers between notifies
+    size_t job_id_capacity;
+    size_t coinbase_1_capacity;
+    size_t coinbase_2_capacity;
+    size_t merkle_branches_capacity;
 } mining_notify;
 
 typedef struct
 {
     char * extranonce_str;
     int extranonce_2_len;
+    // mining.subscribe result, the subscription id a reconnect offers to resume the session, NULL if none
+    char * session_id;
 
     int64_t message_id;
     // Indicates the type of request the message represents.
@@ -64,21 +84,27 @@ typedef struct
     char * error_str;
 } StratumApiV1Message;
 
-typedef struct {
-    int64_t timestamp_us;
-    bool tracking;
-} RequestTiming;
-
 
 void STRATUM_V1_initialize_buffer();
 
-char *STRATUM_V1_receive_jsonrpc_line(int sockfd);
+// returns a NUL terminated view of the next line that stays valid until the next call, or NULL on error
+char *STRATUM_V1_receive_jsonrpc_line(int sockfd, size_t *line_len);
+
+// same on a reader of the caller's own, for connections next to the main one
+char *STRATUM_V1_receive_line(line_reader *reader, int sockfd, size_t *line_len);
+
+// Like STRATUM_V1_receive_line but gives up after timeout_ms without a complete line, setting timed_out.
+// A partial line stays buffered for the next call.
+char *STRATUM_V1_receive_line_timeout(line_reader *reader, int sockfd, size_t *line_len, int timeout_ms,
+                                      bool *timed_out);
 
-int STRATUM_V1_subscribe(int socket, int send_uid, const char * model);
+// session_id from an earlier subscribe result asks the pool to resume that session, NULL for a new one
+int STRATUM_V1_subscribe(int socket, int send_uid, const char * model, const char * session_id);
 
 void STRATUM_V1_parse(StratumApiV1Message *message, const char *stratum_json);
 
-void STRATUM_V1_stamp_tx(int request_id);
+// the full cJSON parser STRATUM_V1_parse() falls back to for messages the fast decoder leaves alone
+void STRATUM_V1_parse_cjson(StratumApiV1Message *message, const char *stratum_json);
 
 void STRATUM_V1_free_mining_notify(mining_notify *params);
 
@@ -94,6 +120,8 @@ int STRATUM_V1_submit_share(int socket, int send_uid, const char *username, cons
                             const char *extranonce_2, const uint32_t ntime, const uint32_t nonce,
                             const uint32_t version);
 
-double STRATUM_V1_get_response_time_ms(int request_id);
+int STRATUM_V1_format_submit(char *buf, size_t size, int send_uid, const char *username, const char *jobid,
+                             const char *extranonce_2, const uint32_t ntime, const uint32_t nonce,
+                             const uint32_t version);
 
 #endif // STRATUM_API_H
\ No newline at end of file
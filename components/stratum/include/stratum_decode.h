@@ -0,0 +1,31 @@
+#ifndef STRATUM_DECODE_H_
+#define STRATUM_DECODE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "stratum_api.h"
+
+// mining_notify records are taken from a fixed pool sized for a full stratum queue (12),
+// the notify being worked on and the one being parsed, with room to spare.
+// Records keep their buffers when released, so a steady stream of notifies stops allocating.
+#define MINING_NOTIFY_POOL_SIZE 16
+
+// Decodes the hot messages (mining.notify, mining.set_difficulty and boolean results) in one pass
+// over the line, straight into a pooled binary notify record, without building a cJSON tree.
+// Returns false without touching message when the line needs the cJSON parser: other methods,
+// escaped strings, non integer numbers, error objects or reject reasons.
+bool STRATUM_V1_decode_fast(StratumApiV1Message *message, const char *json, size_t len);
+
+stratum_method STRATUM_V1_method_from_name(const char *name, size_t len);
+
+// pooled record with every field cleared, falls back to the heap when the pool is exhausted
+mining_notify *STRATUM_V1_alloc_mining_notify(void);
+
+bool STRATUM_V1_notify_set_job_id(mining_notify *notify, const char *job_id, size_t len);
+
+// decode hex_len hex digits into a notify buffer, growing it when needed
+bool STRATUM_V1_notify_decode_hex(uint8_t **buf, size_t *len, size_t *capacity, const char *hex, size_t hex_len);
+
+bool STRATUM_V1_notify_reserve_merkle_branches(mining_notify *notify, size_t n_merkle_branches);
+
+#endif /* STRATUM_DECODE_H_ */
@@ -0,0 +1,108 @@
+#ifndef STRATUM_V2_API_H_
+#define STRATUM_V2_API_H_
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "stratum_api.h"
+#include "sv2_noise.h"
+#include "sv2_protocol.h"
+
+// jobs for the next block kept until their SetNewPrevHash arrives
+#define STRATUM_V2_FUTURE_JOBS 4
+// largest frame payload the client accepts, pool messages on a standard channel are far smaller
+#define STRATUM_V2_MAX_PAYLOAD 1024
+// room for one encrypted client message
+#define STRATUM_V2_SEND_BUFFER_SIZE 512
+
+typedef enum
+{
+    STRATUM_V2_NONE,
+    STRATUM_V2_SETUP_SUCCESS,
+    STRATUM_V2_SETUP_ERROR,
+    STRATUM_V2_CHANNEL_OPENED,
+    STRATUM_V2_CHANNEL_ERROR,
+    STRATUM_V2_NEW_WORK,
+    STRATUM_V2_SET_TARGET,
+    STRATUM_V2_SHARES_ACCEPTED,
+    STRATUM_V2_SHARE_REJECTED,
+    STRATUM_V2_RECONNECT,
+} stratum_v2_event_type;
+
+typedef struct
+{
+    stratum_v2_event_type type;
+    // STRATUM_V2_NEW_WORK: header-only notify, owned by the caller
+    mining_notify *mining_notification;
+    // STRATUM_V2_CHANNEL_OPENED and STRATUM_V2_SET_TARGET
+    uint32_t difficulty;
+    // STRATUM_V2_SHARES_ACCEPTED: last acknowledged sequence number, STRATUM_V2_SHARE_REJECTED: the rejected one
+    uint32_t sequence_number;
+    uint32_t accepted_count;
+    // error code of the pool, valid until the next frame is handled
+    const char *error;
+    // STRATUM_V2_RECONNECT, empty host means the same pool
+    const char *new_host;
+    uint16_t new_port;
+} stratum_v2_event;
+
+// Client side of a Stratum V2 connection with one standard (header-only) mining channel.
+// Socket I/O is left to the caller, so the same client runs against a pool or an in-memory stand-in.
+typedef struct
+{
+    sv2_noise_handshake handshake;
+    sv2_noise_transport transport;
+    // the share submit task encrypts next to the stratum task
+    pthread_mutex_t send_lock;
+
+    uint32_t channel_id;
+    bool channel_open;
+
+    bool has_prev_hash;
+    uint8_t prev_hash[32];
+    uint32_t nbits;
+
+    sv2_new_mining_job future_jobs[STRATUM_V2_FUTURE_JOBS];
+    int future_job_count;
+
+    sv2_message message;
+} stratum_v2_client;
+
+void STRATUM_V2_init(stratum_v2_client *client);
+
+// forget the previous connection, keys, channel and jobs included
+void STRATUM_V2_reset(stratum_v2_client *client);
+
+int STRATUM_V2_handshake_start(stratum_v2_client *client, uint8_t out[SV2_NOISE_ACT1_LEN]);
+
+// authority_key (x only) is optional, without it any pool key is accepted
+int STRATUM_V2_handshake_finish(stratum_v2_client *client, const uint8_t in[SV2_NOISE_ACT2_LEN], const uint8_t *authority_key,
+                                uint32_t now);
+
+// the message writers return the encrypted frame length or -1
+
+int STRATUM_V2_setup_connection(stratum_v2_client *client, uint8_t *out, size_t size, const sv2_setup_connection *setup);
+
+int STRATUM_V2_open_channel(stratum_v2_client *client, uint8_t *out, size_t size, uint32_t request_id, const char *user,
+                            float nominal_hash_rate);
+
+// -1 as well while no channel is open
+int STRATUM_V2_submit_share(stratum_v2_client *client, uint8_t *out, size_t size, uint32_t sequence_number, uint32_t job_id,
+                            uint32_t nonce, uint32_t ntime, uint32_t version);
+
+int STRATUM_V2_decrypt_header(stratum_v2_client *client, const uint8_t in[SV2_ENCRYPTED_HEADER_LEN], sv2_frame_header *header);
+
+// encrypted bytes that follow the header of this frame
+size_t STRATUM_V2_payload_wire_len(const sv2_frame_header *header);
+
+int STRATUM_V2_decrypt_payload(stratum_v2_client *client, const uint8_t *in, const sv2_frame_header *header, uint8_t *payload);
+
+// Decode one frame and translate it into what the miner acts on. Jobs come out as mining_notify records with
+// has_merkle_root set, the job id being the decimal SV2 job id.
+void STRATUM_V2_handle_frame(stratum_v2_client *client, const sv2_frame_header *header, const uint8_t *payload,
+                             stratum_v2_event *event);
+
+// pool difficulty of a 256 bit little endian target, rounded up so shares never fall short of it
+uint32_t STRATUM_V2_target_to_difficulty(const uint8_t target[32]);
+
+#endif /* STRATUM_V2_API_H_ */
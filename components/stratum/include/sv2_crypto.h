@@ -0,0 +1,39 @@
+#ifndef SV2_CRYPTO_H_
+#define SV2_CRYPTO_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// secp256k1 public keys travel as 64 byte ElligatorSwift encodings (BIP324)
+#define SV2_ELLSWIFT_LEN 64
+#define SV2_SCHNORR_SIGNATURE_LEN 64
+
+void sv2_hmac_sha256(const uint8_t *key, size_t key_len, const uint8_t *data, size_t data_len, uint8_t out[32]);
+
+// BIP340 tagged hash: SHA256(SHA256(tag) || SHA256(tag) || data)
+void sv2_tagged_hash(const char *tag, const uint8_t *data, size_t data_len, uint8_t out[32]);
+
+// new random secret key and the ElligatorSwift encoding of its public key
+int sv2_ellswift_create(uint8_t secret[32], uint8_t ellswift[SV2_ELLSWIFT_LEN]);
+
+// ElligatorSwift encoding of the public key of an existing secret key
+int sv2_ellswift_encode(const uint8_t secret[32], uint8_t ellswift[SV2_ELLSWIFT_LEN]);
+
+// x coordinate of the public key behind an ElligatorSwift encoding, every 64 byte string decodes to one
+int sv2_ellswift_decode(const uint8_t ellswift[SV2_ELLSWIFT_LEN], uint8_t x[32]);
+
+// BIP324 x-only ECDH between the party that sent ell_a and the one that sent ell_b,
+// secret belongs to ell_a when initiator is true
+int sv2_ellswift_ecdh(const uint8_t secret[32], const uint8_t ell_a[SV2_ELLSWIFT_LEN], const uint8_t ell_b[SV2_ELLSWIFT_LEN],
+                      bool initiator, uint8_t shared[32]);
+
+// BIP340 public key (x only) of a secret key
+int sv2_schnorr_pubkey(const uint8_t secret[32], uint8_t pubkey[32]);
+
+int sv2_schnorr_sign(const uint8_t secret[32], const uint8_t msg[32], uint8_t sig[SV2_SCHNORR_SIGNATURE_LEN]);
+
+// 0 when sig is a valid BIP340 signature of msg by pubkey
+int sv2_schnorr_verify(const uint8_t pubkey[32], const uint8_t msg[32], const uint8_t sig[SV2_SCHNORR_SIGNATURE_LEN]);
+
+#endif /* SV2_CRYPTO_H_ */
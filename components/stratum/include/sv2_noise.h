@@ -0,0 +1,91 @@
+#ifndef SV2_NOISE_H_
+#define SV2_NOISE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "sv2_crypto.h"
+
+// Noise_NX_Secp256k1+EllSwift_ChaChaPoly_SHA256 as used by Stratum V2:
+// the initiator (miner) sends an ephemeral key, the responder (pool) answers with its ephemeral key,
+// its static key and a certificate of the static key signed by the pool authority.
+
+#define SV2_NOISE_MAC_LEN 16
+#define SV2_NOISE_ACT1_LEN SV2_ELLSWIFT_LEN
+// version (2) + valid_from (4) + not_valid_after (4) + authority signature (64)
+#define SV2_SIGNATURE_NOISE_MESSAGE_LEN 74
+#define SV2_NOISE_ACT2_LEN                                                                                             \
+    (SV2_ELLSWIFT_LEN + SV2_ELLSWIFT_LEN + SV2_NOISE_MAC_LEN + SV2_SIGNATURE_NOISE_MESSAGE_LEN + SV2_NOISE_MAC_LEN)
+
+// after the handshake every frame header and every payload chunk is encrypted on its own
+#define SV2_FRAME_HEADER_LEN 6
+#define SV2_ENCRYPTED_HEADER_LEN (SV2_FRAME_HEADER_LEN + SV2_NOISE_MAC_LEN)
+#define SV2_NOISE_MAX_CHUNK_LEN 65535
+#define SV2_NOISE_MAX_CHUNK_PAYLOAD (SV2_NOISE_MAX_CHUNK_LEN - SV2_NOISE_MAC_LEN)
+
+typedef struct
+{
+    uint8_t key[32];
+    uint64_t nonce;
+    bool has_key;
+} sv2_cipher_state;
+
+typedef struct
+{
+    uint8_t h[32];
+    uint8_t ck[32];
+    sv2_cipher_state cipher;
+    uint8_t e_secret[32];
+    uint8_t e_ellswift[SV2_ELLSWIFT_LEN];
+} sv2_noise_handshake;
+
+typedef struct
+{
+    sv2_cipher_state send;
+    sv2_cipher_state recv;
+} sv2_noise_transport;
+
+typedef struct
+{
+    uint16_t version;
+    uint32_t valid_from;
+    uint32_t not_valid_after;
+    uint8_t signature[SV2_SCHNORR_SIGNATURE_LEN];
+} sv2_certificate;
+
+// initiator: write the first handshake message
+int sv2_noise_initiator_start(sv2_noise_handshake *hs, uint8_t out[SV2_NOISE_ACT1_LEN]);
+
+// same with a given ephemeral key instead of a random one, for replaying a recorded handshake
+int sv2_noise_initiator_start_with_key(sv2_noise_handshake *hs, const uint8_t e_secret[32],
+                                       const uint8_t e_ellswift[SV2_ELLSWIFT_LEN], uint8_t out[SV2_NOISE_ACT1_LEN]);
+
+// initiator: process the responder's answer and derive the transport keys.
+// The certificate is checked against authority_key (x only) when one is given, and its validity period
+// against now (unix time) when now is not 0. server_key receives the x coordinate of the pool's static key.
+int sv2_noise_initiator_finish(sv2_noise_handshake *hs, const uint8_t in[SV2_NOISE_ACT2_LEN], const uint8_t *authority_key,
+                               uint32_t now, sv2_noise_transport *transport, uint8_t server_key[32]);
+
+// responder side, for pool stand-ins: answer the first handshake message with a static key and its certificate
+int sv2_noise_responder_reply(sv2_noise_handshake *hs, const uint8_t in[SV2_NOISE_ACT1_LEN], const uint8_t static_secret[32],
+                              const uint8_t static_ellswift[SV2_ELLSWIFT_LEN], const sv2_certificate *certificate,
+                              uint8_t out[SV2_NOISE_ACT2_LEN], sv2_noise_transport *transport);
+
+// sign a certificate for a static key with the authority secret
+int sv2_certificate_sign(sv2_certificate *certificate, const uint8_t authority_secret[32], const uint8_t server_key[32]);
+
+int sv2_certificate_verify(const sv2_certificate *certificate, const uint8_t authority_key[32], const uint8_t server_key[32]);
+
+// bytes on the wire for a frame with a payload of payload_len bytes
+size_t sv2_noise_encrypted_frame_len(size_t payload_len);
+
+// encrypt a plaintext frame (header followed by its payload) into out, returns the encrypted length or -1
+int sv2_noise_encrypt_frame(sv2_noise_transport *transport, const uint8_t *frame, size_t frame_len, uint8_t *out, size_t out_size);
+
+int sv2_noise_decrypt_header(sv2_noise_transport *transport, const uint8_t in[SV2_ENCRYPTED_HEADER_LEN],
+                             uint8_t header[SV2_FRAME_HEADER_LEN]);
+
+// decrypt the sv2_noise_encrypted_frame_len(payload_len) - SV2_ENCRYPTED_HEADER_LEN bytes that follow a header
+int sv2_noise_decrypt_payload(sv2_noise_transport *transport, const uint8_t *in, size_t payload_len, uint8_t *payload);
+
+#endif /* SV2_NOISE_H_ */
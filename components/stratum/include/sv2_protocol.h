@@ -0,0 +1,154 @@
+#ifndef SV2_PROTOCOL_H_
+#define SV2_PROTOCOL_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "sv2_noise.h"
+
+// Stratum V2 binary framing: extension_type (U16, top bit set on channel messages), msg_type (U8),
+// msg_length (U24), all little endian, followed by the payload
+
+#define SV2_CHANNEL_MSG_BIT 0x8000
+
+#define SV2_SETUP_CONNECTION 0x00
+#define SV2_SETUP_CONNECTION_SUCCESS 0x01
+#define SV2_SETUP_CONNECTION_ERROR 0x02
+#define SV2_OPEN_STANDARD_MINING_CHANNEL 0x10
+#define SV2_OPEN_STANDARD_MINING_CHANNEL_SUCCESS 0x11
+#define SV2_OPEN_MINING_CHANNEL_ERROR 0x12
+#define SV2_NEW_MINING_JOB 0x15
+#define SV2_SUBMIT_SHARES_STANDARD 0x1a
+#define SV2_SUBMIT_SHARES_SUCCESS 0x1c
+#define SV2_SUBMIT_SHARES_ERROR 0x1d
+#define SV2_SET_NEW_PREV_HASH 0x20
+#define SV2_SET_TARGET 0x21
+#define SV2_RECONNECT 0x25
+
+#define SV2_PROTOCOL_MINING 0
+#define SV2_PROTOCOL_VERSION 2
+
+// SetupConnection flags of the mining protocol
+#define SV2_REQUIRES_STANDARD_JOBS 0x01
+#define SV2_REQUIRES_VERSION_ROLLING 0x04
+
+// STR0_255 fields, NUL terminated
+#define SV2_STR_MAX 255
+
+typedef struct
+{
+    uint16_t extension_type;
+    uint8_t msg_type;
+    uint32_t length;
+} sv2_frame_header;
+
+typedef struct
+{
+    uint16_t used_version;
+    uint32_t flags;
+} sv2_setup_connection_success;
+
+typedef struct
+{
+    uint32_t request_id;
+    uint32_t channel_id;
+    uint8_t target[32];
+    uint8_t extranonce_prefix[32];
+    uint8_t extranonce_prefix_len;
+    uint32_t group_channel_id;
+} sv2_open_channel_success;
+
+typedef struct
+{
+    uint32_t channel_id;
+    uint32_t job_id;
+    bool has_min_ntime; // without min_ntime the job is for the next SetNewPrevHash
+    uint32_t min_ntime;
+    uint32_t version;
+    uint8_t merkle_root[32];
+} sv2_new_mining_job;
+
+typedef struct
+{
+    uint32_t channel_id;
+    uint32_t job_id;
+    uint8_t prev_hash[32];
+    uint32_t min_ntime;
+    uint32_t nbits;
+} sv2_set_new_prev_hash;
+
+typedef struct
+{
+    uint32_t channel_id;
+    uint8_t maximum_target[32];
+} sv2_set_target;
+
+typedef struct
+{
+    uint32_t channel_id;
+    uint32_t last_sequence_number;
+    uint32_t new_submits_accepted_count;
+    uint64_t new_shares_sum;
+} sv2_submit_shares_success;
+
+typedef struct
+{
+    uint32_t channel_id;
+    uint32_t sequence_number;
+} sv2_submit_shares_error;
+
+typedef struct
+{
+    uint16_t new_port;
+    char new_host[SV2_STR_MAX + 1];
+} sv2_reconnect;
+
+// every message the client handles, decoded from one frame
+typedef struct
+{
+    uint8_t msg_type;
+    union
+    {
+        sv2_setup_connection_success setup_success;
+        sv2_open_channel_success open_channel_success;
+        sv2_new_mining_job new_mining_job;
+        sv2_set_new_prev_hash set_new_prev_hash;
+        sv2_set_target set_target;
+        sv2_submit_shares_success submit_success;
+        sv2_submit_shares_error submit_error;
+        sv2_reconnect reconnect;
+    };
+    // request_id of OpenMiningChannel.Error
+    uint32_t request_id;
+    // error_code of the error messages
+    char error_code[SV2_STR_MAX + 1];
+} sv2_message;
+
+typedef struct
+{
+    const char *endpoint_host;
+    uint16_t endpoint_port;
+    const char *vendor;
+    const char *hardware_version;
+    const char *firmware;
+    const char *device_id;
+} sv2_setup_connection;
+
+void sv2_write_frame_header(const sv2_frame_header *header, uint8_t out[SV2_FRAME_HEADER_LEN]);
+
+void sv2_read_frame_header(const uint8_t in[SV2_FRAME_HEADER_LEN], sv2_frame_header *header);
+
+// encoders write a plaintext frame, header included, and return its length or -1 when it does not fit
+
+int sv2_encode_setup_connection(uint8_t *out, size_t size, const sv2_setup_connection *setup, uint32_t flags);
+
+int sv2_encode_open_standard_mining_channel(uint8_t *out, size_t size, uint32_t request_id, const char *user_identity,
+                                            float nominal_hash_rate, const uint8_t max_target[32]);
+
+int sv2_encode_submit_shares_standard(uint8_t *out, size_t size, uint32_t channel_id, uint32_t sequence_number, uint32_t job_id,
+                                      uint32_t nonce, uint32_t ntime, uint32_t version);
+
+// false when the payload is malformed or the message is not one the client handles
+bool sv2_decode_message(const sv2_frame_header *header, const uint8_t *payload, sv2_message *message);
+
+#endif /* SV2_PROTOCOL_H_ */
@@ -25,6 +25,8 @@ void single_sha256_bin(const uint8_t *data, const size_t data_len, uint8_t *dest
 void midstate_sha256_bin(const uint8_t *data, const size_t data_len, uint8_t *dest);
 
 void swap_endian_words(const char *hex, uint8_t *output);
+void swap_endian_words_bin(const uint8_t *input, uint8_t *output, size_t len);
+void swap_reverse_words_bin(const uint8_t *input, uint8_t *output, size_t len);
 
 void reverse_bytes(uint8_t *data, size_t len);
 
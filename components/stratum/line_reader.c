@@ -0,0 +1,136 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "line_reader.h"
+
+static const char *TAG = "line_reader";
+
+int line_reader_init(line_reader *reader, size_t size)
+{
+    reader->buffer = malloc(size);
+    if (reader->buffer == NULL)
+    {
+        return -1;
+    }
+    reader->size = size;
+    reader->wrapped_line = NULL;
+    reader->wrapped_line_capacity = 0;
+    line_reader_reset(reader);
+    return 0;
+}
+
+void line_reader_free(line_reader *reader)
+{
+    free(reader->buffer);
+    free(reader->wrapped_line);
+    reader->buffer = NULL;
+    reader->wrapped_line = NULL;
+    reader->wrapped_line_capacity = 0;
+    reader->size = 0;
+    line_reader_reset(reader);
+}
+
+void line_reader_reset(line_reader *reader)
+{
+    reader->start = 0;
+    reader->count = 0;
+    reader->scanned = 0;
+}
+
+// contiguous view of the len bytes at start, whose newline is at start + len
+static char *line_view(line_reader *reader, size_t len)
+{
+    if (reader->start + len < reader->size)
+    {
+        char *line = reader->buffer + reader->start;
+        line[len] = '\0';
+        return line;
+    }
+
+    // the line wraps around the end of the ring, copy both parts out
+    if (len + 1 > reader->wrapped_line_capacity)
+    {
+        char *wrapped_line = realloc(reader->wrapped_line, len + 1);
+        if (wrapped_line == NULL)
+        {
+            ESP_LOGE(TAG, "Failed to allocate %u bytes for a wrapped line", (unsigned)(len + 1));
+            return NULL;
+        }
+        reader->wrapped_line = wrapped_line;
+        reader->wrapped_line_capacity = len + 1;
+    }
+
+    size_t first = reader->size - reader->start;
+    memcpy(reader->wrapped_line, reader->buffer + reader->start, first);
+    memcpy(reader->wrapped_line + first, reader->buffer, len - first);
+    reader->wrapped_line[len] = '\0';
+    return reader->wrapped_line;
+}
+
+static void consume(line_reader *reader, size_t len)
+{
+    reader->count -= len;
+    reader->start = reader->count == 0 ? 0 : (reader->start + len) % reader->size;
+    reader->scanned = 0;
+}
+
+char *line_reader_next(line_reader *reader, size_t *line_len)
+{
+    while (reader->scanned < reader->count)
+    {
+        // unscanned bytes are at most two contiguous runs
+        size_t pos = (reader->start + reader->scanned) % reader->size;
+        size_t run = reader->count - reader->scanned;
+        if (run > reader->size - pos)
+        {
+            run = reader->size - pos;
+        }
+
+        char *newline = memchr(reader->buffer + pos, '\n', run);
+        if (newline == NULL)
+        {
+            reader->scanned += run;
+            continue;
+        }
+
+        size_t len = reader->scanned + (size_t)(newline - (reader->buffer + pos));
+        char *line = line_view(reader, len);
+        consume(reader, len + 1);
+
+        if (line == NULL)
+        {
+            continue;
+        }
+        if (len > 0 && line[len - 1] == '\r')
+        {
+            line[--len] = '\0';
+        }
+        if (len == 0)
+        {
+            continue;
+        }
+
+        *line_len = len;
+        return line;
+    }
+
+    return NULL;
+}
+
+char *line_reader_write_ptr(line_reader *reader, size_t *space)
+{
+    size_t end = (reader->start + reader->count) % reader->size;
+
+    *space = reader->size - reader->count;
+    if (*space > reader->size - end)
+    {
+        *space = reader->size - end;
+    }
+    return reader->buffer + end;
+}
+
+void line_reader_commit(line_reader *reader, size_t len)
+{
+    reader->count += len;
+}
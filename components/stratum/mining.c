@@ -1,111 +1,303 @@
 #include <string.h>
 #include <stdio.h>
 #include <limits.h>
+#include <pthread.h>
 #include "mining.h"
 #include "utils.h"
+#include "sha256d.h"
 #include "mbedtls/sha256.h"
 
+static bm_job bm_job_pool[BM_JOB_POOL_SIZE];
+static bm_job *bm_job_free_list[BM_JOB_POOL_SIZE];
+static int bm_job_free_count = -1; // -1 until the free list is filled on first use
+static pthread_mutex_t bm_job_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// returns NULL when every job in the pool is in use
+bm_job *alloc_bm_job(void)
+{
+    bm_job *job = NULL;
+
+    pthread_mutex_lock(&bm_job_pool_lock);
+    if (bm_job_free_count < 0)
+    {
+        for (int i = 0; i < BM_JOB_POOL_SIZE; i++)
+        {
+            bm_job_free_list[i] = &bm_job_pool[i];
+        }
+        bm_job_free_count = BM_JOB_POOL_SIZE;
+    }
+    if (bm_job_free_count > 0)
+    {
+        job = bm_job_free_list[--bm_job_free_count];
+    }
+    pthread_mutex_unlock(&bm_job_pool_lock);
+
+    return job;
+}
+
 void free_bm_job(bm_job *job)
 {
-    free(job->jobid);
-    free(job->extranonce2);
-    free(job);
+    // jobs outside the pool (e.g. the self test job on the stack) are not ours to release
+    if (job < bm_job_pool || job >= bm_job_pool + BM_JOB_POOL_SIZE)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&bm_job_pool_lock);
+    bm_job_free_list[bm_job_free_count++] = job;
+    pthread_mutex_unlock(&bm_job_pool_lock);
+}
+
+int coinbase_builder_init(coinbase_builder *builder, const mining_notify *params, const char *extranonce, int extranonce_2_len)
+{
+    if (extranonce_2_len < 0 || extranonce_2_len > MAX_EXTRANONCE_2_LEN)
+    {
+        return -1;
+    }
+
+    size_t extranonce_len = strlen(extranonce) / 2;
+    size_t coinbase_tx_len = params->coinbase_1_len + extranonce_len + extranonce_2_len + params->coinbase_2_len;
+
+    // the buffer is reused between notifies and only grows when a larger coinbase arrives
+    if (coinbase_tx_len > builder->capacity)
+    {
+        uint8_t *coinbase_tx = realloc(builder->coinbase_tx, coinbase_tx_len);
+        if (coinbase_tx == NULL)
+        {
+            return -1;
+        }
+        builder->coinbase_tx = coinbase_tx;
+        builder->capacity = coinbase_tx_len;
+    }
+
+    uint8_t *p = builder->coinbase_tx;
+    memcpy(p, params->coinbase_1, params->coinbase_1_len);
+    p += params->coinbase_1_len;
+    hex2bin(extranonce, p, extranonce_len);
+    p += extranonce_len;
+    memset(p, 0, extranonce_2_len);
+    p += extranonce_2_len;
+    memcpy(p, params->coinbase_2, params->coinbase_2_len);
+
+    builder->coinbase_tx_len = coinbase_tx_len;
+    builder->extranonce_2_offset = params->coinbase_1_len + extranonce_len;
+    builder->extranonce_2_len = extranonce_2_len;
+
+    // hash the fixed prefix once, jobs clone this state and only hash the rest
+    mbedtls_sha256_free(&builder->prefix_ctx);
+    mbedtls_sha256_init(&builder->prefix_ctx);
+    mbedtls_sha256_starts(&builder->prefix_ctx, 0);
+    mbedtls_sha256_update(&builder->prefix_ctx, builder->coinbase_tx, builder->extranonce_2_offset);
+
+    return 0;
+}
+
+void coinbase_builder_set_extranonce_2(coinbase_builder *builder, uint32_t extranonce_2)
+{
+    // little endian, zero padded past 4 bytes
+    uint8_t *p = builder->coinbase_tx + builder->extranonce_2_offset;
+    for (size_t i = 0; i < builder->extranonce_2_len; i++)
+    {
+        p[i] = i < 4 ? (extranonce_2 >> (8 * i)) & 0xff : 0;
+    }
 }
 
-char *construct_coinbase_tx(const char *coinbase_1, const char *coinbase_2,
-                            const char *extranonce, const char *extranonce_2)
+// double sha256 of the coinbase_tx, resuming from the cached prefix state
+void coinbase_builder_hash(coinbase_builder *builder, uint8_t coinbase_hash[32])
 {
-    int coinbase_tx_len = strlen(coinbase_1) + strlen(coinbase_2) + strlen(extranonce) + strlen(extranonce_2) + 1;
+    uint8_t first_hash_output[32];
+    mbedtls_sha256_context ctx;
 
-    char *coinbase_tx = malloc(coinbase_tx_len);
-    strcpy(coinbase_tx, coinbase_1);
-    strcat(coinbase_tx, extranonce);
-    strcat(coinbase_tx, extranonce_2);
-    strcat(coinbase_tx, coinbase_2);
-    coinbase_tx[coinbase_tx_len - 1] = '\0';
+    mbedtls_sha256_init(&ctx);
+    mbedtls_sha256_clone(&ctx, &builder->prefix_ctx);
+    mbedtls_sha256_update(&ctx, builder->coinbase_tx + builder->extranonce_2_offset,
+                          builder->coinbase_tx_len - builder->extranonce_2_offset);
+    mbedtls_sha256_finish(&ctx, first_hash_output);
+    mbedtls_sha256_free(&ctx);
 
-    return coinbase_tx;
+    sha256_32(first_hash_output, coinbase_hash);
 }
 
-char *calculate_merkle_root_hash(const char *coinbase_tx, const uint8_t merkle_branches[][32], const int num_merkle_branches)
+void coinbase_builder_free(coinbase_builder *builder)
 {
-    size_t coinbase_tx_bin_len = strlen(coinbase_tx) / 2;
-    uint8_t *coinbase_tx_bin = malloc(coinbase_tx_bin_len);
-    hex2bin(coinbase_tx, coinbase_tx_bin, coinbase_tx_bin_len);
+    free(builder->coinbase_tx);
+    mbedtls_sha256_free(&builder->prefix_ctx);
+    memset(builder, 0, sizeof(coinbase_builder));
+}
+
+void calculate_merkle_root_hash(const uint8_t *coinbase_tx, size_t coinbase_tx_len, const uint8_t merkle_branches[][32],
+                                const int num_merkle_branches, uint8_t merkle_root[32])
+{
+    uint8_t *coinbase_hash = double_sha256_bin(coinbase_tx, coinbase_tx_len);
+    calculate_merkle_root_from_coinbase_hash(coinbase_hash, merkle_branches, num_merkle_branches, merkle_root);
+    free(coinbase_hash);
+}
 
+void calculate_merkle_root_from_coinbase_hash(const uint8_t coinbase_hash[32], const uint8_t merkle_branches[][32],
+                                              const int num_merkle_branches, uint8_t merkle_root[32])
+{
     uint8_t both_merkles[64];
-    uint8_t *new_root = double_sha256_bin(coinbase_tx_bin, coinbase_tx_bin_len);
-    free(coinbase_tx_bin);
-    memcpy(both_merkles, new_root, 32);
-    free(new_root);
+    memcpy(both_merkles, coinbase_hash, 32);
     for (int i = 0; i < num_merkle_branches; i++)
     {
         memcpy(both_merkles + 32, merkle_branches[i], 32);
-        uint8_t *new_root = double_sha256_bin(both_merkles, 64);
-        memcpy(both_merkles, new_root, 32);
-        free(new_root);
+        sha256d_64(both_merkles, both_merkles);
     }
 
-    char *merkle_root_hash = malloc(65);
-    bin2hex(both_merkles, 32, merkle_root_hash, 65);
-    return merkle_root_hash;
+    memcpy(merkle_root, both_merkles, 32);
 }
 
-// take a mining_notify struct with ascii hex strings and convert it to a bm_job struct
-bm_job construct_bm_job(mining_notify *params, const char *merkle_root, const uint32_t version_mask, const uint32_t difficulty)
+void job_template_init(job_template *tmpl, const mining_notify *params, const uint32_t version_mask, const uint32_t difficulty, job_format format)
 {
-    bm_job new_job;
+    bm_job *job = &tmpl->job;
+
+    job->version = params->version;
+    job->version_mask = version_mask;
+    job->notify_version = params->version;
+    job->target = params->target;
+    job->ntime = params->ntime;
+    job->starting_nonce = 0;
+    job->pool_diff = difficulty;
+
+    job->jobid[0] = '\0';
+    if (params->job_id != NULL)
+    {
+        strncpy(job->jobid, params->job_id, MAX_JOB_ID_LEN - 1);
+        job->jobid[MAX_JOB_ID_LEN - 1] = '\0';
+    }
+    job->extranonce2[0] = '\0';
+    job->notify_received_us = 0;
+    job->nonce_midstate_count = 0;
+    job->nonce_midstate_next = 0;
 
-    new_job.version = params->version;
-    new_job.target = params->target;
-    new_job.ntime = params->ntime;
-    new_job.starting_nonce = 0;
-    new_job.pool_diff = difficulty;
+    // prev_block_hash is used to verify nonces for every ASIC family
+    swap_endian_words_bin(params->prev_block_hash, job->prev_block_hash, 32);
 
-    hex2bin(merkle_root, new_job.merkle_root, 32);
+    difficulty_to_target(difficulty, job->pool_target);
+    nbits_to_target(params->target, job->network_target);
 
-    // hex2bin(merkle_root, new_job.merkle_root_be, 32);
-    swap_endian_words(merkle_root, new_job.merkle_root_be);
-    reverse_bytes(new_job.merkle_root_be, 32);
+    tmpl->format = format;
+    if (format == JOB_FORMAT_HEADER)
+    {
+        memcpy(job->prev_block_hash_be, params->prev_block_hash, 32);
+        reverse_bytes(job->prev_block_hash_be, 32);
+        tmpl->num_midstates = 0;
+    }
+    else
+    {
+        tmpl->num_midstates = version_mask != 0 ? 4 : 1;
+    }
+    job->num_midstates = tmpl->num_midstates;
 
-    swap_endian_words(params->prev_block_hash, new_job.prev_block_hash);
+    tmpl->host_version_mask = 0;
+    tmpl->rolls = 1;
+}
 
-    hex2bin(params->prev_block_hash, new_job.prev_block_hash_be, 32);
-    reverse_bytes(new_job.prev_block_hash_be, 32);
+// let each merkle root be stamped into several jobs: one per combination of the host_version_mask bits,
+// or, when there are none, ntime_rolls jobs with ntime stepped forward one second at a time (1 rolls nothing)
+void job_template_set_rolling(job_template *tmpl, uint32_t host_version_mask, uint8_t ntime_rolls)
+{
+    // host bits must not overlap the bits the ASIC rolls
+    host_version_mask &= ~tmpl->job.version_mask;
 
-    ////make the midstate hash
-    uint8_t midstate_data[64];
+    tmpl->host_version_mask = host_version_mask;
+    if (host_version_mask != 0)
+    {
+        tmpl->rolls = 1 << __builtin_popcount(host_version_mask);
+    }
+    else
+    {
+        tmpl->rolls = ntime_rolls > 0 ? ntime_rolls : 1;
+    }
+}
 
-    // copy 68 bytes header data into midstate (and deal with endianess)
-    memcpy(midstate_data, &new_job.version, 4);             // copy version
-    memcpy(midstate_data + 4, new_job.prev_block_hash, 32); // copy prev_block_hash
-    memcpy(midstate_data + 36, new_job.merkle_root, 28);    // copy merkle_root
+// the top JOB_HOST_VERSION_BITS bits of the pool version mask, or 0 when the mask is too narrow to share
+uint32_t host_version_bits(uint32_t version_mask)
+{
+    if (__builtin_popcount(version_mask) < JOB_HOST_VERSION_BITS + JOB_MIN_ASIC_VERSION_BITS)
+        return 0;
+
+    uint32_t host_mask = 0;
+    for (int i = 0; i < JOB_HOST_VERSION_BITS; i++)
+    {
+        uint32_t top_bit = 0x80000000 >> __builtin_clz(version_mask);
+        host_mask |= top_bit;
+        version_mask &= ~top_bit;
+    }
+    return host_mask;
+}
 
-    midstate_sha256_bin(midstate_data, 64, new_job.midstate); // make the midstate hash
-    reverse_bytes(new_job.midstate, 32);                      // reverse the midstate bytes for the BM job packet
+// spread the low bits of value over the set bits of mask, lowest first
+static uint32_t deposit_bits(uint32_t value, uint32_t mask)
+{
+    uint32_t result = 0;
+    while (mask != 0 && value != 0)
+    {
+        uint32_t low_bit = mask & -mask;
+        if (value & 1)
+            result |= low_bit;
+        value >>= 1;
+        mask &= ~low_bit;
+    }
+    return result;
+}
+
+// copy the template and stamp in the fields that depend on the merkle root,
+// roll (0 .. tmpl->rolls - 1) picks the host rolled version bits or ntime step
+void construct_bm_job_from_template(const job_template *tmpl, const uint8_t merkle_root[32], uint8_t roll, bm_job *job)
+{
+    memcpy(job, &tmpl->job, sizeof(bm_job));
 
-    if (version_mask != 0)
+    if (roll != 0)
     {
-        uint32_t rolled_version = increment_bitmask(new_job.version, version_mask);
-        memcpy(midstate_data, &rolled_version, 4);
-        midstate_sha256_bin(midstate_data, 64, new_job.midstate1);
-        reverse_bytes(new_job.midstate1, 32);
+        if (tmpl->host_version_mask != 0)
+        {
+            // flipped like the ASIC rolled bits, so every roll is distinct whatever bits the notify version has set
+            job->version ^= deposit_bits(roll, tmpl->host_version_mask);
+        }
+        else
+        {
+            job->ntime += roll;
+        }
+    }
 
-        rolled_version = increment_bitmask(rolled_version, version_mask);
-        memcpy(midstate_data, &rolled_version, 4);
-        midstate_sha256_bin(midstate_data, 64, new_job.midstate2);
-        reverse_bytes(new_job.midstate2, 32);
+    // merkle_root is used to verify nonces for every ASIC family
+    memcpy(job->merkle_root, merkle_root, 32);
 
-        rolled_version = increment_bitmask(rolled_version, version_mask);
-        memcpy(midstate_data, &rolled_version, 4);
-        midstate_sha256_bin(midstate_data, 64, new_job.midstate3);
-        reverse_bytes(new_job.midstate3, 32);
-        new_job.num_midstates = 4;
+    if (tmpl->format == JOB_FORMAT_HEADER)
+    {
+        swap_reverse_words_bin(merkle_root, job->merkle_root_be, 32);
+        return;
     }
-    else
+
+    ////make the midstate hash
+    uint8_t midstate_data[64];
+    uint8_t *midstates[4] = {job->midstate, job->midstate1, job->midstate2, job->midstate3};
+
+    // copy 68 bytes header data into midstate (and deal with endianess)
+    memcpy(midstate_data + 4, job->prev_block_hash, 32); // copy prev_block_hash
+    memcpy(midstate_data + 36, job->merkle_root, 28);    // copy merkle_root
+
+    uint32_t rolled_version = job->version;
+    for (int i = 0; i < tmpl->num_midstates; i++)
     {
-        new_job.num_midstates = 1;
+        if (i > 0)
+            rolled_version = increment_bitmask(rolled_version, job->version_mask);
+        memcpy(midstate_data, &rolled_version, 4);            // copy version
+        midstate_sha256_bin(midstate_data, 64, midstates[i]); // make the midstate hash
+        reverse_bytes(midstates[i], 32);                      // reverse the midstate bytes for the BM job packet
     }
+}
+
+// take a decoded mining_notify struct and a binary merkle root and convert them to a bm_job struct,
+// only filling in the job packet fields the ASIC family uses
+bm_job construct_bm_job(mining_notify *params, const uint8_t merkle_root[32], const uint32_t version_mask, const uint32_t difficulty, job_format format)
+{
+    job_template tmpl;
+    bm_job new_job;
+
+    job_template_init(&tmpl, params, version_mask, difficulty, format);
+    construct_bm_job_from_template(&tmpl, merkle_root, 0, &new_job);
 
     return new_job;
 }
@@ -113,14 +305,20 @@ bm_job construct_bm_job(mining_notify *params, const char *merkle_root, const ui
 char *extranonce_2_generate(uint32_t extranonce_2, uint32_t length)
 {
     char *extranonce_2_str = malloc(length * 2 + 1);
+    extranonce_2_to_hex(extranonce_2, length, extranonce_2_str);
+    return extranonce_2_str;
+}
+
+// extranonce_2_str must hold length * 2 + 1 chars
+void extranonce_2_to_hex(uint32_t extranonce_2, uint32_t length, char *extranonce_2_str)
+{
     memset(extranonce_2_str, '0', length * 2);
     extranonce_2_str[length * 2] = '\0';
-    bin2hex((uint8_t *)&extranonce_2, length, extranonce_2_str, length * 2 + 1);
+    bin2hex((uint8_t *)&extranonce_2, length < 4 ? length : 4, extranonce_2_str, length * 2 + 1);
     if (length > 4)
     {
         extranonce_2_str[8] = '0';
     }
-    return extranonce_2_str;
 }
 
 ///////cgminer nonce testing
@@ -128,38 +326,167 @@ char *extranonce_2_generate(uint32_t extranonce_2, uint32_t length)
  */
 static const double truediffone = 26959535291011309493156476344723991336010898738574164086137773096960.0;
 
-/* testing a nonce and return the diff - 0 means invalid */
-double test_nonce_value(const bm_job *job, const uint32_t nonce, const uint32_t rolled_version)
+// sha256 state after the first 64 header bytes, which only change with the rolled version
+static const uint32_t *nonce_midstate(bm_job *job, const uint32_t rolled_version)
+{
+    for (int i = 0; i < job->nonce_midstate_count; i++)
+    {
+        if (job->nonce_midstate_versions[i] == rolled_version)
+        {
+            return job->nonce_midstates[i];
+        }
+    }
+
+    int slot = job->nonce_midstate_next;
+    job->nonce_midstate_next = (slot + 1) % NONCE_MIDSTATE_CACHE_SIZE;
+    if (job->nonce_midstate_count < NONCE_MIDSTATE_CACHE_SIZE)
+    {
+        job->nonce_midstate_count++;
+    }
+
+    uint8_t block[64];
+    memcpy(block, &rolled_version, 4);
+    memcpy(block + 4, job->prev_block_hash, 32);
+    memcpy(block + 36, job->merkle_root, 28);
+
+    sha256_state_init(job->nonce_midstates[slot]);
+    sha256_transform(job->nonce_midstates[slot], block);
+    job->nonce_midstate_versions[slot] = rolled_version;
+
+    return job->nonce_midstates[slot];
+}
+
+// double sha256 of the block header for a nonce, as a little endian 256 bit number
+void nonce_hash(bm_job *job, const uint32_t nonce, const uint32_t rolled_version, uint8_t hash[32])
 {
-    double d64, s64, ds;
-    unsigned char header[80];
+    unsigned char tail[16];
+
+    // only the last 16 header bytes are hashed per nonce, the first block comes from the cache
+    memcpy(tail, job->merkle_root + 28, 4);
+    memcpy(tail + 4, &job->ntime, 4);
+    memcpy(tail + 8, &job->target, 4);
+    memcpy(tail + 12, &nonce, 4);
 
-    // // TODO: use the midstate hash instead of hashing the whole header
-    // uint32_t rolled_version = job->version;
-    // for (int i = 0; i < midstate_index; i++) {
-    //     rolled_version = increment_bitmask(rolled_version, job->version_mask);
-    // }
+    unsigned char hash_buffer[32];
+
+    // double hash the header
+    sha256_80_from_midstate(nonce_midstate(job, rolled_version), tail, hash_buffer);
+    sha256_32(hash_buffer, hash);
+}
 
-    // copy data from job to header
+void block_header(const bm_job *job, const uint32_t nonce, const uint32_t rolled_version, uint8_t header[80])
+{
     memcpy(header, &rolled_version, 4);
     memcpy(header + 4, job->prev_block_hash, 32);
     memcpy(header + 36, job->merkle_root, 32);
     memcpy(header + 68, &job->ntime, 4);
     memcpy(header + 72, &job->target, 4);
     memcpy(header + 76, &nonce, 4);
+}
 
-    unsigned char hash_buffer[32];
-    unsigned char hash_result[32];
+/* testing a nonce and return the diff - 0 means invalid */
+double test_nonce_value(bm_job *job, const uint32_t nonce, const uint32_t rolled_version)
+{
+    uint8_t hash[32];
 
-    // double hash the header
-    mbedtls_sha256(header, 80, hash_buffer, 0);
-    mbedtls_sha256(hash_buffer, 32, hash_result, 0);
+    nonce_hash(job, nonce, rolled_version, hash);
+
+    return hash_to_difficulty(hash);
+}
+
+// target = truediffone / difficulty, using integer long division over 32 bit limbs
+void difficulty_to_target(uint32_t difficulty, uint8_t target[32])
+{
+    if (difficulty == 0)
+    {
+        memset(target, 0xff, 32);
+        return;
+    }
+
+    // truediffone = 0xffff << 208, limb 6 holds bits 192..223
+    uint32_t limbs[8] = {0, 0, 0, 0, 0, 0, 0xffff0000, 0};
+    uint64_t remainder = 0;
+
+    for (int i = 7; i >= 0; i--)
+    {
+        uint64_t cur = (remainder << 32) | limbs[i];
+        limbs[i] = cur / difficulty;
+        remainder = cur % difficulty;
+    }
+
+    for (int i = 0; i < 8; i++)
+    {
+        target[i * 4] = limbs[i];
+        target[i * 4 + 1] = limbs[i] >> 8;
+        target[i * 4 + 2] = limbs[i] >> 16;
+        target[i * 4 + 3] = limbs[i] >> 24;
+    }
+}
+
+// expand compact nBits into the full target, mantissa * 256^(exponent - 3)
+void nbits_to_target(uint32_t nbits, uint8_t target[32])
+{
+    uint32_t mantissa = nbits & 0x007fffff;
+    int exponent = (nbits >> 24) & 0xff;
+
+    memset(target, 0, 32);
+
+    if (exponent > 32)
+    {
+        memset(target, 0xff, 32);
+        return;
+    }
+
+    for (int i = 0; i < 3; i++)
+    {
+        int pos = exponent - 3 + i;
+        if (pos >= 0 && pos < 32)
+        {
+            target[pos] = mantissa >> (8 * i);
+        }
+    }
+}
+
+bool hash_meets_target(const uint8_t hash[32], const uint8_t target[32])
+{
+    for (int i = 31; i >= 0; i--)
+    {
+        if (hash[i] != target[i])
+        {
+            return hash[i] < target[i];
+        }
+    }
+    return true;
+}
+
+int hash_leading_zero_bits(const uint8_t hash[32])
+{
+    int bits = 0;
+    for (int i = 31; i >= 0; i--)
+    {
+        if (hash[i] != 0)
+        {
+            return bits + __builtin_clz(hash[i]) - 24;
+        }
+        bits += 8;
+    }
+    return bits;
+}
 
-    d64 = truediffone;
-    s64 = le256todouble(hash_result);
-    ds = d64 / s64;
+// minimum leading zero bits of any hash with a difficulty above the given one:
+// difficulty > 2^k needs hash < truediffone / 2^k < 2^(224 - k)
+int difficulty_leading_zero_bits(uint64_t difficulty)
+{
+    if (difficulty == 0)
+    {
+        return 0;
+    }
+    return 32 + 63 - __builtin_clzll(difficulty);
+}
 
-    return ds;
+double hash_to_difficulty(const uint8_t hash[32])
+{
+    return truediffone / le256todouble(hash);
 }
 
 uint32_t increment_bitmask(const uint32_t value, const uint32_t mask)
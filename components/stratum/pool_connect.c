@@ -0,0 +1,441 @@
+#include <errno.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "lwip/netdb.h"
+#include "lwip/sockets.h"
+#include "pool_connect.h"
+
+static const char *TAG = "pool_connect";
+
+static pool_dns_cache dns_cache = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+void pool_dns_cache_init(pool_dns_cache *cache)
+{
+    memset(cache->entries, 0, sizeof(cache->entries));
+    pthread_mutex_init(&cache->lock, NULL);
+}
+
+// call with the lock held
+static pool_dns_entry *find_entry(pool_dns_cache *cache, const char *host, uint16_t port)
+{
+    for (int i = 0; i < POOL_DNS_CACHE_SIZE; i++)
+    {
+        pool_dns_entry *entry = &cache->entries[i];
+        if (entry->address_count > 0 && entry->port == port && strcmp(entry->host, host) == 0)
+        {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static bool same_address(const struct sockaddr_storage *a, const struct sockaddr_storage *b)
+{
+    if (a->ss_family != b->ss_family)
+    {
+        return false;
+    }
+    if (a->ss_family == AF_INET)
+    {
+        const struct sockaddr_in *a4 = (const struct sockaddr_in *)a;
+        const struct sockaddr_in *b4 = (const struct sockaddr_in *)b;
+        return a4->sin_port == b4->sin_port && a4->sin_addr.s_addr == b4->sin_addr.s_addr;
+    }
+#if LWIP_IPV6
+    if (a->ss_family == AF_INET6)
+    {
+        const struct sockaddr_in6 *a6 = (const struct sockaddr_in6 *)a;
+        const struct sockaddr_in6 *b6 = (const struct sockaddr_in6 *)b;
+        return a6->sin6_port == b6->sin6_port && memcmp(&a6->sin6_addr, &b6->sin6_addr, sizeof(a6->sin6_addr)) == 0;
+    }
+#endif
+    return false;
+}
+
+int pool_dns_cache_lookup(pool_dns_cache *cache, const char *host, uint16_t port, int64_t now_us,
+                          struct sockaddr_storage *addresses, int max_addresses)
+{
+    int count = 0;
+
+    pthread_mutex_lock(&cache->lock);
+    pool_dns_entry *entry = find_entry(cache, host, port);
+    if (entry != NULL && entry->expires_us <= now_us)
+    {
+        entry->address_count = 0;
+        entry = NULL;
+    }
+    if (entry != NULL)
+    {
+        entry->last_used_us = now_us;
+        addresses[count++] = entry->addresses[entry->preferred];
+        for (int i = 0; i < entry->address_count && count < max_addresses; i++)
+        {
+            if (i != entry->preferred)
+            {
+                addresses[count++] = entry->addresses[i];
+            }
+        }
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return count;
+}
+
+void pool_dns_cache_store(pool_dns_cache *cache, const char *host, uint16_t port, const struct sockaddr_storage *addresses,
+                          int address_count, int64_t now_us)
+{
+    if (address_count <= 0 || strlen(host) >= POOL_DNS_MAX_HOST_LEN)
+    {
+        return;
+    }
+    if (address_count > POOL_DNS_MAX_ADDRESSES)
+    {
+        address_count = POOL_DNS_MAX_ADDRESSES;
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    pool_dns_entry *entry = find_entry(cache, host, port);
+    for (int i = 0; entry == NULL && i < POOL_DNS_CACHE_SIZE; i++)
+    {
+        if (cache->entries[i].address_count == 0)
+        {
+            entry = &cache->entries[i];
+        }
+    }
+    if (entry == NULL)
+    {
+        entry = &cache->entries[0];
+        for (int i = 1; i < POOL_DNS_CACHE_SIZE; i++)
+        {
+            if (cache->entries[i].last_used_us < entry->last_used_us)
+            {
+                entry = &cache->entries[i];
+            }
+        }
+    }
+
+    // a fresh answer keeps the address that worked last time in front
+    struct sockaddr_storage preferred;
+    bool had_preferred = entry->address_count > 0 && entry->port == port && strcmp(entry->host, host) == 0;
+    if (had_preferred)
+    {
+        preferred = entry->addresses[entry->preferred];
+    }
+
+    strcpy(entry->host, host);
+    entry->port = port;
+    memcpy(entry->addresses, addresses, sizeof(addresses[0]) * address_count);
+    entry->address_count = address_count;
+    entry->preferred = 0;
+    for (int i = 0; had_preferred && i < address_count; i++)
+    {
+        if (same_address(&entry->addresses[i], &preferred))
+        {
+            entry->preferred = i;
+        }
+    }
+    entry->expires_us = now_us + (int64_t)POOL_DNS_TTL_S * 1000000;
+    entry->last_used_us = now_us;
+    pthread_mutex_unlock(&cache->lock);
+}
+
+void pool_dns_cache_set_preferred(pool_dns_cache *cache, const char *host, uint16_t port, const struct sockaddr_storage *address)
+{
+    pthread_mutex_lock(&cache->lock);
+    pool_dns_entry *entry = find_entry(cache, host, port);
+    for (int i = 0; entry != NULL && i < entry->address_count; i++)
+    {
+        if (same_address(&entry->addresses[i], address))
+        {
+            entry->preferred = i;
+        }
+    }
+    pthread_mutex_unlock(&cache->lock);
+}
+
+void pool_dns_cache_invalidate(pool_dns_cache *cache, const char *host, uint16_t port)
+{
+    pthread_mutex_lock(&cache->lock);
+    pool_dns_entry *entry = find_entry(cache, host, port);
+    if (entry != NULL)
+    {
+        entry->address_count = 0;
+    }
+    pthread_mutex_unlock(&cache->lock);
+}
+
+void pool_connect_interleave_families(struct sockaddr_storage *addresses, int address_count)
+{
+    for (int i = 1; i < address_count; i++)
+    {
+        if (addresses[i].ss_family != addresses[i - 1].ss_family)
+        {
+            continue;
+        }
+        // pull the next address of the other family forward
+        for (int j = i + 1; j < address_count; j++)
+        {
+            if (addresses[j].ss_family != addresses[i - 1].ss_family)
+            {
+                struct sockaddr_storage other = addresses[j];
+                memmove(&addresses[i + 1], &addresses[i], sizeof(addresses[0]) * (j - i));
+                addresses[i] = other;
+                break;
+            }
+        }
+    }
+}
+
+static int resolve(const char *host, uint16_t port, struct sockaddr_storage *addresses, int max_addresses)
+{
+    // IPv4 first, most miners sit on IPv4 only networks
+    static const int families[] = {
+        AF_INET,
+#if LWIP_IPV6
+        AF_INET6,
+#endif
+    };
+    int count = 0;
+
+    for (int f = 0; f < sizeof(families) / sizeof(families[0]); f++)
+    {
+        struct addrinfo hints = {
+            .ai_family = families[f],
+            .ai_socktype = SOCK_STREAM,
+        };
+        struct addrinfo *result = NULL;
+        if (getaddrinfo(host, NULL, &hints, &result) != 0 || result == NULL)
+        {
+            continue;
+        }
+        for (struct addrinfo *ai = result; ai != NULL && count < max_addresses; ai = ai->ai_next)
+        {
+            if (ai->ai_family == AF_INET)
+            {
+                struct sockaddr_in *addr = (struct sockaddr_in *)&addresses[count++];
+                memcpy(addr, ai->ai_addr, sizeof(*addr));
+                addr->sin_port = htons(port);
+            }
+#if LWIP_IPV6
+            else if (ai->ai_family == AF_INET6)
+            {
+                struct sockaddr_in6 *addr = (struct sockaddr_in6 *)&addresses[count++];
+                memcpy(addr, ai->ai_addr, sizeof(*addr));
+                addr->sin6_port = htons(port);
+            }
+#endif
+        }
+        freeaddrinfo(result);
+    }
+
+    pool_connect_interleave_families(addresses, count);
+    return count;
+}
+
+static socklen_t address_len(const struct sockaddr_storage *address)
+{
+#if LWIP_IPV6
+    if (address->ss_family == AF_INET6)
+    {
+        return sizeof(struct sockaddr_in6);
+    }
+#endif
+    return sizeof(struct sockaddr_in);
+}
+
+static void address_to_string(const struct sockaddr_storage *address, char *ip, size_t ip_len)
+{
+    const void *addr = &((const struct sockaddr_in *)address)->sin_addr;
+#if LWIP_IPV6
+    if (address->ss_family == AF_INET6)
+    {
+        addr = &((const struct sockaddr_in6 *)address)->sin6_addr;
+    }
+#endif
+    if (inet_ntop(address->ss_family, addr, ip, ip_len) == NULL && ip_len > 0)
+    {
+        ip[0] = '\0';
+    }
+}
+
+// non-blocking connect, the socket or -1 when the attempt failed right away
+static int start_connect(const struct sockaddr_storage *address, bool *socket_failed)
+{
+    int sock = socket(address->ss_family, SOCK_STREAM, IPPROTO_IP);
+    if (sock < 0)
+    {
+        ESP_LOGE(TAG, "Unable to create socket: errno %d", errno);
+        *socket_failed = true;
+        return -1;
+    }
+
+    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+    if (connect(sock, (const struct sockaddr *)address, address_len(address)) != 0 && errno != EINPROGRESS)
+    {
+        char ip[INET6_ADDRSTRLEN];
+        address_to_string(address, ip, sizeof(ip));
+        ESP_LOGW(TAG, "Connect to %s failed (errno %d: %s)", ip, errno, strerror(errno));
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+// lets lwip notice a half-open connection or an expired NAT mapping on its own
+static void enable_keepalive(int sock)
+{
+    int enable = 1;
+    int idle = POOL_KEEPALIVE_IDLE_S;
+    int interval = POOL_KEEPALIVE_INTERVAL_S;
+    int count = POOL_KEEPALIVE_COUNT;
+    if (setsockopt(sock, SOL_SOCKET, SO_KEEPALIVE, &enable, sizeof(enable)) != 0 ||
+        setsockopt(sock, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle)) != 0 ||
+        setsockopt(sock, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval)) != 0 ||
+        setsockopt(sock, IPPROTO_TCP, TCP_KEEPCNT, &count, sizeof(count)) != 0)
+    {
+        ESP_LOGW(TAG, "Failed to enable TCP keepalive (errno %d)", errno);
+    }
+}
+
+// Stratum messages are whole lines, batched by the caller already. Nagle would only hold a share,
+// a block candidate above all, back until the previous write is acknowledged.
+static void disable_nagle(int sock)
+{
+    int enable = 1;
+    if (setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable)) != 0)
+    {
+        ESP_LOGW(TAG, "Failed to set TCP_NODELAY (errno %d)", errno);
+    }
+}
+
+int pool_connect(const char *host, uint16_t port, char *ip, size_t ip_len, int64_t *connect_us)
+{
+    struct sockaddr_storage addresses[POOL_DNS_MAX_ADDRESSES];
+    int sockets[POOL_DNS_MAX_ADDRESSES];
+    int64_t start_us = esp_timer_get_time();
+
+    int count = pool_dns_cache_lookup(&dns_cache, host, port, start_us, addresses, POOL_DNS_MAX_ADDRESSES);
+    if (count == 0)
+    {
+        count = resolve(host, port, addresses, POOL_DNS_MAX_ADDRESSES);
+        if (count == 0)
+        {
+            ESP_LOGE(TAG, "Unable to resolve %s", host);
+            return POOL_CONNECT_ERR_DNS;
+        }
+        pool_dns_cache_store(&dns_cache, host, port, addresses, count, start_us);
+        ESP_LOGI(TAG, "Resolved %s to %d address%s in %lld ms", host, count, count == 1 ? "" : "es",
+                 (esp_timer_get_time() - start_us) / 1000);
+    }
+
+    int64_t connect_start_us = esp_timer_get_time();
+    int64_t deadline_us = connect_start_us + POOL_CONNECT_TIMEOUT_MS * 1000LL;
+    int64_t next_attempt_us = 0;
+    int started = 0;
+    int pending = 0;
+    int created = 0;
+    int winner = -1;
+    bool socket_failed = false;
+
+    while (winner < 0)
+    {
+        int64_t now_us = esp_timer_get_time();
+        if (now_us >= deadline_us)
+        {
+            break;
+        }
+
+        // the next address gets its turn once the running attempts had their head start, or failed
+        if (started < count && (now_us >= next_attempt_us || pending == 0))
+        {
+            sockets[started] = start_connect(&addresses[started], &socket_failed);
+            if (sockets[started] >= 0)
+            {
+                created++;
+                pending++;
+                next_attempt_us = now_us + POOL_CONNECT_ATTEMPT_DELAY_MS * 1000LL;
+            }
+            started++;
+            continue;
+        }
+        if (pending == 0)
+        {
+            break;
+        }
+
+        fd_set writefds;
+        FD_ZERO(&writefds);
+        int max_fd = -1;
+        for (int i = 0; i < started; i++)
+        {
+            if (sockets[i] >= 0)
+            {
+                FD_SET(sockets[i], &writefds);
+                max_fd = sockets[i] > max_fd ? sockets[i] : max_fd;
+            }
+        }
+
+        int64_t wait_until_us = started < count && next_attempt_us < deadline_us ? next_attempt_us : deadline_us;
+        int64_t wait_us = wait_until_us > now_us ? wait_until_us - now_us : 0;
+        struct timeval timeout = { .tv_sec = wait_us / 1000000, .tv_usec = wait_us % 1000000 };
+        if (select(max_fd + 1, NULL, &writefds, NULL, &timeout) <= 0)
+        {
+            continue;
+        }
+
+        for (int i = 0; i < started && winner < 0; i++)
+        {
+            if (sockets[i] < 0 || !FD_ISSET(sockets[i], &writefds))
+            {
+                continue;
+            }
+            int error = 0;
+            socklen_t error_len = sizeof(error);
+            getsockopt(sockets[i], SOL_SOCKET, SO_ERROR, &error, &error_len);
+            if (error == 0)
+            {
+                winner = i;
+                continue;
+            }
+            char failed_ip[INET6_ADDRSTRLEN];
+            address_to_string(&addresses[i], failed_ip, sizeof(failed_ip));
+            ESP_LOGW(TAG, "Connect to %s failed (errno %d: %s)", failed_ip, error, strerror(error));
+            close(sockets[i]);
+            sockets[i] = -1;
+            pending--;
+        }
+    }
+
+    for (int i = 0; i < started; i++)
+    {
+        if (i != winner && sockets[i] >= 0)
+        {
+            close(sockets[i]);
+        }
+    }
+
+    if (winner < 0)
+    {
+        // the pool may have moved, ask DNS again next time
+        pool_dns_cache_invalidate(&dns_cache, host, port);
+        return socket_failed && created == 0 ? POOL_CONNECT_ERR_SOCKET : POOL_CONNECT_ERR_CONNECT;
+    }
+
+    int sock = sockets[winner];
+    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) & ~O_NONBLOCK);
+    enable_keepalive(sock);
+    disable_nagle(sock);
+    pool_dns_cache_set_preferred(&dns_cache, host, port, &addresses[winner]);
+    if (ip != NULL)
+    {
+        address_to_string(&addresses[winner], ip, ip_len);
+    }
+    if (connect_us != NULL)
+    {
+        *connect_us = esp_timer_get_time() - connect_start_us;
+    }
+    ESP_LOGI(TAG, "Connected to %s:%d in %lld ms (address %d of %d)", host, port, (esp_timer_get_time() - start_us) / 1000,
+             winner + 1, count);
+    return sock;
+}
@@ -0,0 +1,164 @@
+#include "pool_liveness.h"
+
+void pool_liveness_init(pool_liveness *liveness)
+{
+    pthread_mutex_init(&liveness->lock, NULL);
+    liveness->last_rx_us = 0;
+    liveness->last_notify_us = 0;
+    liveness->notify_gap_us = 0;
+    liveness->gaps = 0;
+    liveness->probe_sent_us = 0;
+    liveness->probe_for_silence = false;
+    liveness->probed_us = 0;
+    liveness->stale_since_us = 0;
+    liveness->stale_us = 0;
+}
+
+void pool_liveness_connected(pool_liveness *liveness, int64_t now_us)
+{
+    pthread_mutex_lock(&liveness->lock);
+    liveness->last_rx_us = now_us;
+    liveness->last_notify_us = 0;
+    liveness->notify_gap_us = 0;
+    liveness->gaps = 0;
+    liveness->probe_sent_us = 0;
+    liveness->probe_for_silence = false;
+    liveness->probed_us = 0;
+    pthread_mutex_unlock(&liveness->lock);
+}
+
+void pool_liveness_received(pool_liveness *liveness, bool notify, int64_t now_us)
+{
+    pthread_mutex_lock(&liveness->lock);
+    liveness->last_rx_us = now_us;
+    liveness->probe_sent_us = 0;
+    if (notify)
+    {
+        if (liveness->last_notify_us > 0)
+        {
+            double gap_us = now_us - liveness->last_notify_us;
+            liveness->notify_gap_us = liveness->gaps == 0 ? gap_us
+                                                          : liveness->notify_gap_us + LIVENESS_GAP_SMOOTHING * (gap_us - liveness->notify_gap_us);
+            liveness->gaps++;
+        }
+        liveness->last_notify_us = now_us;
+
+        if (liveness->stale_since_us > 0)
+        {
+            liveness->stale_us += now_us - liveness->stale_since_us;
+            liveness->stale_since_us = 0;
+        }
+    }
+    pthread_mutex_unlock(&liveness->lock);
+}
+
+void pool_liveness_lost(pool_liveness *liveness)
+{
+    pthread_mutex_lock(&liveness->lock);
+    // still counting from an earlier loss, or never had work to go stale
+    if (liveness->stale_since_us == 0 && liveness->last_notify_us > 0)
+    {
+        liveness->stale_since_us = liveness->last_rx_us;
+    }
+    liveness->last_notify_us = 0;
+    pthread_mutex_unlock(&liveness->lock);
+}
+
+// call with the lock held
+static int64_t silence_limit_us(const pool_liveness *liveness)
+{
+    if (liveness->gaps < LIVENESS_MIN_GAPS)
+    {
+        return (int64_t)LIVENESS_MAX_SILENCE_S * 1000000;
+    }
+    int64_t limit_us = (int64_t)(LIVENESS_NOTIFY_FACTOR * liveness->notify_gap_us);
+    if (limit_us < (int64_t)LIVENESS_MIN_SILENCE_S * 1000000)
+    {
+        return (int64_t)LIVENESS_MIN_SILENCE_S * 1000000;
+    }
+    if (limit_us > (int64_t)LIVENESS_MAX_SILENCE_S * 1000000)
+    {
+        return (int64_t)LIVENESS_MAX_SILENCE_S * 1000000;
+    }
+    return limit_us;
+}
+
+int64_t pool_liveness_silence_limit_us(pool_liveness *liveness)
+{
+    pthread_mutex_lock(&liveness->lock);
+    int64_t limit_us = silence_limit_us(liveness);
+    pthread_mutex_unlock(&liveness->lock);
+    return limit_us;
+}
+
+int64_t pool_liveness_response_limit_us(double p99_ms)
+{
+    if (p99_ms < 0)
+    {
+        return (int64_t)LIVENESS_MAX_RESPONSE_S * 1000000;
+    }
+    int64_t limit_us = (int64_t)(LIVENESS_RESPONSE_FACTOR * p99_ms * 1000);
+    if (limit_us < (int64_t)LIVENESS_MIN_RESPONSE_S * 1000000)
+    {
+        return (int64_t)LIVENESS_MIN_RESPONSE_S * 1000000;
+    }
+    if (limit_us > (int64_t)LIVENESS_MAX_RESPONSE_S * 1000000)
+    {
+        return (int64_t)LIVENESS_MAX_RESPONSE_S * 1000000;
+    }
+    return limit_us;
+}
+
+pool_liveness_state pool_liveness_check(pool_liveness *liveness, int64_t oldest_share_us, double p99_ms, int64_t now_us)
+{
+    int64_t response_limit_us = pool_liveness_response_limit_us(p99_ms);
+    pool_liveness_state state = POOL_LIVENESS_OK;
+
+    pthread_mutex_lock(&liveness->lock);
+    bool probe_expired = liveness->probe_sent_us > 0 && now_us - liveness->probe_sent_us >= (int64_t)LIVENESS_PROBE_TIMEOUT_S * 1000000;
+    if (probe_expired && !liveness->probe_for_silence)
+    {
+        // pools like ckpool never answer the probe, the share limit below decides for a pool that is not silent
+        liveness->probe_sent_us = 0;
+    }
+
+    if (liveness->probe_sent_us > 0)
+    {
+        if (probe_expired)
+        {
+            state = POOL_LIVENESS_DEAD;
+        }
+    }
+    else if (oldest_share_us > 0 && now_us - oldest_share_us >= 2 * response_limit_us)
+    {
+        // answers other requests, but not shares
+        state = POOL_LIVENESS_DEAD;
+    }
+    else
+    {
+        bool silent = now_us - liveness->last_rx_us >= silence_limit_us(liveness);
+        bool share_overdue = oldest_share_us > 0 && now_us - oldest_share_us >= response_limit_us;
+        // one probe per overdue share is enough, the silence check re-arms with every line
+        if (silent || (share_overdue && now_us - liveness->probed_us >= response_limit_us))
+        {
+            liveness->probe_sent_us = now_us;
+            liveness->probe_for_silence = silent;
+            liveness->probed_us = now_us;
+            state = POOL_LIVENESS_PROBE;
+        }
+    }
+    pthread_mutex_unlock(&liveness->lock);
+    return state;
+}
+
+double pool_liveness_stale_s(pool_liveness *liveness, int64_t now_us)
+{
+    pthread_mutex_lock(&liveness->lock);
+    int64_t stale_us = liveness->stale_us;
+    if (liveness->stale_since_us > 0)
+    {
+        stale_us += now_us - liveness->stale_since_us;
+    }
+    pthread_mutex_unlock(&liveness->lock);
+    return stale_us / 1e6;
+}
@@ -0,0 +1,194 @@
+#include <math.h>
+#include <string.h>
+
+#include "pool_selector.h"
+
+void pool_selector_init(pool_selector *selector, int pool_count)
+{
+    pthread_mutex_init(&selector->lock, NULL);
+    memset(selector->pools, 0, sizeof(selector->pools));
+    selector->pool_count = pool_count < STRATUM_MAX_POOLS ? pool_count : STRATUM_MAX_POOLS;
+    selector->candidate = -1;
+    selector->candidate_rounds = 0;
+    // free to move right after boot
+    selector->switched_us = -(int64_t)POOL_SWITCH_HOLD_S * 1000000;
+}
+
+void pool_selector_report(pool_selector *selector, int pool, bool ok, double connect_ms, double rtt_ms)
+{
+    if (pool < 0 || pool >= selector->pool_count)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&selector->lock);
+    pool_health *health = &selector->pools[pool];
+    if (ok)
+    {
+        if (health->probed)
+        {
+            health->connect_ms += POOL_LATENCY_SMOOTHING * (connect_ms - health->connect_ms);
+            health->rtt_ms += POOL_LATENCY_SMOOTHING * (rtt_ms - health->rtt_ms);
+        }
+        else
+        {
+            health->connect_ms = connect_ms;
+            health->rtt_ms = rtt_ms;
+        }
+        health->probed = true;
+        health->healthy = true;
+        health->failures = 0;
+    }
+    else
+    {
+        health->failures++;
+        if (!health->probed || health->failures >= POOL_MAX_PROBE_FAILURES)
+        {
+            health->healthy = false;
+        }
+    }
+    pthread_mutex_unlock(&selector->lock);
+}
+
+// call with the lock held
+static double score(const pool_selector *selector, int pool)
+{
+    const pool_health *health = &selector->pools[pool];
+    return health->healthy ? health->connect_ms + health->rtt_ms : INFINITY;
+}
+
+// call with the lock held, lowest latency healthy pool other than skip, ties go to the earlier pool
+static int fastest(const pool_selector *selector, int skip)
+{
+    int best = -1;
+    for (int i = 0; i < selector->pool_count; i++)
+    {
+        if (i != skip && selector->pools[i].healthy && (best < 0 || score(selector, i) < score(selector, best)))
+        {
+            best = i;
+        }
+    }
+    return best;
+}
+
+int pool_selector_choose(pool_selector *selector, int current, int mode, int64_t now_us)
+{
+    int choice = current;
+
+    pthread_mutex_lock(&selector->lock);
+    if (mode == POOL_SELECTION_PRIORITY)
+    {
+        // back to an earlier pool as soon as it answers again
+        for (int i = 0; i < current && i < selector->pool_count; i++)
+        {
+            if (selector->pools[i].healthy)
+            {
+                choice = i;
+                break;
+            }
+        }
+        pthread_mutex_unlock(&selector->lock);
+        return choice;
+    }
+
+    int best = fastest(selector, current);
+    bool better = false;
+    if (best >= 0)
+    {
+        double current_ms = score(selector, current);
+        double best_ms = score(selector, best);
+        // a current pool the prober can't reach is still mined on, any healthy pool beats it
+        better = isinf(current_ms) ||
+                 (best_ms <= current_ms * (1 - POOL_SWITCH_MARGIN) && current_ms - best_ms >= POOL_SWITCH_MIN_GAIN_MS);
+    }
+
+    if (!better)
+    {
+        selector->candidate = -1;
+        selector->candidate_rounds = 0;
+    }
+    else
+    {
+        if (selector->candidate == best)
+        {
+            selector->candidate_rounds++;
+        }
+        else
+        {
+            selector->candidate = best;
+            selector->candidate_rounds = 1;
+        }
+        if (selector->candidate_rounds >= POOL_SWITCH_ROUNDS &&
+            now_us - selector->switched_us >= (int64_t)POOL_SWITCH_HOLD_S * 1000000)
+        {
+            choice = best;
+        }
+    }
+    pthread_mutex_unlock(&selector->lock);
+    return choice;
+}
+
+void pool_selector_switched(pool_selector *selector, int64_t now_us)
+{
+    pthread_mutex_lock(&selector->lock);
+    selector->candidate = -1;
+    selector->candidate_rounds = 0;
+    selector->switched_us = now_us;
+    pthread_mutex_unlock(&selector->lock);
+}
+
+int pool_selector_next(pool_selector *selector, int current)
+{
+    int next = selector->pool_count > 0 ? (current + 1) % selector->pool_count : 0;
+
+    pthread_mutex_lock(&selector->lock);
+    for (int k = 1; k < selector->pool_count; k++)
+    {
+        int pool = (current + k) % selector->pool_count;
+        const pool_health *health = &selector->pools[pool];
+        // never probed pools are worth a try
+        if (health->healthy || health->failures == 0)
+        {
+            next = pool;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&selector->lock);
+    return next;
+}
+
+int pool_selector_best_alternative(pool_selector *selector, int current, int mode)
+{
+    int best = -1;
+
+    pthread_mutex_lock(&selector->lock);
+    if (mode == POOL_SELECTION_PRIORITY)
+    {
+        for (int i = 0; i < selector->pool_count && best < 0; i++)
+        {
+            if (i != current && selector->pools[i].healthy)
+            {
+                best = i;
+            }
+        }
+    }
+    else
+    {
+        best = fastest(selector, current);
+    }
+    pthread_mutex_unlock(&selector->lock);
+    return best;
+}
+
+double pool_selector_latency_ms(pool_selector *selector, int pool)
+{
+    if (pool < 0 || pool >= selector->pool_count)
+    {
+        return -1;
+    }
+
+    pthread_mutex_lock(&selector->lock);
+    double latency = selector->pools[pool].healthy ? score(selector, pool) : -1;
+    pthread_mutex_unlock(&selector->lock);
+    return latency;
+}
@@ -0,0 +1,203 @@
+#include <string.h>
+
+#include "esp_log.h"
+#include "request_tracker.h"
+
+static const char *TAG = "request_tracker";
+
+static unsigned latency_bucket(int64_t latency_us)
+{
+    if (latency_us < LATENCY_SUB_BUCKETS)
+    {
+        return latency_us < 0 ? 0 : (unsigned)latency_us;
+    }
+
+    // the top bit picks the doubling, the two bits below it the quarter within it
+    uint64_t value = (uint64_t)latency_us;
+    unsigned msb = 63 - __builtin_clzll(value);
+    unsigned bucket = msb * LATENCY_SUB_BUCKETS + ((value >> (msb - 2)) & (LATENCY_SUB_BUCKETS - 1));
+    return bucket < LATENCY_BUCKETS ? bucket : LATENCY_BUCKETS - 1;
+}
+
+// geometric middle of the bucket, in microseconds
+static double latency_bucket_value(unsigned bucket)
+{
+    if (bucket < LATENCY_SUB_BUCKETS)
+    {
+        return bucket;
+    }
+
+    unsigned msb = bucket / LATENCY_SUB_BUCKETS;
+    double low = (double)((uint64_t)(LATENCY_SUB_BUCKETS + bucket % LATENCY_SUB_BUCKETS) << (msb - 2));
+    double width = (double)(1ULL << (msb - 2));
+    return low + width / 2;
+}
+
+void request_tracker_init(request_tracker *tracker)
+{
+    pthread_mutex_init(&tracker->lock, NULL);
+    memset(tracker->stats, 0, sizeof(tracker->stats));
+    for (int i = 0; i < REQUEST_TRACKER_SIZE; i++)
+    {
+        tracker->in_flight[i].id = -1;
+    }
+}
+
+void request_tracker_reset(request_tracker *tracker)
+{
+    pthread_mutex_lock(&tracker->lock);
+    for (int i = 0; i < REQUEST_TRACKER_SIZE; i++)
+    {
+        tracked_request *slot = &tracker->in_flight[i];
+        if (slot->id >= 0 && slot->difficulty > 0)
+        {
+            tracker->stats[slot->pool].lost++;
+        }
+        slot->id = -1;
+    }
+    pthread_mutex_unlock(&tracker->lock);
+}
+
+void request_tracker_add(request_tracker *tracker, int id, const char *jobid, uint32_t difficulty, uint8_t pool,
+                         int64_t sent_us)
+{
+    if (id < 0 || pool >= REQUEST_TRACKER_POOLS)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&tracker->lock);
+    tracked_request *slot = &tracker->in_flight[id & (REQUEST_TRACKER_SIZE - 1)];
+    if (slot->id >= 0 && slot->difficulty > 0)
+    {
+        ESP_LOGW(TAG, "No response to request %d for job %s", slot->id, slot->jobid);
+        tracker->stats[slot->pool].lost++;
+    }
+
+    slot->id = id;
+    slot->jobid[0] = '\0';
+    if (jobid != NULL)
+    {
+        strncpy(slot->jobid, jobid, sizeof(slot->jobid) - 1);
+        slot->jobid[sizeof(slot->jobid) - 1] = '\0';
+    }
+    slot->difficulty = jobid != NULL ? difficulty : 0;
+    slot->sent_us = sent_us;
+    slot->pool = pool;
+
+    share_latency_stats *stats = &tracker->stats[pool];
+    if (slot->difficulty > 0 && stats->submitted++ == 0)
+    {
+        stats->first_submit_us = sent_us;
+    }
+    pthread_mutex_unlock(&tracker->lock);
+}
+
+bool request_tracker_complete(request_tracker *tracker, int id, bool accepted, int64_t received_us,
+                              tracked_request *request)
+{
+    if (id < 0)
+    {
+        return false;
+    }
+
+    pthread_mutex_lock(&tracker->lock);
+    tracked_request *slot = &tracker->in_flight[id & (REQUEST_TRACKER_SIZE - 1)];
+    if (slot->id != id)
+    {
+        pthread_mutex_unlock(&tracker->lock);
+        return false;
+    }
+
+    *request = *slot;
+    slot->id = -1;
+
+    if (request->difficulty > 0)
+    {
+        share_latency_stats *stats = &tracker->stats[request->pool];
+        stats->latency_buckets[latency_bucket(received_us - request->sent_us)]++;
+        stats->samples++;
+        if (accepted)
+        {
+            stats->accepted++;
+            stats->accepted_difficulty += request->difficulty;
+        }
+        else
+        {
+            stats->rejected++;
+        }
+    }
+    pthread_mutex_unlock(&tracker->lock);
+
+    return true;
+}
+
+int64_t request_tracker_oldest_share_us(request_tracker *tracker)
+{
+    int64_t oldest_us = 0;
+
+    pthread_mutex_lock(&tracker->lock);
+    for (int i = 0; i < REQUEST_TRACKER_SIZE; i++)
+    {
+        const tracked_request *slot = &tracker->in_flight[i];
+        if (slot->id >= 0 && slot->difficulty > 0 && (oldest_us == 0 || slot->sent_us < oldest_us))
+        {
+            oldest_us = slot->sent_us;
+        }
+    }
+    pthread_mutex_unlock(&tracker->lock);
+    return oldest_us;
+}
+
+double request_tracker_latency_percentile_ms(request_tracker *tracker, uint8_t pool, double percentile)
+{
+    if (pool >= REQUEST_TRACKER_POOLS)
+    {
+        return -1.0;
+    }
+
+    double latency_us = -1.0;
+
+    pthread_mutex_lock(&tracker->lock);
+    share_latency_stats *stats = &tracker->stats[pool];
+    if (stats->samples > 0)
+    {
+        // smallest bucket that has at least percentile of the samples at or below it
+        double rank = stats->samples * percentile / 100.0;
+        uint32_t seen = 0;
+        for (unsigned bucket = 0; bucket < LATENCY_BUCKETS; bucket++)
+        {
+            seen += stats->latency_buckets[bucket];
+            if (seen > 0 && seen >= rank)
+            {
+                latency_us = latency_bucket_value(bucket);
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&tracker->lock);
+
+    return latency_us < 0 ? -1.0 : latency_us / 1000.0;
+}
+
+double request_tracker_accepted_hashrate(request_tracker *tracker, uint8_t pool, int64_t now_us)
+{
+    if (pool >= REQUEST_TRACKER_POOLS)
+    {
+        return 0.0;
+    }
+
+    pthread_mutex_lock(&tracker->lock);
+    share_latency_stats *stats = &tracker->stats[pool];
+    double accepted_difficulty = stats->accepted_difficulty;
+    int64_t elapsed_us = stats->submitted == 0 ? 0 : now_us - stats->first_submit_us;
+    pthread_mutex_unlock(&tracker->lock);
+
+    if (elapsed_us <= 0)
+    {
+        return 0.0;
+    }
+
+    // every unit of difficulty is 2^32 hashes on average
+    return accepted_difficulty * 4294967296.0 / (elapsed_us / 1000000.0) / 1e9;
+}
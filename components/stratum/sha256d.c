@@ -0,0 +1,241 @@
+#include <string.h>
+
+#include "sha256d.h"
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+#define CH(x, y, z) (((x) & (y)) ^ (~(x) & (z)))
+#define MAJ(x, y, z) (((x) & (y)) | ((z) & ((x) | (y))))
+
+#define BSIG0(x) (ROTR(x, 2) ^ ROTR(x, 13) ^ ROTR(x, 22))
+#define BSIG1(x) (ROTR(x, 6) ^ ROTR(x, 11) ^ ROTR(x, 25))
+#define SSIG0(x) (ROTR(x, 7) ^ ROTR(x, 18) ^ ((x) >> 3))
+#define SSIG1(x) (ROTR(x, 17) ^ ROTR(x, 19) ^ ((x) >> 10))
+
+// one round with the message word already added to its round constant
+#define ROUND(a, b, c, d, e, f, g, h, wk)                     \
+    do                                                        \
+    {                                                         \
+        uint32_t t1 = (h) + BSIG1(e) + CH(e, f, g) + (wk);    \
+        uint32_t t2 = BSIG0(a) + MAJ(a, b, c);                \
+        (d) += t1;                                            \
+        (h) = t1 + t2;                                        \
+    } while (0)
+
+static const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static const uint32_t H0[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+// message schedule + K of the padding block that follows a 64 byte message,
+// it never changes so the whole schedule is precomputed
+static const uint32_t PAD64_WK[64] = {
+    0xc28a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf374,
+    0x649b69c1, 0xf0fe4786, 0x0fe1edc6, 0x240cf254, 0x4fe9346f, 0x6cc984be, 0x61b9411e, 0x16f988fa,
+    0xf2c65152, 0xa88e5a6d, 0xb019fc65, 0xb9d99ec7, 0x9a1231c3, 0xe70eeaa0, 0xfdb1232b, 0xc7353eb0,
+    0x3069bad5, 0xcb976d5f, 0x5a0f118f, 0xdc1eeefd, 0x0a35b689, 0xde0b7a04, 0x58f4ca9d, 0xe15d5b16,
+    0x007f3e86, 0x37088980, 0xa507ea32, 0x6fab9537, 0x17406110, 0x0d8cd6f1, 0xcdaa3b6d, 0xc0bbbe37,
+    0x83613bda, 0xdb48a363, 0x0b02e931, 0x6fd15ca7, 0x521afaca, 0x31338431, 0x6ed41a95, 0x6d437890,
+    0xc39c91f2, 0x9eccabbd, 0xb5c9a0e6, 0x532fb63c, 0xd2c741c6, 0x07237ea3, 0xa4954b68, 0x4c191d76,
+};
+
+// byte wise so unaligned buffers are fine on Xtensa
+static inline uint32_t load_be32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static inline void store_be32(uint8_t *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+// 64 rounds over a schedule that already has K added in
+static void sha256_rounds(uint32_t state[8], const uint32_t wk[64])
+{
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+    for (int i = 0; i < 64; i += 8)
+    {
+        ROUND(a, b, c, d, e, f, g, h, wk[i + 0]);
+        ROUND(h, a, b, c, d, e, f, g, wk[i + 1]);
+        ROUND(g, h, a, b, c, d, e, f, wk[i + 2]);
+        ROUND(f, g, h, a, b, c, d, e, wk[i + 3]);
+        ROUND(e, f, g, h, a, b, c, d, wk[i + 4]);
+        ROUND(d, e, f, g, h, a, b, c, wk[i + 5]);
+        ROUND(c, d, e, f, g, h, a, b, wk[i + 6]);
+        ROUND(b, c, d, e, f, g, h, a, wk[i + 7]);
+    }
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+}
+
+// expand 16 message words into the full schedule with K added
+static void sha256_compress(uint32_t state[8], const uint32_t w16[16])
+{
+    uint32_t w[64];
+    uint32_t wk[64];
+
+    memcpy(w, w16, sizeof(uint32_t) * 16);
+    for (int i = 16; i < 64; i++)
+    {
+        w[i] = SSIG1(w[i - 2]) + w[i - 7] + SSIG0(w[i - 15]) + w[i - 16];
+    }
+    for (int i = 0; i < 64; i++)
+    {
+        wk[i] = w[i] + K[i];
+    }
+
+    sha256_rounds(state, wk);
+}
+
+void sha256_state_init(uint32_t state[8])
+{
+    memcpy(state, H0, sizeof(H0));
+}
+
+void sha256_transform(uint32_t state[8], const uint8_t block[64])
+{
+    uint32_t w[16];
+    for (int i = 0; i < 16; i++)
+    {
+        w[i] = load_be32(block + i * 4);
+    }
+    sha256_compress(state, w);
+}
+
+void sha256_state_to_digest(const uint32_t state[8], uint8_t digest[32])
+{
+    for (int i = 0; i < 8; i++)
+    {
+        store_be32(digest + i * 4, state[i]);
+    }
+}
+
+void sha256_32(const uint8_t data[32], uint8_t digest[32])
+{
+    uint32_t state[8];
+    uint32_t w[16];
+
+    for (int i = 0; i < 8; i++)
+    {
+        w[i] = load_be32(data + i * 4);
+    }
+    w[8] = 0x80000000;
+    memset(&w[9], 0, sizeof(uint32_t) * 6);
+    w[15] = 32 * 8;
+
+    sha256_state_init(state);
+    sha256_compress(state, w);
+    sha256_state_to_digest(state, digest);
+}
+
+void sha256_64(const uint8_t data[64], uint8_t digest[32])
+{
+    uint32_t state[8];
+
+    sha256_state_init(state);
+    sha256_transform(state, data);
+    sha256_rounds(state, PAD64_WK);
+    sha256_state_to_digest(state, digest);
+}
+
+void sha256_80(const uint8_t data[80], uint8_t digest[32])
+{
+    uint32_t state[8];
+
+    sha256_state_init(state);
+    sha256_transform(state, data);
+    sha256_80_from_midstate(state, data + 64, digest);
+}
+
+void sha256_80_from_midstate(const uint32_t midstate[8], const uint8_t tail[16], uint8_t digest[32])
+{
+    uint32_t state[8];
+    uint32_t w[16];
+
+    memcpy(state, midstate, sizeof(state));
+
+    for (int i = 0; i < 4; i++)
+    {
+        w[i] = load_be32(tail + i * 4);
+    }
+    w[4] = 0x80000000;
+    memset(&w[5], 0, sizeof(uint32_t) * 10);
+    w[15] = 80 * 8;
+
+    sha256_compress(state, w);
+    sha256_state_to_digest(state, digest);
+}
+
+void sha256_generic(const uint8_t *data, size_t len, uint8_t digest[32])
+{
+    uint32_t state[8];
+    uint8_t block[64];
+    size_t remaining = len;
+
+    sha256_state_init(state);
+    while (remaining >= 64)
+    {
+        sha256_transform(state, data);
+        data += 64;
+        remaining -= 64;
+    }
+
+    // final one or two blocks with the 0x80 terminator and the bit length
+    memcpy(block, data, remaining);
+    block[remaining] = 0x80;
+    if (remaining >= 56)
+    {
+        memset(block + remaining + 1, 0, 63 - remaining);
+        sha256_transform(state, block);
+        memset(block, 0, 56);
+    }
+    else
+    {
+        memset(block + remaining + 1, 0, 55 - remaining);
+    }
+
+    uint64_t bits = (uint64_t)len * 8;
+    store_be32(block + 56, (uint32_t)(bits >> 32));
+    store_be32(block + 60, (uint32_t)bits);
+    sha256_transform(state, block);
+
+    sha256_state_to_digest(state, digest);
+}
+
+void sha256d_64(const uint8_t data[64], uint8_t digest[32])
+{
+    uint8_t first[32];
+    sha256_64(data, first);
+    sha256_32(first, digest);
+}
+
+void sha256d_80(const uint8_t data[80], uint8_t digest[32])
+{
+    uint8_t first[32];
+    sha256_80(data, first);
+    sha256_32(first, digest);
+}
@@ -0,0 +1,49 @@
+#include "share_queue.h"
+
+void share_queue_init(share_queue *queue)
+{
+    atomic_store(&queue->head, 0);
+    atomic_store(&queue->tail, 0);
+    atomic_store(&queue->dropped, 0);
+}
+
+bool share_queue_push(share_queue *queue, const share_submission *share)
+{
+    unsigned tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    unsigned head = atomic_load_explicit(&queue->head, memory_order_acquire);
+
+    if (tail - head == SHARE_QUEUE_SIZE)
+    {
+        atomic_fetch_add_explicit(&queue->dropped, 1, memory_order_relaxed);
+        return false;
+    }
+
+    queue->entries[tail & (SHARE_QUEUE_SIZE - 1)] = *share;
+    // publish the entry before the consumer can see the new tail
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+const share_submission *share_queue_front(share_queue *queue)
+{
+    unsigned head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    unsigned tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+
+    if (head == tail)
+    {
+        return NULL;
+    }
+    return &queue->entries[head & (SHARE_QUEUE_SIZE - 1)];
+}
+
+void share_queue_release(share_queue *queue)
+{
+    unsigned head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    // the entry may be overwritten as soon as the producer sees the new head
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+}
+
+unsigned share_queue_count(share_queue *queue)
+{
+    return atomic_load_explicit(&queue->tail, memory_order_acquire) - atomic_load_explicit(&queue->head, memory_order_acquire);
+}
@@ -0,0 +1,241 @@
+#include <string.h>
+
+#include "share_replay.h"
+
+void share_replay_init(share_replay *replay)
+{
+    pthread_mutex_init(&replay->lock, NULL);
+    replay->count = 0;
+    replay->suspended = false;
+    replay->extranonce1[0] = '\0';
+    replay->pool = -1;
+    replay->candidates_changed = false;
+}
+
+// call with the lock held
+static void remove_entry(share_replay *replay, int index)
+{
+    if (replay->entries[index].share.block_candidate)
+    {
+        replay->candidates_changed = true;
+    }
+    memmove(&replay->entries[index], &replay->entries[index + 1],
+            (replay->count - index - 1) * sizeof(replay->entries[0]));
+    replay->count--;
+}
+
+// call with the lock held, oldest entry that is (or is not) a block candidate, -1 for none
+static int oldest(const share_replay *replay, bool block_candidate)
+{
+    for (int i = 0; i < replay->count; i++)
+    {
+        if (replay->entries[i].share.block_candidate == block_candidate)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static bool same_session(const replay_share *entry, int pool, const char *extranonce1)
+{
+    return entry->pool == pool && extranonce1 != NULL && strcmp(entry->extranonce1, extranonce1) == 0;
+}
+
+void share_replay_suspend(share_replay *replay, int pool, const char *extranonce1)
+{
+    pthread_mutex_lock(&replay->lock);
+    // without a session in between the shares still belong to the one that was lost first
+    if (!replay->suspended)
+    {
+        replay->suspended = true;
+        replay->pool = pool;
+        strncpy(replay->extranonce1, extranonce1 != NULL ? extranonce1 : "", sizeof(replay->extranonce1) - 1);
+        replay->extranonce1[sizeof(replay->extranonce1) - 1] = '\0';
+    }
+    // shares not resent yet and candidates the pool never answered wait for the next connection
+    for (int i = 0; i < replay->count; i++)
+    {
+        replay->entries[i].resend = false;
+        replay->entries[i].sent_id = -1;
+    }
+    pthread_mutex_unlock(&replay->lock);
+}
+
+bool share_replay_suspended(share_replay *replay)
+{
+    pthread_mutex_lock(&replay->lock);
+    bool suspended = replay->suspended;
+    pthread_mutex_unlock(&replay->lock);
+    return suspended;
+}
+
+// call with the lock held
+static bool add_entry(share_replay *replay, const share_submission *share, int id, int64_t now_us)
+{
+    bool kept_all = true;
+
+    int candidates = 0;
+    for (int i = 0; i < replay->count; i++)
+    {
+        candidates += replay->entries[i].share.block_candidate;
+    }
+    if (share->block_candidate && candidates >= SHARE_REPLAY_MAX_CANDIDATES)
+    {
+        remove_entry(replay, oldest(replay, true));
+        kept_all = false;
+    }
+    else if (replay->count == SHARE_REPLAY_SIZE)
+    {
+        // there are always ordinary shares in a full buffer
+        remove_entry(replay, oldest(replay, false));
+        kept_all = false;
+    }
+
+    replay_share *entry = &replay->entries[replay->count++];
+    entry->share = *share;
+    memcpy(entry->extranonce1, replay->extranonce1, sizeof(entry->extranonce1));
+    entry->pool = replay->pool;
+    entry->buffered_us = now_us;
+    entry->resend = false;
+    entry->sent_id = id;
+    if (share->block_candidate)
+    {
+        replay->candidates_changed = true;
+    }
+    return kept_all;
+}
+
+bool share_replay_add(share_replay *replay, const share_submission *share, int64_t now_us)
+{
+    pthread_mutex_lock(&replay->lock);
+    bool kept_all = add_entry(replay, share, -1, now_us);
+    pthread_mutex_unlock(&replay->lock);
+    return kept_all;
+}
+
+void share_replay_add_candidate(share_replay *replay, const share_submission *share, int64_t now_us)
+{
+    pthread_mutex_lock(&replay->lock);
+    add_entry(replay, share, -1, now_us);
+    replay->entries[replay->count - 1].resend = !replay->suspended;
+    pthread_mutex_unlock(&replay->lock);
+}
+
+void share_replay_sent(share_replay *replay, const share_submission *share, int id, int64_t now_us)
+{
+    if (!share->block_candidate)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&replay->lock);
+    add_entry(replay, share, id, now_us);
+    pthread_mutex_unlock(&replay->lock);
+}
+
+void share_replay_answered(share_replay *replay, int id)
+{
+    pthread_mutex_lock(&replay->lock);
+    for (int i = 0; i < replay->count; i++)
+    {
+        if (replay->entries[i].sent_id == id)
+        {
+            remove_entry(replay, i);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&replay->lock);
+}
+
+int share_replay_resume(share_replay *replay, int pool, const char *extranonce1, const uint8_t *prev_block_hash,
+                        int64_t now_us)
+{
+    int resend = 0;
+
+    pthread_mutex_lock(&replay->lock);
+    replay->suspended = false;
+    replay->pool = pool;
+    strncpy(replay->extranonce1, extranonce1 != NULL ? extranonce1 : "", sizeof(replay->extranonce1) - 1);
+    replay->extranonce1[sizeof(replay->extranonce1) - 1] = '\0';
+    int i = 0;
+    while (i < replay->count)
+    {
+        replay_share *entry = &replay->entries[i];
+        bool current = memcmp(entry->share.prev_block_hash, prev_block_hash, sizeof(entry->share.prev_block_hash)) == 0;
+        bool fresh = entry->share.block_candidate || now_us - entry->buffered_us <= (int64_t)SHARE_REPLAY_MAX_AGE_S * 1000000;
+        if (current && fresh && same_session(entry, pool, extranonce1))
+        {
+            entry->resend = true;
+            resend++;
+        }
+        else if (!current || !entry->share.block_candidate)
+        {
+            // work on an old block, or for a session the pool doesn't know anymore
+            remove_entry(replay, i);
+            continue;
+        }
+        i++;
+    }
+    pthread_mutex_unlock(&replay->lock);
+    return resend;
+}
+
+bool share_replay_pop(share_replay *replay, share_submission *share)
+{
+    bool found = false;
+
+    pthread_mutex_lock(&replay->lock);
+    for (int i = 0; i < replay->count; i++)
+    {
+        if (replay->entries[i].resend)
+        {
+            *share = replay->entries[i].share;
+            remove_entry(replay, i);
+            found = true;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&replay->lock);
+    return found;
+}
+
+bool share_replay_take_candidates(share_replay *replay, replay_share *out, int *count)
+{
+    pthread_mutex_lock(&replay->lock);
+    bool changed = replay->candidates_changed;
+    if (changed)
+    {
+        *count = 0;
+        for (int i = 0; i < replay->count && *count < SHARE_REPLAY_MAX_CANDIDATES; i++)
+        {
+            if (replay->entries[i].share.block_candidate)
+            {
+                out[(*count)++] = replay->entries[i];
+            }
+        }
+        replay->candidates_changed = false;
+    }
+    pthread_mutex_unlock(&replay->lock);
+    return changed;
+}
+
+void share_replay_restore(share_replay *replay, const replay_share *candidates, int count)
+{
+    pthread_mutex_lock(&replay->lock);
+    for (int i = 0; i < count && i < SHARE_REPLAY_MAX_CANDIDATES && replay->count < SHARE_REPLAY_SIZE; i++)
+    {
+        replay_share *entry = &replay->entries[replay->count++];
+        *entry = candidates[i];
+        entry->share.block_candidate = true;
+        entry->extranonce1[sizeof(entry->extranonce1) - 1] = '\0';
+        entry->resend = false;
+        entry->sent_id = -1;
+    }
+    if (replay->count > 0)
+    {
+        // the first connection after boot decides what is still worth sending
+        replay->suspended = true;
+    }
+    pthread_mutex_unlock(&replay->lock);
+}
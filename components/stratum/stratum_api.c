@@ -8,9 +8,11 @@
 #include "cJSON.h"
 #include "esp_log.h"
 #include "esp_ota_ops.h"
+#include "esp_timer.h"
 #include "lwip/sockets.h"
 #include "utils.h"
-#include "esp_timer.h"
+#include "line_reader.h"
+#include "stratum_decode.h"
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -19,140 +21,127 @@
 #define BUFFER_SIZE 1024
 static const char * TAG = "stratum_api";
 
-static char * json_rpc_buffer = NULL;
-static size_t json_rpc_buffer_size = 0;
-static int last_parsed_request_id = -1;
-
-static RequestTiming request_timings[MAX_REQUEST_IDS];
-static bool initialized = false;
-
-static void init_request_timings() {
-    if (!initialized) {
-        for (int i = 0; i < MAX_REQUEST_IDS; i++) {
-            request_timings[i].timestamp_us = 0;
-            request_timings[i].tracking = false;
-        }
-        initialized = true;
-    }
-}
-
-static RequestTiming* get_request_timing(int request_id) {
-    if (request_id < 0) return NULL;
-    int index = request_id % MAX_REQUEST_IDS;
-    return &request_timings[index];
-}
+static line_reader json_rpc_reader;
+static void debug_stratum_tx(const char *);
+int _parse_stratum_subscribe_result_message(const char * result_json_str, char ** extranonce, int * extranonce2_len);
 
-void STRATUM_V1_stamp_tx(int request_id)
+void STRATUM_V1_initialize_buffer()
 {
-    init_request_timings();
-    if (request_id >= 1) {
-        RequestTiming *timing = get_request_timing(request_id);
-        if (timing) {
-            timing->timestamp_us = esp_timer_get_time();
-            timing->tracking = true;
-        }
+    if (json_rpc_reader.buffer != NULL) {
+        line_reader_reset(&json_rpc_reader);
+        return;
+    }
+    if (line_reader_init(&json_rpc_reader, STRATUM_LINE_BUFFER_SIZE) != 0) {
+        printf("Error: Failed to allocate memory for buffer\n");
+        exit(1);
     }
 }
 
-double STRATUM_V1_get_response_time_ms(int request_id)
+void cleanup_stratum_buffer()
 {
-    init_request_timings();
-    if (request_id < 0) return -1.0;
-    
-    RequestTiming *timing = get_request_timing(request_id);
-    if (!timing || !timing->tracking) {
-        return -1.0;
-    }
-    
-    double response_time = (esp_timer_get_time() - timing->timestamp_us) / 1000.0;
-    timing->tracking = false;
-    return response_time;
+    line_reader_free(&json_rpc_reader);
 }
 
-static void debug_stratum_tx(const char *);
-int _parse_stratum_subscribe_result_message(const char * result_json_str, char ** extranonce, int * extranonce2_len);
-
-void STRATUM_V1_initialize_buffer()
+char * STRATUM_V1_receive_jsonrpc_line(int sockfd, size_t * line_len)
 {
-    json_rpc_buffer = malloc(BUFFER_SIZE);
-    json_rpc_buffer_size = BUFFER_SIZE;
-    if (json_rpc_buffer == NULL) {
-        printf("Error: Failed to allocate memory for buffer\n");
-        exit(1);
+    if (json_rpc_reader.buffer == NULL) {
+        STRATUM_V1_initialize_buffer();
     }
-    memset(json_rpc_buffer, 0, BUFFER_SIZE);
+
+    return STRATUM_V1_receive_line(&json_rpc_reader, sockfd, line_len);
 }
 
-void cleanup_stratum_buffer()
+char * STRATUM_V1_receive_line(line_reader * reader, int sockfd, size_t * line_len)
 {
-    free(json_rpc_buffer);
+    bool timed_out;
+    return STRATUM_V1_receive_line_timeout(reader, sockfd, line_len, -1, &timed_out);
 }
 
-static void realloc_json_buffer(size_t len)
+char * STRATUM_V1_receive_line_timeout(line_reader * reader, int sockfd, size_t * line_len, int timeout_ms,
+                                       bool * timed_out)
 {
-    size_t old, new;
+    char * line;
+    *timed_out = false;
+    int64_t deadline_us = esp_timer_get_time() + (int64_t) timeout_ms * 1000;
+    while ((line = line_reader_next(reader, line_len)) == NULL) {
+        if (timeout_ms >= 0 && sockfd >= 0) {
+            int64_t remaining_us = deadline_us - esp_timer_get_time();
+            fd_set readfds;
+            FD_ZERO(&readfds);
+            FD_SET(sockfd, &readfds);
+            struct timeval timeout = {
+                .tv_sec = remaining_us > 0 ? remaining_us / 1000000 : 0,
+                .tv_usec = remaining_us > 0 ? remaining_us % 1000000 : 0,
+            };
+            int ready = select(sockfd + 1, &readfds, NULL, NULL, &timeout);
+            if (ready == 0) {
+                *timed_out = true;
+                return NULL;
+            }
+            if (ready < 0) {
+                ESP_LOGI(TAG, "Error: select (errno %d: %s)", errno, strerror(errno));
+                line_reader_reset(reader);
+                return NULL;
+            }
+        }
 
-    old = strlen(json_rpc_buffer);
-    new = old + len + 1;
+        size_t space;
+        char * write_ptr = line_reader_write_ptr(reader, &space);
+        if (space == 0) {
+            ESP_LOGE(TAG, "Error: line longer than %d bytes", STRATUM_LINE_BUFFER_SIZE);
+            line_reader_reset(reader);
+            return NULL;
+        }
 
-    if (new < json_rpc_buffer_size) {
-        return;
+        int nbytes = recv(sockfd, write_ptr, space, 0);
+        if (nbytes <= 0) {
+            if (nbytes == 0) {
+                ESP_LOGI(TAG, "Error: connection closed by pool");
+            } else {
+                ESP_LOGI(TAG, "Error: recv (errno %d: %s)", errno, strerror(errno));
+            }
+            // whatever is left belongs to the dead connection
+            line_reader_reset(reader);
+            return NULL;
+        }
+        line_reader_commit(reader, nbytes);
     }
+    return line;
+}
 
-    new = new + (BUFFER_SIZE - (new % BUFFER_SIZE));
-    void * new_sockbuf = realloc(json_rpc_buffer, new);
-
-    if (new_sockbuf == NULL) {
-        fprintf(stderr, "Error: realloc failed in recalloc_sock()\n");
-        ESP_LOGI(TAG, "Restarting System because of ERROR: realloc failed in recalloc_sock");
-        vTaskDelay(1000 / portTICK_PERIOD_MS);
-        esp_restart();
+void STRATUM_V1_parse(StratumApiV1Message * message, const char * stratum_json)
+{
+    // the hot messages skip cJSON entirely
+    if (STRATUM_V1_decode_fast(message, stratum_json, strlen(stratum_json))) {
+        ESP_LOGD(TAG, "rx: %s", stratum_json);
+        return;
     }
 
-    json_rpc_buffer = new_sockbuf;
-    memset(json_rpc_buffer + old, 0, new - old);
-    json_rpc_buffer_size = new;
+    STRATUM_V1_parse_cjson(message, stratum_json);
 }
 
-char * STRATUM_V1_receive_jsonrpc_line(int sockfd)
+// Subscriptions come as [["mining.set_difficulty", id], ["mining.notify", id]] or as a single pair.
+// The mining.notify subscription id is the one pools take back to resume a session.
+static char * parse_session_id(cJSON * subscriptions)
 {
-    if (json_rpc_buffer == NULL) {
-        STRATUM_V1_initialize_buffer();
+    cJSON * pair = subscriptions;
+    cJSON * item;
+    cJSON_ArrayForEach(item, subscriptions) {
+        if (cJSON_IsArray(item) && cJSON_IsString(cJSON_GetArrayItem(item, 0)) &&
+                strcmp(cJSON_GetArrayItem(item, 0)->valuestring, "mining.notify") == 0) {
+            pair = item;
+        }
     }
-    char *line, *tok = NULL;
-    char recv_buffer[BUFFER_SIZE];
-    int nbytes;
-    size_t buflen = 0;
-
-    if (!strstr(json_rpc_buffer, "\n")) {
-        do {
-            memset(recv_buffer, 0, BUFFER_SIZE);
-            nbytes = recv(sockfd, recv_buffer, BUFFER_SIZE - 1, 0);
-            if (nbytes == -1) {
-                ESP_LOGI(TAG, "Error: recv (errno %d: %s)", errno, strerror(errno));
-                if (json_rpc_buffer) {
-                    free(json_rpc_buffer);
-                    json_rpc_buffer=0;
-                }
-                return 0;
-            }
-
-            realloc_json_buffer(nbytes);
-            strncat(json_rpc_buffer, recv_buffer, nbytes);
-        } while (!strstr(json_rpc_buffer, "\n"));
+    cJSON * id = cJSON_GetArrayItem(pair, 1);
+    // the id goes back into a mining.subscribe as is, only short alphanumeric ones (pools use hex) need no escaping
+    if (!cJSON_IsString(id) || strlen(id->valuestring) == 0 || strlen(id->valuestring) > MAX_SESSION_ID_LEN ||
+            strspn(id->valuestring, "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ") != strlen(id->valuestring)) {
+        return NULL;
     }
-    buflen = strlen(json_rpc_buffer);
-    tok = strtok(json_rpc_buffer, "\n");
-    line = strdup(tok);
-    int len = strlen(line);
-    if (buflen > len + 1)
-        memmove(json_rpc_buffer, json_rpc_buffer + len + 1, buflen - len + 1);
-    else
-        strcpy(json_rpc_buffer, "");
-    return line;
+    return strdup(id->valuestring);
 }
 
-void STRATUM_V1_parse(StratumApiV1Message * message, const char * stratum_json)
+void STRATUM_V1_parse_cjson(StratumApiV1Message * message, const char * stratum_json)
 {
     ESP_LOGI(TAG, "rx: %s", stratum_json); // debug incoming stratum messages
 
@@ -162,7 +151,6 @@ void STRATUM_V1_parse(StratumApiV1Message * message, const char * stratum_json)
     int64_t parsed_id = -1;
     if (id_json != NULL && cJSON_IsNumber(id_json)) {
         parsed_id = id_json->valueint;
-        last_parsed_request_id = parsed_id;
     }
     message->message_id = parsed_id;
 
@@ -171,17 +159,8 @@ void STRATUM_V1_parse(StratumApiV1Message * message, const char * stratum_json)
 
     //if there is a method, then use that to decide what to do
     if (method_json != NULL && cJSON_IsString(method_json)) {
-        if (strcmp("mining.notify", method_json->valuestring) == 0) {
-            result = MINING_NOTIFY;
-        } else if (strcmp("mining.set_difficulty", method_json->valuestring) == 0) {
-            result = MINING_SET_DIFFICULTY;
-        } else if (strcmp("mining.set_version_mask", method_json->valuestring) == 0) {
-            result = MINING_SET_VERSION_MASK;
-        } else if (strcmp("mining.set_extranonce", method_json->valuestring) == 0) {
-            result = MINING_SET_EXTRANONCE;
-        } else if (strcmp("client.reconnect", method_json->valuestring) == 0) {
-            result = CLIENT_RECONNECT;
-        } else {
+        result = STRATUM_V1_method_from_name(method_json->valuestring, strlen(method_json->valuestring));
+        if (result == STRATUM_UNKNOWN) {
             ESP_LOGI(TAG, "unhandled method in stratum message: %s", stratum_json);
         }
 
@@ -252,6 +231,7 @@ void STRATUM_V1_parse(StratumApiV1Message * message, const char * stratum_json)
                 goto done;
             }
             message->extranonce_str = strdup(extranonce_json->valuestring);
+            message->session_id = parse_session_id(cJSON_GetArrayItem(result_json, 0));
             message->response_success = true;
         //if the id is STRATUM_ID_CONFIGURE parse it
         } else if (parsed_id == STRATUM_ID_CONFIGURE) {
@@ -272,13 +252,15 @@ void STRATUM_V1_parse(StratumApiV1Message * message, const char * stratum_json)
 
     if (message->method == MINING_NOTIFY) {
 
-        mining_notify * new_work = malloc(sizeof(mining_notify));
-        // new_work->difficulty = difficulty;
+        mining_notify * new_work = STRATUM_V1_alloc_mining_notify();
         cJSON * params = cJSON_GetObjectItem(json, "params");
-        new_work->job_id = strdup(cJSON_GetArrayItem(params, 0)->valuestring);
-        new_work->prev_block_hash = strdup(cJSON_GetArrayItem(params, 1)->valuestring);
-        new_work->coinbase_1 = strdup(cJSON_GetArrayItem(params, 2)->valuestring);
-        new_work->coinbase_2 = strdup(cJSON_GetArrayItem(params, 3)->valuestring);
+        const char * job_id = cJSON_GetArrayItem(params, 0)->valuestring;
+        const char * coinbase_1 = cJSON_GetArrayItem(params, 2)->valuestring;
+        const char * coinbase_2 = cJSON_GetArrayItem(params, 3)->valuestring;
+        STRATUM_V1_notify_set_job_id(new_work, job_id, strlen(job_id));
+        hex2bin(cJSON_GetArrayItem(params, 1)->valuestring, new_work->prev_block_hash, HASH_SIZE);
+        STRATUM_V1_notify_decode_hex(&new_work->coinbase_1, &new_work->coinbase_1_len, &new_work->coinbase_1_capacity, coinbase_1, strlen(coinbase_1));
+        STRATUM_V1_notify_decode_hex(&new_work->coinbase_2, &new_work->coinbase_2_len, &new_work->coinbase_2_capacity, coinbase_2, strlen(coinbase_2));
 
         cJSON * merkle_branch = cJSON_GetArrayItem(params, 4);
         new_work->n_merkle_branches = cJSON_GetArraySize(merkle_branch);
@@ -286,7 +268,7 @@ void STRATUM_V1_parse(StratumApiV1Message * message, const char * stratum_json)
             printf("Too many Merkle branches.\n");
             abort();
         }
-        new_work->merkle_branches = malloc(HASH_SIZE * new_work->n_merkle_branches);
+        STRATUM_V1_notify_reserve_merkle_branches(new_work, new_work->n_merkle_branches);
         for (size_t i = 0; i < new_work->n_merkle_branches; i++) {
             hex2bin(cJSON_GetArrayItem(merkle_branch, i)->valuestring, new_work->merkle_branches + HASH_SIZE * i, HASH_SIZE);
         }
@@ -301,6 +283,7 @@ void STRATUM_V1_parse(StratumApiV1Message * message, const char * stratum_json)
         int paramsLength = cJSON_GetArraySize(params);
         int value = cJSON_IsTrue(cJSON_GetArrayItem(params, paramsLength - 1));
         message->should_abandon_work = value;
+        new_work->clean_jobs = value;
     } else if (message->method == MINING_SET_DIFFICULTY) {
         cJSON * params = cJSON_GetObjectItem(json, "params");
         uint32_t difficulty = cJSON_GetArrayItem(params, 0)->valueint;
@@ -320,16 +303,6 @@ void STRATUM_V1_parse(StratumApiV1Message * message, const char * stratum_json)
     cJSON_Delete(json);
 }
 
-void STRATUM_V1_free_mining_notify(mining_notify * params)
-{
-    free(params->job_id);
-    free(params->prev_block_hash);
-    free(params->coinbase_1);
-    free(params->coinbase_2);
-    free(params->merkle_branches);
-    free(params);
-}
-
 int _parse_stratum_subscribe_result_message(const char * result_json_str, char ** extranonce, int * extranonce2_len)
 {
     cJSON * root = cJSON_Parse(result_json_str);
@@ -362,13 +335,17 @@ int _parse_stratum_subscribe_result_message(const char * result_json_str, char *
     return 0;
 }
 
-int STRATUM_V1_subscribe(int socket, int send_uid, const char * model)
+int STRATUM_V1_subscribe(int socket, int send_uid, const char * model, const char * session_id)
 {
     // Subscribe
     char subscribe_msg[BUFFER_SIZE];
     const esp_app_desc_t *app_desc = esp_app_get_description();
     const char *version = app_desc->version;	
-    sprintf(subscribe_msg, "{\"id\": %d, \"method\": \"mining.subscribe\", \"params\": [\"bitaxe/%s/%s\"]}\n", send_uid, model, version);
+    if (session_id != NULL) {
+        sprintf(subscribe_msg, "{\"id\": %d, \"method\": \"mining.subscribe\", \"params\": [\"bitaxe/%s/%s\", \"%s\"]}\n", send_uid, model, version, session_id);
+    } else {
+        sprintf(subscribe_msg, "{\"id\": %d, \"method\": \"mining.subscribe\", \"params\": [\"bitaxe/%s/%s\"]}\n", send_uid, model, version);
+    }
     debug_stratum_tx(subscribe_msg);
 
     return write(socket, subscribe_msg, strlen(subscribe_msg));
@@ -413,12 +390,29 @@ int STRATUM_V1_submit_share(int socket, int send_uid, const char * username, con
                             const uint32_t nonce, const uint32_t version)
 {
     char submit_msg[BUFFER_SIZE];
-    sprintf(submit_msg,
+    int len = STRATUM_V1_format_submit(submit_msg, sizeof(submit_msg), send_uid, username, jobid, extranonce_2, ntime, nonce, version);
+    if (len < 0) {
+        return len;
+    }
+
+    return write(socket, submit_msg, len);
+}
+
+/// Writes one newline terminated mining.submit into buf so several can be batched into one send.
+/// @return length written, or -1 when it does not fit in size
+int STRATUM_V1_format_submit(char * buf, size_t size, int send_uid, const char * username, const char * jobid,
+                             const char * extranonce_2, const uint32_t ntime,
+                             const uint32_t nonce, const uint32_t version)
+{
+    int len = snprintf(buf, size,
             "{\"id\": %d, \"method\": \"mining.submit\", \"params\": [\"%s\", \"%s\", \"%s\", \"%08lx\", \"%08lx\", \"%08lx\"]}\n",
             send_uid, username, jobid, extranonce_2, ntime, nonce, version);
-    debug_stratum_tx(submit_msg);
+    if (len < 0 || (size_t) len >= size) {
+        return -1;
+    }
+    debug_stratum_tx(buf);
 
-    return write(socket, submit_msg, strlen(submit_msg));
+    return len;
 }
 
 int STRATUM_V1_configure_version_rolling(int socket, int send_uid, uint32_t * version_mask)
@@ -435,7 +429,6 @@ int STRATUM_V1_configure_version_rolling(int socket, int send_uid, uint32_t * ve
 
 static void debug_stratum_tx(const char * msg)
 {
-    STRATUM_V1_stamp_tx(last_parsed_request_id);
     //remove the trailing newline
     char * newline = strchr(msg, '\n');
     if (newline != NULL) {
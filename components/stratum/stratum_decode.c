@@ -0,0 +1,541 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stratum_decode.h"
+#include "utils.h"
+
+typedef struct
+{
+    const char *p;
+    const char *end;
+} cursor;
+
+typedef struct
+{
+    const char *start;
+    size_t len;
+} span;
+
+typedef bool (*params_decoder)(StratumApiV1Message *message, const span *params);
+
+static bool decode_notify(StratumApiV1Message *message, const span *params);
+static bool decode_set_difficulty(StratumApiV1Message *message, const span *params);
+
+// methods without a decoder are left to the cJSON parser
+static const struct
+{
+    const char *name;
+    size_t len;
+    stratum_method method;
+    params_decoder decode;
+} method_table[] = {
+    {"mining.notify", sizeof("mining.notify") - 1, MINING_NOTIFY, decode_notify},
+    {"mining.set_difficulty", sizeof("mining.set_difficulty") - 1, MINING_SET_DIFFICULTY, decode_set_difficulty},
+    {"mining.set_version_mask", sizeof("mining.set_version_mask") - 1, MINING_SET_VERSION_MASK, NULL},
+    {"mining.set_extranonce", sizeof("mining.set_extranonce") - 1, MINING_SET_EXTRANONCE, NULL},
+    {"client.reconnect", sizeof("client.reconnect") - 1, CLIENT_RECONNECT, NULL},
+};
+
+#define METHOD_TABLE_SIZE (sizeof(method_table) / sizeof(method_table[0]))
+
+static mining_notify mining_notify_pool[MINING_NOTIFY_POOL_SIZE];
+static mining_notify *mining_notify_free_list[MINING_NOTIFY_POOL_SIZE];
+static int mining_notify_free_count = -1; // -1 until the free list is filled on first use
+static pthread_mutex_t mining_notify_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static bool is_pooled(const mining_notify *notify)
+{
+    return notify >= mining_notify_pool && notify < mining_notify_pool + MINING_NOTIFY_POOL_SIZE;
+}
+
+mining_notify *STRATUM_V1_alloc_mining_notify(void)
+{
+    mining_notify *notify = NULL;
+
+    pthread_mutex_lock(&mining_notify_pool_lock);
+    if (mining_notify_free_count < 0)
+    {
+        for (int i = 0; i < MINING_NOTIFY_POOL_SIZE; i++)
+        {
+            mining_notify_free_list[i] = &mining_notify_pool[i];
+        }
+        mining_notify_free_count = MINING_NOTIFY_POOL_SIZE;
+    }
+    if (mining_notify_free_count > 0)
+    {
+        notify = mining_notify_free_list[--mining_notify_free_count];
+    }
+    pthread_mutex_unlock(&mining_notify_pool_lock);
+
+    if (notify == NULL)
+    {
+        return calloc(1, sizeof(mining_notify));
+    }
+
+    // keep the buffers, clear everything else
+    if (notify->job_id != NULL)
+    {
+        notify->job_id[0] = '\0';
+    }
+    notify->coinbase_1_len = 0;
+    notify->coinbase_2_len = 0;
+    notify->n_merkle_branches = 0;
+    memset(notify->prev_block_hash, 0, HASH_SIZE);
+    notify->version = 0;
+    notify->target = 0;
+    notify->ntime = 0;
+    notify->clean_jobs = false;
+    notify->has_merkle_root = false;
+    notify->received_us = 0;
+    return notify;
+}
+
+void STRATUM_V1_free_mining_notify(mining_notify *params)
+{
+    if (params == NULL)
+    {
+        return;
+    }
+
+    if (is_pooled(params))
+    {
+        pthread_mutex_lock(&mining_notify_pool_lock);
+        mining_notify_free_list[mining_notify_free_count++] = params;
+        pthread_mutex_unlock(&mining_notify_pool_lock);
+        return;
+    }
+
+    free(params->job_id);
+    free(params->coinbase_1);
+    free(params->coinbase_2);
+    free(params->merkle_branches);
+    free(params);
+}
+
+static bool reserve(void **buf, size_t *capacity, size_t size)
+{
+    if (size <= *capacity && *buf != NULL)
+    {
+        return true;
+    }
+    void *grown = realloc(*buf, size);
+    if (grown == NULL)
+    {
+        return false;
+    }
+    *buf = grown;
+    *capacity = size;
+    return true;
+}
+
+bool STRATUM_V1_notify_set_job_id(mining_notify *notify, const char *job_id, size_t len)
+{
+    if (!reserve((void **)&notify->job_id, &notify->job_id_capacity, len + 1))
+    {
+        return false;
+    }
+    memcpy(notify->job_id, job_id, len);
+    notify->job_id[len] = '\0';
+    return true;
+}
+
+bool STRATUM_V1_notify_decode_hex(uint8_t **buf, size_t *len, size_t *capacity, const char *hex, size_t hex_len)
+{
+    size_t bin_len = hex_len / 2;
+    // never ask for 0 bytes, an empty coinbase part still gets a valid pointer
+    if (!reserve((void **)buf, capacity, bin_len > 0 ? bin_len : 1))
+    {
+        return false;
+    }
+    *len = hex2bin(hex, *buf, bin_len);
+    return true;
+}
+
+bool STRATUM_V1_notify_reserve_merkle_branches(mining_notify *notify, size_t n_merkle_branches)
+{
+    size_t size = HASH_SIZE * (n_merkle_branches > 0 ? n_merkle_branches : 1);
+    return reserve((void **)&notify->merkle_branches, &notify->merkle_branches_capacity, size);
+}
+
+stratum_method STRATUM_V1_method_from_name(const char *name, size_t len)
+{
+    for (size_t i = 0; i < METHOD_TABLE_SIZE; i++)
+    {
+        if (method_table[i].len == len && memcmp(method_table[i].name, name, len) == 0)
+        {
+            return method_table[i].method;
+        }
+    }
+    return STRATUM_UNKNOWN;
+}
+
+static void skip_whitespace(cursor *c)
+{
+    while (c->p < c->end && (*c->p == ' ' || *c->p == '\t' || *c->p == '\r' || *c->p == '\n'))
+    {
+        c->p++;
+    }
+}
+
+static bool expect(cursor *c, char ch)
+{
+    skip_whitespace(c);
+    if (c->p < c->end && *c->p == ch)
+    {
+        c->p++;
+        return true;
+    }
+    return false;
+}
+
+// string contents without the quotes, strings with escapes are left to cJSON
+static bool read_string(cursor *c, span *s)
+{
+    if (!expect(c, '"'))
+    {
+        return false;
+    }
+    const char *quote = memchr(c->p, '"', c->end - c->p);
+    if (quote == NULL || memchr(c->p, '\\', quote - c->p) != NULL)
+    {
+        return false;
+    }
+    s->start = c->p;
+    s->len = quote - c->p;
+    c->p = quote + 1;
+    return true;
+}
+
+static bool skip_value(cursor *c)
+{
+    skip_whitespace(c);
+    if (c->p >= c->end)
+    {
+        return false;
+    }
+
+    if (*c->p == '"')
+    {
+        // escaped quotes are only skipped, never decoded
+        for (c->p++; c->p < c->end; c->p++)
+        {
+            if (*c->p == '\\')
+            {
+                c->p++;
+            }
+            else if (*c->p == '"')
+            {
+                c->p++;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    if (*c->p == '[' || *c->p == '{')
+    {
+        char close = *c->p == '[' ? ']' : '}';
+        c->p++;
+        if (expect(c, close))
+        {
+            return true;
+        }
+        do
+        {
+            if (close == '}')
+            {
+                span key;
+                if (!read_string(c, &key) || !expect(c, ':'))
+                {
+                    return false;
+                }
+            }
+            if (!skip_value(c))
+            {
+                return false;
+            }
+        } while (expect(c, ','));
+        return expect(c, close);
+    }
+
+    // number or literal
+    const char *start = c->p;
+    while (c->p < c->end && *c->p != ',' && *c->p != ']' && *c->p != '}' &&
+           *c->p != ' ' && *c->p != '\t' && *c->p != '\r' && *c->p != '\n')
+    {
+        c->p++;
+    }
+    return c->p > start;
+}
+
+static bool span_equals(const span *s, const char *literal)
+{
+    size_t len = strlen(literal);
+    return s->start != NULL && s->len == len && memcmp(s->start, literal, len) == 0;
+}
+
+// plain decimal integers only, floats and exponents go through cJSON
+static bool span_to_uint(const span *s, uint64_t max, uint64_t *value)
+{
+    if (s->len == 0 || s->len > 19)
+    {
+        return false;
+    }
+    uint64_t v = 0;
+    for (size_t i = 0; i < s->len; i++)
+    {
+        char ch = s->start[i];
+        if (ch < '0' || ch > '9')
+        {
+            return false;
+        }
+        v = v * 10 + (ch - '0');
+    }
+    if (v > max)
+    {
+        return false;
+    }
+    *value = v;
+    return true;
+}
+
+static bool span_hex_to_u32(const span *s, uint32_t *value)
+{
+    if (s->len == 0 || s->len > 8)
+    {
+        return false;
+    }
+    uint32_t v = 0;
+    for (size_t i = 0; i < s->len; i++)
+    {
+        v = (v << 4) | hex2val(s->start[i]);
+    }
+    *value = v;
+    return true;
+}
+
+static bool read_hex_u32(cursor *c, uint32_t *value)
+{
+    span s;
+    return read_string(c, &s) && span_hex_to_u32(&s, value);
+}
+
+// value span of the next array item
+static bool read_raw(cursor *c, span *s)
+{
+    skip_whitespace(c);
+    s->start = c->p;
+    if (!skip_value(c))
+    {
+        return false;
+    }
+    s->len = c->p - s->start;
+    return true;
+}
+
+static bool decode_notify_params(mining_notify *notify, cursor *c)
+{
+    span s;
+
+    if (!expect(c, '[') || !read_string(c, &s) || s.len == 0 ||
+        !STRATUM_V1_notify_set_job_id(notify, s.start, s.len))
+    {
+        return false;
+    }
+
+    if (!expect(c, ',') || !read_string(c, &s) || s.len != HASH_SIZE * 2)
+    {
+        return false;
+    }
+    hex2bin(s.start, notify->prev_block_hash, HASH_SIZE);
+
+    if (!expect(c, ',') || !read_string(c, &s) ||
+        !STRATUM_V1_notify_decode_hex(&notify->coinbase_1, &notify->coinbase_1_len, &notify->coinbase_1_capacity, s.start, s.len))
+    {
+        return false;
+    }
+    if (!expect(c, ',') || !read_string(c, &s) ||
+        !STRATUM_V1_notify_decode_hex(&notify->coinbase_2, &notify->coinbase_2_len, &notify->coinbase_2_capacity, s.start, s.len))
+    {
+        return false;
+    }
+
+    if (!expect(c, ',') || !expect(c, '[') ||
+        !STRATUM_V1_notify_reserve_merkle_branches(notify, MAX_MERKLE_BRANCHES))
+    {
+        return false;
+    }
+    if (!expect(c, ']'))
+    {
+        do
+        {
+            if (notify->n_merkle_branches == MAX_MERKLE_BRANCHES || !read_string(c, &s) || s.len != HASH_SIZE * 2)
+            {
+                return false;
+            }
+            hex2bin(s.start, notify->merkle_branches + HASH_SIZE * notify->n_merkle_branches, HASH_SIZE);
+            notify->n_merkle_branches++;
+        } while (expect(c, ','));
+        if (!expect(c, ']'))
+        {
+            return false;
+        }
+    }
+
+    if (!expect(c, ',') || !read_hex_u32(c, &notify->version) ||
+        !expect(c, ',') || !read_hex_u32(c, &notify->target) ||
+        !expect(c, ',') || !read_hex_u32(c, &notify->ntime))
+    {
+        return false;
+    }
+
+    // params can be variable length, clean_jobs is the last one
+    span last = {0};
+    while (expect(c, ','))
+    {
+        if (!read_raw(c, &last))
+        {
+            return false;
+        }
+    }
+    if (!expect(c, ']'))
+    {
+        return false;
+    }
+    notify->clean_jobs = span_equals(&last, "true");
+    return true;
+}
+
+static bool decode_notify(StratumApiV1Message *message, const span *params)
+{
+    mining_notify *notify = STRATUM_V1_alloc_mining_notify();
+    if (notify == NULL)
+    {
+        return false;
+    }
+
+    cursor c = {params->start, params->start + params->len};
+    if (!decode_notify_params(notify, &c))
+    {
+        STRATUM_V1_free_mining_notify(notify);
+        return false;
+    }
+
+    message->mining_notification = notify;
+    message->should_abandon_work = notify->clean_jobs;
+    return true;
+}
+
+static bool decode_set_difficulty(StratumApiV1Message *message, const span *params)
+{
+    cursor c = {params->start, params->start + params->len};
+    span s;
+    uint64_t difficulty;
+
+    if (!expect(&c, '[') || !read_raw(&c, &s) || !span_to_uint(&s, UINT32_MAX, &difficulty) || !expect(&c, ']'))
+    {
+        return false;
+    }
+    message->new_difficulty = difficulty;
+    return true;
+}
+
+bool STRATUM_V1_decode_fast(StratumApiV1Message *message, const char *json, size_t len)
+{
+    cursor c = {json, json + len};
+    span id = {0}, method = {0}, params = {0}, result = {0}, error = {0};
+
+    if (!expect(&c, '{'))
+    {
+        return false;
+    }
+
+    // one pass over the top level object, remembering where the interesting values are
+    if (!expect(&c, '}'))
+    {
+        do
+        {
+            span key, value;
+            if (!read_string(&c, &key) || !expect(&c, ':') || !read_raw(&c, &value))
+            {
+                return false;
+            }
+
+            if (span_equals(&key, "id"))
+                id = value;
+            else if (span_equals(&key, "method"))
+                method = value;
+            else if (span_equals(&key, "params"))
+                params = value;
+            else if (span_equals(&key, "result"))
+                result = value;
+            else if (span_equals(&key, "error"))
+                error = value;
+            else
+                // reject-reason and anything else unexpected
+                return false;
+        } while (expect(&c, ','));
+
+        if (!expect(&c, '}'))
+        {
+            return false;
+        }
+    }
+
+    int64_t message_id = -1;
+    if (id.start != NULL && !span_equals(&id, "null"))
+    {
+        uint64_t value;
+        if (!span_to_uint(&id, INT32_MAX, &value))
+        {
+            return false;
+        }
+        message_id = value;
+    }
+
+    if (method.start != NULL)
+    {
+        // the method value still has its quotes
+        if (method.len < 2 || method.start[0] != '"' || params.start == NULL)
+        {
+            return false;
+        }
+        for (size_t i = 0; i < METHOD_TABLE_SIZE; i++)
+        {
+            if (method_table[i].len == method.len - 2 && memcmp(method_table[i].name, method.start + 1, method.len - 2) == 0)
+            {
+                if (method_table[i].decode == NULL || !method_table[i].decode(message, &params))
+                {
+                    return false;
+                }
+                message->message_id = message_id;
+                message->method = method_table[i].method;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // share and setup results, anything but a plain true or false goes through cJSON
+    bool success;
+    if (span_equals(&result, "true"))
+        success = true;
+    else if (span_equals(&result, "false"))
+        success = false;
+    else
+        return false;
+    if (error.start != NULL && !span_equals(&error, "null"))
+    {
+        return false;
+    }
+
+    message->message_id = message_id;
+    message->method = message_id < 5 ? STRATUM_RESULT_SETUP : STRATUM_RESULT;
+    message->response_success = success;
+    if (!success)
+    {
+        message->error_str = strdup("unknown");
+    }
+    return true;
+}
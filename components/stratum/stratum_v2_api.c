@@ -0,0 +1,309 @@
+/******************************************************************************
+ *  *
+ * References:
+ *  1. Stratum V2 specification - [link](https://stratumprotocol.org/specification)
+ *****************************************************************************/
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "mining.h"
+#include "stratum_decode.h"
+#include "stratum_v2_api.h"
+#include "utils.h"
+
+static const char *TAG = "stratum_v2_api";
+
+void STRATUM_V2_init(stratum_v2_client *client)
+{
+    memset(client, 0, sizeof(*client));
+    pthread_mutex_init(&client->send_lock, NULL);
+}
+
+void STRATUM_V2_reset(stratum_v2_client *client)
+{
+    // closed first and under the lock STRATUM_V2_submit_share checks it with,
+    // so a share never gets encrypted with a transport that is being zeroed
+    pthread_mutex_lock(&client->send_lock);
+    client->channel_open = false;
+    memset(&client->handshake, 0, sizeof(client->handshake));
+    memset(&client->transport, 0, sizeof(client->transport));
+    pthread_mutex_unlock(&client->send_lock);
+
+    client->channel_id = 0;
+    client->has_prev_hash = false;
+    client->future_job_count = 0;
+}
+
+int STRATUM_V2_handshake_start(stratum_v2_client *client, uint8_t out[SV2_NOISE_ACT1_LEN])
+{
+    return sv2_noise_initiator_start(&client->handshake, out);
+}
+
+int STRATUM_V2_handshake_finish(stratum_v2_client *client, const uint8_t in[SV2_NOISE_ACT2_LEN], const uint8_t *authority_key,
+                                uint32_t now)
+{
+    uint8_t server_key[32];
+
+    pthread_mutex_lock(&client->send_lock);
+    int ret = sv2_noise_initiator_finish(&client->handshake, in, authority_key, now, &client->transport, server_key);
+    pthread_mutex_unlock(&client->send_lock);
+    return ret;
+}
+
+static int encrypt_frame(stratum_v2_client *client, const uint8_t *frame, int frame_len, uint8_t *out, size_t size)
+{
+    if (frame_len < 0)
+    {
+        return -1;
+    }
+
+    pthread_mutex_lock(&client->send_lock);
+    int len = client->transport.send.has_key ? sv2_noise_encrypt_frame(&client->transport, frame, frame_len, out, size) : -1;
+    pthread_mutex_unlock(&client->send_lock);
+    return len;
+}
+
+int STRATUM_V2_setup_connection(stratum_v2_client *client, uint8_t *out, size_t size, const sv2_setup_connection *setup)
+{
+    uint8_t frame[STRATUM_V2_SEND_BUFFER_SIZE];
+    int len = sv2_encode_setup_connection(frame, sizeof(frame), setup, SV2_REQUIRES_STANDARD_JOBS | SV2_REQUIRES_VERSION_ROLLING);
+    return encrypt_frame(client, frame, len, out, size);
+}
+
+int STRATUM_V2_open_channel(stratum_v2_client *client, uint8_t *out, size_t size, uint32_t request_id, const char *user,
+                            float nominal_hash_rate)
+{
+    uint8_t frame[STRATUM_V2_SEND_BUFFER_SIZE];
+    uint8_t max_target[32];
+
+    // any target the pool picks is fine
+    memset(max_target, 0xff, sizeof(max_target));
+    int len = sv2_encode_open_standard_mining_channel(frame, sizeof(frame), request_id, user, nominal_hash_rate, max_target);
+    return encrypt_frame(client, frame, len, out, size);
+}
+
+int STRATUM_V2_submit_share(stratum_v2_client *client, uint8_t *out, size_t size, uint32_t sequence_number, uint32_t job_id,
+                            uint32_t nonce, uint32_t ntime, uint32_t version)
+{
+    uint8_t frame[SV2_FRAME_HEADER_LEN + 24];
+    int len = -1;
+
+    // shares wait for the channel of the next connection, checked under the lock STRATUM_V2_reset closes it with
+    pthread_mutex_lock(&client->send_lock);
+    if (client->channel_open)
+    {
+        len = sv2_encode_submit_shares_standard(frame, sizeof(frame), client->channel_id, sequence_number, job_id, nonce, ntime,
+                                                version);
+        if (len >= 0)
+        {
+            len = sv2_noise_encrypt_frame(&client->transport, frame, len, out, size);
+        }
+    }
+    pthread_mutex_unlock(&client->send_lock);
+    return len;
+}
+
+int STRATUM_V2_decrypt_header(stratum_v2_client *client, const uint8_t in[SV2_ENCRYPTED_HEADER_LEN], sv2_frame_header *header)
+{
+    uint8_t plain[SV2_FRAME_HEADER_LEN];
+
+    if (sv2_noise_decrypt_header(&client->transport, in, plain) != 0)
+    {
+        ESP_LOGE(TAG, "Frame header failed to decrypt");
+        return -1;
+    }
+    sv2_read_frame_header(plain, header);
+    return 0;
+}
+
+size_t STRATUM_V2_payload_wire_len(const sv2_frame_header *header)
+{
+    return sv2_noise_encrypted_frame_len(header->length) - SV2_ENCRYPTED_HEADER_LEN;
+}
+
+int STRATUM_V2_decrypt_payload(stratum_v2_client *client, const uint8_t *in, const sv2_frame_header *header, uint8_t *payload)
+{
+    if (sv2_noise_decrypt_payload(&client->transport, in, header->length, payload) != 0)
+    {
+        ESP_LOGE(TAG, "Frame payload failed to decrypt");
+        return -1;
+    }
+    return 0;
+}
+
+uint32_t STRATUM_V2_target_to_difficulty(const uint8_t target[32])
+{
+    double difficulty = ceil(hash_to_difficulty(target));
+    if (difficulty < 1)
+    {
+        return 1;
+    }
+    if (difficulty > UINT32_MAX)
+    {
+        return UINT32_MAX;
+    }
+    return difficulty;
+}
+
+// a header-only notify: no coinbase or merkle branches, the pool hands over the merkle root itself
+static mining_notify *job_to_notify(const stratum_v2_client *client, const sv2_new_mining_job *job, uint32_t ntime, bool clean_jobs)
+{
+    mining_notify *notify = STRATUM_V1_alloc_mining_notify();
+    if (notify == NULL)
+    {
+        return NULL;
+    }
+
+    char job_id[11];
+    int len = snprintf(job_id, sizeof(job_id), "%lu", (unsigned long)job->job_id);
+    if (!STRATUM_V1_notify_set_job_id(notify, job_id, len))
+    {
+        STRATUM_V1_free_mining_notify(notify);
+        return NULL;
+    }
+
+    // mining.notify carries the previous block hash with its 32 bit words byte swapped, keep that layout
+    swap_endian_words_bin(client->prev_hash, notify->prev_block_hash, HASH_SIZE);
+    memcpy(notify->merkle_root, job->merkle_root, HASH_SIZE);
+    notify->has_merkle_root = true;
+    notify->version = job->version;
+    notify->target = client->nbits;
+    notify->ntime = ntime;
+    notify->clean_jobs = clean_jobs;
+    return notify;
+}
+
+static void keep_future_job(stratum_v2_client *client, const sv2_new_mining_job *job)
+{
+    if (client->future_job_count == STRATUM_V2_FUTURE_JOBS)
+    {
+        // the oldest one is the least likely to be activated
+        memmove(client->future_jobs, client->future_jobs + 1, sizeof(client->future_jobs[0]) * (STRATUM_V2_FUTURE_JOBS - 1));
+        client->future_job_count--;
+    }
+    client->future_jobs[client->future_job_count++] = *job;
+}
+
+static void handle_new_mining_job(stratum_v2_client *client, const sv2_new_mining_job *job, stratum_v2_event *event)
+{
+    if (!job->has_min_ntime)
+    {
+        keep_future_job(client, job);
+        return;
+    }
+
+    if (!client->has_prev_hash)
+    {
+        ESP_LOGW(TAG, "Job %lu arrived before any SetNewPrevHash", (unsigned long)job->job_id);
+        return;
+    }
+
+    event->mining_notification = job_to_notify(client, job, job->min_ntime, false);
+    if (event->mining_notification != NULL)
+    {
+        event->type = STRATUM_V2_NEW_WORK;
+    }
+}
+
+static void handle_set_new_prev_hash(stratum_v2_client *client, const sv2_set_new_prev_hash *prev_hash, stratum_v2_event *event)
+{
+    memcpy(client->prev_hash, prev_hash->prev_hash, sizeof(client->prev_hash));
+    client->nbits = prev_hash->nbits;
+    client->has_prev_hash = true;
+
+    const sv2_new_mining_job *job = NULL;
+    for (int i = 0; i < client->future_job_count; i++)
+    {
+        if (client->future_jobs[i].job_id == prev_hash->job_id)
+        {
+            job = &client->future_jobs[i];
+        }
+    }
+
+    if (job == NULL)
+    {
+        ESP_LOGW(TAG, "SetNewPrevHash for unknown job %lu", (unsigned long)prev_hash->job_id);
+    }
+    else
+    {
+        event->mining_notification = job_to_notify(client, job, prev_hash->min_ntime, true);
+        if (event->mining_notification != NULL)
+        {
+            event->type = STRATUM_V2_NEW_WORK;
+        }
+    }
+
+    // future jobs were all built on the previous block
+    client->future_job_count = 0;
+}
+
+void STRATUM_V2_handle_frame(stratum_v2_client *client, const sv2_frame_header *header, const uint8_t *payload,
+                             stratum_v2_event *event)
+{
+    sv2_message *message = &client->message;
+
+    memset(event, 0, sizeof(*event));
+    if (!sv2_decode_message(header, payload, message))
+    {
+        ESP_LOGW(TAG, "Ignoring message type 0x%02x (%lu bytes)", header->msg_type, (unsigned long)header->length);
+        return;
+    }
+
+    switch (message->msg_type)
+    {
+    case SV2_SETUP_CONNECTION_SUCCESS:
+        event->type = STRATUM_V2_SETUP_SUCCESS;
+        break;
+    case SV2_SETUP_CONNECTION_ERROR:
+        event->type = STRATUM_V2_SETUP_ERROR;
+        event->error = message->error_code;
+        break;
+    case SV2_OPEN_STANDARD_MINING_CHANNEL_SUCCESS:
+        client->channel_id = message->open_channel_success.channel_id;
+        client->channel_open = true;
+        event->type = STRATUM_V2_CHANNEL_OPENED;
+        event->difficulty = STRATUM_V2_target_to_difficulty(message->open_channel_success.target);
+        break;
+    case SV2_OPEN_MINING_CHANNEL_ERROR:
+        event->type = STRATUM_V2_CHANNEL_ERROR;
+        event->error = message->error_code;
+        break;
+    case SV2_NEW_MINING_JOB:
+        if (client->channel_open && message->new_mining_job.channel_id == client->channel_id)
+        {
+            handle_new_mining_job(client, &message->new_mining_job, event);
+        }
+        break;
+    case SV2_SET_NEW_PREV_HASH:
+        if (client->channel_open && message->set_new_prev_hash.channel_id == client->channel_id)
+        {
+            handle_set_new_prev_hash(client, &message->set_new_prev_hash, event);
+        }
+        break;
+    case SV2_SET_TARGET:
+        if (client->channel_open && message->set_target.channel_id == client->channel_id)
+        {
+            event->type = STRATUM_V2_SET_TARGET;
+            event->difficulty = STRATUM_V2_target_to_difficulty(message->set_target.maximum_target);
+        }
+        break;
+    case SV2_SUBMIT_SHARES_SUCCESS:
+        event->type = STRATUM_V2_SHARES_ACCEPTED;
+        event->sequence_number = message->submit_success.last_sequence_number;
+        event->accepted_count = message->submit_success.new_submits_accepted_count;
+        break;
+    case SV2_SUBMIT_SHARES_ERROR:
+        event->type = STRATUM_V2_SHARE_REJECTED;
+        event->sequence_number = message->submit_error.sequence_number;
+        event->error = message->error_code;
+        break;
+    case SV2_RECONNECT:
+        event->type = STRATUM_V2_RECONNECT;
+        event->new_host = message->reconnect.new_host;
+        event->new_port = message->reconnect.new_port;
+        break;
+    }
+}
@@ -0,0 +1,723 @@
+#include <string.h>
+
+#include "esp_random.h"
+#include "mbedtls/bignum.h"
+#include "mbedtls/ecp.h"
+#include "mbedtls/sha256.h"
+#include "sv2_crypto.h"
+
+// secp256k1 field and curve constants, loaded per operation so nothing is shared between tasks
+typedef struct
+{
+    mbedtls_ecp_group grp;
+    mbedtls_mpi sqrt_exp;     // (p + 1) / 4, p = 3 mod 4 so a^((p + 1) / 4) is a square root when one exists
+    mbedtls_mpi minus_3_sqrt; // a square root of -3, the constant of the ElligatorSwift map
+    mbedtls_mpi RR;           // exp_mod cache for p
+} curve;
+
+// group order, big endian
+static const uint8_t SECP256K1_N[32] = {
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xfe,
+    0xba, 0xae, 0xdc, 0xe6, 0xaf, 0x48, 0xa0, 0x3b, 0xbf, 0xd2, 0x5e, 0x8c, 0xd0, 0x36, 0x41, 0x41,
+};
+
+static int fill_random(void *ctx, unsigned char *buf, size_t len)
+{
+    esp_fill_random(buf, len);
+    return 0;
+}
+
+void sv2_hmac_sha256(const uint8_t *key, size_t key_len, const uint8_t *data, size_t data_len, uint8_t out[32])
+{
+    uint8_t block[64] = {0};
+    uint8_t inner[32];
+    mbedtls_sha256_context ctx;
+
+    if (key_len > sizeof(block))
+    {
+        mbedtls_sha256(key, key_len, block, 0);
+    }
+    else
+    {
+        memcpy(block, key, key_len);
+    }
+
+    for (int i = 0; i < 64; i++)
+        block[i] ^= 0x36;
+    mbedtls_sha256_init(&ctx);
+    mbedtls_sha256_starts(&ctx, 0);
+    mbedtls_sha256_update(&ctx, block, 64);
+    mbedtls_sha256_update(&ctx, data, data_len);
+    mbedtls_sha256_finish(&ctx, inner);
+
+    // 0x36 ^ 0x5c turns the inner pad into the outer one
+    for (int i = 0; i < 64; i++)
+        block[i] ^= 0x36 ^ 0x5c;
+    mbedtls_sha256_starts(&ctx, 0);
+    mbedtls_sha256_update(&ctx, block, 64);
+    mbedtls_sha256_update(&ctx, inner, 32);
+    mbedtls_sha256_finish(&ctx, out);
+    mbedtls_sha256_free(&ctx);
+}
+
+void sv2_tagged_hash(const char *tag, const uint8_t *data, size_t data_len, uint8_t out[32])
+{
+    uint8_t tag_hash[32];
+    mbedtls_sha256_context ctx;
+
+    mbedtls_sha256((const uint8_t *)tag, strlen(tag), tag_hash, 0);
+    mbedtls_sha256_init(&ctx);
+    mbedtls_sha256_starts(&ctx, 0);
+    mbedtls_sha256_update(&ctx, tag_hash, 32);
+    mbedtls_sha256_update(&ctx, tag_hash, 32);
+    mbedtls_sha256_update(&ctx, data, data_len);
+    mbedtls_sha256_finish(&ctx, out);
+    mbedtls_sha256_free(&ctx);
+}
+
+static int fe_sqrt(curve *c, mbedtls_mpi *r, const mbedtls_mpi *a);
+
+static int curve_init(curve *c)
+{
+    int ret;
+    mbedtls_mpi minus_3;
+
+    mbedtls_mpi_init(&minus_3);
+    mbedtls_ecp_group_init(&c->grp);
+    mbedtls_mpi_init(&c->sqrt_exp);
+    mbedtls_mpi_init(&c->minus_3_sqrt);
+    mbedtls_mpi_init(&c->RR);
+
+    MBEDTLS_MPI_CHK(mbedtls_ecp_group_load(&c->grp, MBEDTLS_ECP_DP_SECP256K1));
+    MBEDTLS_MPI_CHK(mbedtls_mpi_add_int(&c->sqrt_exp, &c->grp.P, 1));
+    MBEDTLS_MPI_CHK(mbedtls_mpi_shift_r(&c->sqrt_exp, 2));
+    MBEDTLS_MPI_CHK(mbedtls_mpi_sub_int(&minus_3, &c->grp.P, 3));
+    MBEDTLS_MPI_CHK(fe_sqrt(c, &c->minus_3_sqrt, &minus_3));
+
+cleanup:
+    mbedtls_mpi_free(&minus_3);
+    return ret;
+}
+
+static void curve_free(curve *c)
+{
+    mbedtls_ecp_group_free(&c->grp);
+    mbedtls_mpi_free(&c->sqrt_exp);
+    mbedtls_mpi_free(&c->minus_3_sqrt);
+    mbedtls_mpi_free(&c->RR);
+}
+
+// field arithmetic mod p, every result in [0, p)
+
+static int fe_mul(curve *c, mbedtls_mpi *x, const mbedtls_mpi *a, const mbedtls_mpi *b)
+{
+    int ret;
+    MBEDTLS_MPI_CHK(mbedtls_mpi_mul_mpi(x, a, b));
+    MBEDTLS_MPI_CHK(mbedtls_mpi_mod_mpi(x, x, &c->grp.P));
+cleanup:
+    return ret;
+}
+
+static int fe_add(curve *c, mbedtls_mpi *x, const mbedtls_mpi *a, const mbedtls_mpi *b)
+{
+    int ret;
+    MBEDTLS_MPI_CHK(mbedtls_mpi_add_mpi(x, a, b));
+    MBEDTLS_MPI_CHK(mbedtls_mpi_mod_mpi(x, x, &c->grp.P));
+cleanup:
+    return ret;
+}
+
+static int fe_sub(curve *c, mbedtls_mpi *x, const mbedtls_mpi *a, const mbedtls_mpi *b)
+{
+    int ret;
+    MBEDTLS_MPI_CHK(mbedtls_mpi_sub_mpi(x, a, b));
+    MBEDTLS_MPI_CHK(mbedtls_mpi_mod_mpi(x, x, &c->grp.P));
+cleanup:
+    return ret;
+}
+
+static int fe_neg(curve *c, mbedtls_mpi *x, const mbedtls_mpi *a)
+{
+    int ret;
+    MBEDTLS_MPI_CHK(mbedtls_mpi_sub_mpi(x, &c->grp.P, a));
+    MBEDTLS_MPI_CHK(mbedtls_mpi_mod_mpi(x, x, &c->grp.P));
+cleanup:
+    return ret;
+}
+
+static int fe_div(curve *c, mbedtls_mpi *x, const mbedtls_mpi *a, const mbedtls_mpi *b)
+{
+    int ret;
+    mbedtls_mpi inv;
+    mbedtls_mpi_init(&inv);
+    MBEDTLS_MPI_CHK(mbedtls_mpi_inv_mod(&inv, b, &c->grp.P));
+    MBEDTLS_MPI_CHK(fe_mul(c, x, a, &inv));
+cleanup:
+    mbedtls_mpi_free(&inv);
+    return ret;
+}
+
+static int fe_half(curve *c, mbedtls_mpi *x, const mbedtls_mpi *a)
+{
+    int ret;
+    mbedtls_mpi two;
+    mbedtls_mpi_init(&two);
+    MBEDTLS_MPI_CHK(mbedtls_mpi_lset(&two, 2));
+    MBEDTLS_MPI_CHK(fe_div(c, x, a, &two));
+cleanup:
+    mbedtls_mpi_free(&two);
+    return ret;
+}
+
+// 0 with r set when a is a square, 1 when it is not
+static int fe_sqrt(curve *c, mbedtls_mpi *r, const mbedtls_mpi *a)
+{
+    int ret;
+    mbedtls_mpi check;
+    mbedtls_mpi_init(&check);
+    MBEDTLS_MPI_CHK(mbedtls_mpi_exp_mod(r, a, &c->sqrt_exp, &c->grp.P, &c->RR));
+    MBEDTLS_MPI_CHK(fe_mul(c, &check, r, r));
+    ret = mbedtls_mpi_cmp_mpi(&check, a) == 0 ? 0 : 1;
+cleanup:
+    mbedtls_mpi_free(&check);
+    return ret;
+}
+
+// x^3 + 7
+static int curve_rhs(curve *c, mbedtls_mpi *y2, const mbedtls_mpi *x)
+{
+    int ret;
+    MBEDTLS_MPI_CHK(fe_mul(c, y2, x, x));
+    MBEDTLS_MPI_CHK(fe_mul(c, y2, y2, x));
+    MBEDTLS_MPI_CHK(mbedtls_mpi_add_int(y2, y2, 7));
+    MBEDTLS_MPI_CHK(mbedtls_mpi_mod_mpi(y2, y2, &c->grp.P));
+cleanup:
+    return ret;
+}
+
+// 0 when x is the x coordinate of a curve point, 1 when it is not
+static int is_valid_x(curve *c, const mbedtls_mpi *x)
+{
+    int ret;
+    mbedtls_mpi y2, y;
+    mbedtls_mpi_init(&y2);
+    mbedtls_mpi_init(&y);
+    MBEDTLS_MPI_CHK(curve_rhs(c, &y2, x));
+    ret = fe_sqrt(c, &y, &y2);
+cleanup:
+    mbedtls_mpi_free(&y2);
+    mbedtls_mpi_free(&y);
+    return ret;
+}
+
+// point with x coordinate x and even y
+static int lift_x(curve *c, mbedtls_ecp_point *point, const mbedtls_mpi *x)
+{
+    int ret;
+    uint8_t buf[65];
+    mbedtls_mpi y2, y;
+    mbedtls_mpi_init(&y2);
+    mbedtls_mpi_init(&y);
+
+    MBEDTLS_MPI_CHK(curve_rhs(c, &y2, x));
+    MBEDTLS_MPI_CHK(fe_sqrt(c, &y, &y2));
+    if (mbedtls_mpi_get_bit(&y, 0))
+    {
+        MBEDTLS_MPI_CHK(fe_neg(c, &y, &y));
+    }
+
+    buf[0] = 0x04;
+    MBEDTLS_MPI_CHK(mbedtls_mpi_write_binary(x, buf + 1, 32));
+    MBEDTLS_MPI_CHK(mbedtls_mpi_write_binary(&y, buf + 33, 32));
+    MBEDTLS_MPI_CHK(mbedtls_ecp_point_read_binary(&c->grp, point, buf, sizeof(buf)));
+
+cleanup:
+    mbedtls_mpi_free(&y2);
+    mbedtls_mpi_free(&y);
+    return ret;
+}
+
+// x coordinate and y parity of an affine point
+static int point_x(curve *c, const mbedtls_ecp_point *point, uint8_t x[32], bool *odd_y)
+{
+    uint8_t buf[65];
+    size_t len;
+    int ret = mbedtls_ecp_point_write_binary(&c->grp, point, MBEDTLS_ECP_PF_UNCOMPRESSED, &len, buf, sizeof(buf));
+    if (ret != 0 || len != sizeof(buf))
+    {
+        return ret != 0 ? ret : -1;
+    }
+    memcpy(x, buf + 1, 32);
+    if (odd_y != NULL)
+    {
+        *odd_y = buf[64] & 1;
+    }
+    return 0;
+}
+
+// public key of a secret key in [1, n)
+static int public_key(curve *c, const mbedtls_mpi *secret, mbedtls_ecp_point *pub)
+{
+    if (mbedtls_mpi_cmp_int(secret, 1) < 0 || mbedtls_mpi_cmp_mpi(secret, &c->grp.N) >= 0)
+    {
+        return -1;
+    }
+    return mbedtls_ecp_mul(&c->grp, pub, secret, &c->grp.G, fill_random, NULL);
+}
+
+// XSwiftEC(u, t) from BIP324, maps any pair of field elements to the x coordinate of a curve point
+static int xswiftec(curve *c, mbedtls_mpi *x, const mbedtls_mpi *u_in, const mbedtls_mpi *t_in)
+{
+    int ret;
+    mbedtls_mpi u, t, u3_7, t2, X, Y, tmp;
+    mbedtls_mpi_init(&u);
+    mbedtls_mpi_init(&t);
+    mbedtls_mpi_init(&u3_7);
+    mbedtls_mpi_init(&t2);
+    mbedtls_mpi_init(&X);
+    mbedtls_mpi_init(&Y);
+    mbedtls_mpi_init(&tmp);
+
+    MBEDTLS_MPI_CHK(mbedtls_mpi_mod_mpi(&u, u_in, &c->grp.P));
+    MBEDTLS_MPI_CHK(mbedtls_mpi_mod_mpi(&t, t_in, &c->grp.P));
+    if (mbedtls_mpi_cmp_int(&u, 0) == 0)
+        MBEDTLS_MPI_CHK(mbedtls_mpi_lset(&u, 1));
+    if (mbedtls_mpi_cmp_int(&t, 0) == 0)
+        MBEDTLS_MPI_CHK(mbedtls_mpi_lset(&t, 1));
+
+    MBEDTLS_MPI_CHK(curve_rhs(c, &u3_7, &u));
+    MBEDTLS_MPI_CHK(fe_mul(c, &t2, &t, &t));
+    MBEDTLS_MPI_CHK(fe_add(c, &tmp, &u3_7, &t2));
+    if (mbedtls_mpi_cmp_int(&tmp, 0) == 0)
+    {
+        MBEDTLS_MPI_CHK(fe_add(c, &t, &t, &t));
+        MBEDTLS_MPI_CHK(fe_mul(c, &t2, &t, &t));
+    }
+
+    // X = (u^3 + 7 - t^2) / 2t
+    MBEDTLS_MPI_CHK(fe_sub(c, &X, &u3_7, &t2));
+    MBEDTLS_MPI_CHK(fe_add(c, &tmp, &t, &t));
+    MBEDTLS_MPI_CHK(fe_div(c, &X, &X, &tmp));
+
+    // Y = (X + t) / (sqrt(-3) * u)
+    MBEDTLS_MPI_CHK(fe_add(c, &Y, &X, &t));
+    MBEDTLS_MPI_CHK(fe_mul(c, &tmp, &c->minus_3_sqrt, &u));
+    MBEDTLS_MPI_CHK(fe_div(c, &Y, &Y, &tmp));
+
+    // first valid of u + 4Y^2, (-X/Y - u) / 2, (X/Y - u) / 2
+    MBEDTLS_MPI_CHK(fe_mul(c, x, &Y, &Y));
+    MBEDTLS_MPI_CHK(mbedtls_mpi_mul_int(x, x, 4));
+    MBEDTLS_MPI_CHK(fe_add(c, x, x, &u));
+    if ((ret = is_valid_x(c, x)) <= 0)
+        goto cleanup;
+
+    MBEDTLS_MPI_CHK(fe_div(c, &tmp, &X, &Y));
+    MBEDTLS_MPI_CHK(fe_neg(c, x, &tmp));
+    MBEDTLS_MPI_CHK(fe_sub(c, x, x, &u));
+    MBEDTLS_MPI_CHK(fe_half(c, x, x));
+    if ((ret = is_valid_x(c, x)) <= 0)
+        goto cleanup;
+
+    MBEDTLS_MPI_CHK(fe_sub(c, x, &tmp, &u));
+    MBEDTLS_MPI_CHK(fe_half(c, x, x));
+    ret = is_valid_x(c, x) == 0 ? 0 : -1;
+
+cleanup:
+    mbedtls_mpi_free(&u);
+    mbedtls_mpi_free(&t);
+    mbedtls_mpi_free(&u3_7);
+    mbedtls_mpi_free(&t2);
+    mbedtls_mpi_free(&X);
+    mbedtls_mpi_free(&Y);
+    mbedtls_mpi_free(&tmp);
+    return ret;
+}
+
+// XSwiftECInv(x, u, case) from BIP324: a t with xswiftec(u, t) = x, 1 when this case has none
+static int xswiftec_inv(curve *c, mbedtls_mpi *t, const mbedtls_mpi *x, const mbedtls_mpi *u, int branch)
+{
+    int ret;
+    mbedtls_mpi s, v, r, w, tmp, u3_7;
+    mbedtls_mpi_init(&s);
+    mbedtls_mpi_init(&v);
+    mbedtls_mpi_init(&r);
+    mbedtls_mpi_init(&w);
+    mbedtls_mpi_init(&tmp);
+    mbedtls_mpi_init(&u3_7);
+
+    MBEDTLS_MPI_CHK(curve_rhs(c, &u3_7, u));
+
+    if ((branch & 2) == 0)
+    {
+        // -x - u must not be on the curve, or xswiftec would have picked it first
+        MBEDTLS_MPI_CHK(fe_add(c, &tmp, x, u));
+        MBEDTLS_MPI_CHK(fe_neg(c, &tmp, &tmp));
+        if ((ret = is_valid_x(c, &tmp)) <= 0)
+        {
+            ret = ret == 0 ? 1 : ret;
+            goto cleanup;
+        }
+        MBEDTLS_MPI_CHK(mbedtls_mpi_copy(&v, (branch & 1) ? &tmp : x));
+
+        // s = -(u^3 + 7) / (u^2 + uv + v^2)
+        MBEDTLS_MPI_CHK(fe_mul(c, &r, u, u));
+        MBEDTLS_MPI_CHK(fe_mul(c, &tmp, u, &v));
+        MBEDTLS_MPI_CHK(fe_add(c, &r, &r, &tmp));
+        MBEDTLS_MPI_CHK(fe_mul(c, &tmp, &v, &v));
+        MBEDTLS_MPI_CHK(fe_add(c, &r, &r, &tmp));
+        if (mbedtls_mpi_cmp_int(&r, 0) == 0)
+        {
+            ret = 1;
+            goto cleanup;
+        }
+        MBEDTLS_MPI_CHK(fe_neg(c, &s, &u3_7));
+        MBEDTLS_MPI_CHK(fe_div(c, &s, &s, &r));
+    }
+    else
+    {
+        MBEDTLS_MPI_CHK(fe_sub(c, &s, x, u));
+        if (mbedtls_mpi_cmp_int(&s, 0) == 0)
+        {
+            ret = 1;
+            goto cleanup;
+        }
+
+        // r = sqrt(-s * (4(u^3 + 7) + 3su^2))
+        MBEDTLS_MPI_CHK(fe_mul(c, &tmp, u, u));
+        MBEDTLS_MPI_CHK(fe_mul(c, &tmp, &tmp, &s));
+        MBEDTLS_MPI_CHK(mbedtls_mpi_mul_int(&tmp, &tmp, 3));
+        MBEDTLS_MPI_CHK(mbedtls_mpi_mul_int(&r, &u3_7, 4));
+        MBEDTLS_MPI_CHK(fe_add(c, &tmp, &tmp, &r));
+        MBEDTLS_MPI_CHK(fe_mul(c, &tmp, &tmp, &s));
+        MBEDTLS_MPI_CHK(fe_neg(c, &tmp, &tmp));
+        if ((ret = fe_sqrt(c, &r, &tmp)) != 0)
+            goto cleanup;
+        if ((branch & 1) && mbedtls_mpi_cmp_int(&r, 0) == 0)
+        {
+            ret = 1;
+            goto cleanup;
+        }
+        if (branch & 1)
+            MBEDTLS_MPI_CHK(fe_neg(c, &r, &r));
+
+        // v = (-u + r / s) / 2
+        MBEDTLS_MPI_CHK(fe_div(c, &v, &r, &s));
+        MBEDTLS_MPI_CHK(fe_sub(c, &v, &v, u));
+        MBEDTLS_MPI_CHK(fe_half(c, &v, &v));
+    }
+
+    if ((ret = fe_sqrt(c, &w, &s)) != 0)
+        goto cleanup;
+    if (branch & 4)
+        MBEDTLS_MPI_CHK(fe_neg(c, &w, &w));
+
+    // t = w * (u * (sqrt(-3) - 1) / 2 - v)
+    MBEDTLS_MPI_CHK(mbedtls_mpi_sub_int(&tmp, &c->minus_3_sqrt, 1));
+    MBEDTLS_MPI_CHK(fe_mul(c, &tmp, &tmp, u));
+    MBEDTLS_MPI_CHK(fe_half(c, &tmp, &tmp));
+    MBEDTLS_MPI_CHK(fe_sub(c, &tmp, &tmp, &v));
+    MBEDTLS_MPI_CHK(fe_mul(c, t, &tmp, &w));
+
+    // t = 0 decodes as t = 1
+    ret = mbedtls_mpi_cmp_int(t, 0) == 0 ? 1 : 0;
+
+cleanup:
+    mbedtls_mpi_free(&s);
+    mbedtls_mpi_free(&v);
+    mbedtls_mpi_free(&r);
+    mbedtls_mpi_free(&w);
+    mbedtls_mpi_free(&tmp);
+    mbedtls_mpi_free(&u3_7);
+    return ret;
+}
+
+static int ellswift_decode(curve *c, const uint8_t ellswift[SV2_ELLSWIFT_LEN], mbedtls_mpi *x)
+{
+    int ret;
+    mbedtls_mpi u, t;
+    mbedtls_mpi_init(&u);
+    mbedtls_mpi_init(&t);
+    MBEDTLS_MPI_CHK(mbedtls_mpi_read_binary(&u, ellswift, 32));
+    MBEDTLS_MPI_CHK(mbedtls_mpi_read_binary(&t, ellswift + 32, 32));
+    MBEDTLS_MPI_CHK(xswiftec(c, x, &u, &t));
+cleanup:
+    mbedtls_mpi_free(&u);
+    mbedtls_mpi_free(&t);
+    return ret;
+}
+
+int sv2_ellswift_encode(const uint8_t secret[32], uint8_t ellswift[SV2_ELLSWIFT_LEN])
+{
+    int ret;
+    curve c;
+    mbedtls_mpi d, x, u, t;
+    mbedtls_ecp_point pub;
+    uint8_t buf[32];
+
+    mbedtls_mpi_init(&d);
+    mbedtls_mpi_init(&x);
+    mbedtls_mpi_init(&u);
+    mbedtls_mpi_init(&t);
+    mbedtls_ecp_point_init(&pub);
+    MBEDTLS_MPI_CHK(curve_init(&c));
+
+    MBEDTLS_MPI_CHK(mbedtls_mpi_read_binary(&d, secret, 32));
+    MBEDTLS_MPI_CHK(public_key(&c, &d, &pub));
+    MBEDTLS_MPI_CHK(point_x(&c, &pub, buf, NULL));
+    MBEDTLS_MPI_CHK(mbedtls_mpi_read_binary(&x, buf, 32));
+
+    // a random u with a random branch of the inverse finds a t about one time in four
+    ret = -1;
+    for (int attempt = 0; attempt < 256 && ret != 0; attempt++)
+    {
+        uint8_t branch;
+        esp_fill_random(buf, sizeof(buf));
+        esp_fill_random(&branch, 1);
+        MBEDTLS_MPI_CHK(mbedtls_mpi_read_binary(&u, buf, 32));
+        MBEDTLS_MPI_CHK(mbedtls_mpi_mod_mpi(&u, &u, &c.grp.P));
+        if (mbedtls_mpi_cmp_int(&u, 0) == 0)
+            continue;
+
+        int found = xswiftec_inv(&c, &t, &x, &u, branch & 7);
+        if (found < 0)
+        {
+            ret = found;
+            goto cleanup;
+        }
+        if (found == 0)
+        {
+            MBEDTLS_MPI_CHK(mbedtls_mpi_write_binary(&u, ellswift, 32));
+            MBEDTLS_MPI_CHK(mbedtls_mpi_write_binary(&t, ellswift + 32, 32));
+        }
+        ret = found;
+    }
+
+cleanup:
+    curve_free(&c);
+    mbedtls_mpi_free(&d);
+    mbedtls_mpi_free(&x);
+    mbedtls_mpi_free(&u);
+    mbedtls_mpi_free(&t);
+    mbedtls_ecp_point_free(&pub);
+    return ret;
+}
+
+int sv2_ellswift_create(uint8_t secret[32], uint8_t ellswift[SV2_ELLSWIFT_LEN])
+{
+    static const uint8_t zero[32] = {0};
+
+    // redraw the 1 in 2^128 secrets outside [1, n)
+    do
+    {
+        esp_fill_random(secret, 32);
+    } while (memcmp(secret, zero, 32) == 0 || memcmp(secret, SECP256K1_N, 32) >= 0);
+
+    return sv2_ellswift_encode(secret, ellswift);
+}
+
+int sv2_ellswift_decode(const uint8_t ellswift[SV2_ELLSWIFT_LEN], uint8_t x[32])
+{
+    int ret;
+    curve c;
+    mbedtls_mpi point_x_mpi;
+    mbedtls_mpi_init(&point_x_mpi);
+    MBEDTLS_MPI_CHK(curve_init(&c));
+    MBEDTLS_MPI_CHK(ellswift_decode(&c, ellswift, &point_x_mpi));
+    MBEDTLS_MPI_CHK(mbedtls_mpi_write_binary(&point_x_mpi, x, 32));
+cleanup:
+    curve_free(&c);
+    mbedtls_mpi_free(&point_x_mpi);
+    return ret;
+}
+
+int sv2_ellswift_ecdh(const uint8_t secret[32], const uint8_t ell_a[SV2_ELLSWIFT_LEN], const uint8_t ell_b[SV2_ELLSWIFT_LEN],
+                      bool initiator, uint8_t shared[32])
+{
+    int ret;
+    curve c;
+    mbedtls_mpi d, x;
+    mbedtls_ecp_point theirs, product;
+    uint8_t data[SV2_ELLSWIFT_LEN * 2 + 32];
+
+    mbedtls_mpi_init(&d);
+    mbedtls_mpi_init(&x);
+    mbedtls_ecp_point_init(&theirs);
+    mbedtls_ecp_point_init(&product);
+    MBEDTLS_MPI_CHK(curve_init(&c));
+
+    MBEDTLS_MPI_CHK(mbedtls_mpi_read_binary(&d, secret, 32));
+    if (mbedtls_mpi_cmp_int(&d, 1) < 0 || mbedtls_mpi_cmp_mpi(&d, &c.grp.N) >= 0)
+    {
+        ret = -1;
+        goto cleanup;
+    }
+
+    MBEDTLS_MPI_CHK(ellswift_decode(&c, initiator ? ell_b : ell_a, &x));
+    MBEDTLS_MPI_CHK(lift_x(&c, &theirs, &x));
+    MBEDTLS_MPI_CHK(mbedtls_ecp_mul(&c.grp, &product, &d, &theirs, fill_random, NULL));
+
+    // the y coordinate does not matter, only x goes into the hash
+    memcpy(data, ell_a, SV2_ELLSWIFT_LEN);
+    memcpy(data + SV2_ELLSWIFT_LEN, ell_b, SV2_ELLSWIFT_LEN);
+    MBEDTLS_MPI_CHK(point_x(&c, &product, data + SV2_ELLSWIFT_LEN * 2, NULL));
+    sv2_tagged_hash("bip324_ellswift_xonly_ecdh", data, sizeof(data), shared);
+
+cleanup:
+    curve_free(&c);
+    mbedtls_mpi_free(&d);
+    mbedtls_mpi_free(&x);
+    mbedtls_ecp_point_free(&theirs);
+    mbedtls_ecp_point_free(&product);
+    return ret;
+}
+
+int sv2_schnorr_pubkey(const uint8_t secret[32], uint8_t pubkey[32])
+{
+    int ret;
+    curve c;
+    mbedtls_mpi d;
+    mbedtls_ecp_point pub;
+
+    mbedtls_mpi_init(&d);
+    mbedtls_ecp_point_init(&pub);
+    MBEDTLS_MPI_CHK(curve_init(&c));
+    MBEDTLS_MPI_CHK(mbedtls_mpi_read_binary(&d, secret, 32));
+    MBEDTLS_MPI_CHK(public_key(&c, &d, &pub));
+    MBEDTLS_MPI_CHK(point_x(&c, &pub, pubkey, NULL));
+
+cleanup:
+    curve_free(&c);
+    mbedtls_mpi_free(&d);
+    mbedtls_ecp_point_free(&pub);
+    return ret;
+}
+
+// e = tagged_hash("BIP0340/challenge", r || pubkey || msg) mod n
+static int schnorr_challenge(curve *c, const uint8_t r[32], const uint8_t pubkey[32], const uint8_t msg[32], mbedtls_mpi *e)
+{
+    int ret;
+    uint8_t data[96];
+    uint8_t hash[32];
+
+    memcpy(data, r, 32);
+    memcpy(data + 32, pubkey, 32);
+    memcpy(data + 64, msg, 32);
+    sv2_tagged_hash("BIP0340/challenge", data, sizeof(data), hash);
+    MBEDTLS_MPI_CHK(mbedtls_mpi_read_binary(e, hash, 32));
+    MBEDTLS_MPI_CHK(mbedtls_mpi_mod_mpi(e, e, &c->grp.N));
+cleanup:
+    return ret;
+}
+
+int sv2_schnorr_sign(const uint8_t secret[32], const uint8_t msg[32], uint8_t sig[SV2_SCHNORR_SIGNATURE_LEN])
+{
+    int ret;
+    curve c;
+    mbedtls_mpi d, k, e;
+    mbedtls_ecp_point pub, R;
+    uint8_t pubkey[32], data[96], hash[32];
+    bool odd_y;
+
+    mbedtls_mpi_init(&d);
+    mbedtls_mpi_init(&k);
+    mbedtls_mpi_init(&e);
+    mbedtls_ecp_point_init(&pub);
+    mbedtls_ecp_point_init(&R);
+    MBEDTLS_MPI_CHK(curve_init(&c));
+
+    MBEDTLS_MPI_CHK(mbedtls_mpi_read_binary(&d, secret, 32));
+    MBEDTLS_MPI_CHK(public_key(&c, &d, &pub));
+    MBEDTLS_MPI_CHK(point_x(&c, &pub, pubkey, &odd_y));
+    if (odd_y)
+        MBEDTLS_MPI_CHK(mbedtls_mpi_sub_mpi(&d, &c.grp.N, &d));
+
+    // nonce from the secret masked with fresh randomness, the message and the key
+    uint8_t aux[32];
+    esp_fill_random(aux, sizeof(aux));
+    sv2_tagged_hash("BIP0340/aux", aux, sizeof(aux), hash);
+    MBEDTLS_MPI_CHK(mbedtls_mpi_write_binary(&d, data, 32));
+    for (int i = 0; i < 32; i++)
+        data[i] ^= hash[i];
+    memcpy(data + 32, pubkey, 32);
+    memcpy(data + 64, msg, 32);
+    sv2_tagged_hash("BIP0340/nonce", data, sizeof(data), hash);
+    MBEDTLS_MPI_CHK(mbedtls_mpi_read_binary(&k, hash, 32));
+    MBEDTLS_MPI_CHK(mbedtls_mpi_mod_mpi(&k, &k, &c.grp.N));
+
+    MBEDTLS_MPI_CHK(public_key(&c, &k, &R));
+    MBEDTLS_MPI_CHK(point_x(&c, &R, sig, &odd_y));
+    if (odd_y)
+        MBEDTLS_MPI_CHK(mbedtls_mpi_sub_mpi(&k, &c.grp.N, &k));
+
+    // s = k + e * d mod n
+    MBEDTLS_MPI_CHK(schnorr_challenge(&c, sig, pubkey, msg, &e));
+    MBEDTLS_MPI_CHK(mbedtls_mpi_mul_mpi(&e, &e, &d));
+    MBEDTLS_MPI_CHK(mbedtls_mpi_add_mpi(&e, &e, &k));
+    MBEDTLS_MPI_CHK(mbedtls_mpi_mod_mpi(&e, &e, &c.grp.N));
+    MBEDTLS_MPI_CHK(mbedtls_mpi_write_binary(&e, sig + 32, 32));
+
+cleanup:
+    curve_free(&c);
+    mbedtls_mpi_free(&d);
+    mbedtls_mpi_free(&k);
+    mbedtls_mpi_free(&e);
+    mbedtls_ecp_point_free(&pub);
+    mbedtls_ecp_point_free(&R);
+    return ret;
+}
+
+int sv2_schnorr_verify(const uint8_t pubkey[32], const uint8_t msg[32], const uint8_t sig[SV2_SCHNORR_SIGNATURE_LEN])
+{
+    int ret;
+    curve c;
+    mbedtls_mpi px, r, s, e;
+    mbedtls_ecp_point P, R;
+    uint8_t rx[32];
+    bool odd_y;
+
+    mbedtls_mpi_init(&px);
+    mbedtls_mpi_init(&r);
+    mbedtls_mpi_init(&s);
+    mbedtls_mpi_init(&e);
+    mbedtls_ecp_point_init(&P);
+    mbedtls_ecp_point_init(&R);
+    MBEDTLS_MPI_CHK(curve_init(&c));
+
+    MBEDTLS_MPI_CHK(mbedtls_mpi_read_binary(&px, pubkey, 32));
+    MBEDTLS_MPI_CHK(mbedtls_mpi_read_binary(&r, sig, 32));
+    MBEDTLS_MPI_CHK(mbedtls_mpi_read_binary(&s, sig + 32, 32));
+    if (mbedtls_mpi_cmp_mpi(&px, &c.grp.P) >= 0 || mbedtls_mpi_cmp_mpi(&r, &c.grp.P) >= 0 ||
+        mbedtls_mpi_cmp_mpi(&s, &c.grp.N) >= 0 || mbedtls_mpi_cmp_int(&s, 0) == 0 || is_valid_x(&c, &px) != 0)
+    {
+        ret = -1;
+        goto cleanup;
+    }
+    MBEDTLS_MPI_CHK(lift_x(&c, &P, &px));
+
+    // R = sG - eP
+    MBEDTLS_MPI_CHK(schnorr_challenge(&c, sig, pubkey, msg, &e));
+    if (mbedtls_mpi_cmp_int(&e, 0) == 0)
+    {
+        ret = -1;
+        goto cleanup;
+    }
+    MBEDTLS_MPI_CHK(mbedtls_mpi_sub_mpi(&e, &c.grp.N, &e));
+    MBEDTLS_MPI_CHK(mbedtls_ecp_muladd(&c.grp, &R, &s, &c.grp.G, &e, &P));
+    if (mbedtls_ecp_is_zero(&R))
+    {
+        ret = -1;
+        goto cleanup;
+    }
+    MBEDTLS_MPI_CHK(point_x(&c, &R, rx, &odd_y));
+    ret = !odd_y && memcmp(rx, sig, 32) == 0 ? 0 : -1;
+
+cleanup:
+    curve_free(&c);
+    mbedtls_mpi_free(&px);
+    mbedtls_mpi_free(&r);
+    mbedtls_mpi_free(&s);
+    mbedtls_mpi_free(&e);
+    mbedtls_ecp_point_free(&P);
+    mbedtls_ecp_point_free(&R);
+    return ret;
+}
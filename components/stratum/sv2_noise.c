@@ -0,0 +1,353 @@
+#include <string.h>
+
+#include "esp_log.h"
+#include "mbedtls/chachapoly.h"
+#include "mbedtls/sha256.h"
+#include "sv2_noise.h"
+
+static const char *TAG = "sv2_noise";
+
+static const char PROTOCOL_NAME[] = "Noise_NX_Secp256k1+EllSwift_ChaChaPoly_SHA256";
+
+// ChaChaPoly with the Noise nonce layout: 32 zero bits followed by the little endian 64 bit counter
+static int cipher_encrypt(sv2_cipher_state *cipher, const uint8_t *ad, size_t ad_len, const uint8_t *in, size_t len, uint8_t *out)
+{
+    uint8_t nonce[12] = {0};
+    for (int i = 0; i < 8; i++)
+        nonce[4 + i] = cipher->nonce >> (8 * i);
+
+    mbedtls_chachapoly_context ctx;
+    mbedtls_chachapoly_init(&ctx);
+    int ret = mbedtls_chachapoly_setkey(&ctx, cipher->key);
+    if (ret == 0)
+        ret = mbedtls_chachapoly_encrypt_and_tag(&ctx, len, nonce, ad, ad_len, in, out, out + len);
+    mbedtls_chachapoly_free(&ctx);
+
+    cipher->nonce++;
+    return ret;
+}
+
+// len is the ciphertext length including the MAC
+static int cipher_decrypt(sv2_cipher_state *cipher, const uint8_t *ad, size_t ad_len, const uint8_t *in, size_t len, uint8_t *out)
+{
+    if (len < SV2_NOISE_MAC_LEN)
+        return -1;
+
+    uint8_t nonce[12] = {0};
+    for (int i = 0; i < 8; i++)
+        nonce[4 + i] = cipher->nonce >> (8 * i);
+
+    mbedtls_chachapoly_context ctx;
+    mbedtls_chachapoly_init(&ctx);
+    int ret = mbedtls_chachapoly_setkey(&ctx, cipher->key);
+    if (ret == 0)
+        ret = mbedtls_chachapoly_auth_decrypt(&ctx, len - SV2_NOISE_MAC_LEN, nonce, ad, ad_len, in + len - SV2_NOISE_MAC_LEN, in, out);
+    mbedtls_chachapoly_free(&ctx);
+
+    cipher->nonce++;
+    return ret;
+}
+
+// symmetric state operations from the Noise specification
+
+static void mix_hash(sv2_noise_handshake *hs, const uint8_t *data, size_t len)
+{
+    mbedtls_sha256_context ctx;
+    mbedtls_sha256_init(&ctx);
+    mbedtls_sha256_starts(&ctx, 0);
+    mbedtls_sha256_update(&ctx, hs->h, 32);
+    mbedtls_sha256_update(&ctx, data, len);
+    mbedtls_sha256_finish(&ctx, hs->h);
+    mbedtls_sha256_free(&ctx);
+}
+
+static void hkdf2(const uint8_t ck[32], const uint8_t *ikm, size_t ikm_len, uint8_t out1[32], uint8_t out2[32])
+{
+    uint8_t temp_key[32];
+    uint8_t buf[33];
+
+    sv2_hmac_sha256(ck, 32, ikm, ikm_len, temp_key);
+    buf[0] = 0x01;
+    sv2_hmac_sha256(temp_key, 32, buf, 1, out1);
+    memcpy(buf, out1, 32);
+    buf[32] = 0x02;
+    sv2_hmac_sha256(temp_key, 32, buf, 33, out2);
+}
+
+static void mix_key(sv2_noise_handshake *hs, const uint8_t shared[32])
+{
+    uint8_t ck[32];
+    hkdf2(hs->ck, shared, 32, ck, hs->cipher.key);
+    memcpy(hs->ck, ck, 32);
+    hs->cipher.nonce = 0;
+    hs->cipher.has_key = true;
+}
+
+static int encrypt_and_hash(sv2_noise_handshake *hs, const uint8_t *in, size_t len, uint8_t *out)
+{
+    if (!hs->cipher.has_key)
+    {
+        memcpy(out, in, len);
+        mix_hash(hs, out, len);
+        return 0;
+    }
+    int ret = cipher_encrypt(&hs->cipher, hs->h, 32, in, len, out);
+    if (ret == 0)
+        mix_hash(hs, out, len + SV2_NOISE_MAC_LEN);
+    return ret;
+}
+
+// len is the ciphertext length including the MAC
+static int decrypt_and_hash(sv2_noise_handshake *hs, const uint8_t *in, size_t len, uint8_t *out)
+{
+    int ret = cipher_decrypt(&hs->cipher, hs->h, 32, in, len, out);
+    if (ret == 0)
+        mix_hash(hs, in, len);
+    return ret;
+}
+
+static void split(sv2_noise_handshake *hs, sv2_cipher_state *first, sv2_cipher_state *second)
+{
+    hkdf2(hs->ck, NULL, 0, first->key, second->key);
+    first->nonce = 0;
+    first->has_key = true;
+    second->nonce = 0;
+    second->has_key = true;
+}
+
+static void handshake_init(sv2_noise_handshake *hs)
+{
+    // the protocol name is longer than a hash, so h starts as its hash; the prologue is empty
+    memset(hs, 0, sizeof(*hs));
+    mbedtls_sha256((const uint8_t *)PROTOCOL_NAME, strlen(PROTOCOL_NAME), hs->ck, 0);
+    memcpy(hs->h, hs->ck, 32);
+    mix_hash(hs, NULL, 0);
+}
+
+static void certificate_encode(const sv2_certificate *certificate, uint8_t out[SV2_SIGNATURE_NOISE_MESSAGE_LEN])
+{
+    out[0] = certificate->version;
+    out[1] = certificate->version >> 8;
+    for (int i = 0; i < 4; i++)
+    {
+        out[2 + i] = certificate->valid_from >> (8 * i);
+        out[6 + i] = certificate->not_valid_after >> (8 * i);
+    }
+    memcpy(out + 10, certificate->signature, SV2_SCHNORR_SIGNATURE_LEN);
+}
+
+static void certificate_decode(const uint8_t in[SV2_SIGNATURE_NOISE_MESSAGE_LEN], sv2_certificate *certificate)
+{
+    certificate->version = in[0] | in[1] << 8;
+    certificate->valid_from = 0;
+    certificate->not_valid_after = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        certificate->valid_from |= (uint32_t)in[2 + i] << (8 * i);
+        certificate->not_valid_after |= (uint32_t)in[6 + i] << (8 * i);
+    }
+    memcpy(certificate->signature, in + 10, SV2_SCHNORR_SIGNATURE_LEN);
+}
+
+// the authority signs SHA256(version || valid_from || not_valid_after || server key)
+static void certificate_hash(const sv2_certificate *certificate, const uint8_t server_key[32], uint8_t hash[32])
+{
+    uint8_t message[10 + 32];
+    uint8_t encoded[SV2_SIGNATURE_NOISE_MESSAGE_LEN];
+
+    certificate_encode(certificate, encoded);
+    memcpy(message, encoded, 10);
+    memcpy(message + 10, server_key, 32);
+    mbedtls_sha256(message, sizeof(message), hash, 0);
+}
+
+int sv2_certificate_sign(sv2_certificate *certificate, const uint8_t authority_secret[32], const uint8_t server_key[32])
+{
+    uint8_t hash[32];
+    certificate_hash(certificate, server_key, hash);
+    return sv2_schnorr_sign(authority_secret, hash, certificate->signature);
+}
+
+int sv2_certificate_verify(const sv2_certificate *certificate, const uint8_t authority_key[32], const uint8_t server_key[32])
+{
+    uint8_t hash[32];
+    certificate_hash(certificate, server_key, hash);
+    return sv2_schnorr_verify(authority_key, hash, certificate->signature);
+}
+
+int sv2_noise_initiator_start(sv2_noise_handshake *hs, uint8_t out[SV2_NOISE_ACT1_LEN])
+{
+    uint8_t e_secret[32];
+    uint8_t e_ellswift[SV2_ELLSWIFT_LEN];
+
+    int ret = sv2_ellswift_create(e_secret, e_ellswift);
+    if (ret == 0)
+        ret = sv2_noise_initiator_start_with_key(hs, e_secret, e_ellswift, out);
+    memset(e_secret, 0, sizeof(e_secret));
+    return ret;
+}
+
+int sv2_noise_initiator_start_with_key(sv2_noise_handshake *hs, const uint8_t e_secret[32],
+                                       const uint8_t e_ellswift[SV2_ELLSWIFT_LEN], uint8_t out[SV2_NOISE_ACT1_LEN])
+{
+    handshake_init(hs);
+    memcpy(hs->e_secret, e_secret, 32);
+    memcpy(hs->e_ellswift, e_ellswift, SV2_ELLSWIFT_LEN);
+
+    // -> e, followed by an empty payload
+    memcpy(out, hs->e_ellswift, SV2_ELLSWIFT_LEN);
+    mix_hash(hs, hs->e_ellswift, SV2_ELLSWIFT_LEN);
+    mix_hash(hs, NULL, 0);
+    return 0;
+}
+
+int sv2_noise_initiator_finish(sv2_noise_handshake *hs, const uint8_t in[SV2_NOISE_ACT2_LEN], const uint8_t *authority_key,
+                               uint32_t now, sv2_noise_transport *transport, uint8_t server_key[32])
+{
+    int ret;
+    uint8_t shared[32];
+    uint8_t rs[SV2_ELLSWIFT_LEN];
+    uint8_t signature_message[SV2_SIGNATURE_NOISE_MESSAGE_LEN];
+    const uint8_t *re = in;
+    const uint8_t *encrypted_static = in + SV2_ELLSWIFT_LEN;
+    const uint8_t *encrypted_signature = encrypted_static + SV2_ELLSWIFT_LEN + SV2_NOISE_MAC_LEN;
+
+    // <- e, ee, s, es, followed by the certificate
+    mix_hash(hs, re, SV2_ELLSWIFT_LEN);
+    if ((ret = sv2_ellswift_ecdh(hs->e_secret, hs->e_ellswift, re, true, shared)) != 0)
+        return ret;
+    mix_key(hs, shared);
+
+    if ((ret = decrypt_and_hash(hs, encrypted_static, SV2_ELLSWIFT_LEN + SV2_NOISE_MAC_LEN, rs)) != 0)
+    {
+        ESP_LOGE(TAG, "Pool static key failed to decrypt");
+        return ret;
+    }
+    if ((ret = sv2_ellswift_ecdh(hs->e_secret, hs->e_ellswift, rs, true, shared)) != 0)
+        return ret;
+    mix_key(hs, shared);
+
+    if ((ret = decrypt_and_hash(hs, encrypted_signature, SV2_SIGNATURE_NOISE_MESSAGE_LEN + SV2_NOISE_MAC_LEN, signature_message)) != 0)
+    {
+        ESP_LOGE(TAG, "Pool certificate failed to decrypt");
+        return ret;
+    }
+
+    if ((ret = sv2_ellswift_decode(rs, server_key)) != 0)
+        return ret;
+
+    sv2_certificate certificate;
+    certificate_decode(signature_message, &certificate);
+    if (authority_key != NULL && sv2_certificate_verify(&certificate, authority_key, server_key) != 0)
+    {
+        ESP_LOGE(TAG, "Pool certificate is not signed by the configured authority");
+        return -1;
+    }
+    if (now != 0 && (now < certificate.valid_from || now > certificate.not_valid_after))
+    {
+        ESP_LOGE(TAG, "Pool certificate valid from %lu to %lu, now is %lu", (unsigned long)certificate.valid_from,
+                 (unsigned long)certificate.not_valid_after, (unsigned long)now);
+        return -1;
+    }
+
+    split(hs, &transport->send, &transport->recv);
+    memset(hs->e_secret, 0, sizeof(hs->e_secret));
+    return 0;
+}
+
+int sv2_noise_responder_reply(sv2_noise_handshake *hs, const uint8_t in[SV2_NOISE_ACT1_LEN], const uint8_t static_secret[32],
+                              const uint8_t static_ellswift[SV2_ELLSWIFT_LEN], const sv2_certificate *certificate,
+                              uint8_t out[SV2_NOISE_ACT2_LEN], sv2_noise_transport *transport)
+{
+    int ret;
+    uint8_t shared[32];
+    uint8_t initiator_e[SV2_ELLSWIFT_LEN];
+    uint8_t signature_message[SV2_SIGNATURE_NOISE_MESSAGE_LEN];
+
+    handshake_init(hs);
+    memcpy(initiator_e, in, SV2_ELLSWIFT_LEN);
+    mix_hash(hs, initiator_e, SV2_ELLSWIFT_LEN);
+    mix_hash(hs, NULL, 0);
+
+    if ((ret = sv2_ellswift_create(hs->e_secret, hs->e_ellswift)) != 0)
+        return ret;
+    memcpy(out, hs->e_ellswift, SV2_ELLSWIFT_LEN);
+    mix_hash(hs, hs->e_ellswift, SV2_ELLSWIFT_LEN);
+
+    if ((ret = sv2_ellswift_ecdh(hs->e_secret, initiator_e, hs->e_ellswift, false, shared)) != 0)
+        return ret;
+    mix_key(hs, shared);
+
+    uint8_t *p = out + SV2_ELLSWIFT_LEN;
+    if ((ret = encrypt_and_hash(hs, static_ellswift, SV2_ELLSWIFT_LEN, p)) != 0)
+        return ret;
+    p += SV2_ELLSWIFT_LEN + SV2_NOISE_MAC_LEN;
+
+    if ((ret = sv2_ellswift_ecdh(static_secret, initiator_e, static_ellswift, false, shared)) != 0)
+        return ret;
+    mix_key(hs, shared);
+
+    certificate_encode(certificate, signature_message);
+    if ((ret = encrypt_and_hash(hs, signature_message, SV2_SIGNATURE_NOISE_MESSAGE_LEN, p)) != 0)
+        return ret;
+
+    // the initiator's first key is the responder's receive key
+    split(hs, &transport->recv, &transport->send);
+    memset(hs->e_secret, 0, sizeof(hs->e_secret));
+    return 0;
+}
+
+size_t sv2_noise_encrypted_frame_len(size_t payload_len)
+{
+    size_t chunks = (payload_len + SV2_NOISE_MAX_CHUNK_PAYLOAD - 1) / SV2_NOISE_MAX_CHUNK_PAYLOAD;
+    return SV2_ENCRYPTED_HEADER_LEN + payload_len + chunks * SV2_NOISE_MAC_LEN;
+}
+
+int sv2_noise_encrypt_frame(sv2_noise_transport *transport, const uint8_t *frame, size_t frame_len, uint8_t *out, size_t out_size)
+{
+    if (frame_len < SV2_FRAME_HEADER_LEN)
+        return -1;
+
+    size_t payload_len = frame_len - SV2_FRAME_HEADER_LEN;
+    size_t total = sv2_noise_encrypted_frame_len(payload_len);
+    if (total > out_size)
+        return -1;
+
+    if (cipher_encrypt(&transport->send, NULL, 0, frame, SV2_FRAME_HEADER_LEN, out) != 0)
+        return -1;
+    out += SV2_ENCRYPTED_HEADER_LEN;
+
+    const uint8_t *payload = frame + SV2_FRAME_HEADER_LEN;
+    while (payload_len > 0)
+    {
+        size_t chunk = payload_len < SV2_NOISE_MAX_CHUNK_PAYLOAD ? payload_len : SV2_NOISE_MAX_CHUNK_PAYLOAD;
+        if (cipher_encrypt(&transport->send, NULL, 0, payload, chunk, out) != 0)
+            return -1;
+        payload += chunk;
+        payload_len -= chunk;
+        out += chunk + SV2_NOISE_MAC_LEN;
+    }
+
+    return total;
+}
+
+int sv2_noise_decrypt_header(sv2_noise_transport *transport, const uint8_t in[SV2_ENCRYPTED_HEADER_LEN],
+                             uint8_t header[SV2_FRAME_HEADER_LEN])
+{
+    return cipher_decrypt(&transport->recv, NULL, 0, in, SV2_ENCRYPTED_HEADER_LEN, header);
+}
+
+int sv2_noise_decrypt_payload(sv2_noise_transport *transport, const uint8_t *in, size_t payload_len, uint8_t *payload)
+{
+    while (payload_len > 0)
+    {
+        size_t chunk = payload_len < SV2_NOISE_MAX_CHUNK_PAYLOAD ? payload_len : SV2_NOISE_MAX_CHUNK_PAYLOAD;
+        int ret = cipher_decrypt(&transport->recv, NULL, 0, in, chunk + SV2_NOISE_MAC_LEN, payload);
+        if (ret != 0)
+            return ret;
+        in += chunk + SV2_NOISE_MAC_LEN;
+        payload += chunk;
+        payload_len -= chunk;
+    }
+    return 0;
+}
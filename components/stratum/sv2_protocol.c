@@ -0,0 +1,270 @@
+#include <string.h>
+
+#include "sv2_protocol.h"
+
+typedef struct
+{
+    uint8_t *p;
+    uint8_t *end;
+    bool overflow;
+} writer;
+
+typedef struct
+{
+    const uint8_t *p;
+    const uint8_t *end;
+    bool error;
+} reader;
+
+static void put_bytes(writer *w, const void *data, size_t len)
+{
+    if (w->overflow || (size_t)(w->end - w->p) < len)
+    {
+        w->overflow = true;
+        return;
+    }
+    memcpy(w->p, data, len);
+    w->p += len;
+}
+
+static void put_uint(writer *w, uint64_t value, int bytes)
+{
+    uint8_t buf[8];
+    for (int i = 0; i < bytes; i++)
+        buf[i] = value >> (8 * i);
+    put_bytes(w, buf, bytes);
+}
+
+static void put_str0_255(writer *w, const char *str)
+{
+    size_t len = str != NULL ? strlen(str) : 0;
+    if (len > SV2_STR_MAX)
+        len = SV2_STR_MAX;
+    put_uint(w, len, 1);
+    put_bytes(w, str, len);
+}
+
+static void put_f32(writer *w, float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, 4);
+    put_uint(w, bits, 4);
+}
+
+static const uint8_t *get_bytes(reader *r, size_t len)
+{
+    if (r->error || (size_t)(r->end - r->p) < len)
+    {
+        r->error = true;
+        return NULL;
+    }
+    const uint8_t *data = r->p;
+    r->p += len;
+    return data;
+}
+
+static uint64_t get_uint(reader *r, int bytes)
+{
+    const uint8_t *data = get_bytes(r, bytes);
+    uint64_t value = 0;
+    if (data == NULL)
+        return 0;
+    for (int i = 0; i < bytes; i++)
+        value |= (uint64_t)data[i] << (8 * i);
+    return value;
+}
+
+static void get_u256(reader *r, uint8_t out[32])
+{
+    const uint8_t *data = get_bytes(r, 32);
+    if (data != NULL)
+        memcpy(out, data, 32);
+}
+
+// B0_32, returns the length
+static uint8_t get_b0_32(reader *r, uint8_t out[32])
+{
+    uint8_t len = get_uint(r, 1);
+    if (len > 32)
+    {
+        r->error = true;
+        return 0;
+    }
+    const uint8_t *data = get_bytes(r, len);
+    if (data != NULL)
+        memcpy(out, data, len);
+    return len;
+}
+
+static void get_str0_255(reader *r, char out[SV2_STR_MAX + 1])
+{
+    uint8_t len = get_uint(r, 1);
+    const uint8_t *data = get_bytes(r, len);
+    if (data == NULL)
+        len = 0;
+    else
+        memcpy(out, data, len);
+    out[len] = '\0';
+}
+
+void sv2_write_frame_header(const sv2_frame_header *header, uint8_t out[SV2_FRAME_HEADER_LEN])
+{
+    out[0] = header->extension_type;
+    out[1] = header->extension_type >> 8;
+    out[2] = header->msg_type;
+    out[3] = header->length;
+    out[4] = header->length >> 8;
+    out[5] = header->length >> 16;
+}
+
+void sv2_read_frame_header(const uint8_t in[SV2_FRAME_HEADER_LEN], sv2_frame_header *header)
+{
+    header->extension_type = in[0] | in[1] << 8;
+    header->msg_type = in[2];
+    header->length = in[3] | in[4] << 8 | (uint32_t)in[5] << 16;
+}
+
+static void begin_frame(writer *w, uint8_t *out, size_t size)
+{
+    w->p = out;
+    w->end = out + size;
+    w->overflow = size < SV2_FRAME_HEADER_LEN;
+    if (!w->overflow)
+        w->p += SV2_FRAME_HEADER_LEN;
+}
+
+static int end_frame(writer *w, uint8_t *out, uint16_t extension_type, uint8_t msg_type)
+{
+    if (w->overflow)
+        return -1;
+
+    sv2_frame_header header = {
+        .extension_type = extension_type,
+        .msg_type = msg_type,
+        .length = w->p - out - SV2_FRAME_HEADER_LEN,
+    };
+    sv2_write_frame_header(&header, out);
+    return w->p - out;
+}
+
+int sv2_encode_setup_connection(uint8_t *out, size_t size, const sv2_setup_connection *setup, uint32_t flags)
+{
+    writer w;
+    begin_frame(&w, out, size);
+    put_uint(&w, SV2_PROTOCOL_MINING, 1);
+    put_uint(&w, SV2_PROTOCOL_VERSION, 2); // min_version
+    put_uint(&w, SV2_PROTOCOL_VERSION, 2); // max_version
+    put_uint(&w, flags, 4);
+    put_str0_255(&w, setup->endpoint_host);
+    put_uint(&w, setup->endpoint_port, 2);
+    put_str0_255(&w, setup->vendor);
+    put_str0_255(&w, setup->hardware_version);
+    put_str0_255(&w, setup->firmware);
+    put_str0_255(&w, setup->device_id);
+    return end_frame(&w, out, 0, SV2_SETUP_CONNECTION);
+}
+
+int sv2_encode_open_standard_mining_channel(uint8_t *out, size_t size, uint32_t request_id, const char *user_identity,
+                                            float nominal_hash_rate, const uint8_t max_target[32])
+{
+    writer w;
+    begin_frame(&w, out, size);
+    put_uint(&w, request_id, 4);
+    put_str0_255(&w, user_identity);
+    put_f32(&w, nominal_hash_rate);
+    put_bytes(&w, max_target, 32);
+    return end_frame(&w, out, 0, SV2_OPEN_STANDARD_MINING_CHANNEL);
+}
+
+int sv2_encode_submit_shares_standard(uint8_t *out, size_t size, uint32_t channel_id, uint32_t sequence_number, uint32_t job_id,
+                                      uint32_t nonce, uint32_t ntime, uint32_t version)
+{
+    writer w;
+    begin_frame(&w, out, size);
+    put_uint(&w, channel_id, 4);
+    put_uint(&w, sequence_number, 4);
+    put_uint(&w, job_id, 4);
+    put_uint(&w, nonce, 4);
+    put_uint(&w, ntime, 4);
+    put_uint(&w, version, 4);
+    return end_frame(&w, out, SV2_CHANNEL_MSG_BIT, SV2_SUBMIT_SHARES_STANDARD);
+}
+
+bool sv2_decode_message(const sv2_frame_header *header, const uint8_t *payload, sv2_message *message)
+{
+    reader r = {
+        .p = payload,
+        .end = payload + header->length,
+        .error = false,
+    };
+
+    // extensions are not negotiated, anything but the base protocol is unexpected
+    if ((header->extension_type & ~SV2_CHANNEL_MSG_BIT) != 0)
+        return false;
+
+    memset(message, 0, sizeof(*message));
+    message->msg_type = header->msg_type;
+
+    switch (header->msg_type)
+    {
+    case SV2_SETUP_CONNECTION_SUCCESS:
+        message->setup_success.used_version = get_uint(&r, 2);
+        message->setup_success.flags = get_uint(&r, 4);
+        break;
+    case SV2_SETUP_CONNECTION_ERROR:
+        get_uint(&r, 4); // flags
+        get_str0_255(&r, message->error_code);
+        break;
+    case SV2_OPEN_STANDARD_MINING_CHANNEL_SUCCESS:
+        message->open_channel_success.request_id = get_uint(&r, 4);
+        message->open_channel_success.channel_id = get_uint(&r, 4);
+        get_u256(&r, message->open_channel_success.target);
+        message->open_channel_success.extranonce_prefix_len = get_b0_32(&r, message->open_channel_success.extranonce_prefix);
+        message->open_channel_success.group_channel_id = get_uint(&r, 4);
+        break;
+    case SV2_OPEN_MINING_CHANNEL_ERROR:
+        message->request_id = get_uint(&r, 4);
+        get_str0_255(&r, message->error_code);
+        break;
+    case SV2_NEW_MINING_JOB:
+        message->new_mining_job.channel_id = get_uint(&r, 4);
+        message->new_mining_job.job_id = get_uint(&r, 4);
+        message->new_mining_job.has_min_ntime = get_uint(&r, 1) != 0;
+        if (message->new_mining_job.has_min_ntime)
+            message->new_mining_job.min_ntime = get_uint(&r, 4);
+        message->new_mining_job.version = get_uint(&r, 4);
+        if (get_b0_32(&r, message->new_mining_job.merkle_root) != 32)
+            r.error = true;
+        break;
+    case SV2_SET_NEW_PREV_HASH:
+        message->set_new_prev_hash.channel_id = get_uint(&r, 4);
+        message->set_new_prev_hash.job_id = get_uint(&r, 4);
+        get_u256(&r, message->set_new_prev_hash.prev_hash);
+        message->set_new_prev_hash.min_ntime = get_uint(&r, 4);
+        message->set_new_prev_hash.nbits = get_uint(&r, 4);
+        break;
+    case SV2_SET_TARGET:
+        message->set_target.channel_id = get_uint(&r, 4);
+        get_u256(&r, message->set_target.maximum_target);
+        break;
+    case SV2_SUBMIT_SHARES_SUCCESS:
+        message->submit_success.channel_id = get_uint(&r, 4);
+        message->submit_success.last_sequence_number = get_uint(&r, 4);
+        message->submit_success.new_submits_accepted_count = get_uint(&r, 4);
+        message->submit_success.new_shares_sum = get_uint(&r, 8);
+        break;
+    case SV2_SUBMIT_SHARES_ERROR:
+        message->submit_error.channel_id = get_uint(&r, 4);
+        message->submit_error.sequence_number = get_uint(&r, 4);
+        get_str0_255(&r, message->error_code);
+        break;
+    case SV2_RECONNECT:
+        get_str0_255(&r, message->reconnect.new_host);
+        message->reconnect.new_port = get_uint(&r, 2);
+        break;
+    default:
+        return false;
+    }
+
+    return !r.error;
+}
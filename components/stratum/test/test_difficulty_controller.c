@@ -0,0 +1,54 @@
+#include "unity.h"
+#include "difficulty_controller.h"
+
+#define MINUTE_US (60 * 1000000LL)
+
+TEST_CASE("Difficulty for a share rate is a power of two", "[difficulty_controller]")
+{
+    // 1 TH/s at 10 shares per minute wants 1397
+    TEST_ASSERT_EQUAL_UINT32(1024, difficulty_for_share_rate(1000, 10));
+    TEST_ASSERT_EQUAL_UINT32(2048, difficulty_for_share_rate(1500, 10));
+    TEST_ASSERT_EQUAL_UINT32(1, difficulty_for_share_rate(0.001, 10));
+    TEST_ASSERT_EQUAL_UINT32(1u << 31, difficulty_for_share_rate(1e12, 1));
+    TEST_ASSERT_EQUAL_UINT32(0, difficulty_for_share_rate(0, 10));
+    TEST_ASSERT_EQUAL_UINT32(0, difficulty_for_share_rate(1000, 0));
+}
+
+TEST_CASE("Difficulty controller starts with the configured difficulty without a hashrate", "[difficulty_controller]")
+{
+    difficulty_controller controller;
+
+    difficulty_controller_init(&controller, 10);
+    TEST_ASSERT_EQUAL_UINT32(1000, difficulty_controller_start(&controller, 1000, 0, 0));
+    TEST_ASSERT_EQUAL_UINT32(512, difficulty_controller_start(&controller, 1000, 500, 0));
+
+    // disabled, the configured difficulty stays
+    difficulty_controller_init(&controller, 0);
+    TEST_ASSERT_EQUAL_UINT32(1000, difficulty_controller_start(&controller, 1000, 500, 0));
+    TEST_ASSERT_EQUAL_UINT32(0, difficulty_controller_update(&controller, 5000, 60 * MINUTE_US));
+}
+
+TEST_CASE("Difficulty controller follows large hashrate changes only", "[difficulty_controller]")
+{
+    difficulty_controller controller;
+    difficulty_controller_init(&controller, 10);
+    int64_t now_us = 0;
+
+    TEST_ASSERT_EQUAL_UINT32(1000, difficulty_controller_start(&controller, 1000, 0, now_us));
+
+    // the first hashrate after the interval moves the suggestion
+    now_us += 2 * MINUTE_US;
+    TEST_ASSERT_EQUAL_UINT32(0, difficulty_controller_update(&controller, 3000, now_us));
+    now_us += 4 * MINUTE_US;
+    TEST_ASSERT_EQUAL_UINT32(4096, difficulty_controller_update(&controller, 3000, now_us));
+
+    // swings within a factor of two keep the suggestion
+    now_us += 10 * MINUTE_US;
+    TEST_ASSERT_EQUAL_UINT32(0, difficulty_controller_update(&controller, 2000, now_us));
+    TEST_ASSERT_EQUAL_UINT32(0, difficulty_controller_update(&controller, 5500, now_us));
+
+    // a chip dropping out halves the hashrate and more
+    TEST_ASSERT_EQUAL_UINT32(1024, difficulty_controller_update(&controller, 1000, now_us));
+    TEST_ASSERT_EQUAL_UINT32(0, difficulty_controller_update(&controller, 300, now_us + MINUTE_US));
+    TEST_ASSERT_EQUAL_UINT32(512, difficulty_controller_update(&controller, 300, now_us + 6 * MINUTE_US));
+}
@@ -0,0 +1,131 @@
+#include "unity.h"
+#include "line_reader.h"
+#include "esp_timer.h"
+#include <stdio.h>
+#include <string.h>
+
+// write data into the reader the way recv() would, returns how many bytes fit
+static size_t feed(line_reader *reader, const char *data, size_t len)
+{
+    size_t written = 0;
+    while (written < len)
+    {
+        size_t space;
+        char *write_ptr = line_reader_write_ptr(reader, &space);
+        if (space == 0)
+            break;
+        if (space > len - written)
+            space = len - written;
+        memcpy(write_ptr, data + written, space);
+        line_reader_commit(reader, space);
+        written += space;
+    }
+    return written;
+}
+
+TEST_CASE("Line reader splits lines across receives", "[line_reader]")
+{
+    line_reader reader;
+    TEST_ASSERT_EQUAL(0, line_reader_init(&reader, 64));
+
+    size_t len;
+    feed(&reader, "{\"id\":1", 7);
+    TEST_ASSERT_NULL(line_reader_next(&reader, &len));
+
+    feed(&reader, "}\n{\"id\":2}\r\n\n{\"id\"", 18);
+    TEST_ASSERT_EQUAL_STRING("{\"id\":1}", line_reader_next(&reader, &len));
+    TEST_ASSERT_EQUAL(8, len);
+    // the line ending is stripped and the empty line skipped
+    TEST_ASSERT_EQUAL_STRING("{\"id\":2}", line_reader_next(&reader, &len));
+    TEST_ASSERT_EQUAL(8, len);
+    TEST_ASSERT_NULL(line_reader_next(&reader, &len));
+
+    feed(&reader, ":3}\n", 4);
+    TEST_ASSERT_EQUAL_STRING("{\"id\":3}", line_reader_next(&reader, &len));
+    TEST_ASSERT_NULL(line_reader_next(&reader, &len));
+
+    line_reader_free(&reader);
+}
+
+TEST_CASE("Line reader hands out lines wrapping around the ring", "[line_reader]")
+{
+    line_reader reader;
+    TEST_ASSERT_EQUAL(0, line_reader_init(&reader, 16));
+
+    size_t len;
+    char expected[16];
+    // lines of varying length walk the start offset through every position of the ring
+    for (int i = 0; i < 40; i++)
+    {
+        int line_len = 3 + i % 9;
+        char line[16];
+        for (int j = 0; j < line_len; j++)
+        {
+            line[j] = 'a' + (i + j) % 26;
+        }
+        line[line_len] = '\n';
+        TEST_ASSERT_EQUAL(line_len + 1, feed(&reader, line, line_len + 1));
+
+        memcpy(expected, line, line_len);
+        expected[line_len] = '\0';
+        TEST_ASSERT_EQUAL_STRING(expected, line_reader_next(&reader, &len));
+        TEST_ASSERT_EQUAL(line_len, len);
+        TEST_ASSERT_NULL(line_reader_next(&reader, &len));
+    }
+
+    line_reader_free(&reader);
+}
+
+TEST_CASE("Line reader reports a full ring", "[line_reader]")
+{
+    line_reader reader;
+    TEST_ASSERT_EQUAL(0, line_reader_init(&reader, 8));
+
+    size_t len, space;
+    TEST_ASSERT_EQUAL(8, feed(&reader, "0123456789\n", 11));
+    TEST_ASSERT_NULL(line_reader_next(&reader, &len));
+    line_reader_write_ptr(&reader, &space);
+    TEST_ASSERT_EQUAL(0, space);
+
+    line_reader_reset(&reader);
+    line_reader_write_ptr(&reader, &space);
+    TEST_ASSERT_EQUAL(8, space);
+    feed(&reader, "abc\n", 4);
+    TEST_ASSERT_EQUAL_STRING("abc", line_reader_next(&reader, &len));
+
+    line_reader_free(&reader);
+}
+
+TEST_CASE("Benchmark line reader", "[line_reader bench][not-on-qemu]")
+{
+    line_reader reader;
+    TEST_ASSERT_EQUAL(0, line_reader_init(&reader, 16384));
+
+    // notify sized lines received in TCP segment sized chunks
+    static char line[4096];
+    memset(line, 'a', sizeof(line) - 1);
+    line[sizeof(line) - 1] = '\n';
+
+    const int iterations = 200;
+    size_t total = 0;
+    size_t len;
+
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++)
+    {
+        for (size_t offset = 0; offset < sizeof(line); offset += 1460)
+        {
+            size_t chunk = sizeof(line) - offset < 1460 ? sizeof(line) - offset : 1460;
+            feed(&reader, line + offset, chunk);
+        }
+        char *next = line_reader_next(&reader, &len);
+        TEST_ASSERT_NOT_NULL(next);
+        total += len;
+    }
+    int64_t elapsed_us = esp_timer_get_time() - start;
+
+    printf("line reader: %.2f us per %u byte line\n", (double)elapsed_us / iterations, (unsigned)sizeof(line));
+    TEST_ASSERT_EQUAL(iterations * (sizeof(line) - 1), total);
+
+    line_reader_free(&reader);
+}
@@ -1,21 +1,87 @@
 #include "unity.h"
 #include "mining.h"
 #include "utils.h"
+#include "sha256d.h"
+#include "esp_timer.h"
 
 #include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void hex2bin_dup(const char *hex, uint8_t **bin, size_t *bin_len)
+{
+    *bin_len = strlen(hex) / 2;
+    *bin = malloc(*bin_len);
+    hex2bin(hex, *bin, *bin_len);
+}
+
+static void calculate_merkle_root_hash_hex(const char *coinbase_tx, const uint8_t merkle_branches[][32], const int num_merkle_branches, char *merkle_root_hex)
+{
+    uint8_t *coinbase_tx_bin;
+    size_t coinbase_tx_len;
+    hex2bin_dup(coinbase_tx, &coinbase_tx_bin, &coinbase_tx_len);
+
+    uint8_t merkle_root[32];
+    calculate_merkle_root_hash(coinbase_tx_bin, coinbase_tx_len, merkle_branches, num_merkle_branches, merkle_root);
+    bin2hex(merkle_root, 32, merkle_root_hex, 65);
+    free(coinbase_tx_bin);
+}
 
 TEST_CASE("Check coinbase tx construction", "[mining]")
 {
-    const char *coinbase_1 = "01000000010000000000000000000000000000000000000000000000000000000000000000ffffffff20020862062f503253482f04b8864e5008";
-    const char *coinbase_2 = "072f736c7573682f000000000100f2052a010000001976a914d23fcdf86f7e756a64a7a9688ef9903327048ed988ac00000000";
+    mining_notify notify_message = {};
+    hex2bin_dup("01000000010000000000000000000000000000000000000000000000000000000000000000ffffffff20020862062f503253482f04b8864e5008", &notify_message.coinbase_1, &notify_message.coinbase_1_len);
+    hex2bin_dup("072f736c7573682f000000000100f2052a010000001976a914d23fcdf86f7e756a64a7a9688ef9903327048ed988ac00000000", &notify_message.coinbase_2, &notify_message.coinbase_2_len);
     const char *extranonce = "e9695791";
-    const char *extranonce_2 = "99999999";
-    char *coinbase_tx = construct_coinbase_tx(coinbase_1, coinbase_2, extranonce, extranonce_2);
-    TEST_ASSERT_EQUAL_STRING(coinbase_tx, "01000000010000000000000000000000000000000000000000000000000000000000000000ffffffff20020862062f503253482f04b8864e5008e969579199999999072f736c7573682f000000000100f2052a010000001976a914d23fcdf86f7e756a64a7a9688ef9903327048ed988ac00000000");
-    free(coinbase_tx);
+
+    coinbase_builder builder = {};
+    TEST_ASSERT_EQUAL(0, coinbase_builder_init(&builder, &notify_message, extranonce, 4));
+    coinbase_builder_set_extranonce_2(&builder, 0x99999999);
+
+    char coinbase_tx[512];
+    bin2hex(builder.coinbase_tx, builder.coinbase_tx_len, coinbase_tx, sizeof(coinbase_tx));
+    TEST_ASSERT_EQUAL_STRING("01000000010000000000000000000000000000000000000000000000000000000000000000ffffffff20020862062f503253482f04b8864e5008e969579199999999072f736c7573682f000000000100f2052a010000001976a914d23fcdf86f7e756a64a7a9688ef9903327048ed988ac00000000", coinbase_tx);
+
+    // extranonce_2 is patched in place, little endian
+    coinbase_builder_set_extranonce_2(&builder, 0x04030201);
+    TEST_ASSERT_EQUAL_HEX8(0x01, builder.coinbase_tx[builder.extranonce_2_offset]);
+    TEST_ASSERT_EQUAL_HEX8(0x04, builder.coinbase_tx[builder.extranonce_2_offset + 3]);
+    TEST_ASSERT_EQUAL(notify_message.coinbase_1_len + 4, builder.extranonce_2_offset);
+
+    coinbase_builder_free(&builder);
+    free(notify_message.coinbase_1);
+    free(notify_message.coinbase_2);
 }
 
 // Values calculated from esp-miner/components/stratum/test/verifiers/merklecalc.py
+TEST_CASE("Check coinbase hash from cached prefix", "[mining]")
+{
+    mining_notify notify_message = {};
+    hex2bin_dup("01000000010000000000000000000000000000000000000000000000000000000000000000ffffffff4b03a5020cfabe6d6d379ae882651f6469f2ed6b8b40a4f9a4b41fd838a3ad6de8cba775f4e8f1d3080100000000000000", &notify_message.coinbase_1, &notify_message.coinbase_1_len);
+    hex2bin_dup("41903d4c1b2f736c7573682f0000000003ca890d27000000001976a9147c154ed1dc59609e3d26abb2df2ea3d587cd8c4188ac00000000000000002c6a4c2952534b424c4f434b3a4cb4cb2ddfc37c41baf5ef6b6b4899e3253a8f1dfc7e5dd68a5b5b27005014ef0000000000000000266a24aa21a9ed5caa249f1af9fbf71c986fea8e076ca34ae3514fb2f86400561b28c7b15949bf00000000", &notify_message.coinbase_2, &notify_message.coinbase_2_len);
+
+    coinbase_builder builder = {};
+    TEST_ASSERT_EQUAL(0, coinbase_builder_init(&builder, &notify_message, "e9695791", 8));
+
+    uint32_t extranonce_2_values[] = {0, 1, 0x99999999, UINT32_MAX};
+    for (int i = 0; i < 4; i++)
+    {
+        coinbase_builder_set_extranonce_2(&builder, extranonce_2_values[i]);
+
+        uint8_t coinbase_hash[32];
+        coinbase_builder_hash(&builder, coinbase_hash);
+
+        uint8_t *expected = double_sha256_bin(builder.coinbase_tx, builder.coinbase_tx_len);
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, coinbase_hash, 32);
+        free(expected);
+    }
+
+    coinbase_builder_free(&builder);
+    free(notify_message.coinbase_1);
+    free(notify_message.coinbase_2);
+}
+
 TEST_CASE("Validate merkle root calculation", "[mining]")
 {
     const char *coinbase_tx = "01000000010000000000000000000000000000000000000000000000000000000000000000ffffffff20020862062f503253482f04b8864e5008e969579199999999072f736c7573682f000000000100f2052a010000001976a914d23fcdf86f7e756a64a7a9688ef9903327048ed988ac00000000";
@@ -35,9 +101,9 @@ TEST_CASE("Validate merkle root calculation", "[mining]")
     hex2bin("463c19427286342120039a83218fa87ce45448e246895abac11fff0036076758", merkles[10], 32);
     hex2bin("03d287f655813e540ddb9c4e7aeb922478662b0f5d8e9d0cbd564b20146bab76", merkles[11], 32);
 
-    char *root_hash = calculate_merkle_root_hash(coinbase_tx, merkles, num_merkles);
+    char root_hash[65];
+    calculate_merkle_root_hash_hex(coinbase_tx, merkles, num_merkles, root_hash);
     TEST_ASSERT_EQUAL_STRING("adbcbc21e20388422198a55957aedfa0e61be0b8f2b87d7c08510bb9f099a893", root_hash);
-    free(root_hash);
 }
 
 TEST_CASE("Validate another merkle root calculation", "[mining]")
@@ -52,21 +118,22 @@ TEST_CASE("Validate another merkle root calculation", "[mining]")
     hex2bin("9f64f3b0d9edddb14be6f71c3ac2e80455916e207ffc003316c6a515452aa7b4", merkles[3], 32);
     hex2bin("2d0b54af60fad4ae59ec02031f661d026f2bb95e2eeb1e6657a35036c017c595", merkles[4], 32);
 
-    char *root_hash = calculate_merkle_root_hash(coinbase_tx, merkles, num_merkles);
+    char root_hash[65];
+    calculate_merkle_root_hash_hex(coinbase_tx, merkles, num_merkles, root_hash);
     TEST_ASSERT_EQUAL_STRING("5cc58f5e84aafc740d521b92a7bf72f4e56c4cc3ad1c2159f1d094f97ac34eee", root_hash);
-    free(root_hash);
 }
 
 // Values calculated from esp-miner/components/stratum/test/verifiers/bm1397.py
 TEST_CASE("Validate bm job construction", "[mining]")
 {
-    mining_notify notify_message;
-    notify_message.prev_block_hash = "bf44fd3513dc7b837d60e5c628b572b448d204a8000007490000000000000000";
+    mining_notify notify_message = {};
+    hex2bin("bf44fd3513dc7b837d60e5c628b572b448d204a8000007490000000000000000", notify_message.prev_block_hash, 32);
     notify_message.version = 0x20000004;
     notify_message.target = 0x1705dd01;
     notify_message.ntime = 0x64658bd8;
-    const char *merkle_root = "cd1be82132ef0d12053dcece1fa0247fcfdb61d4dbd3eb32ea9ef9b4c604a846";
-    bm_job job = construct_bm_job(&notify_message, merkle_root, 0, 1000);
+    uint8_t merkle_root[32];
+    hex2bin("cd1be82132ef0d12053dcece1fa0247fcfdb61d4dbd3eb32ea9ef9b4c604a846", merkle_root, 32);
+    bm_job job = construct_bm_job(&notify_message, merkle_root, 0, 1000, JOB_FORMAT_MIDSTATE);
 
     uint8_t expected_midstate_bin[32];
     hex2bin("91DFEA528A9F73683D0D495DD6DD7415E1CA21CB411759E3E05D7D5FF285314D", expected_midstate_bin, 32);
@@ -75,6 +142,197 @@ TEST_CASE("Validate bm job construction", "[mining]")
     TEST_ASSERT_EQUAL_UINT8_ARRAY(expected_midstate_bin, job.midstate, 32);
 }
 
+TEST_CASE("Validate header bm job construction", "[mining]")
+{
+    mining_notify notify_message = {};
+    hex2bin("bf44fd3513dc7b837d60e5c628b572b448d204a8000007490000000000000000", notify_message.prev_block_hash, 32);
+    notify_message.version = 0x20000004;
+    notify_message.target = 0x1705dd01;
+    notify_message.ntime = 0x64658bd8;
+    uint8_t merkle_root[32];
+    hex2bin("cd1be82132ef0d12053dcece1fa0247fcfdb61d4dbd3eb32ea9ef9b4c604a846", merkle_root, 32);
+    bm_job job = construct_bm_job(&notify_message, merkle_root, 0x1fffe000, 1000, JOB_FORMAT_HEADER);
+
+    uint8_t expected_prev_block_hash_be[32];
+    hex2bin("000000000000000049070000a804d248b472b528c6e5607d837bdc1335fd44bf", expected_prev_block_hash_be, 32);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected_prev_block_hash_be, job.prev_block_hash_be, 32);
+
+    uint8_t expected_merkle_root_be[32];
+    hex2bin("c604a846ea9ef9b4dbd3eb32cfdb61d41fa0247f053dcece32ef0d12cd1be821", expected_merkle_root_be, 32);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected_merkle_root_be, job.merkle_root_be, 32);
+    TEST_ASSERT_EQUAL(0, job.num_midstates);
+}
+
+// Values calculated from esp-miner/components/stratum/test/verifiers/bm1397.py, one midstate per rolled version
+TEST_CASE("Validate bm job construction from template", "[mining]")
+{
+    mining_notify notify_message = {};
+    notify_message.job_id = "1b4c3d9041";
+    hex2bin("bf44fd3513dc7b837d60e5c628b572b448d204a8000007490000000000000000", notify_message.prev_block_hash, 32);
+    notify_message.version = 0x20000004;
+    notify_message.target = 0x1705dd01;
+    notify_message.ntime = 0x64658bd8;
+    uint8_t merkle_root[32];
+    hex2bin("cd1be82132ef0d12053dcece1fa0247fcfdb61d4dbd3eb32ea9ef9b4c604a846", merkle_root, 32);
+
+    job_template tmpl;
+    job_template_init(&tmpl, &notify_message, 0x1fffe000, 1000, JOB_FORMAT_MIDSTATE);
+    bm_job job;
+    construct_bm_job_from_template(&tmpl, merkle_root, 0, &job);
+
+    TEST_ASSERT_EQUAL_STRING("1b4c3d9041", job.jobid);
+    TEST_ASSERT_EQUAL_UINT32(0x1fffe000, job.version_mask);
+    TEST_ASSERT_EQUAL(4, job.num_midstates);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(merkle_root, job.merkle_root, 32);
+
+    uint8_t expected_prev_block_hash[32];
+    hex2bin("35fd44bf837bdc13c6e5607db472b528a804d248490700000000000000000000", expected_prev_block_hash, 32);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected_prev_block_hash, job.prev_block_hash, 32);
+
+    // versions 20000004, 20002004, 20004004 and 20006004
+    const char *expected_midstates[4] = {
+        "91DFEA528A9F73683D0D495DD6DD7415E1CA21CB411759E3E05D7D5FF285314D",
+        "589669CBEF33BCD419297793AD8E90D0EAAFC729087FD249CB56EFE956A92312",
+        "7DB9C06689F028320DD0372FA3DA970C38758618A4FCEFA3931264F27E317641",
+        "5A46ECEA515B7FC4BD7BB6E3423CD79C593538865A3BF0C38B6789E5E18A8273",
+    };
+    const uint8_t *midstates[4] = {job.midstate, job.midstate1, job.midstate2, job.midstate3};
+    for (int i = 0; i < 4; i++)
+    {
+        uint8_t expected_midstate_bin[32];
+        hex2bin(expected_midstates[i], expected_midstate_bin, 32);
+        // bytes are reversed for the midstate on the bm job command packet
+        reverse_bytes(expected_midstate_bin, 32);
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(expected_midstate_bin, midstates[i], 32);
+    }
+}
+
+TEST_CASE("Validate host version rolling split", "[mining]")
+{
+    TEST_ASSERT_EQUAL_UINT32(0x18000000, host_version_bits(0x1fffe000));
+    TEST_ASSERT_EQUAL_UINT32(0x00000300, host_version_bits(0x000003ff));
+    // too few bits to share with the ASIC
+    TEST_ASSERT_EQUAL_UINT32(0, host_version_bits(0x1ff00000));
+    TEST_ASSERT_EQUAL_UINT32(0, host_version_bits(0));
+}
+
+TEST_CASE("Validate host version rolled jobs", "[mining]")
+{
+    mining_notify notify_message = {};
+    notify_message.job_id = "1b4c3d9041";
+    hex2bin("bf44fd3513dc7b837d60e5c628b572b448d204a8000007490000000000000000", notify_message.prev_block_hash, 32);
+    notify_message.version = 0x20000004;
+    notify_message.target = 0x1705dd01;
+    notify_message.ntime = 0x64658bd8;
+    uint8_t merkle_root[32];
+    hex2bin("cd1be82132ef0d12053dcece1fa0247fcfdb61d4dbd3eb32ea9ef9b4c604a846", merkle_root, 32);
+
+    uint32_t host_mask = host_version_bits(0x1fffe000);
+    uint32_t asic_mask = 0x1fffe000 & ~host_mask;
+
+    job_template tmpl;
+    job_template_init(&tmpl, &notify_message, asic_mask, 1000, JOB_FORMAT_MIDSTATE);
+    job_template_set_rolling(&tmpl, host_mask, JOB_NTIME_ROLLS);
+    TEST_ASSERT_EQUAL(4, tmpl.rolls);
+
+    const uint32_t expected_versions[4] = {0x20000004, 0x28000004, 0x30000004, 0x38000004};
+    for (int roll = 0; roll < tmpl.rolls; roll++)
+    {
+        bm_job job;
+        construct_bm_job_from_template(&tmpl, merkle_root, roll, &job);
+
+        TEST_ASSERT_EQUAL_UINT32(expected_versions[roll], job.version);
+        TEST_ASSERT_EQUAL_UINT32(0x20000004, job.notify_version);
+        TEST_ASSERT_EQUAL_UINT32(asic_mask, job.version_mask);
+        TEST_ASSERT_EQUAL_UINT32(0x64658bd8, job.ntime);
+
+        // the midstates follow the host rolled version, as if the notify carried it
+        mining_notify rolled_notify = notify_message;
+        rolled_notify.version = expected_versions[roll];
+        bm_job expected = construct_bm_job(&rolled_notify, merkle_root, asic_mask, 1000, JOB_FORMAT_MIDSTATE);
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(expected.midstate, job.midstate, 32);
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(expected.midstate3, job.midstate3, 32);
+    }
+}
+
+TEST_CASE("Validate host version rolled jobs with host bits in the notify version", "[mining]")
+{
+    mining_notify notify_message = {};
+    notify_message.version = 0x28000004;
+    notify_message.target = 0x1705dd01;
+    notify_message.ntime = 0x64658bd8;
+    uint8_t merkle_root[32] = {0};
+
+    job_template tmpl;
+    job_template_init(&tmpl, &notify_message, 0x07ffe000, 1000, JOB_FORMAT_HEADER);
+    job_template_set_rolling(&tmpl, 0x18000000, JOB_NTIME_ROLLS);
+    TEST_ASSERT_EQUAL(4, tmpl.rolls);
+
+    // no two rolls share a version, and submission recovers the rolled bits with version ^ notify_version
+    const uint32_t expected_versions[4] = {0x28000004, 0x20000004, 0x38000004, 0x30000004};
+    for (int roll = 0; roll < tmpl.rolls; roll++)
+    {
+        bm_job job;
+        construct_bm_job_from_template(&tmpl, merkle_root, roll, &job);
+        TEST_ASSERT_EQUAL_UINT32(expected_versions[roll], job.version);
+        TEST_ASSERT_EQUAL_UINT32(0x28000004, job.notify_version);
+    }
+}
+
+TEST_CASE("Validate ntime rolled jobs", "[mining]")
+{
+    mining_notify notify_message = {};
+    notify_message.version = 0x20000004;
+    notify_message.target = 0x1705dd01;
+    notify_message.ntime = 0x64658bd8;
+    uint8_t merkle_root[32] = {0};
+
+    job_template tmpl;
+    job_template_init(&tmpl, &notify_message, 0x1fffe000, 1000, JOB_FORMAT_HEADER);
+    // the host mask overlaps the ASIC mask entirely so ntime is rolled instead
+    job_template_set_rolling(&tmpl, 0x18000000, JOB_NTIME_ROLLS);
+    TEST_ASSERT_EQUAL(JOB_NTIME_ROLLS, tmpl.rolls);
+
+    for (int roll = 0; roll < tmpl.rolls; roll++)
+    {
+        bm_job job;
+        construct_bm_job_from_template(&tmpl, merkle_root, roll, &job);
+        TEST_ASSERT_EQUAL_UINT32(0x20000004, job.version);
+        TEST_ASSERT_EQUAL_UINT32(0x64658bd8 + roll, job.ntime);
+    }
+}
+
+TEST_CASE("Benchmark bm job construction", "[mining bench][not-on-qemu]")
+{
+    mining_notify notify_message = {};
+    hex2bin("bf44fd3513dc7b837d60e5c628b572b448d204a8000007490000000000000000", notify_message.prev_block_hash, 32);
+    notify_message.version = 0x20000004;
+    notify_message.target = 0x1705dd01;
+    notify_message.ntime = 0x64658bd8;
+    uint8_t merkle_root[32];
+    hex2bin("cd1be82132ef0d12053dcece1fa0247fcfdb61d4dbd3eb32ea9ef9b4c604a846", merkle_root, 32);
+
+    const int iterations = 1000;
+    volatile uint8_t num_midstates = 0;
+
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++) {
+        num_midstates = construct_bm_job(&notify_message, merkle_root, 0x1fffe000, 1000, JOB_FORMAT_MIDSTATE).num_midstates;
+    }
+    int64_t midstate_us = esp_timer_get_time() - start;
+
+    start = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++) {
+        num_midstates = construct_bm_job(&notify_message, merkle_root, 0x1fffe000, 1000, JOB_FORMAT_HEADER).num_midstates;
+    }
+    int64_t header_us = esp_timer_get_time() - start;
+
+    printf("construct_bm_job: midstate %.2f us/job, header %.2f us/job\n",
+           (double) midstate_us / iterations, (double) header_us / iterations);
+    TEST_ASSERT_EQUAL(0, num_midstates);
+    TEST_ASSERT_LESS_THAN(midstate_us, header_us);
+}
+
 TEST_CASE("Validate version mask incrementing", "[mining]")
 {
     uint32_t version = 0x20000004;
@@ -138,15 +396,43 @@ TEST_CASE("Test extranonce 2 generation", "[mining extranonce2]")
     free(fifth);
 }
 
+TEST_CASE("Test bm_job pool", "[mining]")
+{
+    bm_job *jobs[BM_JOB_POOL_SIZE];
+    for (int i = 0; i < BM_JOB_POOL_SIZE; i++)
+    {
+        jobs[i] = alloc_bm_job();
+        TEST_ASSERT_NOT_NULL(jobs[i]);
+    }
+
+    // exhausted
+    TEST_ASSERT_NULL(alloc_bm_job());
+
+    free_bm_job(jobs[3]);
+    bm_job *job = alloc_bm_job();
+    TEST_ASSERT_EQUAL_PTR(jobs[3], job);
+
+    // jobs that did not come from the pool are ignored
+    bm_job stack_job;
+    free_bm_job(&stack_job);
+    TEST_ASSERT_NULL(alloc_bm_job());
+
+    for (int i = 0; i < BM_JOB_POOL_SIZE; i++)
+    {
+        free_bm_job(jobs[i]);
+    }
+}
+
 TEST_CASE("Test nonce diff checking", "[mining test_nonce][not-on-qemu]")
 {
-    mining_notify notify_message;
-    notify_message.prev_block_hash = "d02b10fc0d4711eae1a805af50a8a83312a2215e00017f2b0000000000000000";
+    mining_notify notify_message = {};
+    hex2bin("d02b10fc0d4711eae1a805af50a8a83312a2215e00017f2b0000000000000000", notify_message.prev_block_hash, 32);
     notify_message.version = 0x20000004;
     notify_message.target = 0x1705ae3a;
     notify_message.ntime = 0x646ff1a9;
-    const char *merkle_root = "6d0359c451434605c52a5a9ce074340be47c2c63840731f9edf1db3f26b1cdd9a9f16f64";
-    bm_job job = construct_bm_job(&notify_message, merkle_root, 0, 1000);
+    uint8_t merkle_root[32];
+    hex2bin("6d0359c451434605c52a5a9ce074340be47c2c63840731f9edf1db3f26b1cdd9a9f16f64", merkle_root, 32);
+    bm_job job = construct_bm_job(&notify_message, merkle_root, 0, 1000, JOB_FORMAT_MIDSTATE);
 
     uint32_t nonce = 0x276E8947;
     double diff = test_nonce_value(&job, nonce, 0);
@@ -155,8 +441,8 @@ TEST_CASE("Test nonce diff checking", "[mining test_nonce][not-on-qemu]")
 
 TEST_CASE("Test nonce diff checking 2", "[mining test_nonce][not-on-qemu]")
 {
-    mining_notify notify_message;
-    notify_message.prev_block_hash = "0c859545a3498373a57452fac22eb7113df2a465000543520000000000000000";
+    mining_notify notify_message = {};
+    hex2bin("0c859545a3498373a57452fac22eb7113df2a465000543520000000000000000", notify_message.prev_block_hash, 32);
     notify_message.version = 0x20000004;
     notify_message.target = 0x1705ae3a;
     notify_message.ntime = 0x647025b5;
@@ -179,12 +465,145 @@ TEST_CASE("Test nonce diff checking 2", "[mining test_nonce][not-on-qemu]")
     hex2bin("c4f5ab01913fc186d550c1a28f3f3e9ffaca2016b961a6a751f8cca0089df924", merkles[11], 32);
     hex2bin("cff737e1d00176dd6bbfa73071adbb370f227cfb5fba186562e4060fcec877e1", merkles[12], 32);
 
-    char *merkle_root = calculate_merkle_root_hash(coinbase_tx, merkles, num_merkles);
-    TEST_ASSERT_EQUAL_STRING("5bdc1968499c3393873edf8e07a1c3a50a97fc3a9d1a376bbf77087dd63778eb", merkle_root);
+    char merkle_root_hex[65];
+    calculate_merkle_root_hash_hex(coinbase_tx, merkles, num_merkles, merkle_root_hex);
+    TEST_ASSERT_EQUAL_STRING("5bdc1968499c3393873edf8e07a1c3a50a97fc3a9d1a376bbf77087dd63778eb", merkle_root_hex);
 
-    bm_job job = construct_bm_job(&notify_message, merkle_root, 0, 1000);
+    uint8_t merkle_root[32];
+    hex2bin(merkle_root_hex, merkle_root, 32);
+    bm_job job = construct_bm_job(&notify_message, merkle_root, 0, 1000, JOB_FORMAT_MIDSTATE);
 
     uint32_t nonce = 0x0a029ed1;
-    double diff = test_nonce_value(&job, nonce, 0);
+    double diff = test_nonce_value(&job, nonce, job.version);
     TEST_ASSERT_EQUAL_INT(683, (int)diff);
 }
+
+TEST_CASE("Test nonce diff checking with cached midstates", "[mining test_nonce]")
+{
+    mining_notify notify_message = {};
+    hex2bin("0c859545a3498373a57452fac22eb7113df2a465000543520000000000000000", notify_message.prev_block_hash, 32);
+    notify_message.version = 0x20000004;
+    notify_message.target = 0x1705ae3a;
+    notify_message.ntime = 0x647025b5;
+    uint8_t merkle_root[32];
+    hex2bin("5bdc1968499c3393873edf8e07a1c3a50a97fc3a9d1a376bbf77087dd63778eb", merkle_root, 32);
+    bm_job job = construct_bm_job(&notify_message, merkle_root, 0x1fffe000, 1000, JOB_FORMAT_HEADER);
+
+    // more versions than cache slots, each seen twice, against the full header hash
+    uint32_t rolled_version = job.version;
+    for (int i = 0; i < NONCE_MIDSTATE_CACHE_SIZE * 2 + 1; i++)
+    {
+        for (uint32_t nonce = 0x0a029ed1; nonce < 0x0a029ed3; nonce++)
+        {
+            uint8_t header[80];
+            memcpy(header, &rolled_version, 4);
+            memcpy(header + 4, job.prev_block_hash, 32);
+            memcpy(header + 36, job.merkle_root, 32);
+            memcpy(header + 68, &job.ntime, 4);
+            memcpy(header + 72, &job.target, 4);
+            memcpy(header + 76, &nonce, 4);
+
+            uint8_t hash[32];
+            sha256d_80(header, hash);
+            double expected = 26959535291011309493156476344723991336010898738574164086137773096960.0 / le256todouble(hash);
+
+            TEST_ASSERT_EQUAL_DOUBLE(expected, test_nonce_value(&job, nonce, rolled_version));
+        }
+        rolled_version = increment_bitmask(rolled_version, job.version_mask);
+    }
+
+    TEST_ASSERT_EQUAL(683, (int)test_nonce_value(&job, 0x0a029ed1, job.version));
+}
+
+TEST_CASE("Block header hashes to the nonce hash", "[mining test_nonce]")
+{
+    mining_notify notify_message = {};
+    hex2bin("0c859545a3498373a57452fac22eb7113df2a465000543520000000000000000", notify_message.prev_block_hash, 32);
+    notify_message.version = 0x20000004;
+    notify_message.target = 0x1705ae3a;
+    notify_message.ntime = 0x647025b5;
+    uint8_t merkle_root[32];
+    hex2bin("5bdc1968499c3393873edf8e07a1c3a50a97fc3a9d1a376bbf77087dd63778eb", merkle_root, 32);
+    bm_job job = construct_bm_job(&notify_message, merkle_root, 0x1fffe000, 1000, JOB_FORMAT_HEADER);
+
+    uint8_t header[80];
+    block_header(&job, 0x0a029ed1, job.version, header);
+    char header_hex[161];
+    bin2hex(header, 80, header_hex, sizeof(header_hex));
+    TEST_ASSERT_EQUAL_STRING("04000020"
+                             "4595850c738349a3fa5274a511b72ec265a4f23d524305000000000000000000"
+                             "5bdc1968499c3393873edf8e07a1c3a50a97fc3a9d1a376bbf77087dd63778eb"
+                             "b5257064" "3aae0517" "d19e020a", header_hex);
+
+    uint8_t expected[32];
+    uint8_t hash[32];
+    sha256d_80(header, expected);
+    nonce_hash(&job, 0x0a029ed1, job.version, hash);
+    TEST_ASSERT_EQUAL_MEMORY(expected, hash, 32);
+}
+
+TEST_CASE("Difficulty to target", "[mining target]")
+{
+    uint8_t target[32];
+    char target_hex[65];
+
+    difficulty_to_target(1, target);
+    reverse_bytes(target, 32);
+    bin2hex(target, 32, target_hex, sizeof(target_hex));
+    TEST_ASSERT_EQUAL_STRING("00000000ffff0000000000000000000000000000000000000000000000000000", target_hex);
+
+    difficulty_to_target(1000, target);
+    reverse_bytes(target, 32);
+    bin2hex(target, 32, target_hex, sizeof(target_hex));
+    TEST_ASSERT_EQUAL_STRING("00000000004188f5c28f5c28f5c28f5c28f5c28f5c28f5c28f5c28f5c28f5c28", target_hex);
+
+    nbits_to_target(0x1705ae3a, target);
+    reverse_bytes(target, 32);
+    bin2hex(target, 32, target_hex, sizeof(target_hex));
+    TEST_ASSERT_EQUAL_STRING("00000000000000000005ae3a0000000000000000000000000000000000000000", target_hex);
+}
+
+TEST_CASE("Hash meets target", "[mining target]")
+{
+    uint8_t target[32] = {0};
+    uint8_t hash[32] = {0};
+
+    target[28] = 0x10;
+    hash[28] = 0x10;
+    TEST_ASSERT_TRUE(hash_meets_target(hash, target));
+
+    hash[0] = 0x01;
+    TEST_ASSERT_FALSE(hash_meets_target(hash, target));
+
+    hash[28] = 0x0f;
+    hash[27] = 0xff;
+    TEST_ASSERT_TRUE(hash_meets_target(hash, target));
+
+    TEST_ASSERT_EQUAL(24 + 3, hash_leading_zero_bits(target));
+    TEST_ASSERT_EQUAL(256, hash_leading_zero_bits((uint8_t[32]){0}));
+    TEST_ASSERT_EQUAL(32, difficulty_leading_zero_bits(1));
+    TEST_ASSERT_EQUAL(32 + 9, difficulty_leading_zero_bits(683));
+}
+
+TEST_CASE("Integer target checks match nonce difficulty", "[mining target]")
+{
+    mining_notify notify_message = {};
+    hex2bin("0c859545a3498373a57452fac22eb7113df2a465000543520000000000000000", notify_message.prev_block_hash, 32);
+    notify_message.version = 0x20000004;
+    notify_message.target = 0x1705ae3a;
+    notify_message.ntime = 0x647025b5;
+    uint8_t merkle_root[32];
+    hex2bin("5bdc1968499c3393873edf8e07a1c3a50a97fc3a9d1a376bbf77087dd63778eb", merkle_root, 32);
+
+    // the nonce has difficulty 683.x
+    uint8_t hash[32];
+    bm_job job = construct_bm_job(&notify_message, merkle_root, 0, 683, JOB_FORMAT_HEADER);
+    nonce_hash(&job, 0x0a029ed1, job.version, hash);
+    TEST_ASSERT_TRUE(hash_meets_target(hash, job.pool_target));
+    TEST_ASSERT_FALSE(hash_meets_target(hash, job.network_target));
+    TEST_ASSERT_EQUAL(683, (int)hash_to_difficulty(hash));
+    TEST_ASSERT_GREATER_OR_EQUAL(difficulty_leading_zero_bits(682), hash_leading_zero_bits(hash));
+
+    job = construct_bm_job(&notify_message, merkle_root, 0, 684, JOB_FORMAT_HEADER);
+    TEST_ASSERT_FALSE(hash_meets_target(hash, job.pool_target));
+}
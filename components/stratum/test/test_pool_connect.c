@@ -0,0 +1,144 @@
+#include "unity.h"
+#include "pool_connect.h"
+#include <stdio.h>
+#include <string.h>
+
+static struct sockaddr_storage ipv4(const char *ip, uint16_t port)
+{
+    struct sockaddr_storage address = {};
+    struct sockaddr_in *addr = (struct sockaddr_in *)&address;
+    addr->sin_family = AF_INET;
+    addr->sin_port = htons(port);
+    inet_pton(AF_INET, ip, &addr->sin_addr);
+    return address;
+}
+
+static struct sockaddr_storage ipv6(const char *ip, uint16_t port)
+{
+    struct sockaddr_storage address = {};
+    struct sockaddr_in6 *addr = (struct sockaddr_in6 *)&address;
+    addr->sin6_family = AF_INET6;
+    addr->sin6_port = htons(port);
+    inet_pton(AF_INET6, ip, &addr->sin6_addr);
+    return address;
+}
+
+static uint32_t ipv4_of(const struct sockaddr_storage *address)
+{
+    return ntohl(((const struct sockaddr_in *)address)->sin_addr.s_addr);
+}
+
+TEST_CASE("Pool DNS cache keeps addresses until they expire", "[pool_connect]")
+{
+    static pool_dns_cache cache;
+    pool_dns_cache_init(&cache);
+    struct sockaddr_storage out[POOL_DNS_MAX_ADDRESSES];
+    struct sockaddr_storage addresses[] = { ipv4("10.0.0.1", 3333), ipv4("10.0.0.2", 3333) };
+
+    TEST_ASSERT_EQUAL(0, pool_dns_cache_lookup(&cache, "pool.example", 3333, 0, out, POOL_DNS_MAX_ADDRESSES));
+
+    pool_dns_cache_store(&cache, "pool.example", 3333, addresses, 2, 1000);
+    TEST_ASSERT_EQUAL(2, pool_dns_cache_lookup(&cache, "pool.example", 3333, 2000, out, POOL_DNS_MAX_ADDRESSES));
+    TEST_ASSERT_EQUAL_UINT32(0x0a000001, ipv4_of(&out[0]));
+    TEST_ASSERT_EQUAL_UINT32(0x0a000002, ipv4_of(&out[1]));
+
+    // another port is another pool
+    TEST_ASSERT_EQUAL(0, pool_dns_cache_lookup(&cache, "pool.example", 4444, 2000, out, POOL_DNS_MAX_ADDRESSES));
+
+    int64_t expiry_us = 1000 + POOL_DNS_TTL_S * 1000000LL;
+    TEST_ASSERT_EQUAL(2, pool_dns_cache_lookup(&cache, "pool.example", 3333, expiry_us - 1, out, POOL_DNS_MAX_ADDRESSES));
+    TEST_ASSERT_EQUAL(0, pool_dns_cache_lookup(&cache, "pool.example", 3333, expiry_us, out, POOL_DNS_MAX_ADDRESSES));
+
+    pool_dns_cache_store(&cache, "pool.example", 3333, addresses, 2, expiry_us);
+    pool_dns_cache_invalidate(&cache, "pool.example", 3333);
+    TEST_ASSERT_EQUAL(0, pool_dns_cache_lookup(&cache, "pool.example", 3333, expiry_us, out, POOL_DNS_MAX_ADDRESSES));
+}
+
+TEST_CASE("Pool DNS cache hands out the winning address first", "[pool_connect]")
+{
+    static pool_dns_cache cache;
+    pool_dns_cache_init(&cache);
+    struct sockaddr_storage out[POOL_DNS_MAX_ADDRESSES];
+    struct sockaddr_storage addresses[] = { ipv4("10.0.0.1", 3333), ipv4("10.0.0.2", 3333), ipv4("10.0.0.3", 3333) };
+
+    pool_dns_cache_store(&cache, "pool.example", 3333, addresses, 3, 0);
+    pool_dns_cache_set_preferred(&cache, "pool.example", 3333, &addresses[2]);
+    TEST_ASSERT_EQUAL(3, pool_dns_cache_lookup(&cache, "pool.example", 3333, 0, out, POOL_DNS_MAX_ADDRESSES));
+    TEST_ASSERT_EQUAL_UINT32(0x0a000003, ipv4_of(&out[0]));
+    TEST_ASSERT_EQUAL_UINT32(0x0a000001, ipv4_of(&out[1]));
+    TEST_ASSERT_EQUAL_UINT32(0x0a000002, ipv4_of(&out[2]));
+
+    // a fresh answer in another order keeps the winner in front
+    struct sockaddr_storage refreshed[] = { ipv4("10.0.0.2", 3333), ipv4("10.0.0.3", 3333) };
+    pool_dns_cache_store(&cache, "pool.example", 3333, refreshed, 2, 0);
+    TEST_ASSERT_EQUAL(2, pool_dns_cache_lookup(&cache, "pool.example", 3333, 0, out, POOL_DNS_MAX_ADDRESSES));
+    TEST_ASSERT_EQUAL_UINT32(0x0a000003, ipv4_of(&out[0]));
+    TEST_ASSERT_EQUAL_UINT32(0x0a000002, ipv4_of(&out[1]));
+}
+
+TEST_CASE("Pool DNS cache evicts the least recently used pool", "[pool_connect]")
+{
+    static pool_dns_cache cache;
+    pool_dns_cache_init(&cache);
+    struct sockaddr_storage out[POOL_DNS_MAX_ADDRESSES];
+    char host[16];
+
+    for (int i = 0; i < POOL_DNS_CACHE_SIZE; i++)
+    {
+        struct sockaddr_storage address = ipv4("10.0.0.1", 3333);
+        snprintf(host, sizeof(host), "pool%d", i);
+        pool_dns_cache_store(&cache, host, 3333, &address, 1, i);
+    }
+    // pool0 is used again, pool1 becomes the oldest
+    TEST_ASSERT_EQUAL(1, pool_dns_cache_lookup(&cache, "pool0", 3333, 100, out, POOL_DNS_MAX_ADDRESSES));
+
+    struct sockaddr_storage address = ipv4("10.0.0.9", 3333);
+    pool_dns_cache_store(&cache, "newpool", 3333, &address, 1, 101);
+    TEST_ASSERT_EQUAL(1, pool_dns_cache_lookup(&cache, "newpool", 3333, 102, out, POOL_DNS_MAX_ADDRESSES));
+    TEST_ASSERT_EQUAL(1, pool_dns_cache_lookup(&cache, "pool0", 3333, 102, out, POOL_DNS_MAX_ADDRESSES));
+    TEST_ASSERT_EQUAL(0, pool_dns_cache_lookup(&cache, "pool1", 3333, 102, out, POOL_DNS_MAX_ADDRESSES));
+}
+
+TEST_CASE("Pool DNS cache holds every configured pool", "[pool_connect]")
+{
+    static pool_dns_cache cache;
+    pool_dns_cache_init(&cache);
+    struct sockaddr_storage out[POOL_DNS_MAX_ADDRESSES];
+    struct sockaddr_storage address = ipv4("10.0.0.1", 3333);
+    char host[16];
+
+    // a latency mode probe round walks the pools in order, the second round must not miss
+    for (int round = 0; round < 2; round++)
+    {
+        for (int i = 0; i < STRATUM_MAX_POOLS; i++)
+        {
+            snprintf(host, sizeof(host), "pool%d", i);
+            int64_t now_us = round * STRATUM_MAX_POOLS + i;
+            if (round == 0)
+            {
+                pool_dns_cache_store(&cache, host, 3333, &address, 1, now_us);
+            }
+            else
+            {
+                TEST_ASSERT_EQUAL(1, pool_dns_cache_lookup(&cache, host, 3333, now_us, out, POOL_DNS_MAX_ADDRESSES));
+            }
+        }
+    }
+}
+
+TEST_CASE("Pool addresses alternate between families", "[pool_connect]")
+{
+    struct sockaddr_storage addresses[] = {
+        ipv4("10.0.0.1", 3333),
+        ipv4("10.0.0.2", 3333),
+        ipv4("10.0.0.3", 3333),
+        ipv6("2001:db8::1", 3333),
+    };
+
+    pool_connect_interleave_families(addresses, 4);
+    TEST_ASSERT_EQUAL(AF_INET, addresses[0].ss_family);
+    TEST_ASSERT_EQUAL_UINT32(0x0a000001, ipv4_of(&addresses[0]));
+    TEST_ASSERT_EQUAL(AF_INET6, addresses[1].ss_family);
+    TEST_ASSERT_EQUAL_UINT32(0x0a000002, ipv4_of(&addresses[2]));
+    TEST_ASSERT_EQUAL_UINT32(0x0a000003, ipv4_of(&addresses[3]));
+}
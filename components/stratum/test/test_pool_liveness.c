@@ -0,0 +1,118 @@
+#include "unity.h"
+#include "pool_liveness.h"
+
+#define S_US 1000000LL
+
+TEST_CASE("Pool liveness learns the notify cadence", "[pool_liveness]")
+{
+    static pool_liveness liveness;
+    pool_liveness_init(&liveness);
+    pool_liveness_connected(&liveness, 0);
+
+    // no cadence yet, the old fixed receive timeout
+    TEST_ASSERT_EQUAL_INT64(LIVENESS_MAX_SILENCE_S * S_US, pool_liveness_silence_limit_us(&liveness));
+
+    for (int i = 1; i <= LIVENESS_MIN_GAPS + 1; i++)
+    {
+        pool_liveness_received(&liveness, true, i * 30 * S_US);
+    }
+    TEST_ASSERT_EQUAL_INT64(LIVENESS_NOTIFY_FACTOR * 30 * S_US, pool_liveness_silence_limit_us(&liveness));
+
+    // pools that send work every few seconds still get the minimum
+    pool_liveness_connected(&liveness, 0);
+    for (int i = 1; i <= 10; i++)
+    {
+        pool_liveness_received(&liveness, true, i * 2 * S_US);
+    }
+    TEST_ASSERT_EQUAL_INT64(LIVENESS_MIN_SILENCE_S * S_US, pool_liveness_silence_limit_us(&liveness));
+}
+
+TEST_CASE("Pool liveness probes a silent pool and gives up without an answer", "[pool_liveness]")
+{
+    static pool_liveness liveness;
+    pool_liveness_init(&liveness);
+    pool_liveness_connected(&liveness, 0);
+    int64_t now_us = 0;
+    for (int i = 0; i < 5; i++)
+    {
+        now_us += 30 * S_US;
+        pool_liveness_received(&liveness, true, now_us);
+    }
+
+    TEST_ASSERT_EQUAL(POOL_LIVENESS_OK, pool_liveness_check(&liveness, 0, -1, now_us + 119 * S_US));
+    TEST_ASSERT_EQUAL(POOL_LIVENESS_PROBE, pool_liveness_check(&liveness, 0, -1, now_us + 120 * S_US));
+    TEST_ASSERT_EQUAL(POOL_LIVENESS_OK, pool_liveness_check(&liveness, 0, -1, now_us + 125 * S_US));
+
+    // the answer counts as a sign of life
+    pool_liveness_received(&liveness, false, now_us + 126 * S_US);
+    TEST_ASSERT_EQUAL(POOL_LIVENESS_OK, pool_liveness_check(&liveness, 0, -1, now_us + 130 * S_US));
+
+    TEST_ASSERT_EQUAL(POOL_LIVENESS_PROBE, pool_liveness_check(&liveness, 0, -1, now_us + 246 * S_US));
+    TEST_ASSERT_EQUAL(POOL_LIVENESS_DEAD,
+                      pool_liveness_check(&liveness, 0, -1, now_us + (246 + LIVENESS_PROBE_TIMEOUT_S) * S_US));
+}
+
+TEST_CASE("Pool liveness probes once for unanswered shares", "[pool_liveness]")
+{
+    static pool_liveness liveness;
+    pool_liveness_init(&liveness);
+    pool_liveness_connected(&liveness, 0);
+
+    // 5 s p99 allows 20 s
+    TEST_ASSERT_EQUAL_INT64(20 * S_US, pool_liveness_response_limit_us(5000));
+    TEST_ASSERT_EQUAL_INT64(LIVENESS_MIN_RESPONSE_S * S_US, pool_liveness_response_limit_us(50));
+    TEST_ASSERT_EQUAL_INT64(LIVENESS_MAX_RESPONSE_S * S_US, pool_liveness_response_limit_us(-1));
+
+    int64_t share_us = 10 * S_US;
+    TEST_ASSERT_EQUAL(POOL_LIVENESS_OK, pool_liveness_check(&liveness, share_us, 5000, share_us + 19 * S_US));
+    TEST_ASSERT_EQUAL(POOL_LIVENESS_PROBE, pool_liveness_check(&liveness, share_us, 5000, share_us + 20 * S_US));
+
+    // notifies keep coming, the share stays unanswered
+    pool_liveness_received(&liveness, true, share_us + 21 * S_US);
+    TEST_ASSERT_EQUAL(POOL_LIVENESS_OK, pool_liveness_check(&liveness, share_us, 5000, share_us + 30 * S_US));
+    TEST_ASSERT_EQUAL(POOL_LIVENESS_DEAD, pool_liveness_check(&liveness, share_us, 5000, share_us + 40 * S_US));
+}
+
+TEST_CASE("Pool liveness only gives up on an unanswered probe of a silent pool", "[pool_liveness]")
+{
+    static pool_liveness liveness;
+    pool_liveness_init(&liveness);
+    pool_liveness_connected(&liveness, 0);
+
+    // a pool that ignores the probe sent for an overdue share is still waited on up to twice the response limit
+    int64_t share_us = 10 * S_US;
+    TEST_ASSERT_EQUAL(POOL_LIVENESS_PROBE, pool_liveness_check(&liveness, share_us, 5000, share_us + 20 * S_US));
+    TEST_ASSERT_EQUAL(POOL_LIVENESS_OK,
+                      pool_liveness_check(&liveness, share_us, 5000, share_us + (20 + LIVENESS_PROBE_TIMEOUT_S) * S_US));
+    TEST_ASSERT_EQUAL(POOL_LIVENESS_OK, pool_liveness_check(&liveness, share_us, 5000, share_us + 39 * S_US));
+    TEST_ASSERT_EQUAL(POOL_LIVENESS_DEAD, pool_liveness_check(&liveness, share_us, 5000, share_us + 40 * S_US));
+
+    // the share is answered, then the pool goes silent and ignores the probe as well
+    pool_liveness_received(&liveness, false, share_us + 40 * S_US);
+    int64_t silent_us = share_us + 40 * S_US + LIVENESS_MAX_SILENCE_S * S_US;
+    TEST_ASSERT_EQUAL(POOL_LIVENESS_PROBE, pool_liveness_check(&liveness, 0, 5000, silent_us));
+    TEST_ASSERT_EQUAL(POOL_LIVENESS_DEAD, pool_liveness_check(&liveness, 0, 5000, silent_us + LIVENESS_PROBE_TIMEOUT_S * S_US));
+}
+
+TEST_CASE("Pool liveness counts the time without fresh work", "[pool_liveness]")
+{
+    static pool_liveness liveness;
+    pool_liveness_init(&liveness);
+
+    // nothing mined yet, nothing goes stale
+    pool_liveness_connected(&liveness, 0);
+    pool_liveness_lost(&liveness);
+    TEST_ASSERT_EQUAL_DOUBLE(0, pool_liveness_stale_s(&liveness, 50 * S_US));
+
+    pool_liveness_connected(&liveness, 0);
+    pool_liveness_received(&liveness, true, 10 * S_US);
+    pool_liveness_received(&liveness, false, 20 * S_US);
+    // silent from 20 s, noticed at 100 s, reconnects fail until 130 s
+    pool_liveness_lost(&liveness);
+    TEST_ASSERT_EQUAL_DOUBLE(80, pool_liveness_stale_s(&liveness, 100 * S_US));
+    pool_liveness_lost(&liveness);
+    pool_liveness_connected(&liveness, 125 * S_US);
+    pool_liveness_received(&liveness, false, 128 * S_US);
+    pool_liveness_received(&liveness, true, 130 * S_US);
+    TEST_ASSERT_EQUAL_DOUBLE(110, pool_liveness_stale_s(&liveness, 500 * S_US));
+}
@@ -0,0 +1,132 @@
+#include "unity.h"
+#include "pool_selector.h"
+
+#define ROUND_US (60 * 1000000LL)
+
+TEST_CASE("Pool selector smooths probe latencies and marks pools down", "[pool_selector]")
+{
+    static pool_selector selector;
+    pool_selector_init(&selector, 3);
+
+    TEST_ASSERT_EQUAL_DOUBLE(-1, pool_selector_latency_ms(&selector, 0));
+
+    pool_selector_report(&selector, 0, true, 20, 30);
+    TEST_ASSERT_EQUAL_DOUBLE(50, pool_selector_latency_ms(&selector, 0));
+    pool_selector_report(&selector, 0, true, 30, 40);
+    TEST_ASSERT_DOUBLE_WITHIN(0.001, 20 + 0.3 * 10 + 30 + 0.3 * 10, pool_selector_latency_ms(&selector, 0));
+
+    // one failed probe is forgiven, the second one takes the pool down
+    pool_selector_report(&selector, 0, false, 0, 0);
+    TEST_ASSERT_TRUE(selector.pools[0].healthy);
+    pool_selector_report(&selector, 0, false, 0, 0);
+    TEST_ASSERT_FALSE(selector.pools[0].healthy);
+    TEST_ASSERT_EQUAL_DOUBLE(-1, pool_selector_latency_ms(&selector, 0));
+
+    // a pool that never answered is down right away
+    pool_selector_report(&selector, 1, false, 0, 0);
+    TEST_ASSERT_FALSE(selector.pools[1].healthy);
+
+    pool_selector_report(&selector, 0, true, 10, 10);
+    TEST_ASSERT_TRUE(selector.pools[0].healthy);
+    TEST_ASSERT_EQUAL(0, selector.pools[0].failures);
+}
+
+TEST_CASE("Pool selector moves to a faster pool only after it kept its lead", "[pool_selector]")
+{
+    static pool_selector selector;
+    pool_selector_init(&selector, 3);
+    int64_t now_us = 0;
+
+    pool_selector_report(&selector, 0, true, 40, 60);
+    pool_selector_report(&selector, 1, true, 20, 30);
+    pool_selector_report(&selector, 2, true, 45, 60);
+
+    for (int round = 1; round < POOL_SWITCH_ROUNDS; round++)
+    {
+        now_us += ROUND_US;
+        TEST_ASSERT_EQUAL(0, pool_selector_choose(&selector, 0, POOL_SELECTION_LATENCY, now_us));
+    }
+    now_us += ROUND_US;
+    TEST_ASSERT_EQUAL(1, pool_selector_choose(&selector, 0, POOL_SELECTION_LATENCY, now_us));
+    pool_selector_switched(&selector, now_us);
+
+    // pool 0 gets faster than pool 1, but not by enough to flap back
+    for (int round = 0; round < POOL_SWITCH_ROUNDS * 2; round++)
+    {
+        pool_selector_report(&selector, 0, true, 20, 25);
+        now_us += ROUND_US;
+        TEST_ASSERT_EQUAL(1, pool_selector_choose(&selector, 1, POOL_SELECTION_LATENCY, now_us));
+    }
+
+    // clearly faster now, but the miner stays put until the hold time is over
+    for (int round = 0; round < 20; round++)
+    {
+        pool_selector_report(&selector, 0, true, 5, 5);
+    }
+    int64_t hold_end_us = ROUND_US * POOL_SWITCH_ROUNDS + POOL_SWITCH_HOLD_S * 1000000LL;
+    while (now_us + ROUND_US < hold_end_us)
+    {
+        now_us += ROUND_US;
+        TEST_ASSERT_EQUAL(1, pool_selector_choose(&selector, 1, POOL_SELECTION_LATENCY, now_us));
+    }
+    now_us += ROUND_US;
+    TEST_ASSERT_EQUAL(0, pool_selector_choose(&selector, 1, POOL_SELECTION_LATENCY, now_us));
+}
+
+TEST_CASE("Pool selector restarts the lead count when the candidate falls back", "[pool_selector]")
+{
+    static pool_selector selector;
+    pool_selector_init(&selector, 2);
+
+    pool_selector_report(&selector, 0, true, 50, 50);
+    pool_selector_report(&selector, 1, true, 20, 20);
+    TEST_ASSERT_EQUAL(0, pool_selector_choose(&selector, 0, POOL_SELECTION_LATENCY, ROUND_US));
+    TEST_ASSERT_EQUAL(0, pool_selector_choose(&selector, 0, POOL_SELECTION_LATENCY, 2 * ROUND_US));
+
+    // one slow round and the count starts over
+    for (int round = 0; round < 5; round++)
+    {
+        pool_selector_report(&selector, 1, true, 200, 200);
+    }
+    TEST_ASSERT_EQUAL(0, pool_selector_choose(&selector, 0, POOL_SELECTION_LATENCY, 3 * ROUND_US));
+    TEST_ASSERT_EQUAL(-1, selector.candidate);
+}
+
+TEST_CASE("Pool selector in priority mode returns to earlier pools", "[pool_selector]")
+{
+    static pool_selector selector;
+    pool_selector_init(&selector, 3);
+
+    pool_selector_report(&selector, 0, false, 0, 0);
+    pool_selector_report(&selector, 1, true, 90, 90);
+    pool_selector_report(&selector, 2, true, 10, 10);
+
+    // an earlier pool wins however slow it is
+    TEST_ASSERT_EQUAL(1, pool_selector_choose(&selector, 2, POOL_SELECTION_PRIORITY, 0));
+    TEST_ASSERT_EQUAL(1, pool_selector_choose(&selector, 1, POOL_SELECTION_PRIORITY, 0));
+    TEST_ASSERT_EQUAL(1, pool_selector_best_alternative(&selector, 2, POOL_SELECTION_PRIORITY));
+
+    pool_selector_report(&selector, 0, true, 200, 200);
+    TEST_ASSERT_EQUAL(0, pool_selector_choose(&selector, 2, POOL_SELECTION_PRIORITY, 0));
+    TEST_ASSERT_EQUAL(2, pool_selector_best_alternative(&selector, 0, POOL_SELECTION_LATENCY));
+}
+
+TEST_CASE("Pool selector fails over past pools that are down", "[pool_selector]")
+{
+    static pool_selector selector;
+    pool_selector_init(&selector, 4);
+
+    // unprobed pools are worth a try
+    TEST_ASSERT_EQUAL(1, pool_selector_next(&selector, 0));
+    TEST_ASSERT_EQUAL(0, pool_selector_next(&selector, 3));
+
+    pool_selector_report(&selector, 1, false, 0, 0);
+    pool_selector_report(&selector, 2, false, 0, 0);
+    TEST_ASSERT_EQUAL(3, pool_selector_next(&selector, 0));
+
+    // everything else down, keep cycling in order
+    pool_selector_report(&selector, 3, false, 0, 0);
+    pool_selector_report(&selector, 0, false, 0, 0);
+    TEST_ASSERT_EQUAL(1, pool_selector_next(&selector, 0));
+    TEST_ASSERT_EQUAL(-1, pool_selector_best_alternative(&selector, 0, POOL_SELECTION_LATENCY));
+}
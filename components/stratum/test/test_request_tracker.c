@@ -0,0 +1,115 @@
+#include "unity.h"
+#include "request_tracker.h"
+
+TEST_CASE("Request tracker matches responses to shares", "[request_tracker]")
+{
+    static request_tracker tracker;
+    request_tracker_init(&tracker);
+
+    tracked_request request;
+    request_tracker_add(&tracker, 3, NULL, 0, 0, 1000);
+    request_tracker_add(&tracker, 7, "1d2e0c4d3d", 1024, 0, 2000);
+
+    // setup requests come back without touching the share statistics
+    TEST_ASSERT_TRUE(request_tracker_complete(&tracker, 3, true, 6000, &request));
+    TEST_ASSERT_EQUAL(0, request.difficulty);
+    TEST_ASSERT_EQUAL(0, tracker.stats[0].samples);
+
+    TEST_ASSERT_TRUE(request_tracker_complete(&tracker, 7, false, 52000, &request));
+    TEST_ASSERT_EQUAL_STRING("1d2e0c4d3d", request.jobid);
+    TEST_ASSERT_EQUAL(1024, request.difficulty);
+    TEST_ASSERT_EQUAL(2000, request.sent_us);
+    TEST_ASSERT_EQUAL(1, tracker.stats[0].rejected);
+    TEST_ASSERT_EQUAL(0, tracker.stats[0].accepted);
+
+    // answered once, unknown ids and notifications are not tracked
+    TEST_ASSERT_FALSE(request_tracker_complete(&tracker, 7, true, 60000, &request));
+    TEST_ASSERT_FALSE(request_tracker_complete(&tracker, 8, true, 60000, &request));
+    TEST_ASSERT_FALSE(request_tracker_complete(&tracker, -1, true, 60000, &request));
+}
+
+TEST_CASE("Request tracker forgets requests of a dead connection", "[request_tracker]")
+{
+    static request_tracker tracker;
+    request_tracker_init(&tracker);
+
+    tracked_request request;
+    request_tracker_add(&tracker, 5, "job", 512, 1, 0);
+    // a request REQUEST_TRACKER_SIZE ids later takes over the slot
+    request_tracker_add(&tracker, 5 + REQUEST_TRACKER_SIZE, "job", 512, 1, 0);
+    TEST_ASSERT_EQUAL(1, tracker.stats[1].lost);
+    TEST_ASSERT_FALSE(request_tracker_complete(&tracker, 5, true, 100, &request));
+
+    request_tracker_reset(&tracker);
+    TEST_ASSERT_EQUAL(2, tracker.stats[1].lost);
+    TEST_ASSERT_FALSE(request_tracker_complete(&tracker, 5 + REQUEST_TRACKER_SIZE, true, 100, &request));
+}
+
+TEST_CASE("Request tracker finds the oldest unanswered share", "[request_tracker]")
+{
+    static request_tracker tracker;
+    request_tracker_init(&tracker);
+
+    tracked_request request;
+    TEST_ASSERT_EQUAL(0, request_tracker_oldest_share_us(&tracker));
+
+    // setup requests a pool may never answer don't count
+    request_tracker_add(&tracker, 4, NULL, 0, 0, 1000);
+    request_tracker_add(&tracker, 9, "job", 512, 0, 3000);
+    request_tracker_add(&tracker, 10, "job", 512, 0, 4000);
+    TEST_ASSERT_EQUAL(3000, request_tracker_oldest_share_us(&tracker));
+
+    request_tracker_complete(&tracker, 9, true, 5000, &request);
+    TEST_ASSERT_EQUAL(4000, request_tracker_oldest_share_us(&tracker));
+    request_tracker_complete(&tracker, 10, true, 5000, &request);
+    TEST_ASSERT_EQUAL(0, request_tracker_oldest_share_us(&tracker));
+}
+
+TEST_CASE("Request tracker share latency percentiles", "[request_tracker]")
+{
+    static request_tracker tracker;
+    request_tracker_init(&tracker);
+
+    tracked_request request;
+    TEST_ASSERT_EQUAL_DOUBLE(-1.0, request_tracker_latency_percentile_ms(&tracker, 0, 50));
+
+    // 90 shares answered in 20 ms, 9 in 200 ms and one in 2 s
+    for (int id = 0; id < 100; id++)
+    {
+        int64_t latency_us = id < 90 ? 20000 : id < 99 ? 200000 : 2000000;
+        request_tracker_add(&tracker, id, "job", 1000, 0, 0);
+        TEST_ASSERT_TRUE(request_tracker_complete(&tracker, id, true, latency_us, &request));
+    }
+
+    // buckets are a quarter of a doubling wide, so within 20% of the real value
+    TEST_ASSERT_DOUBLE_WITHIN(4.0, 20.0, request_tracker_latency_percentile_ms(&tracker, 0, 50));
+    TEST_ASSERT_DOUBLE_WITHIN(40.0, 200.0, request_tracker_latency_percentile_ms(&tracker, 0, 95));
+    TEST_ASSERT_DOUBLE_WITHIN(40.0, 200.0, request_tracker_latency_percentile_ms(&tracker, 0, 99));
+    TEST_ASSERT_DOUBLE_WITHIN(400.0, 2000.0, request_tracker_latency_percentile_ms(&tracker, 0, 100));
+
+    // the other pool has its own statistics
+    TEST_ASSERT_EQUAL_DOUBLE(-1.0, request_tracker_latency_percentile_ms(&tracker, 1, 50));
+}
+
+TEST_CASE("Request tracker accepted work hashrate", "[request_tracker]")
+{
+    static request_tracker tracker;
+    request_tracker_init(&tracker);
+
+    tracked_request request;
+    TEST_ASSERT_EQUAL_DOUBLE(0.0, request_tracker_accepted_hashrate(&tracker, 0, 1000000));
+
+    // 100 accepted shares at diff 1000 over 100 s, plus a rejected one that adds no work
+    for (int id = 1; id <= 100; id++)
+    {
+        request_tracker_add(&tracker, id, "job", 1000, 0, (id - 1) * 1000000LL);
+        TEST_ASSERT_TRUE(request_tracker_complete(&tracker, id, true, (id - 1) * 1000000LL + 30000, &request));
+    }
+    request_tracker_add(&tracker, 101, "job", 1000, 0, 100000000LL);
+    request_tracker_complete(&tracker, 101, false, 100030000LL, &request);
+
+    // 1000 * 2^32 hashes per second is ~4295 GH/s
+    TEST_ASSERT_DOUBLE_WITHIN(1.0, 4294.967, request_tracker_accepted_hashrate(&tracker, 0, 100000000LL));
+    TEST_ASSERT_EQUAL(100, tracker.stats[0].accepted);
+    TEST_ASSERT_EQUAL_DOUBLE(100000.0, tracker.stats[0].accepted_difficulty);
+}
@@ -0,0 +1,119 @@
+#include "unity.h"
+#include "sha256d.h"
+#include "mbedtls/sha256.h"
+#include "esp_timer.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static void fill_pattern(uint8_t *buf, size_t len, uint8_t seed)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        buf[i] = (uint8_t)(seed + i * 31);
+    }
+}
+
+TEST_CASE("Fixed length sha256 matches mbedtls", "[sha256]")
+{
+    uint8_t data[80];
+    uint8_t expected[32];
+    uint8_t digest[32];
+
+    for (uint8_t seed = 0; seed < 8; seed++)
+    {
+        fill_pattern(data, sizeof(data), seed);
+
+        mbedtls_sha256(data, 32, expected, 0);
+        sha256_32(data, digest);
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, digest, 32);
+
+        mbedtls_sha256(data, 64, expected, 0);
+        sha256_64(data, digest);
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, digest, 32);
+
+        mbedtls_sha256(data, 80, expected, 0);
+        sha256_80(data, digest);
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, digest, 32);
+
+        mbedtls_sha256(data, 80, expected, 0);
+        mbedtls_sha256(expected, 32, expected, 0);
+        sha256d_80(data, digest);
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, digest, 32);
+
+        mbedtls_sha256(data, 64, expected, 0);
+        mbedtls_sha256(expected, 32, expected, 0);
+        sha256d_64(data, digest);
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, digest, 32);
+    }
+}
+
+TEST_CASE("Generic sha256 matches mbedtls", "[sha256]")
+{
+    uint8_t data[300];
+    uint8_t expected[32];
+    uint8_t digest[32];
+
+    fill_pattern(data, sizeof(data), 0x5a);
+
+    // covers the one and two padding block cases around 55/56 and 63/64 bytes
+    for (size_t len = 0; len <= sizeof(data); len++)
+    {
+        mbedtls_sha256(data, len, expected, 0);
+        sha256_generic(data, len, digest);
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, digest, 32);
+    }
+}
+
+TEST_CASE("Known sha256 digest", "[sha256]")
+{
+    // sha256("abc")
+    const uint8_t expected[32] = {
+        0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea, 0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22, 0x23,
+        0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c, 0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad,
+    };
+    uint8_t digest[32];
+
+    sha256_generic((const uint8_t *)"abc", 3, digest);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, digest, 32);
+}
+
+TEST_CASE("Benchmark fixed length sha256 against mbedtls", "[sha256 bench][not-on-qemu]")
+{
+    const int iterations = 2000;
+    uint8_t data[80];
+    uint8_t digest[32];
+
+    fill_pattern(data, sizeof(data), 1);
+
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++) {
+        mbedtls_sha256(data, 64, digest, 0);
+        mbedtls_sha256(digest, 32, data, 0);
+    }
+    int64_t mbedtls_64_us = esp_timer_get_time() - start;
+
+    start = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++) {
+        sha256d_64(data, data);
+    }
+    int64_t kernel_64_us = esp_timer_get_time() - start;
+
+    start = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++) {
+        mbedtls_sha256(data, 80, digest, 0);
+        mbedtls_sha256(digest, 32, data, 0);
+    }
+    int64_t mbedtls_80_us = esp_timer_get_time() - start;
+
+    start = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++) {
+        sha256d_80(data, data);
+    }
+    int64_t kernel_80_us = esp_timer_get_time() - start;
+
+    printf("sha256d 64 bytes: mbedtls %.2f us, kernel %.2f us\n",
+           (double) mbedtls_64_us / iterations, (double) kernel_64_us / iterations);
+    printf("sha256d 80 bytes: mbedtls %.2f us, kernel %.2f us\n",
+           (double) mbedtls_80_us / iterations, (double) kernel_80_us / iterations);
+}
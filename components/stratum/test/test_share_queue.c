@@ -0,0 +1,85 @@
+#include "unity.h"
+#include "share_queue.h"
+#include "stratum_api.h"
+#include <stdio.h>
+#include <string.h>
+
+static share_submission make_share(uint32_t nonce)
+{
+    share_submission share = {};
+    snprintf(share.jobid, sizeof(share.jobid), "job%lu", (unsigned long)nonce);
+    strcpy(share.extranonce2, "00000001");
+    share.ntime = 0x64495522;
+    share.nonce = nonce;
+    share.version = 0x00400000;
+    return share;
+}
+
+TEST_CASE("Share queue hands shares out in order", "[share_queue]")
+{
+    static share_queue queue;
+    share_queue_init(&queue);
+    TEST_ASSERT_NULL(share_queue_front(&queue));
+
+    // go around the ring a few times
+    for (uint32_t i = 0; i < SHARE_QUEUE_SIZE * 3; i++)
+    {
+        share_submission share = make_share(i);
+        TEST_ASSERT_TRUE(share_queue_push(&queue, &share));
+        TEST_ASSERT_EQUAL(1, share_queue_count(&queue));
+
+        const share_submission *front = share_queue_front(&queue);
+        TEST_ASSERT_NOT_NULL(front);
+        TEST_ASSERT_EQUAL_UINT32(i, front->nonce);
+        TEST_ASSERT_EQUAL_STRING(share.jobid, front->jobid);
+        share_queue_release(&queue);
+        TEST_ASSERT_NULL(share_queue_front(&queue));
+    }
+}
+
+TEST_CASE("Share queue drops shares when full", "[share_queue]")
+{
+    static share_queue queue;
+    share_queue_init(&queue);
+
+    for (uint32_t i = 0; i < SHARE_QUEUE_SIZE; i++)
+    {
+        share_submission share = make_share(i);
+        TEST_ASSERT_TRUE(share_queue_push(&queue, &share));
+    }
+    share_submission extra = make_share(SHARE_QUEUE_SIZE);
+    TEST_ASSERT_FALSE(share_queue_push(&queue, &extra));
+    TEST_ASSERT_EQUAL(1, queue.dropped);
+    TEST_ASSERT_EQUAL(SHARE_QUEUE_SIZE, share_queue_count(&queue));
+
+    // the oldest shares survive, the one that did not fit is gone
+    for (uint32_t i = 0; i < SHARE_QUEUE_SIZE; i++)
+    {
+        TEST_ASSERT_EQUAL_UINT32(i, share_queue_front(&queue)->nonce);
+        share_queue_release(&queue);
+    }
+    TEST_ASSERT_NULL(share_queue_front(&queue));
+}
+
+TEST_CASE("Submits are formatted back to back into one buffer", "[share_queue]")
+{
+    char buf[512];
+    size_t len = 0;
+
+    for (int i = 0; i < 2; i++)
+    {
+        int written = STRATUM_V1_format_submit(buf + len, sizeof(buf) - len, 10 + i, "bc1q.worker", "1d2e0c4d3d",
+                                               "00000001", 0x64495522, 0x1a2b3c4d + i, 0x00400000);
+        TEST_ASSERT_GREATER_THAN(0, written);
+        len += written;
+    }
+
+    TEST_ASSERT_EQUAL_STRING(
+        "{\"id\": 10, \"method\": \"mining.submit\", \"params\": [\"bc1q.worker\", \"1d2e0c4d3d\", \"00000001\", \"64495522\", \"1a2b3c4d\", \"00400000\"]}\n"
+        "{\"id\": 11, \"method\": \"mining.submit\", \"params\": [\"bc1q.worker\", \"1d2e0c4d3d\", \"00000001\", \"64495522\", \"1a2b3c4e\", \"00400000\"]}\n",
+        buf);
+
+    // a submit that does not fit is not written at all
+    TEST_ASSERT_EQUAL(-1, STRATUM_V1_format_submit(buf, 32, 12, "bc1q.worker", "1d2e0c4d3d", "00000001",
+                                                   0x64495522, 0x1a2b3c4d, 0x00400000));
+}
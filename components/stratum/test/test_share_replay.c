@@ -0,0 +1,202 @@
+#include "unity.h"
+#include "share_replay.h"
+#include <string.h>
+
+#define SECOND_US 1000000LL
+
+static const uint8_t block_a[32] = { 0xaa };
+static const uint8_t block_b[32] = { 0xbb };
+
+static share_submission make_share(uint32_t nonce, const uint8_t *prev_block_hash, bool block_candidate)
+{
+    share_submission share = {
+        .nonce = nonce,
+        .block_candidate = block_candidate,
+    };
+    strcpy(share.jobid, "job");
+    memcpy(share.prev_block_hash, prev_block_hash, sizeof(share.prev_block_hash));
+    return share;
+}
+
+TEST_CASE("Share replay resends the shares of a resumed session", "[share_replay]")
+{
+    static share_replay replay;
+    share_replay_init(&replay);
+    share_submission share = make_share(1, block_a, false);
+
+    share_replay_suspend(&replay, 0, "abcd");
+    TEST_ASSERT_TRUE(share_replay_suspended(&replay));
+    TEST_ASSERT_TRUE(share_replay_add(&replay, &share, 0));
+    share = make_share(2, block_a, false);
+    share_replay_add(&replay, &share, SECOND_US);
+
+    // nothing goes out before the session is back
+    TEST_ASSERT_FALSE(share_replay_pop(&replay, &share));
+
+    TEST_ASSERT_EQUAL(2, share_replay_resume(&replay, 0, "abcd", block_a, 10 * SECOND_US));
+    TEST_ASSERT_FALSE(share_replay_suspended(&replay));
+    TEST_ASSERT_TRUE(share_replay_pop(&replay, &share));
+    TEST_ASSERT_EQUAL_UINT32(1, share.nonce);
+    TEST_ASSERT_TRUE(share_replay_pop(&replay, &share));
+    TEST_ASSERT_EQUAL_UINT32(2, share.nonce);
+    TEST_ASSERT_FALSE(share_replay_pop(&replay, &share));
+    TEST_ASSERT_EQUAL(0, replay.count);
+}
+
+TEST_CASE("Share replay drops stale shares and keeps block candidates", "[share_replay]")
+{
+    static share_replay replay;
+    share_replay_init(&replay);
+    share_submission share = make_share(1, block_a, false);
+
+    share_replay_suspend(&replay, 0, "abcd");
+    share_replay_add(&replay, &share, 0);
+    share = make_share(2, block_a, true);
+    share_replay_add(&replay, &share, 0);
+    share = make_share(3, block_a, false);
+    share_replay_add(&replay, &share, 100 * SECOND_US);
+
+    // another session: ordinary shares are worthless, the candidate waits for the session to come back
+    TEST_ASSERT_EQUAL(0, share_replay_resume(&replay, 0, "ef01", block_a, 101 * SECOND_US));
+    TEST_ASSERT_EQUAL(1, replay.count);
+
+    share_replay_suspend(&replay, 0, "ef01");
+    share = make_share(4, block_a, false);
+    share_replay_add(&replay, &share, 101 * SECOND_US);
+    // too old to resend
+    int64_t late_us = 102 * SECOND_US + SHARE_REPLAY_MAX_AGE_S * SECOND_US;
+    TEST_ASSERT_EQUAL(0, share_replay_resume(&replay, 0, "ef01", block_a, late_us));
+    TEST_ASSERT_EQUAL(1, replay.count);
+
+    share_replay_suspend(&replay, 0, "ef01");
+    TEST_ASSERT_EQUAL(1, share_replay_resume(&replay, 0, "abcd", block_a, late_us));
+    TEST_ASSERT_TRUE(share_replay_pop(&replay, &share));
+    TEST_ASSERT_EQUAL_UINT32(2, share.nonce);
+
+    // a new block makes everything stale
+    share_replay_suspend(&replay, 0, "abcd");
+    share = make_share(5, block_a, true);
+    share_replay_add(&replay, &share, late_us);
+    TEST_ASSERT_EQUAL(0, share_replay_resume(&replay, 0, "abcd", block_b, late_us));
+    TEST_ASSERT_EQUAL(0, replay.count);
+}
+
+TEST_CASE("Share replay makes room with the oldest ordinary share", "[share_replay]")
+{
+    static share_replay replay;
+    share_replay_init(&replay);
+    share_submission share = make_share(0, block_a, true);
+
+    share_replay_suspend(&replay, 1, "abcd");
+    share_replay_add(&replay, &share, 0);
+    for (uint32_t nonce = 1; nonce < SHARE_REPLAY_SIZE; nonce++)
+    {
+        share = make_share(nonce, block_a, false);
+        TEST_ASSERT_TRUE(share_replay_add(&replay, &share, 0));
+    }
+    share = make_share(SHARE_REPLAY_SIZE, block_a, false);
+    TEST_ASSERT_FALSE(share_replay_add(&replay, &share, 0));
+
+    TEST_ASSERT_EQUAL(SHARE_REPLAY_SIZE, share_replay_resume(&replay, 1, "abcd", block_a, 0));
+    TEST_ASSERT_TRUE(share_replay_pop(&replay, &share));
+    TEST_ASSERT_EQUAL_UINT32(0, share.nonce);
+    TEST_ASSERT_TRUE(share_replay_pop(&replay, &share));
+    TEST_ASSERT_EQUAL_UINT32(2, share.nonce);
+}
+
+TEST_CASE("Share replay persists and restores block candidates", "[share_replay]")
+{
+    static share_replay replay;
+    share_replay_init(&replay);
+    replay_share candidates[SHARE_REPLAY_MAX_CANDIDATES];
+    int count;
+    share_submission share = make_share(1, block_a, false);
+
+    share_replay_suspend(&replay, 0, "abcd");
+    share_replay_add(&replay, &share, 0);
+    TEST_ASSERT_FALSE(share_replay_take_candidates(&replay, candidates, &count));
+
+    share = make_share(2, block_a, true);
+    share_replay_add(&replay, &share, 0);
+    TEST_ASSERT_TRUE(share_replay_take_candidates(&replay, candidates, &count));
+    TEST_ASSERT_EQUAL(1, count);
+    TEST_ASSERT_EQUAL_UINT32(2, candidates[0].share.nonce);
+    TEST_ASSERT_EQUAL_STRING("abcd", candidates[0].extranonce1);
+    TEST_ASSERT_FALSE(share_replay_take_candidates(&replay, candidates, &count));
+
+    // after a reboot
+    static share_replay rebooted;
+    share_replay_init(&rebooted);
+    share_replay_restore(&rebooted, candidates, count);
+    TEST_ASSERT_TRUE(share_replay_suspended(&rebooted));
+    TEST_ASSERT_EQUAL(1, share_replay_resume(&rebooted, 0, "abcd", block_a, 0));
+    TEST_ASSERT_TRUE(share_replay_pop(&rebooted, &share));
+    TEST_ASSERT_EQUAL_UINT32(2, share.nonce);
+
+    // sent, nothing left to persist
+    TEST_ASSERT_TRUE(share_replay_take_candidates(&rebooted, candidates, &count));
+    TEST_ASSERT_EQUAL(0, count);
+}
+
+TEST_CASE("Share replay keeps sent block candidates until the pool answers", "[share_replay]")
+{
+    static share_replay replay;
+    share_replay_init(&replay);
+    share_submission share = make_share(1, block_a, false);
+
+    share_replay_resume(&replay, 0, "abcd", block_a, 0);
+    // ordinary shares are gone once sent
+    share_replay_sent(&replay, &share, 5, 0);
+    TEST_ASSERT_EQUAL(0, replay.count);
+
+    share = make_share(2, block_a, true);
+    share_replay_sent(&replay, &share, 6, 0);
+    share = make_share(3, block_a, true);
+    share_replay_sent(&replay, &share, 7, 0);
+    TEST_ASSERT_EQUAL(2, replay.count);
+    share_replay_answered(&replay, 6);
+    TEST_ASSERT_EQUAL(1, replay.count);
+
+    // the connection died before the answer, the candidate goes out again on the same session
+    share_replay_suspend(&replay, 0, "abcd");
+    share_replay_answered(&replay, 7);
+    TEST_ASSERT_EQUAL(1, share_replay_resume(&replay, 0, "abcd", block_a, SECOND_US));
+    TEST_ASSERT_TRUE(share_replay_pop(&replay, &share));
+    TEST_ASSERT_EQUAL_UINT32(3, share.nonce);
+}
+
+TEST_CASE("Share replay holds shares for the first session that was lost", "[share_replay]")
+{
+    static share_replay replay;
+    share_replay_init(&replay);
+    share_submission share = make_share(1, block_a, false);
+
+    share_replay_suspend(&replay, 0, "abcd");
+    // another close before anything reconnected, like a switch to another pool
+    share_replay_suspend(&replay, 1, "ef01");
+    share_replay_add(&replay, &share, 0);
+
+    TEST_ASSERT_EQUAL(0, share_replay_resume(&replay, 1, "ef01", block_a, 0));
+    TEST_ASSERT_EQUAL(0, replay.count);
+}
+
+TEST_CASE("Share replay sends new block candidates right away unless suspended", "[share_replay]")
+{
+    static share_replay replay;
+    share_replay_init(&replay);
+    share_submission share = make_share(1, block_a, true);
+
+    share_replay_resume(&replay, 0, "abcd", block_a, 0);
+    share_replay_add_candidate(&replay, &share, 0);
+    TEST_ASSERT_TRUE(share_replay_pop(&replay, &share));
+    TEST_ASSERT_EQUAL_UINT32(1, share.nonce);
+
+    // found while the connection is down, it waits for the session
+    share_replay_suspend(&replay, 0, "abcd");
+    share = make_share(2, block_a, true);
+    share_replay_add_candidate(&replay, &share, 0);
+    TEST_ASSERT_FALSE(share_replay_pop(&replay, &share));
+    TEST_ASSERT_EQUAL(1, share_replay_resume(&replay, 0, "abcd", block_a, 0));
+    TEST_ASSERT_TRUE(share_replay_pop(&replay, &share));
+    TEST_ASSERT_EQUAL_UINT32(2, share.nonce);
+}
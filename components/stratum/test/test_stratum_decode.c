@@ -0,0 +1,158 @@
+#include "unity.h"
+#include "stratum_api.h"
+#include "stratum_decode.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// lines recorded from public-pool.io, in the order they arrived
+static const char *recorded_traffic[] = {
+    "{\"id\":null,\"method\":\"mining.set_difficulty\",\"params\":[1638]}",
+    "{\"id\":null,\"method\":\"mining.notify\",\"params\":"
+    "[\"1d2e0c4d3d\","
+    "\"ef4b9a48c7986466de4adc002f7337a6e121bc43000376ea0000000000000000\","
+    "\"01000000010000000000000000000000000000000000000000000000000000000000000000ffffffff4b03a5020cfabe6d6d379ae882651f6469f2ed6b8b40a4f9a4b41fd838a3ad6de8cba775f4e8f1d3080100000000000000\","
+    "\"41903d4c1b2f736c7573682f0000000003ca890d27000000001976a9147c154ed1dc59609e3d26abb2df2ea3d587cd8c4188ac00000000000000002c6a4c2952534b424c4f434b3a4cb4cb2ddfc37c41baf5ef6b6b4899e3253a8f1dfc7e5dd68a5b5b27005014ef0000000000000000266a24aa21a9ed5caa249f1af9fbf71c986fea8e076ca34ae3514fb2f86400561b28c7b15949bf00000000\","
+    "[\"ae23055e00f0f697cc3640124812d96d4fe8bdfa03484c1c638ce5a1c0e9aa81\",\"980fb87cb61021dd7afd314fcb0dabd096f3d56a7377f6f320684652e7410a21\",\"a52e9868343c55ce405be8971ff340f562ae9ab6353f07140d01666180e19b52\",\"7435bdfa004e603953b2ed39f118803934d9cf17b06d979ceb682f2251bafac2\",\"2a91f061a22d27cb8f44eea79938fb241ebeb359891aa907f05ffde7ed44e52e\",\"302401f80eb5e958155135e25200bb8ea181ad2d05e804a531c7314d86403cdc\",\"318ecb6161eb9b4cfd802bd730e2d36c167ddf102e70aa7b4158e2870dd47392\",\"1114332a9858e0cf84b2425bb1e59eaabf91dd102d114aa443d57fc1b3beb0c9\",\"f43f38095c810613ed795a44d9fab02ff25269706f454885db9be05cdf9c06e1\",\"3e2fc26b27fddc39668b59099cd9635761bb72ed92404204e12bdff08b16fb75\",\"463c19427286342120039a83218fa87ce45448e246895abac11fff0036076758\",\"03d287f655813e540ddb9c4e7aeb922478662b0f5d8e9d0cbd564b20146bab76\"],"
+    "\"20000004\",\"1705c739\",\"64495522\",true]}",
+    "{\"id\":4,\"error\":null,\"result\":true}",
+    "{\"id\":null,\"method\":\"mining.notify\",\"params\":"
+    "[\"1b4c3d9041\","
+    "\"ef4b9a48c7986466de4adc002f7337a6e121bc43000376ea0000000000000000\","
+    "\"01000000010000000000000000000000000000000000000000000000000000000000000000ffffffff4b03a5020cfabe6d6d379ae882651f6469f2ed6b8b40a4f9a4b41fd838a3ad6de8cba775f4e8f1d3080100000000000000\","
+    "\"41903d4c1b2f736c7573682f0000000003ca890d27000000001976a9147c154ed1dc59609e3d26abb2df2ea3d587cd8c4188ac00000000000000002c6a4c2952534b424c4f434b3a4cb4cb2ddfc37c41baf5ef6b6b4899e3253a8f1dfc7e5dd68a5b5b27005014ef0000000000000000266a24aa21a9ed5caa249f1af9fbf71c986fea8e076ca34ae3514fb2f86400561b28c7b15949bf00000000\","
+    "[\"ae23055e00f0f697cc3640124812d96d4fe8bdfa03484c1c638ce5a1c0e9aa81\",\"980fb87cb61021dd7afd314fcb0dabd096f3d56a7377f6f320684652e7410a21\",\"a52e9868343c55ce405be8971ff340f562ae9ab6353f07140d01666180e19b52\",\"7435bdfa004e603953b2ed39f118803934d9cf17b06d979ceb682f2251bafac2\",\"2a91f061a22d27cb8f44eea79938fb241ebeb359891aa907f05ffde7ed44e52e\",\"302401f80eb5e958155135e25200bb8ea181ad2d05e804a531c7314d86403cdc\",\"318ecb6161eb9b4cfd802bd730e2d36c167ddf102e70aa7b4158e2870dd47392\",\"1114332a9858e0cf84b2425bb1e59eaabf91dd102d114aa443d57fc1b3beb0c9\",\"f43f38095c810613ed795a44d9fab02ff25269706f454885db9be05cdf9c06e1\",\"3e2fc26b27fddc39668b59099cd9635761bb72ed92404204e12bdff08b16fb75\",\"463c19427286342120039a83218fa87ce45448e246895abac11fff0036076758\",\"03d287f655813e540ddb9c4e7aeb922478662b0f5d8e9d0cbd564b20146bab76\"],"
+    "\"20000004\",\"1705c739\",\"64495522\",false]}",
+    "{\"id\":5,\"error\":null,\"result\":true}",
+    "{\"id\":6,\"error\":null,\"result\":false}",
+};
+
+#define RECORDED_TRAFFIC_COUNT (sizeof(recorded_traffic) / sizeof(recorded_traffic[0]))
+
+static void release_message(StratumApiV1Message *message)
+{
+    if (message->method == MINING_NOTIFY)
+    {
+        STRATUM_V1_free_mining_notify(message->mining_notification);
+    }
+    free(message->error_str);
+    memset(message, 0, sizeof(*message));
+}
+
+TEST_CASE("Fast decoder matches the cJSON parser on recorded traffic", "[stratum decode]")
+{
+    for (size_t i = 0; i < RECORDED_TRAFFIC_COUNT; i++)
+    {
+        StratumApiV1Message fast = {};
+        StratumApiV1Message full = {};
+
+        TEST_ASSERT_TRUE(STRATUM_V1_decode_fast(&fast, recorded_traffic[i], strlen(recorded_traffic[i])));
+        STRATUM_V1_parse_cjson(&full, recorded_traffic[i]);
+
+        TEST_ASSERT_EQUAL(full.method, fast.method);
+        TEST_ASSERT_EQUAL(full.message_id, fast.message_id);
+        TEST_ASSERT_EQUAL(full.response_success, fast.response_success);
+        TEST_ASSERT_EQUAL_UINT32(full.new_difficulty, fast.new_difficulty);
+        TEST_ASSERT_EQUAL(full.should_abandon_work, fast.should_abandon_work);
+
+        if (full.method == MINING_NOTIFY)
+        {
+            mining_notify *a = fast.mining_notification;
+            mining_notify *b = full.mining_notification;
+            TEST_ASSERT_EQUAL_STRING(b->job_id, a->job_id);
+            TEST_ASSERT_EQUAL_UINT8_ARRAY(b->prev_block_hash, a->prev_block_hash, HASH_SIZE);
+            TEST_ASSERT_EQUAL(b->coinbase_1_len, a->coinbase_1_len);
+            TEST_ASSERT_EQUAL_UINT8_ARRAY(b->coinbase_1, a->coinbase_1, b->coinbase_1_len);
+            TEST_ASSERT_EQUAL(b->coinbase_2_len, a->coinbase_2_len);
+            TEST_ASSERT_EQUAL_UINT8_ARRAY(b->coinbase_2, a->coinbase_2, b->coinbase_2_len);
+            TEST_ASSERT_EQUAL(b->n_merkle_branches, a->n_merkle_branches);
+            TEST_ASSERT_EQUAL_UINT8_ARRAY(b->merkle_branches, a->merkle_branches, HASH_SIZE * b->n_merkle_branches);
+            TEST_ASSERT_EQUAL_UINT32(b->version, a->version);
+            TEST_ASSERT_EQUAL_UINT32(b->target, a->target);
+            TEST_ASSERT_EQUAL_UINT32(b->ntime, a->ntime);
+            TEST_ASSERT_EQUAL(b->clean_jobs, a->clean_jobs);
+        }
+
+        release_message(&fast);
+        release_message(&full);
+    }
+}
+
+TEST_CASE("Fast decoder leaves uncommon messages to cJSON", "[stratum decode]")
+{
+    const char *fallbacks[] = {
+        "{\"id\":null,\"method\":\"mining.set_difficulty\",\"params\":[0.5]}",
+        "{\"id\":null,\"method\":\"mining.set_version_mask\",\"params\":[\"1fffe000\"]}",
+        "{\"id\":null,\"method\":\"client.reconnect\",\"params\":[]}",
+        "{\"id\":5,\"result\":null,\"error\":[21,\"Job not found\",\"\"]}",
+        "{\"reject-reason\":\"Above target 2\",\"result\":false,\"error\":null,\"id\":8}",
+        "{\"id\":2,\"result\":[[[\"mining.notify\",\"e26e1928\"]],\"e26e1928\",4],\"error\":null}",
+        "{\"id\":null,\"method\":\"mining.notify\",\"params\":[\"job\\\"1\"]}",
+        "not json",
+    };
+
+    for (size_t i = 0; i < sizeof(fallbacks) / sizeof(fallbacks[0]); i++)
+    {
+        StratumApiV1Message message = {};
+        TEST_ASSERT_FALSE(STRATUM_V1_decode_fast(&message, fallbacks[i], strlen(fallbacks[i])));
+        TEST_ASSERT_EQUAL(STRATUM_UNKNOWN, message.method);
+        TEST_ASSERT_NULL(message.mining_notification);
+    }
+}
+
+TEST_CASE("Notify records are reused with their buffers", "[stratum decode]")
+{
+    StratumApiV1Message message = {};
+    TEST_ASSERT_TRUE(STRATUM_V1_decode_fast(&message, recorded_traffic[1], strlen(recorded_traffic[1])));
+    mining_notify *first = message.mining_notification;
+    uint8_t *coinbase_1 = first->coinbase_1;
+    STRATUM_V1_free_mining_notify(first);
+
+    // the pool hands back the record just released, buffers and all
+    TEST_ASSERT_TRUE(STRATUM_V1_decode_fast(&message, recorded_traffic[3], strlen(recorded_traffic[3])));
+    TEST_ASSERT_EQUAL_PTR(first, message.mining_notification);
+    TEST_ASSERT_EQUAL_PTR(coinbase_1, message.mining_notification->coinbase_1);
+    TEST_ASSERT_EQUAL_STRING("1b4c3d9041", message.mining_notification->job_id);
+    TEST_ASSERT_FALSE(message.mining_notification->clean_jobs);
+    STRATUM_V1_free_mining_notify(message.mining_notification);
+}
+
+TEST_CASE("Benchmark stratum message decoding", "[stratum decode bench][not-on-qemu]")
+{
+    const int iterations = 200;
+
+    // the cJSON path logs every line, keep that out of the measurement
+    esp_log_level_set("stratum_api", ESP_LOG_WARN);
+
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++)
+    {
+        for (size_t j = 0; j < RECORDED_TRAFFIC_COUNT; j++)
+        {
+            StratumApiV1Message message = {};
+            STRATUM_V1_parse_cjson(&message, recorded_traffic[j]);
+            release_message(&message);
+        }
+    }
+    int64_t cjson_us = esp_timer_get_time() - start;
+
+    start = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++)
+    {
+        for (size_t j = 0; j < RECORDED_TRAFFIC_COUNT; j++)
+        {
+            StratumApiV1Message message = {};
+            STRATUM_V1_parse(&message, recorded_traffic[j]);
+            release_message(&message);
+        }
+    }
+    int64_t fast_us = esp_timer_get_time() - start;
+
+    esp_log_level_set("stratum_api", ESP_LOG_INFO);
+
+    printf("%u recorded lines: cJSON %.2f us, fast decoder %.2f us\n", (unsigned)RECORDED_TRAFFIC_COUNT,
+           (double)cjson_us / iterations, (double)fast_us / iterations);
+    TEST_ASSERT_LESS_THAN(cjson_us, fast_us);
+}
@@ -1,5 +1,6 @@
 #include "unity.h"
 #include "stratum_api.h"
+#include "utils.h"
 
 TEST_CASE("Parse stratum method", "[stratum]")
 {
@@ -16,6 +17,7 @@ TEST_CASE("Parse stratum method", "[stratum]")
     STRATUM_V1_parse(&stratum_api_v1_message, json_string_standard);
     TEST_ASSERT_EQUAL(MINING_NOTIFY, stratum_api_v1_message.method);
     TEST_ASSERT_EQUAL_INT(0, stratum_api_v1_message.should_abandon_work);
+    TEST_ASSERT_EQUAL(0, stratum_api_v1_message.mining_notification->clean_jobs);
 }
 
 TEST_CASE("Parse stratum mining.notify abandon work", "[stratum]")
@@ -33,6 +35,7 @@ TEST_CASE("Parse stratum mining.notify abandon work", "[stratum]")
     STRATUM_V1_parse(&stratum_api_v1_message, json_string_abandon_work_false);
     TEST_ASSERT_EQUAL(MINING_NOTIFY, stratum_api_v1_message.method);
     TEST_ASSERT_EQUAL_INT(0, stratum_api_v1_message.should_abandon_work);
+    TEST_ASSERT_EQUAL(0, stratum_api_v1_message.mining_notification->clean_jobs);
 
     const char *json_string_abandon_work = "{\"id\":null,\"method\":\"mining.notify\",\"params\":"
                                            "[\"1b4c3d9041\","
@@ -45,6 +48,7 @@ TEST_CASE("Parse stratum mining.notify abandon work", "[stratum]")
     STRATUM_V1_parse(&stratum_api_v1_message, json_string_abandon_work);
     TEST_ASSERT_EQUAL(MINING_NOTIFY, stratum_api_v1_message.method);
     TEST_ASSERT_EQUAL_INT(1, stratum_api_v1_message.should_abandon_work);
+    TEST_ASSERT_EQUAL(1, stratum_api_v1_message.mining_notification->clean_jobs);
 
     const char *json_string_abandon_work_length_9 = "{\"id\":null,\"method\":\"mining.notify\",\"params\":"
                                                     "[\"1b4c3d9041\","
@@ -57,6 +61,7 @@ TEST_CASE("Parse stratum mining.notify abandon work", "[stratum]")
     STRATUM_V1_parse(&stratum_api_v1_message, json_string_abandon_work_length_9);
     TEST_ASSERT_EQUAL(MINING_NOTIFY, stratum_api_v1_message.method);
     TEST_ASSERT_EQUAL_INT(1, stratum_api_v1_message.should_abandon_work);
+    TEST_ASSERT_EQUAL(1, stratum_api_v1_message.mining_notification->clean_jobs);
 }
 
 TEST_CASE("Parse stratum set_difficulty params", "[mining.set_difficulty]")
@@ -80,9 +85,16 @@ TEST_CASE("Parse stratum notify params", "[mining.notify]")
                               "\"20000004\",\"1705c739\",\"64495522\",false]}";
     STRATUM_V1_parse(&stratum_api_v1_message, json_string);
     TEST_ASSERT_EQUAL_STRING("1d2e0c4d3d", stratum_api_v1_message.mining_notification->job_id);
-    TEST_ASSERT_EQUAL_STRING("ef4b9a48c7986466de4adc002f7337a6e121bc43000376ea0000000000000000", stratum_api_v1_message.mining_notification->prev_block_hash);
-    TEST_ASSERT_EQUAL_STRING("01000000010000000000000000000000000000000000000000000000000000000000000000ffffffff4b03a5020cfabe6d6d379ae882651f6469f2ed6b8b40a4f9a4b41fd838a3ad6de8cba775f4e8f1d3080100000000000000", stratum_api_v1_message.mining_notification->coinbase_1);
-    TEST_ASSERT_EQUAL_STRING("41903d4c1b2f736c7573682f0000000003ca890d27000000001976a9147c154ed1dc59609e3d26abb2df2ea3d587cd8c4188ac00000000000000002c6a4c2952534b424c4f434b3a4cb4cb2ddfc37c41baf5ef6b6b4899e3253a8f1dfc7e5dd68a5b5b27005014ef0000000000000000266a24aa21a9ed5caa249f1af9fbf71c986fea8e076ca34ae3514fb2f86400561b28c7b15949bf00000000", stratum_api_v1_message.mining_notification->coinbase_2);
+    mining_notify * notify = stratum_api_v1_message.mining_notification;
+
+    char hex[512];
+    bin2hex(notify->prev_block_hash, 32, hex, sizeof(hex));
+    TEST_ASSERT_EQUAL_STRING("ef4b9a48c7986466de4adc002f7337a6e121bc43000376ea0000000000000000", hex);
+    bin2hex(notify->coinbase_1, notify->coinbase_1_len, hex, sizeof(hex));
+    TEST_ASSERT_EQUAL_STRING("01000000010000000000000000000000000000000000000000000000000000000000000000ffffffff4b03a5020cfabe6d6d379ae882651f6469f2ed6b8b40a4f9a4b41fd838a3ad6de8cba775f4e8f1d3080100000000000000", hex);
+    bin2hex(notify->coinbase_2, notify->coinbase_2_len, hex, sizeof(hex));
+    TEST_ASSERT_EQUAL_STRING("41903d4c1b2f736c7573682f0000000003ca890d27000000001976a9147c154ed1dc59609e3d26abb2df2ea3d587cd8c4188ac00000000000000002c6a4c2952534b424c4f434b3a4cb4cb2ddfc37c41baf5ef6b6b4899e3253a8f1dfc7e5dd68a5b5b27005014ef0000000000000000266a24aa21a9ed5caa249f1af9fbf71c986fea8e076ca34ae3514fb2f86400561b28c7b15949bf00000000", hex);
+    TEST_ASSERT_EQUAL(12, notify->n_merkle_branches);
     TEST_ASSERT_EQUAL_UINT32(0x20000004, stratum_api_v1_message.mining_notification->version);
     TEST_ASSERT_EQUAL_UINT32(0x1705c739, stratum_api_v1_message.mining_notification->target);
     TEST_ASSERT_EQUAL_UINT32(0x64495522, stratum_api_v1_message.mining_notification->ntime);
@@ -105,6 +117,49 @@ TEST_CASE("Parse stratum notify params", "[mining.notify]")
 //     TEST_ASSERT_EQUAL_INT(extranonce2_len, 4);
 // }
 
+TEST_CASE("Parse stratum mining.subscribe result session id", "[mining.subscribe]")
+{
+    StratumApiV1Message stratum_api_v1_message = {};
+    const char * json_string = "{\"result\":["
+        "[[\"mining.set_difficulty\",\"1\"],"
+        "[\"mining.notify\",\"731ec5e0649606ff\"]],"
+        "\"e9695791\",4],"
+        "\"id\":2,\"error\":null}";
+    STRATUM_V1_parse(&stratum_api_v1_message, json_string);
+    TEST_ASSERT_EQUAL(STRATUM_RESULT_SUBSCRIBE, stratum_api_v1_message.method);
+    TEST_ASSERT_EQUAL_STRING("e9695791", stratum_api_v1_message.extranonce_str);
+    TEST_ASSERT_EQUAL_INT(4, stratum_api_v1_message.extranonce_2_len);
+    TEST_ASSERT_EQUAL_STRING("731ec5e0649606ff", stratum_api_v1_message.session_id);
+    free(stratum_api_v1_message.extranonce_str);
+    free(stratum_api_v1_message.session_id);
+
+    // a single subscription pair
+    json_string = "{\"id\":2,\"result\":[[\"mining.notify\",\"ae6812eb4cd7735a\"],\"08000002\",4],\"error\":null}";
+    STRATUM_V1_parse(&stratum_api_v1_message, json_string);
+    TEST_ASSERT_EQUAL_STRING("ae6812eb4cd7735a", stratum_api_v1_message.session_id);
+    free(stratum_api_v1_message.extranonce_str);
+    free(stratum_api_v1_message.session_id);
+
+    // ids that would need escaping in the mining.subscribe that offers them back are not kept
+    json_string = "{\"id\":2,\"result\":[[\"mining.notify\",\"ae68\\\"], \\\"x\"],\"08000002\",4],\"error\":null}";
+    STRATUM_V1_parse(&stratum_api_v1_message, json_string);
+    TEST_ASSERT_EQUAL(STRATUM_RESULT_SUBSCRIBE, stratum_api_v1_message.method);
+    TEST_ASSERT_NULL(stratum_api_v1_message.session_id);
+    free(stratum_api_v1_message.extranonce_str);
+
+    json_string = "{\"id\":2,\"result\":[[\"mining.notify\",\"ae68 12eb\"],\"08000002\",4],\"error\":null}";
+    STRATUM_V1_parse(&stratum_api_v1_message, json_string);
+    TEST_ASSERT_NULL(stratum_api_v1_message.session_id);
+    free(stratum_api_v1_message.extranonce_str);
+
+    // pools without session ids
+    json_string = "{\"id\":2,\"result\":[[],\"08000002\",4],\"error\":null}";
+    STRATUM_V1_parse(&stratum_api_v1_message, json_string);
+    TEST_ASSERT_EQUAL(STRATUM_RESULT_SUBSCRIBE, stratum_api_v1_message.method);
+    TEST_ASSERT_NULL(stratum_api_v1_message.session_id);
+    free(stratum_api_v1_message.extranonce_str);
+}
+
 TEST_CASE("Parse stratum mining.set_version_mask params", "[stratum]")
 {
     StratumApiV1Message stratum_api_v1_message = {};
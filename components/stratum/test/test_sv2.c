@@ -0,0 +1,380 @@
+#include "unity.h"
+#include "mining.h"
+#include "stratum_decode.h"
+#include "stratum_v2_api.h"
+#include "sv2_crypto.h"
+#include "sv2_noise.h"
+#include "sv2_protocol.h"
+#include "utils.h"
+#include <string.h>
+
+// in-memory pool stand-in: the responder end of the handshake plus a message writer
+typedef struct
+{
+    uint8_t authority_secret[32];
+    uint8_t authority_key[32];
+    uint8_t static_secret[32];
+    uint8_t static_ellswift[SV2_ELLSWIFT_LEN];
+    sv2_certificate certificate;
+    sv2_noise_handshake handshake;
+    sv2_noise_transport transport;
+} pool_stand_in;
+
+static void pool_init(pool_stand_in *pool, uint32_t valid_from, uint32_t not_valid_after)
+{
+    uint8_t server_key[32];
+
+    memset(pool, 0, sizeof(*pool));
+    memset(pool->authority_secret, 0x11, 32);
+    TEST_ASSERT_EQUAL(0, sv2_schnorr_pubkey(pool->authority_secret, pool->authority_key));
+    TEST_ASSERT_EQUAL(0, sv2_ellswift_create(pool->static_secret, pool->static_ellswift));
+    TEST_ASSERT_EQUAL(0, sv2_ellswift_decode(pool->static_ellswift, server_key));
+    pool->certificate.valid_from = valid_from;
+    pool->certificate.not_valid_after = not_valid_after;
+    TEST_ASSERT_EQUAL(0, sv2_certificate_sign(&pool->certificate, pool->authority_secret, server_key));
+}
+
+static void connect_client(stratum_v2_client *client, pool_stand_in *pool)
+{
+    uint8_t act1[SV2_NOISE_ACT1_LEN];
+    uint8_t act2[SV2_NOISE_ACT2_LEN];
+
+    STRATUM_V2_init(client);
+    TEST_ASSERT_EQUAL(0, STRATUM_V2_handshake_start(client, act1));
+    TEST_ASSERT_EQUAL(0, sv2_noise_responder_reply(&pool->handshake, act1, pool->static_secret, pool->static_ellswift,
+                                                   &pool->certificate, act2, &pool->transport));
+    TEST_ASSERT_EQUAL(0, STRATUM_V2_handshake_finish(client, act2, pool->authority_key, 1500));
+}
+
+// encrypt a pool message and run it through the client like the stratum task does
+static void pool_send(stratum_v2_client *client, pool_stand_in *pool, uint16_t extension_type, uint8_t msg_type,
+                      const uint8_t *payload, size_t len, stratum_v2_event *event)
+{
+    uint8_t frame[SV2_FRAME_HEADER_LEN + 128];
+    uint8_t wire[sizeof(frame) + 2 * SV2_NOISE_MAC_LEN];
+    uint8_t plain[128];
+    sv2_frame_header header = {extension_type, msg_type, len};
+
+    sv2_write_frame_header(&header, frame);
+    memcpy(frame + SV2_FRAME_HEADER_LEN, payload, len);
+    int wire_len = sv2_noise_encrypt_frame(&pool->transport, frame, SV2_FRAME_HEADER_LEN + len, wire, sizeof(wire));
+    TEST_ASSERT_EQUAL(sv2_noise_encrypted_frame_len(len), wire_len);
+
+    sv2_frame_header received;
+    TEST_ASSERT_EQUAL(0, STRATUM_V2_decrypt_header(client, wire, &received));
+    TEST_ASSERT_EQUAL(len, received.length);
+    TEST_ASSERT_EQUAL(wire_len - SV2_ENCRYPTED_HEADER_LEN, STRATUM_V2_payload_wire_len(&received));
+    TEST_ASSERT_EQUAL(0, STRATUM_V2_decrypt_payload(client, wire + SV2_ENCRYPTED_HEADER_LEN, &received, plain));
+    STRATUM_V2_handle_frame(client, &received, plain, event);
+}
+
+static size_t put_u32(uint8_t *p, uint32_t value)
+{
+    for (int i = 0; i < 4; i++)
+        p[i] = value >> (8 * i);
+    return 4;
+}
+
+TEST_CASE("BIP340 signatures verify", "[stratum v2]")
+{
+    uint8_t pubkey[32], msg[32] = {0}, sig[64];
+
+    // test vector 0 of BIP340
+    hex2bin("f9308a019258c31049344f85f89d5229b531c845836f99b08601f113bce036f9", pubkey, 32);
+    hex2bin("e907831f80848d1069a5371b402410364bdf1c5f8307b0084c55f1ce2dca821525f66a4a85ea8b71e482a74f382d2ce5ebeee8fdb2172f477df4900d310536c0",
+            sig, 64);
+    TEST_ASSERT_EQUAL(0, sv2_schnorr_verify(pubkey, msg, sig));
+    sig[10] ^= 1;
+    TEST_ASSERT_NOT_EQUAL(0, sv2_schnorr_verify(pubkey, msg, sig));
+
+    uint8_t secret[32] = {0};
+    secret[31] = 3;
+    TEST_ASSERT_EQUAL(0, sv2_schnorr_pubkey(secret, pubkey));
+    TEST_ASSERT_EQUAL(0, sv2_schnorr_sign(secret, msg, sig));
+    TEST_ASSERT_EQUAL(0, sv2_schnorr_verify(pubkey, msg, sig));
+}
+
+TEST_CASE("ElligatorSwift keys agree on a shared secret", "[stratum v2]")
+{
+    uint8_t secret_a[32], ell_a[SV2_ELLSWIFT_LEN], secret_b[32], ell_b[SV2_ELLSWIFT_LEN];
+    uint8_t shared_a[32], shared_b[32], x[32], pubkey[32];
+
+    TEST_ASSERT_EQUAL(0, sv2_ellswift_create(secret_a, ell_a));
+    TEST_ASSERT_EQUAL(0, sv2_ellswift_create(secret_b, ell_b));
+
+    // the encoding decodes back to the public key
+    TEST_ASSERT_EQUAL(0, sv2_ellswift_decode(ell_a, x));
+    TEST_ASSERT_EQUAL(0, sv2_schnorr_pubkey(secret_a, pubkey));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(pubkey, x, 32);
+
+    TEST_ASSERT_EQUAL(0, sv2_ellswift_ecdh(secret_a, ell_a, ell_b, true, shared_a));
+    TEST_ASSERT_EQUAL(0, sv2_ellswift_ecdh(secret_b, ell_a, ell_b, false, shared_b));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(shared_a, shared_b, 32);
+}
+
+TEST_CASE("ElligatorSwift decodes match BIP324 reference values", "[stratum v2]")
+{
+    // the first is the published BIP324 vector, the others were computed with a separate implementation
+    // of XSwiftEC to cover its special cases: u and t at or above p, u = 0, t = 0 and u^3 + t^2 + 7 = 0
+    static const char *vectors[][2] = {
+        {"00000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000",
+         "edd1fd3e327ce90cc7a3542614289aee9682003e9cf7dcc9cf2ca9743be5aa0c"},
+        {"fffffffffffffffffffffffffffffffffffffffffffffffffffffffefffffc2f0000000000000000000000000000000000000000000000000000000000000000",
+         "edd1fd3e327ce90cc7a3542614289aee9682003e9cf7dcc9cf2ca9743be5aa0c"},
+        {"ffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffe3b98a4da31a127d4bde6e43033f66ba274cab0eb7eb1c70ec41402bf6273dd8",
+         "a6643ac87afe4398ad73b665caca75caaa6b95a7e10443088f72e6914a7f8b39"},
+        {"0000000000000000000000000000000000000000000000000000000000000005350ae3b48047adacdeea49fb8a0b289a94f726801078408aba79631fa7a1b6ba",
+         "aaee74bef85ee588ed43aa2a45b30e457127b97a48a8cfdff4de85545d2f1ccf"},
+        {"0bfe935e70c321c7ca3afc75ce0d0ca2f98b5422e008bb31c00c6d7f1f1c0ad6fffffffffffffffffffffffffffffffffffffffffffffffffffffffefffffc34",
+         "8ce24141168ac6612f0fec06449ae99df8f977b4ba8a848fa4f346d6cb5b78f8"},
+    };
+    uint8_t ell[SV2_ELLSWIFT_LEN], expected[32], x[32];
+
+    for (int i = 0; i < sizeof(vectors) / sizeof(vectors[0]); i++)
+    {
+        hex2bin(vectors[i][0], ell, SV2_ELLSWIFT_LEN);
+        hex2bin(vectors[i][1], expected, 32);
+        TEST_ASSERT_EQUAL(0, sv2_ellswift_decode(ell, x));
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, x, 32);
+    }
+}
+
+TEST_CASE("ElligatorSwift ECDH matches BIP324 reference values", "[stratum v2]")
+{
+    uint8_t secret[32], ours[SV2_ELLSWIFT_LEN], theirs[SV2_ELLSWIFT_LEN], expected[32], shared[32];
+
+    hex2bin("3e11dc9536584bcc0bf06a75f165017091022addc6ea28f4e56aaa62fb5b6116", secret, 32);
+    hex2bin("334d1d2efc6c08001807472cc6c7271c1c75a4d0ff50ba4dfc2878d48578c0df5c5597e923643014ef6547552cefb52e9c09bf94300dfecddcbfd5b8b16be826",
+            ours, SV2_ELLSWIFT_LEN);
+
+    // initiating: the tagged hash covers our encoding first
+    hex2bin("ffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffe3b98a4da31a127d4bde6e43033f66ba274cab0eb7eb1c70ec41402bf6273dd8",
+            theirs, SV2_ELLSWIFT_LEN);
+    hex2bin("0875789efa51bdbac28d34d4b4eaf23f500f5d829b94cd1b30db957603ae55f3", expected, 32);
+    TEST_ASSERT_EQUAL(0, sv2_ellswift_ecdh(secret, ours, theirs, true, shared));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, shared, 32);
+
+    // responding: theirs first
+    hex2bin("0000000000000000000000000000000000000000000000000000000000000005350ae3b48047adacdeea49fb8a0b289a94f726801078408aba79631fa7a1b6ba",
+            theirs, SV2_ELLSWIFT_LEN);
+    hex2bin("524ed3ca0b5c11bf57d8b7e2ae9ecd7a8629899910497e0577670f7170a57828", expected, 32);
+    TEST_ASSERT_EQUAL(0, sv2_ellswift_ecdh(secret, theirs, ours, false, shared));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, shared, 32);
+}
+
+TEST_CASE("Noise handshake reproduces a reference transcript", "[stratum v2]")
+{
+    // recorded from a separate implementation of the handshake with fixed keys: initiator ephemeral key,
+    // the pool's answer (ephemeral key, encrypted static key, encrypted certificate valid from 1000 to 2000
+    // signed by the 0x11.. authority), the resulting transport keys and a first encrypted frame
+    static sv2_noise_handshake handshake;
+    static sv2_noise_transport transport;
+    uint8_t e_secret[32], e_ellswift[SV2_ELLSWIFT_LEN], act1[SV2_NOISE_ACT1_LEN], act2[SV2_NOISE_ACT2_LEN];
+    uint8_t authority_key[32], server_key[32], expected[42];
+    const uint8_t frame[] = {0x00, 0x00, 0x00, 0x04, 0x00, 0x00, 0x01, 0x02, 0x03, 0x04};
+    uint8_t wire[sizeof(expected)];
+
+    hex2bin("620be318ccfe9b1685ba2954a24c1b57f2cec0e57e5e2e0ae7c831e91d14309f", e_secret, 32);
+    hex2bin("0495bc30cf39041bbb384a7396a200d7a8280bf2a9bf4c8c779d1344805e35537c7bd9dcb86acc4dc67ff31a3c8ae1e8d9f8c895d63b23c932977ff70bc04675",
+            e_ellswift, SV2_ELLSWIFT_LEN);
+    hex2bin("07a1157bed986ceae5e8b35cd65c48f5fa784f397591bc0573ea5c8e3ada66799ced7f861e3559d832af547fb06413bae17a87b30db7bb73fc0b51e3b862289f"
+            "a7bb656fd03689b00ae6673f8ce081204ba0f59b3f894a79e876ee4cba4b5475df8a609de0388d1ff37c16278359dd4ac3aa1fe2e68c7eb2b26ff546ee807ca6"
+            "2c2bc4bb330fa56e29a363f52239ac42eb204a70f74632deb1949b39134aca84129bee53dd3b04c20a58fede9d7e6e3807d6b49092fbef369a734d21f6efb17b"
+            "584b624b1d035bc761b8caa115b5e76e55cb60c9ae97a772eadcd300ff47eab5463b603bd80005e6e4c6",
+            act2, SV2_NOISE_ACT2_LEN);
+    hex2bin("4f355bdcb7cc0af728ef3cceb9615d90684bb5b2ca5f859ab0f0b704075871aa", authority_key, 32);
+
+    TEST_ASSERT_EQUAL(0, sv2_noise_initiator_start_with_key(&handshake, e_secret, e_ellswift, act1));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(e_ellswift, act1, SV2_NOISE_ACT1_LEN);
+    TEST_ASSERT_EQUAL(0, sv2_noise_initiator_finish(&handshake, act2, authority_key, 1500, &transport, server_key));
+
+    hex2bin("5c16c4b4c8b9e5d72d7ea4bfdada7ac7d89e8a7e2a6d948c5e2c76f1d655b52b", expected, 32);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, server_key, 32);
+    hex2bin("f145c448394331f0ec803e485c1a2399b11b61b928c59af7975a0f543428e458", expected, 32);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, transport.send.key, 32);
+    hex2bin("017b49deaf2bba6169de31ee8c956e7f5fabff1cb85ee55dad5fc4aaece8f889", expected, 32);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, transport.recv.key, 32);
+
+    hex2bin("6a6323fa2e6d935fc479d8eb275a1215e2c30ff4906620e066b3283875d87a8633025a3fb1b408fa5028", expected, sizeof(expected));
+    TEST_ASSERT_EQUAL(sizeof(expected), sv2_noise_encrypt_frame(&transport, frame, sizeof(frame), wire, sizeof(wire)));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, wire, sizeof(expected));
+}
+
+TEST_CASE("Noise handshake checks the pool certificate", "[stratum v2]")
+{
+    static pool_stand_in pool;
+    static stratum_v2_client client;
+    uint8_t act1[SV2_NOISE_ACT1_LEN];
+    uint8_t act2[SV2_NOISE_ACT2_LEN];
+    uint8_t other_authority[32], other_secret[32];
+
+    pool_init(&pool, 1000, 2000);
+    connect_client(&client, &pool);
+
+    // signed by someone else
+    memset(other_secret, 0x22, 32);
+    sv2_schnorr_pubkey(other_secret, other_authority);
+    STRATUM_V2_init(&client);
+    STRATUM_V2_handshake_start(&client, act1);
+    sv2_noise_responder_reply(&pool.handshake, act1, pool.static_secret, pool.static_ellswift, &pool.certificate, act2, &pool.transport);
+    TEST_ASSERT_NOT_EQUAL(0, STRATUM_V2_handshake_finish(&client, act2, other_authority, 1500));
+
+    // expired
+    STRATUM_V2_init(&client);
+    STRATUM_V2_handshake_start(&client, act1);
+    sv2_noise_responder_reply(&pool.handshake, act1, pool.static_secret, pool.static_ellswift, &pool.certificate, act2, &pool.transport);
+    TEST_ASSERT_NOT_EQUAL(0, STRATUM_V2_handshake_finish(&client, act2, pool.authority_key, 2001));
+
+    // tampered in transit
+    STRATUM_V2_init(&client);
+    STRATUM_V2_handshake_start(&client, act1);
+    sv2_noise_responder_reply(&pool.handshake, act1, pool.static_secret, pool.static_ellswift, &pool.certificate, act2, &pool.transport);
+    act2[SV2_NOISE_ACT2_LEN - 1] ^= 1;
+    TEST_ASSERT_NOT_EQUAL(0, STRATUM_V2_handshake_finish(&client, act2, NULL, 0));
+}
+
+TEST_CASE("Stratum V2 client messages reach the pool intact", "[stratum v2]")
+{
+    static pool_stand_in pool;
+    static stratum_v2_client client;
+    uint8_t wire[STRATUM_V2_SEND_BUFFER_SIZE];
+    uint8_t header_plain[SV2_FRAME_HEADER_LEN];
+    uint8_t payload[256];
+    sv2_frame_header header;
+
+    pool_init(&pool, 0, UINT32_MAX);
+    connect_client(&client, &pool);
+
+    sv2_setup_connection setup = {"pool.example", 3336, "bitaxe", "BM1366", "v2.4.0", "bitaxe-1"};
+    int len = STRATUM_V2_setup_connection(&client, wire, sizeof(wire), &setup);
+    TEST_ASSERT_GREATER_THAN(0, len);
+    TEST_ASSERT_EQUAL(0, sv2_noise_decrypt_header(&pool.transport, wire, header_plain));
+    sv2_read_frame_header(header_plain, &header);
+    TEST_ASSERT_EQUAL(SV2_SETUP_CONNECTION, header.msg_type);
+    TEST_ASSERT_EQUAL(len, sv2_noise_encrypted_frame_len(header.length));
+    TEST_ASSERT_EQUAL(0, sv2_noise_decrypt_payload(&pool.transport, wire + SV2_ENCRYPTED_HEADER_LEN, header.length, payload));
+    TEST_ASSERT_EQUAL(SV2_PROTOCOL_MINING, payload[0]);
+    TEST_ASSERT_EQUAL(SV2_REQUIRES_STANDARD_JOBS | SV2_REQUIRES_VERSION_ROLLING, payload[5]);
+    TEST_ASSERT_EQUAL(12, payload[9]);
+    TEST_ASSERT_EQUAL_MEMORY("pool.example", payload + 10, 12);
+
+    TEST_ASSERT_EQUAL(-1, STRATUM_V2_submit_share(&client, wire, sizeof(wire), 42, 3, 0xdeadbeef, 0x66000000, 0x20002000));
+    client.channel_id = 7;
+    client.channel_open = true;
+    len = STRATUM_V2_submit_share(&client, wire, sizeof(wire), 42, 3, 0xdeadbeef, 0x66000000, 0x20002000);
+    TEST_ASSERT_EQUAL(SV2_ENCRYPTED_HEADER_LEN + 24 + SV2_NOISE_MAC_LEN, len);
+    TEST_ASSERT_EQUAL(0, sv2_noise_decrypt_header(&pool.transport, wire, header_plain));
+    sv2_read_frame_header(header_plain, &header);
+    TEST_ASSERT_EQUAL(SV2_CHANNEL_MSG_BIT, header.extension_type);
+    TEST_ASSERT_EQUAL(SV2_SUBMIT_SHARES_STANDARD, header.msg_type);
+    TEST_ASSERT_EQUAL(0, sv2_noise_decrypt_payload(&pool.transport, wire + SV2_ENCRYPTED_HEADER_LEN, header.length, payload));
+    const uint8_t expected[24] = {7, 0, 0, 0, 42, 0, 0, 0, 3, 0, 0, 0, 0xef, 0xbe, 0xad, 0xde, 0, 0, 0, 0x66, 0, 0x20, 0, 0x20};
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, payload, 24);
+}
+
+TEST_CASE("Stratum V2 jobs become header-only notifies", "[stratum v2]")
+{
+    static pool_stand_in pool;
+    static stratum_v2_client client;
+    stratum_v2_event event;
+    uint8_t payload[128];
+    size_t len;
+
+    pool_init(&pool, 0, UINT32_MAX);
+    connect_client(&client, &pool);
+
+    // OpenStandardMiningChannel.Success with the target of difficulty 1024
+    len = put_u32(payload, 1);
+    len += put_u32(payload + len, 7);
+    difficulty_to_target(1024, payload + len);
+    len += 32;
+    payload[len++] = 4;
+    len += put_u32(payload + len, 0x01020304);
+    len += put_u32(payload + len, 0);
+    pool_send(&client, &pool, 0, SV2_OPEN_STANDARD_MINING_CHANNEL_SUCCESS, payload, len, &event);
+    TEST_ASSERT_EQUAL(STRATUM_V2_CHANNEL_OPENED, event.type);
+    TEST_ASSERT_EQUAL(1024, event.difficulty);
+    TEST_ASSERT_EQUAL(7, client.channel_id);
+
+    // a future job waits for its prev hash
+    uint8_t merkle_root[32];
+    for (int i = 0; i < 32; i++)
+        merkle_root[i] = i;
+    len = put_u32(payload, 7);
+    len += put_u32(payload + len, 5);
+    payload[len++] = 0;
+    len += put_u32(payload + len, 0x20000000);
+    payload[len++] = 32;
+    memcpy(payload + len, merkle_root, 32);
+    len += 32;
+    pool_send(&client, &pool, SV2_CHANNEL_MSG_BIT, SV2_NEW_MINING_JOB, payload, len, &event);
+    TEST_ASSERT_EQUAL(STRATUM_V2_NONE, event.type);
+
+    uint8_t prev_hash[32];
+    memset(prev_hash, 0, 32);
+    prev_hash[0] = 0xaa;
+    prev_hash[4] = 0xbb;
+    len = put_u32(payload, 7);
+    len += put_u32(payload + len, 5);
+    memcpy(payload + len, prev_hash, 32);
+    len += 32;
+    len += put_u32(payload + len, 0x66000000);
+    len += put_u32(payload + len, 0x17034219);
+    pool_send(&client, &pool, SV2_CHANNEL_MSG_BIT, SV2_SET_NEW_PREV_HASH, payload, len, &event);
+    TEST_ASSERT_EQUAL(STRATUM_V2_NEW_WORK, event.type);
+
+    mining_notify *notify = event.mining_notification;
+    TEST_ASSERT_EQUAL_STRING("5", notify->job_id);
+    TEST_ASSERT_TRUE(notify->has_merkle_root);
+    TEST_ASSERT_TRUE(notify->clean_jobs);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(merkle_root, notify->merkle_root, 32);
+    TEST_ASSERT_EQUAL_HEX32(0x20000000, notify->version);
+    TEST_ASSERT_EQUAL_HEX32(0x17034219, notify->target);
+    TEST_ASSERT_EQUAL_HEX32(0x66000000, notify->ntime);
+    // stored with the byte swapped words of mining.notify
+    TEST_ASSERT_EQUAL_HEX8(0xaa, notify->prev_block_hash[3]);
+    TEST_ASSERT_EQUAL_HEX8(0xbb, notify->prev_block_hash[7]);
+
+    // the job builder sees the block header bytes the pool hashed
+    bm_job job = construct_bm_job(notify, notify->merkle_root, 0x1fffe000, 1024, JOB_FORMAT_HEADER);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(prev_hash, job.prev_block_hash, 32);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(merkle_root, job.merkle_root, 32);
+    STRATUM_V1_free_mining_notify(notify);
+
+    // jobs with min_ntime are live on the current prev hash
+    len = put_u32(payload, 7);
+    len += put_u32(payload + len, 6);
+    payload[len++] = 1;
+    len += put_u32(payload + len, 0x66000010);
+    len += put_u32(payload + len, 0x20000000);
+    payload[len++] = 32;
+    memcpy(payload + len, merkle_root, 32);
+    len += 32;
+    pool_send(&client, &pool, SV2_CHANNEL_MSG_BIT, SV2_NEW_MINING_JOB, payload, len, &event);
+    TEST_ASSERT_EQUAL(STRATUM_V2_NEW_WORK, event.type);
+    TEST_ASSERT_EQUAL_STRING("6", event.mining_notification->job_id);
+    TEST_ASSERT_FALSE(event.mining_notification->clean_jobs);
+    TEST_ASSERT_EQUAL_HEX32(0x66000010, event.mining_notification->ntime);
+    STRATUM_V1_free_mining_notify(event.mining_notification);
+
+    // SubmitShares.Success acknowledges everything up to a sequence number
+    len = put_u32(payload, 7);
+    len += put_u32(payload + len, 12);
+    len += put_u32(payload + len, 3);
+    memset(payload + len, 0, 8);
+    len += 8;
+    pool_send(&client, &pool, SV2_CHANNEL_MSG_BIT, SV2_SUBMIT_SHARES_SUCCESS, payload, len, &event);
+    TEST_ASSERT_EQUAL(STRATUM_V2_SHARES_ACCEPTED, event.type);
+    TEST_ASSERT_EQUAL(12, event.sequence_number);
+    TEST_ASSERT_EQUAL(3, event.accepted_count);
+
+    len = put_u32(payload, 7);
+    len += put_u32(payload + len, 13);
+    payload[len++] = 18;
+    memcpy(payload + len, "difficulty-too-low", 18);
+    len += 18;
+    pool_send(&client, &pool, SV2_CHANNEL_MSG_BIT, SV2_SUBMIT_SHARES_ERROR, payload, len, &event);
+    TEST_ASSERT_EQUAL(STRATUM_V2_SHARE_REJECTED, event.type);
+    TEST_ASSERT_EQUAL(13, event.sequence_number);
+    TEST_ASSERT_EQUAL_STRING("difficulty-too-low", event.error);
+}
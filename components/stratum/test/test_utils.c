@@ -1,5 +1,7 @@
 #include "unity.h"
 #include "utils.h"
+#include "esp_timer.h"
+#include <stdio.h>
 #include <string.h>
 
 TEST_CASE("Test double sha", "[utils]")
@@ -44,3 +46,174 @@ TEST_CASE("Test hex2char", "[utils]")
     result = hex2char(16, &output);
     TEST_ASSERT_EQUAL(-1, result);
 }
+
+// reference copies of the previous branch and sscanf based codecs
+static uint8_t ref_hex2val(char c)
+{
+    if (c >= '0' && c <= '9')
+    {
+        return c - '0';
+    }
+    else if (c >= 'a' && c <= 'f')
+    {
+        return c - 'a' + 10;
+    }
+    else if (c >= 'A' && c <= 'F')
+    {
+        return c - 'A' + 10;
+    }
+    return 0;
+}
+
+static size_t ref_hex2bin(const char *hex, uint8_t *bin, size_t bin_len)
+{
+    size_t len = 0;
+
+    while (*hex && len < bin_len)
+    {
+        bin[len] = ref_hex2val(*hex++) << 4;
+
+        if (!*hex)
+        {
+            len++;
+            break;
+        }
+
+        bin[len++] |= ref_hex2val(*hex++);
+    }
+
+    return len;
+}
+
+static int ref_hex2char(uint8_t x, char *c)
+{
+    if (x <= 9)
+    {
+        *c = x + '0';
+    }
+    else if (x <= 15)
+    {
+        *c = x - 10 + 'a';
+    }
+    else
+    {
+        return -1;
+    }
+    return 0;
+}
+
+static size_t ref_bin2hex(const uint8_t *buf, size_t buflen, char *hex, size_t hexlen)
+{
+    for (size_t i = 0; i < buflen; i++)
+    {
+        ref_hex2char(buf[i] >> 4, &hex[2 * i]);
+        ref_hex2char(buf[i] & 0xf, &hex[2 * i + 1]);
+    }
+    hex[2 * buflen] = '\0';
+    return 2 * buflen;
+}
+
+static void ref_swap_endian_words(const char *hex_words, uint8_t *output)
+{
+    size_t binary_length = strlen(hex_words) / 2;
+
+    for (size_t i = 0; i < binary_length; i += 4)
+    {
+        for (int j = 0; j < 4; j++)
+        {
+            unsigned int byte_val;
+            sscanf(hex_words + (i + j) * 2, "%2x", &byte_val);
+            output[i + (3 - j)] = byte_val;
+        }
+    }
+}
+
+static const char *hash_hex = "bf44fd3513dc7b837d60e5c628b572b448d204a8000007490000000000000000";
+
+TEST_CASE("Test hex codec matches reference", "[utils]")
+{
+    uint8_t bin[64];
+    uint8_t expected_bin[64];
+    char hex[129];
+    char expected_hex[129];
+
+    for (int i = 0; i < 64; i++)
+    {
+        bin[i] = i * 37 + 11;
+    }
+    bin2hex(bin, 64, hex, sizeof(hex));
+    ref_bin2hex(bin, 64, expected_hex, sizeof(expected_hex));
+    TEST_ASSERT_EQUAL_STRING(expected_hex, hex);
+
+    // upper case, invalid digits and odd lengths decode like before
+    const char *inputs[] = {"48454C4C4F", "0123456789abcdefABCDEF", "zz12", "abc", "", hash_hex};
+    for (int i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++)
+    {
+        memset(bin, 0xaa, sizeof(bin));
+        memset(expected_bin, 0xaa, sizeof(expected_bin));
+        TEST_ASSERT_EQUAL(ref_hex2bin(inputs[i], expected_bin, 32), hex2bin(inputs[i], bin, 32));
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(expected_bin, bin, 64);
+    }
+
+    // bin_len shorter than the input
+    TEST_ASSERT_EQUAL(2, hex2bin(hash_hex, bin, 2));
+    TEST_ASSERT_EQUAL_HEX8(0xbf, bin[0]);
+    TEST_ASSERT_EQUAL_HEX8(0x44, bin[1]);
+}
+
+TEST_CASE("Test swap endian words matches reference", "[utils]")
+{
+    uint8_t expected[32];
+    uint8_t output[32];
+    uint8_t raw[32];
+
+    ref_swap_endian_words(hash_hex, expected);
+    swap_endian_words(hash_hex, output);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, output, 32);
+
+    reverse_bytes(expected, 32);
+    hex2bin(hash_hex, raw, 32);
+    swap_reverse_words_bin(raw, output, 32);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, output, 32);
+}
+
+TEST_CASE("Benchmark hex codec", "[utils bench][not-on-qemu]")
+{
+    const int iterations = 1000;
+    uint8_t bin[32];
+    char hex[65];
+
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++) {
+        ref_swap_endian_words(hash_hex, bin);
+        reverse_bytes(bin, 32);
+    }
+    int64_t ref_swap_us = esp_timer_get_time() - start;
+
+    start = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++) {
+        swap_endian_words(hash_hex, bin);
+        reverse_bytes(bin, 32);
+    }
+    int64_t swap_us = esp_timer_get_time() - start;
+
+    start = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++) {
+        ref_hex2bin(hash_hex, bin, 32);
+        ref_bin2hex(bin, 32, hex, sizeof(hex));
+    }
+    int64_t ref_codec_us = esp_timer_get_time() - start;
+
+    start = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++) {
+        hex2bin(hash_hex, bin, 32);
+        bin2hex(bin, 32, hex, sizeof(hex));
+    }
+    int64_t codec_us = esp_timer_get_time() - start;
+
+    printf("32 byte swap + reverse: sscanf %.2f us, table %.2f us\n",
+           (double) ref_swap_us / iterations, (double) swap_us / iterations);
+    printf("32 byte hex2bin + bin2hex: branches %.2f us, table %.2f us\n",
+           (double) ref_codec_us / iterations, (double) codec_us / iterations);
+    TEST_ASSERT_LESS_THAN(ref_swap_us, swap_us);
+}
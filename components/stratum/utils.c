@@ -3,7 +3,7 @@
 #include <string.h>
 #include <stdio.h>
 
-#include "mbedtls/sha256.h"
+#include "sha256d.h"
 
 #ifndef bswap_16
 #define bswap_16(a) ((((uint16_t)(a) << 8) & 0xff00) | (((uint16_t)(a) >> 8) & 0xff))
@@ -59,21 +59,28 @@ void flip32bytes(void *dest_p, const void *src_p)
         dest[i] = swab32(src[i]);
 }
 
+static const char hex_digits[16] = "0123456789abcdef";
+
+// hex digit to nibble, anything that is not a hex digit decodes as 0
+static const uint8_t hex_values[256] = {
+    ['0'] = 0, ['1'] = 1, ['2'] = 2, ['3'] = 3, ['4'] = 4, ['5'] = 5, ['6'] = 6, ['7'] = 7, ['8'] = 8, ['9'] = 9,
+    ['a'] = 10, ['b'] = 11, ['c'] = 12, ['d'] = 13, ['e'] = 14, ['f'] = 15,
+    ['A'] = 10, ['B'] = 11, ['C'] = 12, ['D'] = 13, ['E'] = 14, ['F'] = 15,
+};
+
+static inline uint8_t hex_byte(const char *hex)
+{
+    return (hex_values[(uint8_t)hex[0]] << 4) | hex_values[(uint8_t)hex[1]];
+}
+
 int hex2char(uint8_t x, char *c)
 {
-    if (x <= 9)
-    {
-        *c = x + '0';
-    }
-    else if (x <= 15)
-    {
-        *c = x - 10 + 'a';
-    }
-    else
+    if (x > 15)
     {
         return -1;
     }
 
+    *c = hex_digits[x];
     return 0;
 }
 
@@ -86,14 +93,8 @@ size_t bin2hex(const uint8_t *buf, size_t buflen, char *hex, size_t hexlen)
 
     for (size_t i = 0; i < buflen; i++)
     {
-        if (hex2char(buf[i] >> 4, &hex[2 * i]) < 0)
-        {
-            return 0;
-        }
-        if (hex2char(buf[i] & 0xf, &hex[2 * i + 1]) < 0)
-        {
-            return 0;
-        }
+        hex[2 * i] = hex_digits[buf[i] >> 4];
+        hex[2 * i + 1] = hex_digits[buf[i] & 0xf];
     }
 
     hex[2 * buflen] = '\0';
@@ -102,39 +103,23 @@ size_t bin2hex(const uint8_t *buf, size_t buflen, char *hex, size_t hexlen)
 
 uint8_t hex2val(char c)
 {
-    if (c >= '0' && c <= '9')
-    {
-        return c - '0';
-    }
-    else if (c >= 'a' && c <= 'f')
-    {
-        return c - 'a' + 10;
-    }
-    else if (c >= 'A' && c <= 'F')
-    {
-        return c - 'A' + 10;
-    }
-    else
-    {
-        return 0;
-    }
+    return hex_values[(uint8_t)c];
 }
 
 size_t hex2bin(const char *hex, uint8_t *bin, size_t bin_len)
 {
     size_t len = 0;
 
-    while (*hex && len < bin_len)
+    while (len < bin_len && hex[0] && hex[1])
     {
-        bin[len] = hex2val(*hex++) << 4;
-
-        if (!*hex)
-        {
-            len++;
-            break;
-        }
+        bin[len++] = hex_byte(hex);
+        hex += 2;
+    }
 
-        bin[len++] |= hex2val(*hex++);
+    // odd number of digits, the last one is the high nibble
+    if (len < bin_len && hex[0])
+    {
+        bin[len++] = hex_values[(uint8_t)hex[0]] << 4;
     }
 
     return len;
@@ -173,8 +158,8 @@ char *double_sha256(const char *hex_string)
 
     unsigned char first_hash_output[32], second_hash_output[32];
 
-    mbedtls_sha256(bin, bin_len, first_hash_output, 0);
-    mbedtls_sha256(first_hash_output, 32, second_hash_output, 0);
+    sha256_generic(bin, bin_len, first_hash_output);
+    sha256_32(first_hash_output, second_hash_output);
 
     free(bin);
 
@@ -188,41 +173,33 @@ uint8_t *double_sha256_bin(const uint8_t *data, const size_t data_len)
     uint8_t first_hash_output[32];
     uint8_t *second_hash_output = malloc(32);
 
-    mbedtls_sha256(data, data_len, first_hash_output, 0);
-    mbedtls_sha256(first_hash_output, 32, second_hash_output, 0);
+    sha256_generic(data, data_len, first_hash_output);
+    sha256_32(first_hash_output, second_hash_output);
 
     return second_hash_output;
 }
 
 void single_sha256_bin(const uint8_t *data, const size_t data_len, uint8_t *dest)
 {
-    // mbedtls_sha256(data, data_len, dest, 0);
-
-    // Initialize SHA256 context
-    mbedtls_sha256_context sha256_ctx;
-    mbedtls_sha256_init(&sha256_ctx);
-    mbedtls_sha256_starts(&sha256_ctx, 0);
-
-    // Compute first SHA256 hash of header
-    mbedtls_sha256_update(&sha256_ctx, data, 64);
-    unsigned char hash[32];
-    mbedtls_sha256_finish(&sha256_ctx, hash);
-
-    // Compute midstate from hash
-    memcpy(dest, hash, 32);
+    sha256_64(data, dest);
 }
 
 void midstate_sha256_bin(const uint8_t *data, const size_t data_len, uint8_t *dest)
 {
-    mbedtls_sha256_context midstate;
+    uint32_t state[8];
 
     // Calculate midstate
-    mbedtls_sha256_init(&midstate);
-    mbedtls_sha256_starts(&midstate, 0);
-    mbedtls_sha256_update(&midstate, data, 64);
+    sha256_state_init(state);
+    sha256_transform(state, data);
 
-    // memcpy(dest, midstate.state, 32);
-     flip32bytes(dest, midstate.state);
+    // state words in little endian byte order
+    for (int i = 0; i < 8; i++)
+    {
+        dest[i * 4] = state[i];
+        dest[i * 4 + 1] = state[i] >> 8;
+        dest[i * 4 + 2] = state[i] >> 16;
+        dest[i * 4 + 3] = state[i] >> 24;
+    }
 }
 
 void swap_endian_words(const char *hex_words, uint8_t *output)
@@ -238,12 +215,35 @@ void swap_endian_words(const char *hex_words, uint8_t *output)
 
     for (size_t i = 0; i < binary_length; i += 4)
     {
-        for (int j = 0; j < 4; j++)
-        {
-            unsigned int byte_val;
-            sscanf(hex_words + (i + j) * 2, "%2x", &byte_val);
-            output[i + (3 - j)] = byte_val;
-        }
+        const char *word = hex_words + i * 2;
+        output[i] = hex_byte(word + 6);
+        output[i + 1] = hex_byte(word + 4);
+        output[i + 2] = hex_byte(word + 2);
+        output[i + 3] = hex_byte(word);
+    }
+}
+
+// same result as swap_endian_words_bin() followed by reverse_bytes(): the word order is reversed
+// while the bytes of each word stay in order
+void swap_reverse_words_bin(const uint8_t *input, uint8_t *output, size_t len)
+{
+    size_t words = len / 4;
+
+    for (size_t w = 0; w < words; w++)
+    {
+        memcpy(output + (words - 1 - w) * 4, input + w * 4, 4);
+    }
+}
+
+// byte-wise so it is safe on unaligned buffers, input and output must not overlap
+void swap_endian_words_bin(const uint8_t *input, uint8_t *output, size_t len)
+{
+    for (size_t i = 0; i < len; i += 4)
+    {
+        output[i] = input[i + 3];
+        output[i + 1] = input[i + 2];
+        output[i + 2] = input[i + 1];
+        output[i + 3] = input[i];
     }
 }
 
@@ -3,11 +3,18 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include "asic_task.h"
 #include "common.h"
 #include "power_management_task.h"
 #include "statistics_task.h"
 #include "serial.h"
+#include "share_queue.h"
+#include "request_tracker.h"
+#include "pool_selector.h"
+#include "pool_liveness.h"
+#include "share_replay.h"
 #include "stratum_api.h"
 #include "work_queue.h"
 #include "device_config.h"
@@ -16,6 +23,9 @@
 #define STRATUM_USER CONFIG_STRATUM_USER
 #define FALLBACK_STRATUM_USER CONFIG_FALLBACK_STRATUM_USER
 
+#define STRATUM_PROTOCOL_V1 1
+#define STRATUM_PROTOCOL_V2 2
+
 #define HISTORY_LENGTH 100
 #define DIFF_STRING_SIZE 10
 
@@ -24,6 +34,17 @@ typedef struct {
     uint32_t count;
 } RejectedReasonStat;
 
+// a pool the miner can work on, the primary and fallback settings come first
+typedef struct {
+    char * url;
+    uint16_t port;
+    char * user;
+    char * pass;
+    uint16_t difficulty;
+    bool extranonce_subscribe;
+    char * authority_key;
+} StratumPool;
+
 typedef struct
 {
     double duration_start;
@@ -61,8 +82,24 @@ typedef struct
     uint16_t fallback_pool_difficulty;
     bool pool_extranonce_subscribe;
     bool fallback_pool_extranonce_subscribe;
+    // keep the fallback pool connected next to the primary one for an immediate failover
+    bool fallback_hot_standby;
+    // Stratum V2 pools prove their identity with a key signed by this authority (hex x only key), empty accepts any
+    char * pool_authority_key;
+    char * fallback_pool_authority_key;
+    uint16_t stratum_protocol;
     double response_time;
-    bool is_using_fallback;
+    double new_work_latency;
+    StratumPool pools[STRATUM_MAX_POOLS];
+    uint8_t pool_count;
+    // pool currently mined on, 0 is the primary pool
+    uint8_t pool_index;
+    // POOL_SELECTION_PRIORITY or POOL_SELECTION_LATENCY
+    uint16_t pool_selection;
+    // shares per minute the suggested difficulty aims for, 0 suggests the configured pool difficulty
+    uint16_t target_share_rate;
+    // step ntime forward for more jobs per merkle root when no version bits are left for the host
+    bool ntime_rolling;
     uint16_t overheat_mode;
     uint16_t power_fault;
     uint32_t lastClockSync;
@@ -112,6 +149,27 @@ typedef struct
     // A message ID that must be unique per request that expects a response.
     // For requests not expecting a response (called notifications), this is null.
     int send_uid;
+    // The stratum task and the share submit task both write to sock. An id is taken from send_uid
+    // and the message using it is written under this lock, and sock is only replaced under it.
+    pthread_mutex_t send_lock;
+
+    // woken on every notify so new work is picked up without waiting out a poll
+    TaskHandle_t create_jobs_task_handle;
+
+    // shares found by the ASIC result task, sent by the share submit task
+    share_queue share_queue;
+    TaskHandle_t share_submit_task_handle;
+    // shares found while the pool connection is down, resent when the session comes back
+    share_replay share_replay;
+
+    // requests waiting on a pool response, with share latency and accepted work per pool
+    request_tracker request_tracker;
+
+    // probe results of all pools and the pick of the one to mine on
+    pool_selector pool_selector;
+
+    // notices a pool that went quiet and counts the time mining without fresh work
+    pool_liveness pool_liveness;
 
     bool ASIC_initalized;
     bool psram_is_available;
@@ -265,11 +265,22 @@ export class HomeComponent {
         this.maxFrequency = Math.max(800, info.frequency);
 
         const isFallback = info.isUsingFallbackStratum;
-
-        this.activePoolLabel = isFallback ? 'Fallback' : 'Primary';
-        this.activePoolURL = isFallback ? info.fallbackStratumURL : info.stratumURL;
-        this.activePoolUser = isFallback ? info.fallbackStratumUser : info.stratumUser;
-        this.activePoolPort = isFallback ? info.fallbackStratumPort : info.stratumPort;
+        // the pool list skips an unset fallback, so only the entry itself tells which pool is in use
+        const activePool = info.stratumPoolStatus?.[info.stratumPoolIndex];
+
+        if (activePool) {
+          const isFallbackPool = info.stratumPoolIndex > 0 && activePool.url === info.fallbackStratumURL
+            && activePool.port === info.fallbackStratumPort && activePool.user === info.fallbackStratumUser;
+          this.activePoolLabel = info.stratumPoolIndex === 0 ? 'Primary' : isFallbackPool ? 'Fallback' : `Pool ${info.stratumPoolIndex + 1}`;
+          this.activePoolURL = activePool.url;
+          this.activePoolUser = activePool.user;
+          this.activePoolPort = activePool.port;
+        } else {
+          this.activePoolLabel = isFallback ? 'Fallback' : 'Primary';
+          this.activePoolURL = isFallback ? info.fallbackStratumURL : info.stratumURL;
+          this.activePoolUser = isFallback ? info.fallbackStratumUser : info.stratumUser;
+          this.activePoolPort = isFallback ? info.fallbackStratumPort : info.stratumPort;
+        }
         this.responseTime = info.responseTime;
       }),
       map(info => {
@@ -295,8 +306,9 @@ export class HomeComponent {
 
     this.quickLink$ = this.info$.pipe(
       map(info => {
-        const url = info.isUsingFallbackStratum ? info.fallbackStratumURL : info.stratumURL;
-        const user = info.isUsingFallbackStratum ? info.fallbackStratumUser : info.stratumUser;
+        const activePool = info.stratumPoolStatus?.[info.stratumPoolIndex];
+        const url = activePool?.url ?? (info.isUsingFallbackStratum ? info.fallbackStratumURL : info.stratumURL);
+        const user = activePool?.user ?? (info.isUsingFallbackStratum ? info.fallbackStratumUser : info.stratumUser);
         return this.quickLinkService.getQuickLink(url, user);
       })
     );
@@ -33,6 +33,7 @@ export class SystemService {
         nominalVoltage: 5,
         hashRate: 475,
         expectedHashrate: 420,
+        acceptedHashrate: 462,
         bestDiff: "0",
         bestSessionDiff: "0",
         freeHeap: 200504,
@@ -62,7 +63,25 @@ export class SystemService {
         fallbackStratumUser: "bc1q99n3pu025yyu0jlywpmwzalyhm36tg5u37w20d.bitaxe-U1",
         fallbackStratumSuggestedDifficulty: 1000,
         fallbackStratumExtranonceSubscribe: 0,
+        fallbackStratumHotStandby: 0,
+        stratumProtocol: 1,
+        stratumAuthorityKey: "",
+        fallbackStratumAuthorityKey: "",
+        stratumPoolSelection: 0,
+        stratumTargetShareRate: 0,
+        stratumNtimeRolling: 0,
+        staleWorkSeconds: 12.5,
+        stratumPools: [],
+        stratumPoolStatus: [
+          { url: "public-pool.io", port: 21496, user: "bc1q99n3pu025yyu0jlywpmwzalyhm36tg5u37w20d.bitaxe-U1", latency: -1, healthy: false },
+          { url: "test.public-pool.io", port: 21497, user: "bc1q99n3pu025yyu0jlywpmwzalyhm36tg5u37w20d.bitaxe-U1", latency: 38.5, healthy: true }
+        ],
+        stratumPoolIndex: 1,
         responseTime: 10,
+        newWorkLatency: 5,
+        shareLatencyP50: 42,
+        shareLatencyP95: 110,
+        shareLatencyP99: 240,
         isUsingFallbackStratum: true,
         frequency: 485,
         version: "2.0",
@@ -3,6 +3,24 @@ interface ISharesRejectedStat {
     count: number;
 }
 
+export interface IStratumPool {
+    url: string;
+    port: number;
+    user?: string;
+    password?: string;
+    suggestedDifficulty?: number;
+    extranonceSubscribe?: boolean;
+    authorityKey?: string;
+}
+
+export interface IStratumPoolStatus {
+    url: string;
+    port: number;
+    user: string;
+    latency: number;
+    healthy: boolean;
+}
+
 export interface ISystemInfo {
     display: string;
     rotation: number;
@@ -17,6 +35,7 @@ export interface ISystemInfo {
     nominalVoltage: number,
     hashRate: number,
     expectedHashrate: number,
+    acceptedHashrate: number,
     bestDiff: string,
     bestSessionDiff: string,
     freeHeap: number,
@@ -44,7 +63,22 @@ export interface ISystemInfo {
     fallbackStratumUser: string,
     fallbackStratumSuggestedDifficulty: number,
     fallbackStratumExtranonceSubscribe: number,
+    fallbackStratumHotStandby: number,
+    stratumProtocol: number,
+    stratumAuthorityKey: string,
+    fallbackStratumAuthorityKey: string,
+    stratumPoolSelection: number,
+    stratumTargetShareRate: number,
+    stratumNtimeRolling: number,
+    staleWorkSeconds: number,
+    stratumPools: IStratumPool[],
+    stratumPoolStatus: IStratumPoolStatus[],
+    stratumPoolIndex: number,
     responseTime: number,
+    newWorkLatency: number,
+    shareLatencyP50: number,
+    shareLatencyP95: number,
+    shareLatencyP99: number,
     isUsingFallbackStratum: boolean,
     frequency: number,
     version: string,
@@ -434,6 +434,66 @@ static esp_err_t handle_options_request(httpd_req_t * req)
     return ESP_OK;
 }
 
+// Store the additional pools, a pool sent without password keeps the one stored at its position
+// since GET never returns them.
+static bool same_string_item(cJSON * a, cJSON * b, const char * name)
+{
+    const char * value_a = cJSON_GetStringValue(cJSON_GetObjectItem(a, name));
+    const char * value_b = cJSON_GetStringValue(cJSON_GetObjectItem(b, name));
+    return value_a == NULL ? value_b == NULL : value_b != NULL && strcmp(value_a, value_b) == 0;
+}
+
+// password of the stored pool with the same url, port and user, NULL when there is none
+static const char * stored_pool_password(cJSON * stored, cJSON * pool)
+{
+    cJSON * port = cJSON_GetObjectItem(pool, "port");
+    cJSON * candidate;
+    cJSON_ArrayForEach(candidate, stored) {
+        cJSON * stored_port = cJSON_GetObjectItem(candidate, "port");
+        if (same_string_item(candidate, pool, "url") && same_string_item(candidate, pool, "user") &&
+            cJSON_IsNumber(stored_port) && stored_port->valueint == port->valueint) {
+            return cJSON_GetStringValue(cJSON_GetObjectItem(candidate, "password"));
+        }
+    }
+    return NULL;
+}
+
+static void update_stratum_pools(cJSON * pools)
+{
+    char * stored_json = nvs_config_get_string(NVS_CONFIG_STRATUM_POOLS, "[]");
+    cJSON * stored = cJSON_Parse(stored_json);
+    free(stored_json);
+
+    cJSON * updated = cJSON_CreateArray();
+    cJSON * pool;
+    cJSON_ArrayForEach(pool, pools) {
+        cJSON * url = cJSON_GetObjectItem(pool, "url");
+        cJSON * port = cJSON_GetObjectItem(pool, "port");
+        if (!cJSON_IsString(url) || url->valuestring[0] == '\0' || !cJSON_IsNumber(port)) {
+            continue;
+        }
+        // primary and fallback take the first two places
+        if (cJSON_GetArraySize(updated) >= STRATUM_MAX_POOLS - 2) {
+            break;
+        }
+
+        cJSON * copy = cJSON_Duplicate(pool, true);
+        // the list comes back without passwords, reordering or removing pools must not hand one pool's password to another
+        if (!cJSON_IsString(cJSON_GetObjectItem(copy, "password"))) {
+            const char * old_pass = stored_pool_password(stored, pool);
+            cJSON_DeleteItemFromObject(copy, "password");
+            cJSON_AddStringToObject(copy, "password", old_pass != NULL ? old_pass : "x");
+        }
+        cJSON_AddItemToArray(updated, copy);
+    }
+
+    char * updated_json = cJSON_PrintUnformatted(updated);
+    nvs_config_set_string(NVS_CONFIG_STRATUM_POOLS, updated_json);
+    free(updated_json);
+    cJSON_Delete(updated);
+    cJSON_Delete(stored);
+}
+
 static esp_err_t PATCH_update_settings(httpd_req_t * req)
 {
 
@@ -495,6 +555,9 @@ static esp_err_t PATCH_update_settings(httpd_req_t * req)
     if ((item = cJSON_GetObjectItem(root, "fallbackStratumExtranonceSubscribe")) != NULL) {
         nvs_config_set_u16(NVS_CONFIG_FALLBACK_STRATUM_EXTRANONCE_SUBSCRIBE, item->valueint);
     }
+    if ((item = cJSON_GetObjectItem(root, "fallbackStratumHotStandby")) != NULL) {
+        nvs_config_set_u16(NVS_CONFIG_FALLBACK_STRATUM_HOT_STANDBY, item->valueint);
+    }
     if ((item = cJSON_GetObjectItem(root, "fallbackStratumSuggestedDifficulty")) != NULL) {
         nvs_config_set_u16(NVS_CONFIG_FALLBACK_STRATUM_DIFFICULTY, item->valueint);
     }
@@ -510,6 +573,29 @@ static esp_err_t PATCH_update_settings(httpd_req_t * req)
     if ((item = cJSON_GetObjectItem(root, "fallbackStratumPort")) != NULL) {
         nvs_config_set_u16(NVS_CONFIG_FALLBACK_STRATUM_PORT, item->valueint);
     }
+    if ((item = cJSON_GetObjectItem(root, "stratumProtocol")) != NULL &&
+        (item->valueint == STRATUM_PROTOCOL_V1 || item->valueint == STRATUM_PROTOCOL_V2)) {
+        nvs_config_set_u16(NVS_CONFIG_STRATUM_PROTOCOL, item->valueint);
+    }
+    if (cJSON_IsString(item = cJSON_GetObjectItem(root, "stratumAuthorityKey"))) {
+        nvs_config_set_string(NVS_CONFIG_STRATUM_AUTHORITY_KEY, item->valuestring);
+    }
+    if (cJSON_IsString(item = cJSON_GetObjectItem(root, "fallbackStratumAuthorityKey"))) {
+        nvs_config_set_string(NVS_CONFIG_FALLBACK_STRATUM_AUTHORITY_KEY, item->valuestring);
+    }
+    if (cJSON_IsArray(item = cJSON_GetObjectItem(root, "stratumPools"))) {
+        update_stratum_pools(item);
+    }
+    if ((item = cJSON_GetObjectItem(root, "stratumPoolSelection")) != NULL &&
+        (item->valueint == POOL_SELECTION_PRIORITY || item->valueint == POOL_SELECTION_LATENCY)) {
+        nvs_config_set_u16(NVS_CONFIG_STRATUM_POOL_SELECTION, item->valueint);
+    }
+    if ((item = cJSON_GetObjectItem(root, "stratumTargetShareRate")) != NULL && item->valueint >= 0) {
+        nvs_config_set_u16(NVS_CONFIG_STRATUM_SHARE_RATE, item->valueint);
+    }
+    if ((item = cJSON_GetObjectItem(root, "stratumNtimeRolling")) != NULL) {
+        nvs_config_set_u16(NVS_CONFIG_STRATUM_NTIME_ROLLING, item->valueint);
+    }
     if (cJSON_IsString(item = cJSON_GetObjectItem(root, "ssid"))) {
         nvs_config_set_string(NVS_CONFIG_WIFI_SSID, item->valuestring);
     }
@@ -611,6 +697,8 @@ static esp_err_t GET_system_info(httpd_req_t * req)
     char * fallbackStratumURL = nvs_config_get_string(NVS_CONFIG_FALLBACK_STRATUM_URL, CONFIG_FALLBACK_STRATUM_URL);
     char * stratumUser = nvs_config_get_string(NVS_CONFIG_STRATUM_USER, CONFIG_STRATUM_USER);
     char * fallbackStratumUser = nvs_config_get_string(NVS_CONFIG_FALLBACK_STRATUM_USER, CONFIG_FALLBACK_STRATUM_USER);
+    char * stratumAuthorityKey = nvs_config_get_string(NVS_CONFIG_STRATUM_AUTHORITY_KEY, "");
+    char * fallbackStratumAuthorityKey = nvs_config_get_string(NVS_CONFIG_FALLBACK_STRATUM_AUTHORITY_KEY, "");
     char * display = nvs_config_get_string(NVS_CONFIG_DISPLAY, "SSD1306 (128x32)");
     uint16_t frequency = nvs_config_get_u16(NVS_CONFIG_ASIC_FREQ, CONFIG_ASIC_FREQUENCY);
     float expected_hashrate = frequency * GLOBAL_STATE->DEVICE_CONFIG.family.asic.small_core_count * GLOBAL_STATE->DEVICE_CONFIG.family.asic_count / 1000.0;
@@ -623,6 +711,9 @@ static esp_err_t GET_system_info(httpd_req_t * req)
     int8_t wifi_rssi = -90;
     get_wifi_current_rssi(&wifi_rssi);
 
+    // latency and accepted work are tracked per pool, report the one being mined on
+    uint8_t pool = GLOBAL_STATE->SYSTEM_MODULE.pool_index;
+
     cJSON * root = cJSON_CreateObject();
     cJSON_AddNumberToObject(root, "power", GLOBAL_STATE->POWER_MANAGEMENT_MODULE.power);
     cJSON_AddNumberToObject(root, "voltage", GLOBAL_STATE->POWER_MANAGEMENT_MODULE.voltage);
@@ -633,11 +724,13 @@ static esp_err_t GET_system_info(httpd_req_t * req)
     cJSON_AddNumberToObject(root, "nominalVoltage", GLOBAL_STATE->DEVICE_CONFIG.family.nominal_voltage);
     cJSON_AddNumberToObject(root, "hashRate", GLOBAL_STATE->SYSTEM_MODULE.current_hashrate);
     cJSON_AddNumberToObject(root, "expectedHashrate", expected_hashrate);
+    cJSON_AddNumberToObject(root, "acceptedHashrate", request_tracker_accepted_hashrate(&GLOBAL_STATE->request_tracker, pool, esp_timer_get_time()));
     cJSON_AddStringToObject(root, "bestDiff", GLOBAL_STATE->SYSTEM_MODULE.best_diff_string);
     cJSON_AddStringToObject(root, "bestSessionDiff", GLOBAL_STATE->SYSTEM_MODULE.best_session_diff_string);
     cJSON_AddNumberToObject(root, "stratumDifficulty", GLOBAL_STATE->stratum_difficulty);
 
-    cJSON_AddNumberToObject(root, "isUsingFallbackStratum", GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback);
+    cJSON_AddNumberToObject(root, "isUsingFallbackStratum", pool != 0);
+    cJSON_AddNumberToObject(root, "stratumPoolIndex", pool);
 
     cJSON_AddNumberToObject(root, "isPSRAMAvailable", GLOBAL_STATE->psram_is_available);
 
@@ -653,6 +746,7 @@ static esp_err_t GET_system_info(httpd_req_t * req)
     cJSON_AddNumberToObject(root, "apEnabled", GLOBAL_STATE->SYSTEM_MODULE.ap_enabled);
     cJSON_AddNumberToObject(root, "sharesAccepted", GLOBAL_STATE->SYSTEM_MODULE.shares_accepted);
     cJSON_AddNumberToObject(root, "sharesRejected", GLOBAL_STATE->SYSTEM_MODULE.shares_rejected);
+    cJSON_AddNumberToObject(root, "staleWorkSeconds", pool_liveness_stale_s(&GLOBAL_STATE->pool_liveness, esp_timer_get_time()));
 
     cJSON *error_array = cJSON_CreateArray();
     cJSON_AddItemToObject(root, "sharesRejectedReasons", error_array);
@@ -678,7 +772,47 @@ static esp_err_t GET_system_info(httpd_req_t * req)
     cJSON_AddStringToObject(root, "fallbackStratumUser", fallbackStratumUser);
     cJSON_AddNumberToObject(root, "fallbackStratumSuggestedDifficulty", nvs_config_get_u16(NVS_CONFIG_FALLBACK_STRATUM_DIFFICULTY, CONFIG_FALLBACK_STRATUM_DIFFICULTY));
     cJSON_AddNumberToObject(root, "fallbackStratumExtranonceSubscribe", nvs_config_get_u16(NVS_CONFIG_FALLBACK_STRATUM_EXTRANONCE_SUBSCRIBE, FALLBACK_STRATUM_EXTRANONCE_SUBSCRIBE));
+    cJSON_AddNumberToObject(root, "fallbackStratumHotStandby", nvs_config_get_u16(NVS_CONFIG_FALLBACK_STRATUM_HOT_STANDBY, 0));
+    cJSON_AddNumberToObject(root, "stratumProtocol", nvs_config_get_u16(NVS_CONFIG_STRATUM_PROTOCOL, STRATUM_PROTOCOL_V1));
+    cJSON_AddStringToObject(root, "stratumAuthorityKey", stratumAuthorityKey);
+    cJSON_AddStringToObject(root, "fallbackStratumAuthorityKey", fallbackStratumAuthorityKey);
+    cJSON_AddNumberToObject(root, "stratumPoolSelection", nvs_config_get_u16(NVS_CONFIG_STRATUM_POOL_SELECTION, POOL_SELECTION_PRIORITY));
+    cJSON_AddNumberToObject(root, "stratumTargetShareRate", nvs_config_get_u16(NVS_CONFIG_STRATUM_SHARE_RATE, 0));
+    cJSON_AddNumberToObject(root, "stratumNtimeRolling", nvs_config_get_u16(NVS_CONFIG_STRATUM_NTIME_ROLLING, 0));
+
+    // additional pools as stored, without their passwords
+    char * stratumPools = nvs_config_get_string(NVS_CONFIG_STRATUM_POOLS, "[]");
+    cJSON * pools_array = cJSON_Parse(stratumPools);
+    if (!cJSON_IsArray(pools_array)) {
+        cJSON_Delete(pools_array);
+        pools_array = cJSON_CreateArray();
+    }
+    cJSON * pool_obj;
+    cJSON_ArrayForEach(pool_obj, pools_array) {
+        cJSON_DeleteItemFromObject(pool_obj, "password");
+    }
+    cJSON_AddItemToObject(root, "stratumPools", pools_array);
+    free(stratumPools);
+
+    // probe results of the pools in use since boot, in failover order
+    cJSON * status_array = cJSON_CreateArray();
+    for (int i = 0; i < GLOBAL_STATE->SYSTEM_MODULE.pool_count; i++) {
+        cJSON * status_obj = cJSON_CreateObject();
+        double latency = pool_selector_latency_ms(&GLOBAL_STATE->pool_selector, i);
+        cJSON_AddStringToObject(status_obj, "url", GLOBAL_STATE->SYSTEM_MODULE.pools[i].url);
+        cJSON_AddNumberToObject(status_obj, "port", GLOBAL_STATE->SYSTEM_MODULE.pools[i].port);
+        cJSON_AddStringToObject(status_obj, "user", GLOBAL_STATE->SYSTEM_MODULE.pools[i].user);
+        cJSON_AddNumberToObject(status_obj, "latency", latency);
+        cJSON_AddBoolToObject(status_obj, "healthy", latency >= 0);
+        cJSON_AddItemToArray(status_array, status_obj);
+    }
+    cJSON_AddItemToObject(root, "stratumPoolStatus", status_array);
+
     cJSON_AddNumberToObject(root, "responseTime", GLOBAL_STATE->SYSTEM_MODULE.response_time);
+    cJSON_AddNumberToObject(root, "newWorkLatency", GLOBAL_STATE->SYSTEM_MODULE.new_work_latency);
+    cJSON_AddNumberToObject(root, "shareLatencyP50", request_tracker_latency_percentile_ms(&GLOBAL_STATE->request_tracker, pool, 50));
+    cJSON_AddNumberToObject(root, "shareLatencyP95", request_tracker_latency_percentile_ms(&GLOBAL_STATE->request_tracker, pool, 95));
+    cJSON_AddNumberToObject(root, "shareLatencyP99", request_tracker_latency_percentile_ms(&GLOBAL_STATE->request_tracker, pool, 99));
 
     cJSON_AddStringToObject(root, "version", esp_app_get_description()->version);
     cJSON_AddStringToObject(root, "axeOSVersion", axeOSVersion);
@@ -712,6 +846,8 @@ static esp_err_t GET_system_info(httpd_req_t * req)
     free(fallbackStratumURL);
     free(stratumUser);
     free(fallbackStratumUser);
+    free(stratumAuthorityKey);
+    free(fallbackStratumAuthorityKey);
     free(display);
 
     const char * sys_info = cJSON_Print(root);
@@ -11,9 +11,12 @@
 #include "http_server.h"
 #include "serial.h"
 #include "stratum_task.h"
+#include "stratum_v2_task.h"
+#include "share_submit_task.h"
 #include "i2c_bitaxe.h"
 #include "adc.h"
 #include "nvs_device.h"
+#include "nvs_config.h"
 #include "self_test.h"
 #include "asic.h"
 #include "device_config.h"
@@ -75,8 +78,23 @@ void app_main(void)
         vTaskDelay(100 / portTICK_PERIOD_MS);
     }
 
+    pthread_mutex_init(&GLOBAL_STATE.send_lock, NULL);
     queue_init(&GLOBAL_STATE.stratum_queue);
     queue_init(&GLOBAL_STATE.ASIC_jobs_queue);
+    share_queue_init(&GLOBAL_STATE.share_queue);
+    request_tracker_init(&GLOBAL_STATE.request_tracker);
+    pool_selector_init(&GLOBAL_STATE.pool_selector, GLOBAL_STATE.SYSTEM_MODULE.pool_count);
+    pool_liveness_init(&GLOBAL_STATE.pool_liveness);
+    share_replay_init(&GLOBAL_STATE.share_replay);
+    if (GLOBAL_STATE.SYSTEM_MODULE.stratum_protocol == STRATUM_PROTOCOL_V1) {
+        // block candidates found before a reboot are still worth sending while the block is current
+        replay_share candidates[SHARE_REPLAY_MAX_CANDIDATES];
+        size_t size = nvs_config_get_blob(NVS_CONFIG_BLOCK_CANDIDATES, candidates, sizeof(candidates));
+        if (size > 0 && size % sizeof(replay_share) == 0) {
+            ESP_LOGI(TAG, "Restoring %u block candidates", (unsigned) (size / sizeof(replay_share)));
+            share_replay_restore(&GLOBAL_STATE.share_replay, candidates, size / sizeof(replay_share));
+        }
+    }
 
     if (asic_reset() != ESP_OK) {
         GLOBAL_STATE.SYSTEM_MODULE.asic_status = "ASIC reset failed";
@@ -97,9 +115,14 @@ void app_main(void)
 
     GLOBAL_STATE.ASIC_initalized = true;
 
-    xTaskCreate(stratum_task, "stratum admin", 8192, (void *) &GLOBAL_STATE, 5, NULL);
-    xTaskCreate(create_jobs_task, "stratum miner", 8192, (void *) &GLOBAL_STATE, 10, NULL);
+    if (GLOBAL_STATE.SYSTEM_MODULE.stratum_protocol == STRATUM_PROTOCOL_V2) {
+        xTaskCreate(stratum_v2_task, "stratum admin", 8192, (void *) &GLOBAL_STATE, 5, NULL);
+    } else {
+        xTaskCreate(stratum_task, "stratum admin", 8192, (void *) &GLOBAL_STATE, 5, NULL);
+    }
+    xTaskCreate(create_jobs_task, "stratum miner", 8192, (void *) &GLOBAL_STATE, 10, &GLOBAL_STATE.create_jobs_task_handle);
     xTaskCreate(ASIC_task, "asic", 8192, (void *) &GLOBAL_STATE, 10, NULL);
     xTaskCreate(ASIC_result_task, "asic result", 8192, (void *) &GLOBAL_STATE, 15, NULL);
+    xTaskCreate(share_submit_task, "share submit", 4096, (void *) &GLOBAL_STATE, 12, &GLOBAL_STATE.share_submit_task_handle);
     xTaskCreate(statistics_task, "statistics", 8192, (void *) &GLOBAL_STATE, 3, NULL);
 }
@@ -167,6 +167,51 @@ void nvs_config_set_u64(const char * key, const uint64_t value)
     nvs_close(handle);
 }
 
+size_t nvs_config_get_blob(const char * key, void * out, size_t max_size)
+{
+    nvs_handle handle;
+    esp_err_t err;
+    err = nvs_open(NVS_CONFIG_NAMESPACE, NVS_READONLY, &handle);
+    if (err != ESP_OK) {
+        return 0;
+    }
+
+    size_t size = max_size;
+    err = nvs_get_blob(handle, key, out, &size);
+
+    if (err != ESP_OK) {
+        nvs_close(handle);
+        return 0;
+    }
+
+    nvs_close(handle);
+    return size;
+}
+
+void nvs_config_set_blob(const char * key, const void * value, size_t size)
+{
+    nvs_handle handle;
+    esp_err_t err;
+    err = nvs_open(NVS_CONFIG_NAMESPACE, NVS_READWRITE, &handle);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Could not open nvs");
+        return;
+    }
+
+    if (size == 0) {
+        err = nvs_erase_key(handle, key);
+        if (err == ESP_ERR_NVS_NOT_FOUND) {
+            err = ESP_OK;
+        }
+    } else {
+        err = nvs_set_blob(handle, key, value, size);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Could not write nvs key: %s, %u bytes", key, (unsigned) size);
+    }
+    nvs_close(handle);
+}
+
 void nvs_config_commit()
 {
     nvs_handle handle;
@@ -1,6 +1,7 @@
 #ifndef MAIN_NVS_CONFIG_H
 #define MAIN_NVS_CONFIG_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 // Max length 15
@@ -20,6 +21,20 @@
 #define NVS_CONFIG_FALLBACK_STRATUM_EXTRANONCE_SUBSCRIBE "stratumfbxnsub"
 #define NVS_CONFIG_FALLBACK_STRATUM_DIFFICULTY "fbstratumdiff"
 #define NVS_CONFIG_FALLBACK_STRATUM_PASS "fbstratumpass"
+#define NVS_CONFIG_FALLBACK_STRATUM_HOT_STANDBY "fbstandby"
+#define NVS_CONFIG_STRATUM_PROTOCOL "stratumproto"
+#define NVS_CONFIG_STRATUM_AUTHORITY_KEY "stratumauth"
+#define NVS_CONFIG_FALLBACK_STRATUM_AUTHORITY_KEY "fbstratumauth"
+#define NVS_CONFIG_STRATUM_POOLS "stratumpools"
+#define NVS_CONFIG_STRATUM_POOL_SELECTION "poolselect"
+#define NVS_CONFIG_STRATUM_SHARE_RATE "sharerate"
+#define NVS_CONFIG_STRATUM_NTIME_ROLLING "ntimeroll"
+// block candidates waiting to be resent, kept across reboots
+#define NVS_CONFIG_BLOCK_CANDIDATES "blockcands"
+// subscription the block candidates were found on, offered on the first connection after a reboot
+#define NVS_CONFIG_STRATUM_SESSION "stratumsession"
+// header of the last block candidate found
+#define NVS_CONFIG_BLOCK_HEADER "blockheader"
 #define NVS_CONFIG_ASIC_FREQ "asicfrequency"
 #define NVS_CONFIG_ASIC_VOLTAGE "asicvoltage"
 #define NVS_CONFIG_ASIC_MODEL "asicmodel"
@@ -65,6 +80,10 @@ int32_t nvs_config_get_i32(const char * key, const int32_t default_value);
 void nvs_config_set_i32(const char * key, const int32_t value);
 uint64_t nvs_config_get_u64(const char * key, const uint64_t default_value);
 void nvs_config_set_u64(const char * key, const uint64_t value);
+// size read into out, 0 when the key is missing or doesn't fit
+size_t nvs_config_get_blob(const char * key, void * out, size_t max_size);
+// an empty blob erases the key
+void nvs_config_set_blob(const char * key, const void * value, size_t size);
 void nvs_config_commit(void);
 
 #endif // MAIN_NVS_CONFIG_H
@@ -371,7 +371,7 @@ bool self_test(void * pvParameters)
 
     mining_notify notify_message;
     notify_message.job_id = 0;
-    notify_message.prev_block_hash = "0c859545a3498373a57452fac22eb7113df2a465000543520000000000000000";
+    hex2bin("0c859545a3498373a57452fac22eb7113df2a465000543520000000000000000", notify_message.prev_block_hash, HASH_SIZE);
     notify_message.version = 0x20000004;
     notify_message.target = 0x1705ae3a;
     notify_message.ntime = 0x647025b5;
@@ -402,9 +402,15 @@ bool self_test(void * pvParameters)
     hex2bin("c4f5ab01913fc186d550c1a28f3f3e9ffaca2016b961a6a751f8cca0089df924", merkles[11], 32);
     hex2bin("cff737e1d00176dd6bbfa73071adbb370f227cfb5fba186562e4060fcec877e1", merkles[12], 32);
 
-    char * merkle_root = calculate_merkle_root_hash(coinbase_tx, merkles, num_merkles);
+    size_t coinbase_tx_len = strlen(coinbase_tx) / 2;
+    uint8_t * coinbase_tx_bin = malloc(coinbase_tx_len);
+    hex2bin(coinbase_tx, coinbase_tx_bin, coinbase_tx_len);
 
-    bm_job job = construct_bm_job(&notify_message, merkle_root, 0x1fffe000, 1000000);
+    uint8_t merkle_root[32];
+    calculate_merkle_root_hash(coinbase_tx_bin, coinbase_tx_len, merkles, num_merkles, merkle_root);
+    free(coinbase_tx_bin);
+
+    bm_job job = construct_bm_job(&notify_message, merkle_root, 0x1fffe000, 1000000, ASIC_get_job_format(GLOBAL_STATE));
 
     uint8_t difficulty_mask = 8;
 
@@ -2,6 +2,7 @@
 #include <math.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/time.h>
 
@@ -17,6 +18,7 @@
 #include "esp_timer.h"
 #include "esp_wifi.h"
 #include "lwip/inet.h"
+#include "cJSON.h"
 
 #include "system.h"
 #include "i2c_bitaxe.h"
@@ -36,8 +38,9 @@ static void _suffix_string(uint64_t, char *, size_t, int);
 
 //local function prototypes
 static esp_err_t ensure_overheat_mode_config();
+static void _load_pools(SystemModule * module);
 
-static void _check_for_best_diff(GlobalState * GLOBAL_STATE, double diff, uint8_t job_id);
+static void _check_for_best_diff(GlobalState * GLOBAL_STATE, const uint8_t hash[32], uint8_t job_id);
 static void _suffix_string(uint64_t val, char * buf, size_t bufsiz, int sigdigits);
 
 void SYSTEM_init_system(GlobalState * GLOBAL_STATE)
@@ -81,8 +84,20 @@ void SYSTEM_init_system(GlobalState * GLOBAL_STATE)
     module->pool_extranonce_subscribe = nvs_config_get_u16(NVS_CONFIG_STRATUM_EXTRANONCE_SUBSCRIBE, STRATUM_EXTRANONCE_SUBSCRIBE);
     module->fallback_pool_extranonce_subscribe = nvs_config_get_u16(NVS_CONFIG_FALLBACK_STRATUM_EXTRANONCE_SUBSCRIBE, FALLBACK_STRATUM_EXTRANONCE_SUBSCRIBE);
 
-    // set fallback to false.
-    module->is_using_fallback = false;
+    // set the fallback pool hot standby
+    module->fallback_hot_standby = nvs_config_get_u16(NVS_CONFIG_FALLBACK_STRATUM_HOT_STANDBY, 0);
+
+    // set the stratum protocol, both pools speak the same one
+    module->stratum_protocol = nvs_config_get_u16(NVS_CONFIG_STRATUM_PROTOCOL, STRATUM_PROTOCOL_V1);
+    module->pool_authority_key = nvs_config_get_string(NVS_CONFIG_STRATUM_AUTHORITY_KEY, "");
+    module->fallback_pool_authority_key = nvs_config_get_string(NVS_CONFIG_FALLBACK_STRATUM_AUTHORITY_KEY, "");
+
+    // primary, fallback and the additional pools, mining starts on the primary
+    _load_pools(module);
+    module->pool_index = 0;
+    module->pool_selection = nvs_config_get_u16(NVS_CONFIG_STRATUM_POOL_SELECTION, POOL_SELECTION_PRIORITY);
+    module->target_share_rate = nvs_config_get_u16(NVS_CONFIG_STRATUM_SHARE_RATE, 0);
+    module->ntime_rolling = nvs_config_get_u16(NVS_CONFIG_STRATUM_NTIME_ROLLING, 0);
 
     // Initialize overheat_mode
     module->overheat_mode = nvs_config_get_u16(NVS_CONFIG_OVERHEAT_MODE, 0);
@@ -96,6 +111,71 @@ void SYSTEM_init_system(GlobalState * GLOBAL_STATE)
     _suffix_string(module->best_session_nonce_diff, module->best_session_diff_string, DIFF_STRING_SIZE, 0);
 }
 
+static void _load_pools(SystemModule * module)
+{
+    module->pools[0] = (StratumPool) {
+        .url = module->pool_url,
+        .port = module->pool_port,
+        .user = module->pool_user,
+        .pass = module->pool_pass,
+        .difficulty = module->pool_difficulty,
+        .extranonce_subscribe = module->pool_extranonce_subscribe,
+        .authority_key = module->pool_authority_key,
+    };
+    module->pool_count = 1;
+
+    if (module->fallback_pool_url != NULL && module->fallback_pool_url[0] != '\0') {
+        module->pools[module->pool_count++] = (StratumPool) {
+            .url = module->fallback_pool_url,
+            .port = module->fallback_pool_port,
+            .user = module->fallback_pool_user,
+            .pass = module->fallback_pool_pass,
+            .difficulty = module->fallback_pool_difficulty,
+            .extranonce_subscribe = module->fallback_pool_extranonce_subscribe,
+            .authority_key = module->fallback_pool_authority_key,
+        };
+    }
+
+    // additional pools are stored as a JSON array of pool objects
+    char * pools_json = nvs_config_get_string(NVS_CONFIG_STRATUM_POOLS, "[]");
+    cJSON * pools = cJSON_Parse(pools_json);
+    free(pools_json);
+    if (!cJSON_IsArray(pools)) {
+        ESP_LOGW(TAG, "Ignoring invalid additional pool list");
+        cJSON_Delete(pools);
+        return;
+    }
+
+    cJSON * pool;
+    cJSON_ArrayForEach(pool, pools) {
+        if (module->pool_count >= STRATUM_MAX_POOLS) {
+            ESP_LOGW(TAG, "Only %d pools are supported, ignoring the rest", STRATUM_MAX_POOLS);
+            break;
+        }
+        cJSON * url = cJSON_GetObjectItem(pool, "url");
+        cJSON * port = cJSON_GetObjectItem(pool, "port");
+        if (!cJSON_IsString(url) || url->valuestring[0] == '\0' || !cJSON_IsNumber(port)) {
+            continue;
+        }
+        cJSON * user = cJSON_GetObjectItem(pool, "user");
+        cJSON * pass = cJSON_GetObjectItem(pool, "password");
+        cJSON * difficulty = cJSON_GetObjectItem(pool, "suggestedDifficulty");
+        cJSON * authority_key = cJSON_GetObjectItem(pool, "authorityKey");
+        module->pools[module->pool_count++] = (StratumPool) {
+            .url = strdup(url->valuestring),
+            .port = port->valueint,
+            .user = strdup(cJSON_IsString(user) ? user->valuestring : module->pool_user),
+            .pass = strdup(cJSON_IsString(pass) ? pass->valuestring : "x"),
+            .difficulty = cJSON_IsNumber(difficulty) ? difficulty->valueint : module->pool_difficulty,
+            .extranonce_subscribe = cJSON_IsTrue(cJSON_GetObjectItem(pool, "extranonceSubscribe")),
+            .authority_key = strdup(cJSON_IsString(authority_key) ? authority_key->valuestring : ""),
+        };
+    }
+    cJSON_Delete(pools);
+
+    ESP_LOGI(TAG, "%d pools configured", module->pool_count);
+}
+
 esp_err_t SYSTEM_init_peripherals(GlobalState * GLOBAL_STATE) {
     
     ESP_RETURN_ON_ERROR(gpio_install_isr_service(0), TAG, "Error installing ISR service");
@@ -184,7 +264,7 @@ void SYSTEM_notify_new_ntime(GlobalState * GLOBAL_STATE, uint32_t ntime)
     settimeofday(&tv, NULL);
 }
 
-void SYSTEM_notify_found_nonce(GlobalState * GLOBAL_STATE, double found_diff, uint8_t job_id)
+void SYSTEM_notify_found_nonce(GlobalState * GLOBAL_STATE, const uint8_t hash[32], uint8_t job_id)
 {
     SystemModule * module = &GLOBAL_STATE->SYSTEM_MODULE;
 
@@ -224,36 +304,32 @@ void SYSTEM_notify_found_nonce(GlobalState * GLOBAL_STATE, double found_diff, ui
     // logArrayContents(historical_hashrate, HISTORY_LENGTH);
     // logArrayContents(historical_hashrate_time_stamps, HISTORY_LENGTH);
 
-    _check_for_best_diff(GLOBAL_STATE, found_diff, job_id);
+    _check_for_best_diff(GLOBAL_STATE, hash, job_id);
 }
 
-static double _calculate_network_difficulty(uint32_t nBits)
+static void _check_for_best_diff(GlobalState * GLOBAL_STATE, const uint8_t hash[32], uint8_t job_id)
 {
-    uint32_t mantissa = nBits & 0x007fffff;  // Extract the mantissa from nBits
-    uint8_t exponent = (nBits >> 24) & 0xff; // Extract the exponent from nBits
-
-    double target = (double) mantissa * pow(256, (exponent - 3)); // Calculate the target value
+    SystemModule * module = &GLOBAL_STATE->SYSTEM_MODULE;
+    bm_job * job = GLOBAL_STATE->ASIC_TASK_MODULE.active_jobs[job_id];
 
-    double difficulty = (pow(2, 208) * 65535) / target; // Calculate the difficulty
+    if (hash_meets_target(hash, job->network_target)) {
+        module->FOUND_BLOCK = true;
+        ESP_LOGI(TAG, "FOUND BLOCK!!!!!!!!!!!!!!!!!!!!!! %f > %f", hash_to_difficulty(hash), hash_to_difficulty(job->network_target));
+    }
 
-    return difficulty;
-}
+    // the session best is never above the all time best, so a hash without enough
+    // leading zeros to beat it can be skipped before any floating point math
+    if (hash_leading_zero_bits(hash) < difficulty_leading_zero_bits(module->best_session_nonce_diff)) {
+        return;
+    }
 
-static void _check_for_best_diff(GlobalState * GLOBAL_STATE, double diff, uint8_t job_id)
-{
-    SystemModule * module = &GLOBAL_STATE->SYSTEM_MODULE;
+    double diff = hash_to_difficulty(hash);
 
     if ((uint64_t) diff > module->best_session_nonce_diff) {
         module->best_session_nonce_diff = (uint64_t) diff;
         _suffix_string((uint64_t) diff, module->best_session_diff_string, DIFF_STRING_SIZE, 0);
     }
 
-    double network_diff = _calculate_network_difficulty(GLOBAL_STATE->ASIC_TASK_MODULE.active_jobs[job_id]->target);
-    if (diff > network_diff) {
-        module->FOUND_BLOCK = true;
-        ESP_LOGI(TAG, "FOUND BLOCK!!!!!!!!!!!!!!!!!!!!!! %f > %f", diff, network_diff);
-    }
-
     if ((uint64_t) diff <= module->best_nonce_diff) {
         return;
     }
@@ -264,7 +340,7 @@ static void _check_for_best_diff(GlobalState * GLOBAL_STATE, double diff, uint8_
     // make the best_nonce_diff into a string
     _suffix_string((uint64_t) diff, module->best_diff_string, DIFF_STRING_SIZE, 0);
 
-    ESP_LOGI(TAG, "Network diff: %f", network_diff);
+    ESP_LOGI(TAG, "Network diff: %f", hash_to_difficulty(job->network_target));
 }
 
 /* Convert a uint64_t value into a truncated string for displaying with its
@@ -7,11 +7,26 @@
 #include "esp_log.h"
 #include "nvs_config.h"
 #include "utils.h"
-#include "stratum_task.h"
+#include "share_queue.h"
+#include "share_replay.h"
+#include "share_submit_task.h"
+#include "esp_timer.h"
 #include "asic.h"
 
 static const char *TAG = "asic_result";
 
+// Log the header of a block candidate and have the share submit task keep it in flash.
+static void log_block_candidate(GlobalState *GLOBAL_STATE, const bm_job *job, uint32_t nonce, uint32_t rolled_version)
+{
+    uint8_t header[80];
+    char header_hex[161];
+    block_header(job, nonce, rolled_version, header);
+    bin2hex(header, sizeof(header), header_hex, sizeof(header_hex));
+    ESP_LOGW(TAG, "Block candidate on pool %d, job %s, header %s", GLOBAL_STATE->SYSTEM_MODULE.pool_index, job->jobid, header_hex);
+
+    share_submit_save_block_header(header);
+}
+
 void ASIC_result_task(void *pvParameters)
 {
     GlobalState *GLOBAL_STATE = (GlobalState *)pvParameters;
@@ -35,31 +50,49 @@ void ASIC_result_task(void *pvParameters)
         }
 
         bm_job *active_job = GLOBAL_STATE->ASIC_TASK_MODULE.active_jobs[job_id];
-        // check the nonce difficulty
-        double nonce_diff = test_nonce_value(active_job, asic_result->nonce, asic_result->rolled_version);
-
-        //log the ASIC response
-        ESP_LOGI(TAG, "ID: %s, ver: %08" PRIX32 " Nonce %08" PRIX32 " diff %.1f of %ld.", active_job->jobid, asic_result->rolled_version, asic_result->nonce, nonce_diff, active_job->pool_diff);
+        // check the nonce against the pool target, the difficulty itself is only needed for shares
+        uint8_t hash[32];
+        nonce_hash(active_job, asic_result->nonce, asic_result->rolled_version, hash);
 
-        if (nonce_diff >= active_job->pool_diff)
+        if (!hash_meets_target(hash, active_job->pool_target))
         {
-            char * user = GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback ? GLOBAL_STATE->SYSTEM_MODULE.fallback_pool_user : GLOBAL_STATE->SYSTEM_MODULE.pool_user;
-            int ret = STRATUM_V1_submit_share(
-                GLOBAL_STATE->sock,
-                GLOBAL_STATE->send_uid++,
-                user,
-                active_job->jobid,
-                active_job->extranonce2,
-                active_job->ntime,
-                asic_result->nonce,
-                asic_result->rolled_version ^ active_job->version);
+            ESP_LOGI(TAG, "ID: %s, ver: %08" PRIX32 " Nonce %08" PRIX32 " below diff %ld.", active_job->jobid, asic_result->rolled_version, asic_result->nonce, active_job->pool_diff);
+        }
+        else
+        {
+            double nonce_diff = hash_to_difficulty(hash);
+
+            //log the ASIC response
+            ESP_LOGI(TAG, "ID: %s, ver: %08" PRIX32 " Nonce %08" PRIX32 " diff %.1f of %ld.", active_job->jobid, asic_result->rolled_version, asic_result->nonce, nonce_diff, active_job->pool_diff);
 
-            if (ret < 0) {
-                ESP_LOGI(TAG, "Unable to write share to socket. Closing connection. Ret: %d (errno %d: %s)", ret, errno, strerror(errno));
-                stratum_close_connection(GLOBAL_STATE);
+            share_submission share = {
+                .ntime = active_job->ntime,
+                .nonce = asic_result->nonce,
+                .version = asic_result->rolled_version,
+                .notify_version = active_job->notify_version,
+                .pool_diff = active_job->pool_diff,
+                .block_candidate = hash_meets_target(hash, active_job->network_target),
+            };
+            strncpy(share.jobid, active_job->jobid, sizeof(share.jobid) - 1);
+            strncpy(share.extranonce2, active_job->extranonce2, sizeof(share.extranonce2) - 1);
+            // the job holds it word swapped for the ASIC, swapping again gives the notify order back
+            swap_endian_words_bin(active_job->prev_block_hash, share.prev_block_hash, sizeof(share.prev_block_hash));
+
+            if (share.block_candidate && GLOBAL_STATE->SYSTEM_MODULE.stratum_protocol == STRATUM_PROTOCOL_V1) {
+                // skips the share queue, goes out on its own and is retried across reconnects until the pool answers
+                share_replay_add_candidate(&GLOBAL_STATE->share_replay, &share, esp_timer_get_time());
+                xTaskNotifyGive(GLOBAL_STATE->share_submit_task_handle);
+            } else if (share_queue_push(&GLOBAL_STATE->share_queue, &share)) {
+                // the share submit task sends it, hand the share over and keep reading results.
+                // Stratum V2 block candidates take this way too and get no retry: every connection opens
+                // a new channel, the share doesn't outlive the one it was found on
+                xTaskNotifyGive(GLOBAL_STATE->share_submit_task_handle);
+            }
+            if (share.block_candidate) {
+                log_block_candidate(GLOBAL_STATE, active_job, asic_result->nonce, asic_result->rolled_version);
             }
         }
 
-        SYSTEM_notify_found_nonce(GLOBAL_STATE, nonce_diff, job_id);
+        SYSTEM_notify_found_nonce(GLOBAL_STATE, hash, job_id);
     }
 }
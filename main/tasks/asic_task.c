@@ -3,6 +3,7 @@
 #include "serial.h"
 #include <string.h>
 #include "esp_log.h"
+#include "esp_timer.h"
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
@@ -37,10 +38,19 @@ void ASIC_task(void *pvParameters)
     while (1)
     {
         bm_job *next_bm_job = (bm_job *)queue_dequeue(&GLOBAL_STATE->ASIC_jobs_queue);
+        int64_t notify_received_us = next_bm_job->notify_received_us;
+
+        // a give that came in while waiting for the job was meant for this one, not the next
+        xSemaphoreTake(GLOBAL_STATE->ASIC_TASK_MODULE.semaphore, 0);
 
         //(*GLOBAL_STATE->ASIC_functions.send_work_fn)(GLOBAL_STATE, next_bm_job); // send the job to the ASIC
         ASIC_send_work(GLOBAL_STATE, next_bm_job);
 
+        if (notify_received_us != 0) {
+            GLOBAL_STATE->SYSTEM_MODULE.new_work_latency = (esp_timer_get_time() - notify_received_us) / 1000.0;
+            ESP_LOGI(TAG, "New work latency: %.2f ms", GLOBAL_STATE->SYSTEM_MODULE.new_work_latency);
+        }
+
         // Time to execute the above code is ~0.3ms
         // Delay for ASIC(s) to finish the job
         //vTaskDelay((asic_job_frequency_ms - 0.3) / portTICK_PERIOD_MS);
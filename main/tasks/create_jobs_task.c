@@ -12,16 +12,22 @@
 
 static const char *TAG = "create_jobs_task";
 
-#define QUEUE_LOW_WATER_MARK 10 // Adjust based on your requirements
+_Static_assert(BM_JOB_QUEUE_LOW_WATER_MARK < QUEUE_SIZE, "the ASIC job queue must fit its low water mark");
+
+static coinbase_builder coinbase;
+static job_format asic_job_format;
+static job_template template;
+static uint8_t merkle_root[32];
 
 static bool should_generate_more_work(GlobalState *GLOBAL_STATE);
-static void generate_work(GlobalState *GLOBAL_STATE, mining_notify *notification, uint32_t extranonce_2, uint32_t difficulty);
+static void generate_work(GlobalState *GLOBAL_STATE, mining_notify *notification, uint32_t extranonce_2, uint8_t roll, bool first_job);
 
 void create_jobs_task(void *pvParameters)
 {
     GlobalState *GLOBAL_STATE = (GlobalState *)pvParameters;
 
     uint32_t difficulty = GLOBAL_STATE->stratum_difficulty;
+    asic_job_format = ASIC_get_job_format(GLOBAL_STATE);
     while (1)
     {
         mining_notify *mining_notification = (mining_notify *)queue_dequeue(&GLOBAL_STATE->stratum_queue);
@@ -40,26 +46,61 @@ void create_jobs_task(void *pvParameters)
             GLOBAL_STATE->new_set_mining_difficulty_msg = false;
         }
 
+        // the top bits of the pool version mask are rolled here, the ASIC rolls the rest
+        uint32_t host_version_mask = host_version_bits(GLOBAL_STATE->version_mask);
+        uint32_t asic_version_mask = GLOBAL_STATE->version_mask & ~host_version_mask;
+
         if (GLOBAL_STATE->new_stratum_version_rolling_msg) {
-            ESP_LOGI(TAG, "Set chip version rolls %i", (int)(GLOBAL_STATE->version_mask >> 13));
-            ASIC_set_version_mask(GLOBAL_STATE, GLOBAL_STATE->version_mask);
+            ESP_LOGI(TAG, "Set chip version rolls %i, host version rolls %08lx", (int)(asic_version_mask >> 13), host_version_mask);
+            ASIC_set_version_mask(GLOBAL_STATE, asic_version_mask);
             GLOBAL_STATE->new_stratum_version_rolling_msg = false;
         }
 
+        if (strlen(mining_notification->job_id) >= MAX_JOB_ID_LEN) {
+            ESP_LOGE(TAG, "Job id too long: %s", mining_notification->job_id);
+            STRATUM_V1_free_mining_notify(mining_notification);
+            continue;
+        }
+
+        // header-only jobs come with their merkle root, there is no coinbase to build
+        bool header_only = mining_notification->has_merkle_root;
+        if (!header_only &&
+            coinbase_builder_init(&coinbase, mining_notification, GLOBAL_STATE->extranonce_str, GLOBAL_STATE->extranonce_2_len) != 0) {
+            ESP_LOGE(TAG, "Failed to construct coinbase_tx");
+            STRATUM_V1_free_mining_notify(mining_notification);
+            continue;
+        }
+
+        job_template_init(&template, mining_notification, asic_version_mask, difficulty, asic_job_format);
+        job_template_set_rolling(&template, host_version_mask, GLOBAL_STATE->SYSTEM_MODULE.ntime_rolling ? JOB_NTIME_ROLLS : 1);
+
         uint32_t extranonce_2 = 0;
-        while (GLOBAL_STATE->stratum_queue.count < 1 && GLOBAL_STATE->abandon_work == 0)
+        uint8_t roll = 0;
+        // after clean_jobs the first job skips the queue and the ASIC job interval
+        bool first_job = mining_notification->clean_jobs;
+        while (queue_count(&GLOBAL_STATE->stratum_queue) < 1 && GLOBAL_STATE->abandon_work == 0)
         {
-            if (should_generate_more_work(GLOBAL_STATE))
+            if (header_only && extranonce_2 > 0)
             {
-                generate_work(GLOBAL_STATE, mining_notification, extranonce_2, difficulty);
-
-                // Increase extranonce_2 for the next job.
-                extranonce_2++;
+                // every roll of the one merkle root is queued, each covers the full nonce and ASIC version space
+                ulTaskNotifyTake(pdTRUE, 100 / portTICK_PERIOD_MS);
+            }
+            else if (first_job || should_generate_more_work(GLOBAL_STATE))
+            {
+                generate_work(GLOBAL_STATE, mining_notification, extranonce_2, roll, first_job);
+                first_job = false;
+
+                // Roll the next job from the same merkle root, or increase extranonce_2 once they are used up.
+                roll++;
+                if (roll == template.rolls) {
+                    roll = 0;
+                    extranonce_2++;
+                }
             }
             else
             {
-                // If no more work needed, wait a bit before checking again.
-                vTaskDelay(100 / portTICK_PERIOD_MS);
+                // If no more work needed, wait a bit before checking again, a new notify wakes us early.
+                ulTaskNotifyTake(pdTRUE, 100 / portTICK_PERIOD_MS);
             }
         }
 
@@ -76,50 +117,39 @@ void create_jobs_task(void *pvParameters)
 
 static bool should_generate_more_work(GlobalState *GLOBAL_STATE)
 {
-    return GLOBAL_STATE->ASIC_jobs_queue.count < QUEUE_LOW_WATER_MARK;
+    return queue_count(&GLOBAL_STATE->ASIC_jobs_queue) < BM_JOB_QUEUE_LOW_WATER_MARK;
 }
 
-static void generate_work(GlobalState *GLOBAL_STATE, mining_notify *notification, uint32_t extranonce_2, uint32_t difficulty)
+static void generate_work(GlobalState *GLOBAL_STATE, mining_notify *notification, uint32_t extranonce_2, uint8_t roll, bool first_job)
 {
-    char *extranonce_2_str = extranonce_2_generate(extranonce_2, GLOBAL_STATE->extranonce_2_len);
-    if (extranonce_2_str == NULL) {
-        ESP_LOGE(TAG, "Failed to generate extranonce_2");
+    bm_job *queued_next_job = alloc_bm_job();
+    if (queued_next_job == NULL) {
+        ESP_LOGE(TAG, "No free job in the job pool");
         return;
     }
 
-    char *coinbase_tx = construct_coinbase_tx(notification->coinbase_1, notification->coinbase_2, GLOBAL_STATE->extranonce_str, extranonce_2_str);
-    if (coinbase_tx == NULL) {
-        ESP_LOGE(TAG, "Failed to construct coinbase_tx");
-        free(extranonce_2_str);
-        return;
-    }
+    // only the first roll of an extranonce_2 walks the merkle branches
+    if (roll == 0 && notification->has_merkle_root) {
+        memcpy(merkle_root, notification->merkle_root, 32);
+    } else if (roll == 0) {
+        coinbase_builder_set_extranonce_2(&coinbase, extranonce_2);
 
-    char *merkle_root = calculate_merkle_root_hash(coinbase_tx, (uint8_t(*)[32])notification->merkle_branches, notification->n_merkle_branches);
-    if (merkle_root == NULL) {
-        ESP_LOGE(TAG, "Failed to calculate merkle_root");
-        free(extranonce_2_str);
-        free(coinbase_tx);
-        return;
+        uint8_t coinbase_hash[32];
+        coinbase_builder_hash(&coinbase, coinbase_hash);
+
+        calculate_merkle_root_from_coinbase_hash(coinbase_hash, (uint8_t(*)[32])notification->merkle_branches, notification->n_merkle_branches, merkle_root);
     }
 
-    bm_job next_job = construct_bm_job(notification, merkle_root, GLOBAL_STATE->version_mask, difficulty);
+    construct_bm_job_from_template(&template, merkle_root, roll, queued_next_job);
+    extranonce_2_to_hex(extranonce_2, GLOBAL_STATE->extranonce_2_len, queued_next_job->extranonce2);
 
-    bm_job *queued_next_job = malloc(sizeof(bm_job));
-    if (queued_next_job == NULL) {
-        ESP_LOGE(TAG, "Failed to allocate memory for queued_next_job");
-        free(extranonce_2_str);
-        free(coinbase_tx);
-        free(merkle_root);
+    if (first_job) {
+        queued_next_job->notify_received_us = notification->received_us;
+        queue_enqueue_front(&GLOBAL_STATE->ASIC_jobs_queue, queued_next_job);
+        // cut short the wait on the current job, the ASIC task sends this one right away
+        xSemaphoreGive(GLOBAL_STATE->ASIC_TASK_MODULE.semaphore);
         return;
     }
 
-    memcpy(queued_next_job, &next_job, sizeof(bm_job));
-    queued_next_job->extranonce2 = extranonce_2_str; // Transfer ownership
-    queued_next_job->jobid = strdup(notification->job_id);
-    queued_next_job->version_mask = GLOBAL_STATE->version_mask;
-
     queue_enqueue(&GLOBAL_STATE->ASIC_jobs_queue, queued_next_job);
-
-    free(coinbase_tx);
-    free(merkle_root);
-}
\ No newline at end of file
+}
@@ -0,0 +1,261 @@
+#include <lwip/sockets.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "global_state.h"
+#include "nvs_config.h"
+#include "request_tracker.h"
+#include "share_queue.h"
+#include "share_replay.h"
+#include "share_submit_task.h"
+#include "stratum_api.h"
+#include "stratum_task.h"
+#include "stratum_v2_task.h"
+#include "utils.h"
+
+// a mining.submit is around 170 bytes, a dozen of them fit in one send (or 33 encrypted SubmitSharesStandard)
+#define SHARE_SUBMIT_BUFFER_SIZE 2048
+// Stratum V1 shares in one send, kept for resending when the write fails
+#define SHARE_SUBMIT_MAX_BATCH 16
+
+static const char *TAG = "share_submit";
+
+static char submit_buffer[SHARE_SUBMIT_BUFFER_SIZE];
+
+// shares in submit_buffer and where each one ends, to buffer what didn't go out when the write fails
+static share_submission batch[SHARE_SUBMIT_MAX_BATCH];
+static size_t batch_end[SHARE_SUBMIT_MAX_BATCH];
+
+// a share taken out of the replay buffer that didn't fit into the last send
+static share_submission replayed;
+static bool has_replayed;
+
+// header of the latest block candidate, waiting to be written to NVS
+static uint8_t candidate_header[80];
+static bool has_candidate_header;
+static pthread_mutex_t candidate_header_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Stratum V1 resends shares after a reconnect, the Stratum V2 task sets up a new channel every time
+static bool replay_enabled(GlobalState *GLOBAL_STATE)
+{
+    return GLOBAL_STATE->SYSTEM_MODULE.stratum_protocol == STRATUM_PROTOCOL_V1;
+}
+
+static void buffer_share(GlobalState *GLOBAL_STATE, const share_submission *share)
+{
+    if (!share_replay_add(&GLOBAL_STATE->share_replay, share, esp_timer_get_time()))
+    {
+        ESP_LOGW(TAG, "Replay buffer full, dropped the oldest share");
+    }
+}
+
+// Move the pending shares into the replay buffer while there is no connection to send them on.
+static void buffer_pending_shares(GlobalState *GLOBAL_STATE)
+{
+    const share_submission *share;
+    int buffered = 0;
+
+    if (has_replayed)
+    {
+        buffer_share(GLOBAL_STATE, &replayed);
+        has_replayed = false;
+    }
+    while ((share = share_queue_front(&GLOBAL_STATE->share_queue)) != NULL)
+    {
+        buffer_share(GLOBAL_STATE, share);
+        share_queue_release(&GLOBAL_STATE->share_queue);
+        buffered++;
+    }
+    if (buffered > 0)
+    {
+        ESP_LOGI(TAG, "No pool connection, holding %d shares for the reconnect", buffered);
+    }
+}
+
+// Write the block candidates waiting to be resent to NVS, so a reboot doesn't lose them.
+static void persist_block_candidates(GlobalState *GLOBAL_STATE)
+{
+    static replay_share candidates[SHARE_REPLAY_MAX_CANDIDATES];
+    int count;
+
+    if (share_replay_take_candidates(&GLOBAL_STATE->share_replay, candidates, &count))
+    {
+        nvs_config_set_blob(NVS_CONFIG_BLOCK_CANDIDATES, candidates, count * sizeof(replay_share));
+        nvs_config_commit();
+    }
+}
+
+void share_submit_save_block_header(const uint8_t header[80])
+{
+    pthread_mutex_lock(&candidate_header_lock);
+    memcpy(candidate_header, header, sizeof(candidate_header));
+    has_candidate_header = true;
+    pthread_mutex_unlock(&candidate_header_lock);
+}
+
+// Keep the header of the latest block candidate in flash, it is all it takes to submit the block by other means.
+// Written here rather than by the ASIC result task so the flash write never holds up reading results.
+static void persist_block_header(void)
+{
+    char header_hex[sizeof(candidate_header) * 2 + 1];
+
+    pthread_mutex_lock(&candidate_header_lock);
+    bool pending = has_candidate_header;
+    if (pending)
+    {
+        bin2hex(candidate_header, sizeof(candidate_header), header_hex, sizeof(header_hex));
+        has_candidate_header = false;
+    }
+    pthread_mutex_unlock(&candidate_header_lock);
+
+    if (pending)
+    {
+        nvs_config_set_string(NVS_CONFIG_BLOCK_HEADER, header_hex);
+        nvs_config_commit();
+    }
+}
+
+// Format as many pending shares as fit into submit_buffer, resent shares first, releasing each one as it is written.
+static size_t fill_submit_buffer(GlobalState *GLOBAL_STATE, int *batched)
+{
+    size_t len = 0;
+
+    *batched = 0;
+    while (!replay_enabled(GLOBAL_STATE) || *batched < SHARE_SUBMIT_MAX_BATCH)
+    {
+        const share_submission *share;
+        if (has_replayed || (replay_enabled(GLOBAL_STATE) && share_replay_pop(&GLOBAL_STATE->share_replay, &replayed)))
+        {
+            has_replayed = true;
+            share = &replayed;
+        }
+        else if ((share = share_queue_front(&GLOBAL_STATE->share_queue)) == NULL)
+        {
+            break;
+        }
+
+        int written;
+        if (GLOBAL_STATE->SYSTEM_MODULE.stratum_protocol == STRATUM_PROTOCOL_V2)
+        {
+            // the sequence number doubles as the tracker id, like the mining.submit id does
+            written = stratum_v2_format_submit((uint8_t *)submit_buffer + len, sizeof(submit_buffer) - len,
+                                               GLOBAL_STATE->send_uid, share);
+        }
+        else
+        {
+            char *user = GLOBAL_STATE->SYSTEM_MODULE.pools[GLOBAL_STATE->SYSTEM_MODULE.pool_index].user;
+            written = STRATUM_V1_format_submit(submit_buffer + len, sizeof(submit_buffer) - len,
+                                               GLOBAL_STATE->send_uid, user, share->jobid, share->extranonce2,
+                                               share->ntime, share->nonce, share->version ^ share->notify_version);
+        }
+        if (written < 0)
+        {
+            // the rest goes out with the next send, or once the Stratum V2 channel is open
+            break;
+        }
+        int64_t now_us = esp_timer_get_time();
+        request_tracker_add(&GLOBAL_STATE->request_tracker, GLOBAL_STATE->send_uid, share->jobid, share->pool_diff,
+                            GLOBAL_STATE->SYSTEM_MODULE.pool_index, now_us);
+        len += written;
+        if (replay_enabled(GLOBAL_STATE))
+        {
+            // a block candidate is resent after a reconnect until the pool answered it
+            share_replay_sent(&GLOBAL_STATE->share_replay, share, GLOBAL_STATE->send_uid, now_us);
+            batch[*batched] = *share;
+            batch_end[*batched] = len;
+        }
+        GLOBAL_STATE->send_uid++;
+        (*batched)++;
+        bool block_candidate = share->block_candidate;
+        if (share == &replayed)
+        {
+            has_replayed = false;
+        }
+        else
+        {
+            share_queue_release(&GLOBAL_STATE->share_queue);
+        }
+        if (block_candidate)
+        {
+            // out on its own write, the queued shares wait for the next one
+            break;
+        }
+    }
+
+    return len;
+}
+
+// Sends the shares while mining, so the ASIC result task never blocks on the network. The stratum task writes
+// its own requests to the same socket, both under send_lock.
+void share_submit_task(void *pvParameters)
+{
+    GlobalState *GLOBAL_STATE = (GlobalState *)pvParameters;
+
+    while (1)
+    {
+        ulTaskNotifyTake(pdTRUE, 1000 / portTICK_PERIOD_MS);
+
+        if (replay_enabled(GLOBAL_STATE) &&
+            (GLOBAL_STATE->sock < 0 || share_replay_suspended(&GLOBAL_STATE->share_replay)))
+        {
+            buffer_pending_shares(GLOBAL_STATE);
+        }
+
+        while (1)
+        {
+            int batched;
+            // the ids of the batch and its write must not interleave with a request from the stratum task
+            pthread_mutex_lock(&GLOBAL_STATE->send_lock);
+            size_t len = fill_submit_buffer(GLOBAL_STATE, &batched);
+            if (len == 0)
+            {
+                pthread_mutex_unlock(&GLOBAL_STATE->send_lock);
+                break;
+            }
+            if (batched > 1)
+            {
+                ESP_LOGD(TAG, "Sending %d shares in one write", batched);
+            }
+
+            size_t sent = 0;
+            int ret = 0;
+            // a write of 0 bytes makes no progress, it fails the send like an error rather than spinning under send_lock
+            while (sent < len && (ret = write(GLOBAL_STATE->sock, submit_buffer + sent, len - sent)) > 0)
+            {
+                sent += ret;
+            }
+            pthread_mutex_unlock(&GLOBAL_STATE->send_lock);
+
+            if (sent < len)
+            {
+                ESP_LOGI(TAG, "Unable to write share to socket. Closing connection. Ret: %d (errno %d: %s)", ret, errno, strerror(errno));
+                stratum_close_connection(GLOBAL_STATE);
+                if (replay_enabled(GLOBAL_STATE))
+                {
+                    // shares cut off by the failed write are resent if the session comes back
+                    for (int i = 0; i < batched; i++)
+                    {
+                        // block candidates are held since they went out
+                        if (batch_end[i] > sent && !batch[i].block_candidate)
+                        {
+                            buffer_share(GLOBAL_STATE, &batch[i]);
+                        }
+                    }
+                }
+                break;
+            }
+        }
+
+        unsigned dropped = atomic_exchange(&GLOBAL_STATE->share_queue.dropped, 0);
+        if (dropped > 0)
+        {
+            ESP_LOGW(TAG, "Share queue full, dropped %u shares", dropped);
+        }
+
+        persist_block_candidates(GLOBAL_STATE);
+        persist_block_header();
+    }
+}
@@ -0,0 +1,11 @@
+#ifndef SHARE_SUBMIT_TASK_H_
+#define SHARE_SUBMIT_TASK_H_
+
+#include <stdint.h>
+
+void share_submit_task(void *pvParameters);
+
+// hand the header of a block candidate to the share submit task, which keeps it in NVS once the share is out
+void share_submit_save_block_header(const uint8_t header[80]);
+
+#endif
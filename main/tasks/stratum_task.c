@@ -5,6 +5,8 @@
 #include "lwip/dns.h"
 #include <lwip/tcpip.h>
 #include "nvs_config.h"
+#include "pool_connect.h"
+#include "difficulty_controller.h"
 #include "stratum_task.h"
 #include "work_queue.h"
 #include "esp_wifi.h"
@@ -13,18 +15,78 @@
 #include <sys/time.h>
 #include "esp_timer.h"
 #include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
 
 #define MAX_RETRY_ATTEMPTS 3
 #define MAX_CRITICAL_RETRY_ATTEMPTS 5
 
-#define BUFFER_SIZE 1024
+// first probe round after boot, then one per interval
+#define POOL_PROBE_START_DELAY_MS 10000
+#define POOL_PROBE_INTERVAL_MS 60000
+// how often a quiet connection is checked on
+#define LIVENESS_POLL_MS 1000
 
 static const char * TAG = "stratum_task";
 
 static StratumApiV1Message stratum_api_v1_message = {};
+static StratumApiV1Message standby_message = {};
+static StratumApiV1Message probe_message = {};
 
-static const char * primary_stratum_url;
-static uint16_t primary_stratum_port;
+// lines of the connection being mined on
+static line_reader connection_reader;
+
+// difficulty suggested on the connection being mined on
+static difficulty_controller difficulty_ctl;
+
+// pool the prober wants the miner on, -1 for none. The prober only publishes it and shuts the connection down,
+// the stratum task makes the switch once its receive fails, like it takes over the standby connection.
+static atomic_int requested_pool = -1;
+
+// subscription of the last session on the main connection, a reconnect to the same pool offers it to resume
+static char * session_id;
+static int session_id_pool = -1;
+
+// the session as kept in NVS, so block candidates restored after a reboot can still go out on it
+typedef struct
+{
+    char url[128];
+    uint16_t port;
+    int32_t pool;
+    char session_id[MAX_SESSION_ID_LEN + 1];
+    char extranonce1[SHARE_REPLAY_EXTRANONCE_LEN];
+    int32_t extranonce_2_len;
+} persisted_session;
+
+// Hot standby connection to the pool the miner would fail over to. It is kept subscribed and authorized
+// with the latest notify cached, so failing over only swaps it in for the dead connection.
+typedef struct
+{
+    int sock;
+    int pool;
+    line_reader reader;
+    int send_uid;
+    int authorize_message_id;
+    bool authorized;
+    char * extranonce_str;
+    int extranonce_2_len;
+    char * session_id;
+    uint32_t version_mask;
+    uint32_t difficulty;
+    mining_notify * notify;
+} stratum_standby;
+
+static stratum_standby standby = { .sock = -1, .pool = -1 };
+// held while the standby task works on the connection and while the stratum task takes it over
+static pthread_mutex_t standby_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// lines of the probe connections
+static line_reader probe_reader;
+
+struct timeval tcp_probe_timeout = {
+    .tv_sec = 5,
+    .tv_usec = 0
+};
 
 struct timeval tcp_snd_timeout = {
     .tv_sec = 5,
@@ -56,18 +118,69 @@ void cleanQueue(GlobalState * GLOBAL_STATE) {
         GLOBAL_STATE->valid_jobs[i] = 0;
     }
     pthread_mutex_unlock(&GLOBAL_STATE->valid_jobs_lock);
+    // stop rolling the old notify right away instead of at the next poll
+    if (GLOBAL_STATE->create_jobs_task_handle != NULL) {
+        xTaskNotifyGive(GLOBAL_STATE->create_jobs_task_handle);
+    }
+}
+
+void stratum_enqueue_work(GlobalState * GLOBAL_STATE, mining_notify * notify, bool clean_jobs)
+{
+    SYSTEM_notify_new_ntime(GLOBAL_STATE, notify->ntime);
+    if (clean_jobs && (queue_count(&GLOBAL_STATE->stratum_queue) > 0 || queue_count(&GLOBAL_STATE->ASIC_jobs_queue) > 0)) {
+        cleanQueue(GLOBAL_STATE);
+    }
+    if (queue_count(&GLOBAL_STATE->stratum_queue) == QUEUE_SIZE) {
+        // create_jobs_task may have taken it in the meantime
+        mining_notify * next_notify_json_str = (mining_notify *) queue_try_dequeue(&GLOBAL_STATE->stratum_queue);
+        if (next_notify_json_str != NULL) {
+            STRATUM_V1_free_mining_notify(next_notify_json_str);
+        }
+    }
+    queue_enqueue(&GLOBAL_STATE->stratum_queue, notify);
+    if (GLOBAL_STATE->create_jobs_task_handle != NULL) {
+        xTaskNotifyGive(GLOBAL_STATE->create_jobs_task_handle);
+    }
 }
 
 void stratum_reset_uid(GlobalState * GLOBAL_STATE)
 {
     ESP_LOGI(TAG, "Resetting stratum uid");
+    pthread_mutex_lock(&GLOBAL_STATE->send_lock);
     GLOBAL_STATE->send_uid = 1;
+    pthread_mutex_unlock(&GLOBAL_STATE->send_lock);
+    // responses still owed on the old connection will never arrive
+    request_tracker_reset(&GLOBAL_STATE->request_tracker);
+}
+
+// hands out the next stratum id for a setup request and remembers when it went out,
+// call with send_lock held until the request is written
+static int track_setup_request(GlobalState * GLOBAL_STATE)
+{
+    int id = GLOBAL_STATE->send_uid++;
+    request_tracker_add(&GLOBAL_STATE->request_tracker, id, NULL, 0, GLOBAL_STATE->SYSTEM_MODULE.pool_index,
+                        esp_timer_get_time());
+    return id;
 }
 
 
+// share stats start over at failover
+static void reset_share_stats(GlobalState * GLOBAL_STATE)
+{
+    for (int i = 0; i < GLOBAL_STATE->SYSTEM_MODULE.rejected_reason_stats_count; i++) {
+        GLOBAL_STATE->SYSTEM_MODULE.rejected_reason_stats[i].count = 0;
+        GLOBAL_STATE->SYSTEM_MODULE.rejected_reason_stats[i].message[0] = '\0';
+    }
+    GLOBAL_STATE->SYSTEM_MODULE.rejected_reason_stats_count = 0;
+    GLOBAL_STATE->SYSTEM_MODULE.shares_accepted = 0;
+    GLOBAL_STATE->SYSTEM_MODULE.shares_rejected = 0;
+}
+
 void stratum_close_connection(GlobalState * GLOBAL_STATE)
 {
+    pthread_mutex_lock(&GLOBAL_STATE->send_lock);
     if (GLOBAL_STATE->sock < 0) {
+        pthread_mutex_unlock(&GLOBAL_STATE->send_lock);
         ESP_LOGE(TAG, "Socket already shutdown, not shutting down again..");
         return;
     }
@@ -75,98 +188,476 @@ void stratum_close_connection(GlobalState * GLOBAL_STATE)
     ESP_LOGE(TAG, "Shutting down socket and restarting...");
     shutdown(GLOBAL_STATE->sock, SHUT_RDWR);
     close(GLOBAL_STATE->sock);
-    cleanQueue(GLOBAL_STATE);
+    GLOBAL_STATE->sock = -1;
+    pthread_mutex_unlock(&GLOBAL_STATE->send_lock);
+    if (GLOBAL_STATE->SYSTEM_MODULE.stratum_protocol == STRATUM_PROTOCOL_V1) {
+        // keep the jobs valid so shares found until the reconnect are held for the session, it clears them once up
+        share_replay_suspend(&GLOBAL_STATE->share_replay, GLOBAL_STATE->SYSTEM_MODULE.pool_index, GLOBAL_STATE->extranonce_str);
+    } else {
+        cleanQueue(GLOBAL_STATE);
+    }
     vTaskDelay(1000 / portTICK_PERIOD_MS);
 }
 
-void stratum_primary_heartbeat(void * pvParameters)
+// first work of a new session: resend the shares held for it, drop the ones gone stale
+static void resume_share_replay(GlobalState * GLOBAL_STATE, const mining_notify * notify)
 {
-    GlobalState * GLOBAL_STATE = (GlobalState *) pvParameters;
+    int resend = share_replay_resume(&GLOBAL_STATE->share_replay, GLOBAL_STATE->SYSTEM_MODULE.pool_index,
+                                     GLOBAL_STATE->extranonce_str, notify->prev_block_hash, esp_timer_get_time());
+    if (resend > 0) {
+        ESP_LOGI(TAG, "Session resumed on the same block, resending %d shares", resend);
+        if (GLOBAL_STATE->share_submit_task_handle != NULL) {
+            xTaskNotifyGive(GLOBAL_STATE->share_submit_task_handle);
+        }
+    }
+}
 
-    ESP_LOGI(TAG, "Starting heartbeat thread for primary pool: %s:%d", primary_stratum_url, primary_stratum_port);
-    vTaskDelay(10000 / portTICK_PERIOD_MS);
+// Keep the session of the main connection in NVS, an empty session id when the pool gave none.
+static void persist_session(GlobalState * GLOBAL_STATE)
+{
+    static persisted_session saved;
+    StratumPool * pool = session_id != NULL ? &GLOBAL_STATE->SYSTEM_MODULE.pools[session_id_pool] : NULL;
+
+    memset(&saved, 0, sizeof(saved));
+    if (pool != NULL && GLOBAL_STATE->extranonce_str != NULL && strlen(pool->url) < sizeof(saved.url) &&
+        strlen(GLOBAL_STATE->extranonce_str) < sizeof(saved.extranonce1)) {
+        strcpy(saved.url, pool->url);
+        saved.port = pool->port;
+        saved.pool = session_id_pool;
+        strcpy(saved.session_id, session_id);
+        strcpy(saved.extranonce1, GLOBAL_STATE->extranonce_str);
+        saved.extranonce_2_len = GLOBAL_STATE->extranonce_2_len;
+    }
+    nvs_config_set_blob(NVS_CONFIG_STRATUM_SESSION, &saved, sizeof(saved));
+    nvs_config_commit();
+}
 
-    int addr_family = AF_INET;
-    int ip_protocol = IPPROTO_IP;
+// Block candidates restored from NVS were found on the session from before the reboot,
+// the first connection to that pool offers it so they can still be resent.
+static void restore_session(GlobalState * GLOBAL_STATE)
+{
+    static persisted_session saved;
 
-    struct timeval tcp_timeout = {
-        .tv_sec = 5,
-        .tv_usec = 0
-    };
+    if (!share_replay_suspended(&GLOBAL_STATE->share_replay) ||
+        nvs_config_get_blob(NVS_CONFIG_STRATUM_SESSION, &saved, sizeof(saved)) != sizeof(saved)) {
+        return;
+    }
+    saved.url[sizeof(saved.url) - 1] = '\0';
+    saved.session_id[sizeof(saved.session_id) - 1] = '\0';
+    saved.extranonce1[sizeof(saved.extranonce1) - 1] = '\0';
+    if (saved.session_id[0] == '\0' || saved.pool < 0 || saved.pool >= GLOBAL_STATE->SYSTEM_MODULE.pool_count) {
+        return;
+    }
+    // the pool list may have changed with the reboot
+    StratumPool * pool = &GLOBAL_STATE->SYSTEM_MODULE.pools[saved.pool];
+    if (strcmp(pool->url, saved.url) != 0 || pool->port != saved.port) {
+        return;
+    }
 
-    while (1)
-    {
-        if (GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback == false) {
-            vTaskDelay(10000 / portTICK_PERIOD_MS);
-            continue;
+    ESP_LOGI(TAG, "Restored session %s on pool %d for the block candidates found before the reboot", saved.session_id, saved.pool);
+    session_id = strdup(saved.session_id);
+    session_id_pool = saved.pool;
+    free(GLOBAL_STATE->extranonce_str);
+    GLOBAL_STATE->extranonce_str = strdup(saved.extranonce1);
+    GLOBAL_STATE->extranonce_2_len = saved.extranonce_2_len;
+}
+
+// Make the switch the prober asked for, on the stratum task so nothing else swaps the session state underneath it.
+static void switch_to_requested_pool(GlobalState * GLOBAL_STATE, int64_t now_us)
+{
+    int requested = atomic_exchange(&requested_pool, -1);
+    int current = GLOBAL_STATE->SYSTEM_MODULE.pool_index;
+    if (requested < 0 || requested == current) {
+        return;
+    }
+
+    // shares held from here on belong to the session being left
+    share_replay_suspend(&GLOBAL_STATE->share_replay, current, GLOBAL_STATE->extranonce_str);
+    // the share submit task formats a whole batch under send_lock, it sees one pool or the other
+    pthread_mutex_lock(&GLOBAL_STATE->send_lock);
+    GLOBAL_STATE->SYSTEM_MODULE.pool_index = requested;
+    pthread_mutex_unlock(&GLOBAL_STATE->send_lock);
+    reset_share_stats(GLOBAL_STATE);
+    pool_selector_switched(&GLOBAL_STATE->pool_selector, now_us);
+}
+
+// pool the standby connection should be on, -1 for none
+static int standby_target(GlobalState * GLOBAL_STATE)
+{
+    int current = GLOBAL_STATE->SYSTEM_MODULE.pool_index;
+    int target = pool_selector_best_alternative(&GLOBAL_STATE->pool_selector, current, GLOBAL_STATE->SYSTEM_MODULE.pool_selection);
+    // nothing probed healthy yet, follow the failover order
+    if (target < 0) {
+        target = pool_selector_next(&GLOBAL_STATE->pool_selector, current);
+    }
+    return target != current ? target : -1;
+}
+
+// call with standby_lock held
+static void standby_disconnect(void)
+{
+    if (standby.sock >= 0) {
+        shutdown(standby.sock, SHUT_RDWR);
+        close(standby.sock);
+        standby.sock = -1;
+    }
+    line_reader_reset(&standby.reader);
+    standby.pool = -1;
+    standby.authorized = false;
+    free(standby.extranonce_str);
+    standby.extranonce_str = NULL;
+    standby.extranonce_2_len = 0;
+    free(standby.session_id);
+    standby.session_id = NULL;
+    standby.version_mask = 0;
+    standby.difficulty = 0;
+    if (standby.notify != NULL) {
+        STRATUM_V1_free_mining_notify(standby.notify);
+        standby.notify = NULL;
+    }
+}
+
+static bool standby_is_ready(void)
+{
+    return standby.sock >= 0 && standby.authorized && standby.extranonce_str != NULL && standby.notify != NULL;
+}
+
+static int standby_connect(GlobalState * GLOBAL_STATE, int pool)
+{
+    StratumPool * stratum_pool = &GLOBAL_STATE->SYSTEM_MODULE.pools[pool];
+    char * url = stratum_pool->url;
+    uint16_t port = stratum_pool->port;
+    char host_ip[INET6_ADDRSTRLEN];
+
+    int sock = pool_connect(url, port, host_ip, sizeof(host_ip), NULL);
+    if (sock < 0) {
+        ESP_LOGD(TAG, "Standby. Failed to connect to %s:%d (error %d)", url, port, sock);
+        return -1;
+    }
+    if (setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tcp_snd_timeout, sizeof(tcp_snd_timeout)) != 0) {
+        ESP_LOGE(TAG, "Fail to setsockopt SO_SNDTIMEO");
+    }
+    if (setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO , &tcp_rcv_timeout, sizeof(tcp_rcv_timeout)) != 0) {
+        ESP_LOGE(TAG, "Fail to setsockopt SO_RCVTIMEO ");
+    }
+
+    ESP_LOGI(TAG, "Standby connected to pool %d stratum+tcp://%s:%d (%s)", pool, url, port, host_ip);
+
+    // same ids as on the main connection, ids below 5 are parsed as setup results
+    pthread_mutex_lock(&standby_lock);
+    standby.sock = sock;
+    standby.pool = pool;
+    standby.send_uid = 1;
+    STRATUM_V1_configure_version_rolling(sock, standby.send_uid++, &standby.version_mask);
+    STRATUM_V1_subscribe(sock, standby.send_uid++, GLOBAL_STATE->DEVICE_CONFIG.family.asic.name, NULL);
+    standby.authorize_message_id = standby.send_uid++;
+    STRATUM_V1_authorize(sock, standby.authorize_message_id, stratum_pool->user, stratum_pool->pass);
+    pthread_mutex_unlock(&standby_lock);
+    return 0;
+}
+
+// remember what the standby pool sent, call with standby_lock held
+static void standby_handle_line(GlobalState * GLOBAL_STATE, const char * line, int64_t line_received_us)
+{
+    STRATUM_V1_parse(&standby_message, line);
+
+    if (standby_message.method == MINING_NOTIFY) {
+        // the latest notify is all a takeover needs, it goes out with clean_jobs set
+        if (standby.notify != NULL) {
+            STRATUM_V1_free_mining_notify(standby.notify);
+        }
+        standby.notify = standby_message.mining_notification;
+        standby.notify->received_us = line_received_us;
+    } else if (standby_message.method == MINING_SET_DIFFICULTY) {
+        standby.difficulty = standby_message.new_difficulty;
+    } else if (standby_message.method == MINING_SET_VERSION_MASK ||
+            standby_message.method == STRATUM_RESULT_VERSION_MASK) {
+        standby.version_mask = standby_message.version_mask;
+    } else if (standby_message.method == MINING_SET_EXTRANONCE ||
+            standby_message.method == STRATUM_RESULT_SUBSCRIBE) {
+        free(standby.extranonce_str);
+        standby.extranonce_str = standby_message.extranonce_str;
+        standby.extranonce_2_len = standby_message.extranonce_2_len;
+        if (standby_message.method == STRATUM_RESULT_SUBSCRIBE) {
+            free(standby.session_id);
+            standby.session_id = standby_message.session_id;
+        }
+    } else if (standby_message.method == CLIENT_RECONNECT) {
+        ESP_LOGW(TAG, "Pool %d requested client reconnect on the standby connection", standby.pool);
+        standby_disconnect();
+    } else if (standby_message.method == STRATUM_RESULT_SETUP &&
+            standby_message.message_id == standby.authorize_message_id) {
+        if (!standby_message.response_success) {
+            ESP_LOGE(TAG, "Pool %d rejected authorize on the standby connection: %s", standby.pool, standby_message.error_str);
+            standby_disconnect();
+            return;
         }
+        standby.authorized = true;
+        StratumPool * stratum_pool = &GLOBAL_STATE->SYSTEM_MODULE.pools[standby.pool];
+        STRATUM_V1_suggest_difficulty(standby.sock, standby.send_uid++, stratum_pool->difficulty);
+        if (stratum_pool->extranonce_subscribe) {
+            STRATUM_V1_extranonce_subscribe(standby.sock, standby.send_uid++);
+        }
+    }
+}
 
-        char host_ip[INET_ADDRSTRLEN];
-        ESP_LOGD(TAG, "Running Heartbeat on: %s!", primary_stratum_url);
+// Swap the standby connection in for the current one: the cached extranonce, difficulty and version
+// mask are applied and the cached notify is queued as clean work. Returns false when the standby isn't
+// ready or, with pool not -1, connected to another pool.
+static bool stratum_standby_take_over(GlobalState * GLOBAL_STATE, int pool)
+{
+    pthread_mutex_lock(&standby_lock);
+    if (!standby_is_ready() || (pool >= 0 && standby.pool != pool)) {
+        pthread_mutex_unlock(&standby_lock);
+        return false;
+    }
 
-        if (!is_wifi_connected()) {
-            ESP_LOGD(TAG, "Heartbeat. Failed WiFi check!");
-            vTaskDelay(10000 / portTICK_PERIOD_MS);
+    // shares held for the old pool are stale on the new one, only block candidates wait for it to come back
+    share_replay_suspend(&GLOBAL_STATE->share_replay, GLOBAL_STATE->SYSTEM_MODULE.pool_index, GLOBAL_STATE->extranonce_str);
+    pthread_mutex_lock(&GLOBAL_STATE->send_lock);
+    if (GLOBAL_STATE->sock >= 0) {
+        shutdown(GLOBAL_STATE->sock, SHUT_RDWR);
+        close(GLOBAL_STATE->sock);
+    }
+    GLOBAL_STATE->sock = standby.sock;
+    standby.sock = -1;
+    // shares formatted for the standby connection carry its pool's user
+    GLOBAL_STATE->SYSTEM_MODULE.pool_index = standby.pool;
+    // setup replies still owed to the standby connection keep their ids
+    GLOBAL_STATE->send_uid = standby.send_uid;
+    // responses still owed on the old connection will never arrive
+    request_tracker_reset(&GLOBAL_STATE->request_tracker);
+    pthread_mutex_unlock(&GLOBAL_STATE->send_lock);
+
+    // the standby reader holds whatever arrived after its last complete line
+    line_reader reader = connection_reader;
+    connection_reader = standby.reader;
+    standby.reader = reader;
+    line_reader_reset(&standby.reader);
+
+    reset_share_stats(GLOBAL_STATE);
+
+    char * old_extranonce_str = GLOBAL_STATE->extranonce_str;
+    GLOBAL_STATE->extranonce_str = standby.extranonce_str;
+    GLOBAL_STATE->extranonce_2_len = standby.extranonce_2_len;
+    free(old_extranonce_str);
+    standby.extranonce_str = NULL;
+
+    // a later reconnect resumes the standby's session
+    free(session_id);
+    session_id = standby.session_id;
+    session_id_pool = standby.pool;
+    standby.session_id = NULL;
+    persist_session(GLOBAL_STATE);
+
+    GLOBAL_STATE->version_mask = standby.version_mask;
+    GLOBAL_STATE->new_stratum_version_rolling_msg = true;
+    if (standby.difficulty > 0) {
+        GLOBAL_STATE->stratum_difficulty = standby.difficulty;
+        GLOBAL_STATE->new_set_mining_difficulty_msg = true;
+    }
+
+    mining_notify * notify = standby.notify;
+    standby.notify = NULL;
+    standby_disconnect();
+    pthread_mutex_unlock(&standby_lock);
+
+    resume_share_replay(GLOBAL_STATE, notify);
+    // work for the old pool's extranonce is worthless now
+    cleanQueue(GLOBAL_STATE);
+    GLOBAL_STATE->abandon_work = 0;
+    notify->clean_jobs = true;
+    stratum_enqueue_work(GLOBAL_STATE, notify, true);
+    return true;
+}
+
+// keeps the standby connection up to the pool the miner would move to next
+void stratum_standby_task(void * pvParameters)
+{
+    GlobalState * GLOBAL_STATE = (GlobalState *) pvParameters;
+
+    if (line_reader_init(&standby.reader, STRATUM_LINE_BUFFER_SIZE) != 0) {
+        ESP_LOGE(TAG, "Failed to allocate the standby line buffer");
+        vTaskDelete(NULL);
+        return;
+    }
+
+    ESP_LOGI(TAG, "Starting hot standby connection");
+
+    while (1) {
+        int target = standby_target(GLOBAL_STATE);
+        if (target < 0 || !is_wifi_connected()) {
+            pthread_mutex_lock(&standby_lock);
+            if (standby.sock >= 0) {
+                standby_disconnect();
+            }
+            pthread_mutex_unlock(&standby_lock);
+            vTaskDelay(1000 / portTICK_PERIOD_MS);
             continue;
         }
 
-        struct hostent *primary_dns_addr = gethostbyname(primary_stratum_url);
-        if (primary_dns_addr == NULL) {
-            ESP_LOGD(TAG, "Heartbeat. Failed DNS check for: %s!", primary_stratum_url);
-            vTaskDelay(60000 / portTICK_PERIOD_MS);
+        // the miner moved or another pool became the better one to fail over to
+        if (standby.sock >= 0 && standby.pool != target) {
+            ESP_LOGI(TAG, "Moving standby connection from pool %d to pool %d", standby.pool, target);
+            pthread_mutex_lock(&standby_lock);
+            standby_disconnect();
+            pthread_mutex_unlock(&standby_lock);
+        }
+
+        int sock = standby.sock;
+        if (sock < 0) {
+            if (standby_connect(GLOBAL_STATE, target) != 0) {
+                vTaskDelay(10000 / portTICK_PERIOD_MS);
+            }
             continue;
         }
-        inet_ntop(AF_INET, (void *)primary_dns_addr->h_addr_list[0], host_ip, sizeof(host_ip));
 
-        struct sockaddr_in dest_addr;
-        dest_addr.sin_addr.s_addr = inet_addr(host_ip);
-        dest_addr.sin_family = AF_INET;
-        dest_addr.sin_port = htons(primary_stratum_port);
+        // wait without the lock so a takeover never waits on the standby pool
+        fd_set readfds;
+        FD_ZERO(&readfds);
+        FD_SET(sock, &readfds);
+        struct timeval timeout = { .tv_sec = 1, .tv_usec = 0 };
+        if (select(sock + 1, &readfds, NULL, NULL, &timeout) <= 0) {
+            continue;
+        }
 
-        int sock = socket(addr_family, SOCK_STREAM, ip_protocol);
-        if (sock < 0) {
-            ESP_LOGD(TAG, "Heartbeat. Failed socket create check!");
-            vTaskDelay(60000 / portTICK_PERIOD_MS);
+        pthread_mutex_lock(&standby_lock);
+        // taken over while waiting
+        if (standby.sock != sock) {
+            pthread_mutex_unlock(&standby_lock);
             continue;
         }
 
-        int err = connect(sock, (struct sockaddr *)&dest_addr, sizeof(struct sockaddr_in6));
-        if (err != 0)
-        {
-            ESP_LOGD(TAG, "Heartbeat. Failed connect check: %s:%d (errno %d: %s)", host_ip, primary_stratum_port, errno, strerror(errno));
-            close(sock);
-            vTaskDelay(60000 / portTICK_PERIOD_MS);
+        size_t space;
+        char * write_ptr = line_reader_write_ptr(&standby.reader, &space);
+        int nbytes = space > 0 ? recv(sock, write_ptr, space, 0) : -1;
+        if (nbytes <= 0) {
+            ESP_LOGW(TAG, "Standby connection to pool %d lost", standby.pool);
+            standby_disconnect();
+            pthread_mutex_unlock(&standby_lock);
+            vTaskDelay(5000 / portTICK_PERIOD_MS);
             continue;
         }
+        line_reader_commit(&standby.reader, nbytes);
 
-        if (setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO , &tcp_timeout, sizeof(tcp_timeout)) != 0) {
-            ESP_LOGE(TAG, "Fail to setsockopt SO_RCVTIMEO ");
+        int64_t line_received_us = esp_timer_get_time();
+        char * line;
+        size_t line_len;
+        while (standby.sock == sock && (line = line_reader_next(&standby.reader, &line_len)) != NULL) {
+            standby_handle_line(GLOBAL_STATE, line, line_received_us);
         }
+        bool dropped = standby.sock != sock;
+        pthread_mutex_unlock(&standby_lock);
 
-        int send_uid = 1;
-        STRATUM_V1_subscribe(sock, send_uid++, GLOBAL_STATE->DEVICE_CONFIG.family.asic.name);
-        STRATUM_V1_authorize(sock, send_uid++, GLOBAL_STATE->SYSTEM_MODULE.pool_user, GLOBAL_STATE->SYSTEM_MODULE.pool_pass);
+        // dropped on a reconnect request or rejected authorize, don't hammer the pool
+        if (dropped) {
+            vTaskDelay(10000 / portTICK_PERIOD_MS);
+        }
+    }
+}
 
-        char recv_buffer[BUFFER_SIZE];
-        memset(recv_buffer, 0, BUFFER_SIZE);
-        int bytes_received = recv(sock, recv_buffer, BUFFER_SIZE - 1, 0);
+// Time the TCP connect and the mining.subscribe round trip to a pool and hand the result to the selector.
+static void probe_pool(GlobalState * GLOBAL_STATE, int pool)
+{
+    StratumPool * stratum_pool = &GLOBAL_STATE->SYSTEM_MODULE.pools[pool];
+
+    // connect time without DNS, a cache miss shouldn't count against the pool
+    int64_t connect_us = 0;
+    int sock = pool_connect(stratum_pool->url, stratum_pool->port, NULL, 0, &connect_us);
+    if (sock < 0) {
+        ESP_LOGD(TAG, "Probe. Failed connect check: %s:%d (error %d)", stratum_pool->url, stratum_pool->port, sock);
+        pool_selector_report(&GLOBAL_STATE->pool_selector, pool, false, 0, 0);
+        return;
+    }
+    int64_t connected_us = esp_timer_get_time();
 
-        shutdown(sock, SHUT_RDWR);
-        close(sock);
+    if (setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO , &tcp_probe_timeout, sizeof(tcp_probe_timeout)) != 0) {
+        ESP_LOGE(TAG, "Fail to setsockopt SO_RCVTIMEO ");
+    }
 
-        if (bytes_received == -1)  {
-            vTaskDelay(60000 / portTICK_PERIOD_MS);
-            continue;
+    line_reader_reset(&probe_reader);
+    STRATUM_V1_subscribe(sock, STRATUM_ID_SUBSCRIBE, GLOBAL_STATE->DEVICE_CONFIG.family.asic.name, NULL);
+    size_t line_len;
+    char * line = STRATUM_V1_receive_line(&probe_reader, sock, &line_len);
+    int64_t answered_us = esp_timer_get_time();
+
+    shutdown(sock, SHUT_RDWR);
+    close(sock);
+
+    bool ok = false;
+    if (line != NULL) {
+        STRATUM_V1_parse(&probe_message, line);
+        ok = probe_message.method == STRATUM_RESULT_SUBSCRIBE && probe_message.response_success;
+        free(probe_message.extranonce_str);
+        probe_message.extranonce_str = NULL;
+        if (probe_message.method == STRATUM_RESULT_SUBSCRIBE) {
+            free(probe_message.session_id);
+            probe_message.session_id = NULL;
         }
+    }
 
-        if (strstr(recv_buffer, "mining.notify") != NULL) {
-            ESP_LOGI(TAG, "Heartbeat successful and in fallback mode. Switching back to primary.");
-            GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback = false;
-            stratum_close_connection(GLOBAL_STATE);
+    double connect_ms = connect_us / 1000.0;
+    double rtt_ms = (answered_us - connected_us) / 1000.0;
+    ESP_LOGD(TAG, "Probe. Pool %d %s:%d %s, connect %.1f ms, subscribe %.1f ms", pool, stratum_pool->url,
+             stratum_pool->port, ok ? "up" : "down", connect_ms, rtt_ms);
+    pool_selector_report(&GLOBAL_STATE->pool_selector, pool, ok, connect_ms, rtt_ms);
+}
+
+// Probes the configured pools once a minute and has the stratum task move the miner when the selector picks another pool,
+// back to an earlier pool in priority mode or to a clearly faster one in latency mode.
+// Latency mode probes every pool, priority mode only the ones that can take over.
+void stratum_pool_prober(void * pvParameters)
+{
+    GlobalState * GLOBAL_STATE = (GlobalState *) pvParameters;
+
+    if (line_reader_init(&probe_reader, STRATUM_LINE_BUFFER_SIZE) != 0) {
+        ESP_LOGE(TAG, "Failed to allocate the probe line buffer");
+        vTaskDelete(NULL);
+        return;
+    }
+
+    ESP_LOGI(TAG, "Starting pool prober for %d pools", GLOBAL_STATE->SYSTEM_MODULE.pool_count);
+    vTaskDelay(POOL_PROBE_START_DELAY_MS / portTICK_PERIOD_MS);
+
+    while (1)
+    {
+        if (!is_wifi_connected()) {
+            ESP_LOGD(TAG, "Probe. Failed WiFi check!");
+            vTaskDelay(10000 / portTICK_PERIOD_MS);
             continue;
         }
 
-        vTaskDelay(60000 / portTICK_PERIOD_MS);
+        int current = GLOBAL_STATE->SYSTEM_MODULE.pool_index;
+        if (GLOBAL_STATE->SYSTEM_MODULE.pool_selection == POOL_SELECTION_PRIORITY) {
+            // only pools ranked before the current one can win, plus the one the standby and failover go to
+            for (int pool = 0; pool < current; pool++) {
+                probe_pool(GLOBAL_STATE, pool);
+            }
+            int target = standby_target(GLOBAL_STATE);
+            if (target > current) {
+                probe_pool(GLOBAL_STATE, target);
+            }
+        } else {
+            for (int pool = 0; pool < GLOBAL_STATE->SYSTEM_MODULE.pool_count; pool++) {
+                probe_pool(GLOBAL_STATE, pool);
+            }
+        }
+
+        int64_t now_us = esp_timer_get_time();
+        int choice = pool_selector_choose(&GLOBAL_STATE->pool_selector, current,
+                                          GLOBAL_STATE->SYSTEM_MODULE.pool_selection, now_us);
+        if (choice != current) {
+            ESP_LOGI(TAG, "Switching from pool %d (%s) to pool %d (%s)", current, GLOBAL_STATE->SYSTEM_MODULE.pools[current].url,
+                     choice, GLOBAL_STATE->SYSTEM_MODULE.pools[choice].url);
+            atomic_store(&requested_pool, choice);
+            pthread_mutex_lock(&GLOBAL_STATE->send_lock);
+            if (GLOBAL_STATE->sock >= 0) {
+                shutdown(GLOBAL_STATE->sock, SHUT_RDWR);
+            }
+            pthread_mutex_unlock(&GLOBAL_STATE->send_lock);
+        }
+
+        vTaskDelay(POOL_PROBE_INTERVAL_MS / portTICK_PERIOD_MS);
     }
 }
 
@@ -174,24 +665,29 @@ void stratum_task(void * pvParameters)
 {
     GlobalState * GLOBAL_STATE = (GlobalState *) pvParameters;
 
-    primary_stratum_url = GLOBAL_STATE->SYSTEM_MODULE.pool_url;
-    primary_stratum_port = GLOBAL_STATE->SYSTEM_MODULE.pool_port;
-    char * stratum_url = GLOBAL_STATE->SYSTEM_MODULE.pool_url;
-    uint16_t port = GLOBAL_STATE->SYSTEM_MODULE.pool_port;
-    bool extranonce_subscribe = GLOBAL_STATE->SYSTEM_MODULE.pool_extranonce_subscribe;
-    uint16_t difficulty = GLOBAL_STATE->SYSTEM_MODULE.pool_difficulty;
-
-    STRATUM_V1_initialize_buffer();
-    char host_ip[20];
-    int addr_family = AF_INET;
-    int ip_protocol = IPPROTO_IP;
+    StratumPool * pool = &GLOBAL_STATE->SYSTEM_MODULE.pools[GLOBAL_STATE->SYSTEM_MODULE.pool_index];
+    bool extranonce_subscribe = pool->extranonce_subscribe;
+
+    if (line_reader_init(&connection_reader, STRATUM_LINE_BUFFER_SIZE) != 0) {
+        ESP_LOGE(TAG, "Failed to allocate the stratum line buffer");
+        vTaskDelete(NULL);
+        return;
+    }
+    difficulty_controller_init(&difficulty_ctl, GLOBAL_STATE->SYSTEM_MODULE.target_share_rate);
+    restore_session(GLOBAL_STATE);
+    char host_ip[INET6_ADDRSTRLEN];
     int retry_attempts = 0;
     int retry_critical_attempts = 0;
 
 
-    xTaskCreate(stratum_primary_heartbeat, "stratum primary heartbeat", 8192, pvParameters, 1, NULL);
+    if (GLOBAL_STATE->SYSTEM_MODULE.pool_count > 1) {
+        xTaskCreate(stratum_pool_prober, "stratum pool prober", 8192, pvParameters, 1, NULL);
+        if (GLOBAL_STATE->SYSTEM_MODULE.fallback_hot_standby) {
+            xTaskCreate(stratum_standby_task, "stratum standby", 8192, pvParameters, 4, NULL);
+        }
+    }
 
-    ESP_LOGI(TAG, "Opening connection to pool: %s:%d", stratum_url, port);
+    ESP_LOGI(TAG, "Opening connection to pool: %s:%d", pool->url, pool->port);
     while (1) {
         if (!is_wifi_connected()) {
             ESP_LOGI(TAG, "WiFi disconnected, attempting to reconnect...");
@@ -201,52 +697,35 @@ void stratum_task(void * pvParameters)
 
         if (retry_attempts >= MAX_RETRY_ATTEMPTS)
         {
-            if (GLOBAL_STATE->SYSTEM_MODULE.fallback_pool_url == NULL || GLOBAL_STATE->SYSTEM_MODULE.fallback_pool_url[0] == '\0') {
+            if (GLOBAL_STATE->SYSTEM_MODULE.pool_count < 2) {
                 ESP_LOGI(TAG, "Unable to switch to fallback. No url configured. (retries: %d)...", retry_attempts);
-                GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback = false;
                 retry_attempts = 0;
                 continue;
             }
 
-            GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback = !GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback;
-            
-            // Reset share stats at failover
-            for (int i = 0; i < GLOBAL_STATE->SYSTEM_MODULE.rejected_reason_stats_count; i++) {
-                GLOBAL_STATE->SYSTEM_MODULE.rejected_reason_stats[i].count = 0;
-                GLOBAL_STATE->SYSTEM_MODULE.rejected_reason_stats[i].message[0] = '\0';
-            }
-            GLOBAL_STATE->SYSTEM_MODULE.rejected_reason_stats_count = 0;
-            GLOBAL_STATE->SYSTEM_MODULE.shares_accepted = 0;
-            GLOBAL_STATE->SYSTEM_MODULE.shares_rejected = 0;
+            GLOBAL_STATE->SYSTEM_MODULE.pool_index = pool_selector_next(&GLOBAL_STATE->pool_selector, GLOBAL_STATE->SYSTEM_MODULE.pool_index);
+            reset_share_stats(GLOBAL_STATE);
 
             ESP_LOGI(TAG, "Switching target due to too many failures (retries: %d)...", retry_attempts);
             retry_attempts = 0;
         }
 
-        stratum_url = GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback ? GLOBAL_STATE->SYSTEM_MODULE.fallback_pool_url : GLOBAL_STATE->SYSTEM_MODULE.pool_url;
-        port = GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback ? GLOBAL_STATE->SYSTEM_MODULE.fallback_pool_port : GLOBAL_STATE->SYSTEM_MODULE.pool_port;
-        extranonce_subscribe = GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback ? GLOBAL_STATE->SYSTEM_MODULE.fallback_pool_extranonce_subscribe : GLOBAL_STATE->SYSTEM_MODULE.pool_extranonce_subscribe;
-        difficulty = GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback ? GLOBAL_STATE->SYSTEM_MODULE.fallback_pool_difficulty : GLOBAL_STATE->SYSTEM_MODULE.pool_difficulty;
-
-        struct hostent *dns_addr = gethostbyname(stratum_url);
-        if (dns_addr == NULL) {
+        // a switch the prober asked for while there was no connection to shut down
+        switch_to_requested_pool(GLOBAL_STATE, esp_timer_get_time());
+        int session_pool = GLOBAL_STATE->SYSTEM_MODULE.pool_index;
+        pool = &GLOBAL_STATE->SYSTEM_MODULE.pools[session_pool];
+        extranonce_subscribe = pool->extranonce_subscribe;
+        uint16_t difficulty = pool->difficulty;
+
+        ESP_LOGI(TAG, "Connecting to: stratum+tcp://%s:%d", pool->url, pool->port);
+        GLOBAL_STATE->sock = pool_connect(pool->url, pool->port, host_ip, sizeof(host_ip), NULL);
+        if (GLOBAL_STATE->sock == POOL_CONNECT_ERR_DNS) {
+            pool_selector_report(&GLOBAL_STATE->pool_selector, session_pool, false, 0, 0);
             retry_attempts++;
             vTaskDelay(1000 / portTICK_PERIOD_MS);
             continue;
         }
-        inet_ntop(AF_INET, (void *)dns_addr->h_addr_list[0], host_ip, sizeof(host_ip));
-
-        ESP_LOGI(TAG, "Connecting to: stratum+tcp://%s:%d (%s)", stratum_url, port, host_ip);
-
-        struct sockaddr_in dest_addr;
-        dest_addr.sin_addr.s_addr = inet_addr(host_ip);
-        dest_addr.sin_family = AF_INET;
-        dest_addr.sin_port = htons(port);
-
-        GLOBAL_STATE->sock = socket(addr_family, SOCK_STREAM, ip_protocol);
-        vTaskDelay(300 / portTICK_PERIOD_MS);
-        if (GLOBAL_STATE->sock < 0) {
-            ESP_LOGE(TAG, "Unable to create socket: errno %d", errno);
+        if (GLOBAL_STATE->sock == POOL_CONNECT_ERR_SOCKET) {
             if (++retry_critical_attempts > MAX_CRITICAL_RETRY_ATTEMPTS) {
                 ESP_LOGE(TAG, "Max retry attempts reached, restarting...");
                 esp_restart();
@@ -255,20 +734,15 @@ void stratum_task(void * pvParameters)
             continue;
         }
         retry_critical_attempts = 0;
-
-        ESP_LOGI(TAG, "Socket created, connecting to %s:%d", host_ip, port);
-        int err = connect(GLOBAL_STATE->sock, (struct sockaddr *)&dest_addr, sizeof(struct sockaddr_in6));
-        if (err != 0)
-        {
+        if (GLOBAL_STATE->sock < 0) {
+            pool_selector_report(&GLOBAL_STATE->pool_selector, session_pool, false, 0, 0);
             retry_attempts++;
-            ESP_LOGE(TAG, "Socket unable to connect to %s:%d (errno %d: %s)", stratum_url, port, errno, strerror(errno));
-            // close the socket
-            shutdown(GLOBAL_STATE->sock, SHUT_RDWR);
-            close(GLOBAL_STATE->sock);
+            ESP_LOGE(TAG, "Socket unable to connect to %s:%d", pool->url, pool->port);
             // instead of restarting, retry this every 5 seconds
             vTaskDelay(5000 / portTICK_PERIOD_MS);
             continue;
         }
+        ESP_LOGI(TAG, "Connected to %s:%d (%s)", pool->url, pool->port, host_ip);
 
         if (setsockopt(GLOBAL_STATE->sock, SOL_SOCKET, SO_SNDTIMEO, &tcp_snd_timeout, sizeof(tcp_snd_timeout)) != 0) {
             ESP_LOGE(TAG, "Fail to setsockopt SO_SNDTIMEO");
@@ -278,56 +752,119 @@ void stratum_task(void * pvParameters)
             ESP_LOGE(TAG, "Fail to setsockopt SO_RCVTIMEO ");
         }
 
+        // Back on the pool of the last session: offer its subscription and keep the work in flight,
+        // it is only cleared if the pool hands out another extranonce.
+        bool resuming = session_id != NULL && session_id_pool == session_pool && GLOBAL_STATE->extranonce_str != NULL;
         stratum_reset_uid(GLOBAL_STATE);
-        cleanQueue(GLOBAL_STATE);
+        if (!resuming) {
+            cleanQueue(GLOBAL_STATE);
+        }
+        // drop anything left over from the previous connection
+        line_reader_reset(&connection_reader);
 
         ///// Start Stratum Action
+        pthread_mutex_lock(&GLOBAL_STATE->send_lock);
         // mining.configure - ID: 1
-        STRATUM_V1_configure_version_rolling(GLOBAL_STATE->sock, GLOBAL_STATE->send_uid++, &GLOBAL_STATE->version_mask);
+        STRATUM_V1_configure_version_rolling(GLOBAL_STATE->sock, track_setup_request(GLOBAL_STATE), &GLOBAL_STATE->version_mask);
 
         // mining.subscribe - ID: 2
-        STRATUM_V1_subscribe(GLOBAL_STATE->sock, GLOBAL_STATE->send_uid++, GLOBAL_STATE->DEVICE_CONFIG.family.asic.name);
-
-        char * username = GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback ? GLOBAL_STATE->SYSTEM_MODULE.fallback_pool_user : GLOBAL_STATE->SYSTEM_MODULE.pool_user;
-        char * password = GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback ? GLOBAL_STATE->SYSTEM_MODULE.fallback_pool_pass : GLOBAL_STATE->SYSTEM_MODULE.pool_pass;
+        int subscribe_message_id = track_setup_request(GLOBAL_STATE);
+        if (resuming) {
+            ESP_LOGI(TAG, "Resuming session %s", session_id);
+        }
+        STRATUM_V1_subscribe(GLOBAL_STATE->sock, subscribe_message_id, GLOBAL_STATE->DEVICE_CONFIG.family.asic.name,
+                             resuming ? session_id : NULL);
 
-        int authorize_message_id = GLOBAL_STATE->send_uid++;
+        int authorize_message_id = track_setup_request(GLOBAL_STATE);
         //mining.authorize - ID: 3
-        STRATUM_V1_authorize(GLOBAL_STATE->sock, authorize_message_id, username, password);
-        STRATUM_V1_stamp_tx(authorize_message_id);
+        STRATUM_V1_authorize(GLOBAL_STATE->sock, authorize_message_id, pool->user, pool->pass);
+        pthread_mutex_unlock(&GLOBAL_STATE->send_lock);
 
         // Everything is set up, lets make sure we don't abandon work unnecessarily.
         GLOBAL_STATE->abandon_work = 0;
+        pool_liveness_connected(&GLOBAL_STATE->pool_liveness, esp_timer_get_time());
 
         while (1) {
-            char * line = STRATUM_V1_receive_jsonrpc_line(GLOBAL_STATE->sock);
+            size_t line_len;
+            bool timed_out;
+            char * line = STRATUM_V1_receive_line_timeout(&connection_reader, GLOBAL_STATE->sock, &line_len, LIVENESS_POLL_MS, &timed_out);
+            int64_t line_received_us = esp_timer_get_time();
+            if (!line && timed_out) {
+                pool_liveness_state liveness = pool_liveness_check(&GLOBAL_STATE->pool_liveness,
+                    request_tracker_oldest_share_us(&GLOBAL_STATE->request_tracker),
+                    request_tracker_latency_percentile_ms(&GLOBAL_STATE->request_tracker, session_pool, 99), line_received_us);
+                if (liveness == POOL_LIVENESS_OK) {
+                    continue;
+                }
+                if (liveness == POOL_LIVENESS_PROBE) {
+                    // suggesting the difficulty already in effect changes nothing. Pools that answer it get their
+                    // probe answered; ckpool and its forks accept it silently, which is why an unanswered probe only
+                    // counts against a pool that has gone silent altogether
+                    ESP_LOGW(TAG, "Pool %d is quiet, probing it", session_pool);
+                    uint32_t probe_difficulty = GLOBAL_STATE->stratum_difficulty > 0 ? GLOBAL_STATE->stratum_difficulty : difficulty;
+                    pthread_mutex_lock(&GLOBAL_STATE->send_lock);
+                    STRATUM_V1_suggest_difficulty(GLOBAL_STATE->sock, track_setup_request(GLOBAL_STATE), probe_difficulty);
+                    pthread_mutex_unlock(&GLOBAL_STATE->send_lock);
+                    continue;
+                }
+                ESP_LOGE(TAG, "Pool %d stopped answering", session_pool);
+            }
             if (!line) {
+                pool_liveness_lost(&GLOBAL_STATE->pool_liveness);
+                switch_to_requested_pool(GLOBAL_STATE, line_received_us);
+                // a session closed by the prober only hands over to a standby on the pool it picked
+                bool switched = GLOBAL_STATE->SYSTEM_MODULE.pool_index != session_pool;
+                if (stratum_standby_take_over(GLOBAL_STATE, switched ? GLOBAL_STATE->SYSTEM_MODULE.pool_index : -1)) {
+                    ESP_LOGW(TAG, "Pool %d connection closed, switched to the pool %d standby connection", session_pool,
+                             GLOBAL_STATE->SYSTEM_MODULE.pool_index);
+                    retry_attempts = 0;
+                    session_pool = GLOBAL_STATE->SYSTEM_MODULE.pool_index;
+                    pool = &GLOBAL_STATE->SYSTEM_MODULE.pools[session_pool];
+                    // the standby connection suggested the pool's configured difficulty
+                    difficulty_controller_start(&difficulty_ctl, pool->difficulty, 0, line_received_us);
+                    // the standby's cached notify is fresh work
+                    pool_liveness_connected(&GLOBAL_STATE->pool_liveness, line_received_us);
+                    pool_liveness_received(&GLOBAL_STATE->pool_liveness, true, line_received_us);
+                    // the standby connection did its own setup
+                    extranonce_subscribe = false;
+                    continue;
+                }
                 ESP_LOGE(TAG, "Failed to receive JSON-RPC line, reconnecting...");
-                retry_attempts++;
+                if (!switched) {
+                    retry_attempts++;
+                }
                 stratum_close_connection(GLOBAL_STATE);
                 break;
             }
 
-            double response_time_ms = STRATUM_V1_get_response_time_ms(stratum_api_v1_message.message_id);
-            if (response_time_ms >= 0) {
+            STRATUM_V1_parse(&stratum_api_v1_message, line);
+            pool_liveness_received(&GLOBAL_STATE->pool_liveness, stratum_api_v1_message.method == MINING_NOTIFY, line_received_us);
+
+            tracked_request request;
+            bool is_tracked = request_tracker_complete(&GLOBAL_STATE->request_tracker, stratum_api_v1_message.message_id,
+                                                       stratum_api_v1_message.response_success, line_received_us, &request);
+            if (is_tracked) {
+                double response_time_ms = (line_received_us - request.sent_us) / 1000.0;
                 ESP_LOGI(TAG, "Stratum response time: %.2f ms", response_time_ms);
                 GLOBAL_STATE->SYSTEM_MODULE.response_time = response_time_ms;
             }
 
-            STRATUM_V1_parse(&stratum_api_v1_message, line);
-            free(line);
-
             if (stratum_api_v1_message.method == MINING_NOTIFY) {
-                SYSTEM_notify_new_ntime(GLOBAL_STATE, stratum_api_v1_message.mining_notification->ntime);
-                if (stratum_api_v1_message.should_abandon_work &&
-                    (GLOBAL_STATE->stratum_queue.count > 0 || GLOBAL_STATE->ASIC_jobs_queue.count > 0)) {
-                    cleanQueue(GLOBAL_STATE);
+                stratum_api_v1_message.mining_notification->received_us = line_received_us;
+                if (share_replay_suspended(&GLOBAL_STATE->share_replay)) {
+                    resume_share_replay(GLOBAL_STATE, stratum_api_v1_message.mining_notification);
                 }
-                if (GLOBAL_STATE->stratum_queue.count == QUEUE_SIZE) {
-                    mining_notify * next_notify_json_str = (mining_notify *) queue_dequeue(&GLOBAL_STATE->stratum_queue);
-                    STRATUM_V1_free_mining_notify(next_notify_json_str);
+                stratum_enqueue_work(GLOBAL_STATE, stratum_api_v1_message.mining_notification, stratum_api_v1_message.should_abandon_work);
+
+                // keep the share rate on target as the hashrate changes
+                uint32_t suggestion = difficulty_controller_update(&difficulty_ctl, GLOBAL_STATE->SYSTEM_MODULE.current_hashrate,
+                                                                   line_received_us);
+                if (suggestion > 0) {
+                    ESP_LOGI(TAG, "Suggesting difficulty %lu for %.2f GH/s", suggestion, GLOBAL_STATE->SYSTEM_MODULE.current_hashrate);
+                    pthread_mutex_lock(&GLOBAL_STATE->send_lock);
+                    STRATUM_V1_suggest_difficulty(GLOBAL_STATE->sock, track_setup_request(GLOBAL_STATE), suggestion);
+                    pthread_mutex_unlock(&GLOBAL_STATE->send_lock);
                 }
-                queue_enqueue(&GLOBAL_STATE->stratum_queue, stratum_api_v1_message.mining_notification);
             } else if (stratum_api_v1_message.method == MINING_SET_DIFFICULTY) {
                 ESP_LOGI(TAG, "Set stratum difficulty: %ld", stratum_api_v1_message.new_difficulty);
                 GLOBAL_STATE->stratum_difficulty = stratum_api_v1_message.new_difficulty;
@@ -340,20 +877,54 @@ void stratum_task(void * pvParameters)
             } else if (stratum_api_v1_message.method == MINING_SET_EXTRANONCE ||
                     stratum_api_v1_message.method == STRATUM_RESULT_SUBSCRIBE) {
                 ESP_LOGI(TAG, "Set extranonce: %s, extranonce_2_len: %d", stratum_api_v1_message.extranonce_str, stratum_api_v1_message.extranonce_2_len);
+                bool session_changed = true;
+                if (stratum_api_v1_message.method == STRATUM_RESULT_SUBSCRIBE) {
+                    bool resumed = resuming && strcmp(GLOBAL_STATE->extranonce_str, stratum_api_v1_message.extranonce_str) == 0 &&
+                                   GLOBAL_STATE->extranonce_2_len == stratum_api_v1_message.extranonce_2_len;
+                    if (resumed) {
+                        ESP_LOGI(TAG, "Session resumed, keeping the work in flight");
+                        session_changed = false;
+                    } else if (resuming) {
+                        ESP_LOGI(TAG, "Pool started a new session");
+                        cleanQueue(GLOBAL_STATE);
+                    }
+                    resuming = false;
+                    free(session_id);
+                    session_id = stratum_api_v1_message.session_id;
+                    session_id_pool = session_pool;
+                }
                 char * old_extranonce_str = GLOBAL_STATE->extranonce_str;
                 GLOBAL_STATE->extranonce_str = stratum_api_v1_message.extranonce_str;
                 GLOBAL_STATE->extranonce_2_len = stratum_api_v1_message.extranonce_2_len;
                 free(old_extranonce_str);
+                if (session_changed) {
+                    persist_session(GLOBAL_STATE);
+                }
             } else if (stratum_api_v1_message.method == CLIENT_RECONNECT) {
                 ESP_LOGE(TAG, "Pool requested client reconnect...");
                 stratum_close_connection(GLOBAL_STATE);
                 break;
+            } else if (stratum_api_v1_message.method == STRATUM_RESULT && is_tracked && request.difficulty == 0) {
+                // answer to a request made after setup that isn't a share, like a later mining.suggest_difficulty
+                ESP_LOGI(TAG, "message result %s", stratum_api_v1_message.response_success ? "accepted" : "rejected");
             } else if (stratum_api_v1_message.method == STRATUM_RESULT) {
+                if (is_tracked) {
+                    // a block candidate isn't resent once the pool answered it
+                    share_replay_answered(&GLOBAL_STATE->share_replay, stratum_api_v1_message.message_id);
+                }
                 if (stratum_api_v1_message.response_success) {
-                    ESP_LOGI(TAG, "message result accepted");
+                    if (is_tracked && request.difficulty > 0) {
+                        ESP_LOGI(TAG, "share for job %s accepted at diff %lu", request.jobid, request.difficulty);
+                    } else {
+                        ESP_LOGI(TAG, "message result accepted");
+                    }
                     SYSTEM_notify_accepted_share(GLOBAL_STATE);
                 } else {
-                    ESP_LOGW(TAG, "message result rejected: %s", stratum_api_v1_message.error_str);
+                    if (is_tracked && request.difficulty > 0) {
+                        ESP_LOGW(TAG, "share for job %s rejected at diff %lu: %s", request.jobid, request.difficulty, stratum_api_v1_message.error_str);
+                    } else {
+                        ESP_LOGW(TAG, "message result rejected: %s", stratum_api_v1_message.error_str);
+                    }
                     SYSTEM_notify_rejected_share(GLOBAL_STATE, stratum_api_v1_message.error_str);
                 }
             } else if (stratum_api_v1_message.method == STRATUM_RESULT_SETUP) {
@@ -361,14 +932,26 @@ void stratum_task(void * pvParameters)
                 retry_attempts = 0;
                 if (stratum_api_v1_message.response_success) {
                     ESP_LOGI(TAG, "setup message accepted");
+                    pthread_mutex_lock(&GLOBAL_STATE->send_lock);
                     if (stratum_api_v1_message.message_id == authorize_message_id) {
-                        STRATUM_V1_suggest_difficulty(GLOBAL_STATE->sock, GLOBAL_STATE->send_uid++, difficulty);
+                        uint32_t suggestion = difficulty_controller_start(&difficulty_ctl, difficulty,
+                                                                          GLOBAL_STATE->SYSTEM_MODULE.current_hashrate, line_received_us);
+                        STRATUM_V1_suggest_difficulty(GLOBAL_STATE->sock, track_setup_request(GLOBAL_STATE), suggestion);
                     }
                     if (extranonce_subscribe) {
-                        STRATUM_V1_extranonce_subscribe(GLOBAL_STATE->sock, GLOBAL_STATE->send_uid++);
+                        STRATUM_V1_extranonce_subscribe(GLOBAL_STATE->sock, track_setup_request(GLOBAL_STATE));
                     }
+                    pthread_mutex_unlock(&GLOBAL_STATE->send_lock);
                 } else {
                     ESP_LOGE(TAG, "setup message rejected: %s", stratum_api_v1_message.error_str);
+                    if (stratum_api_v1_message.message_id == subscribe_message_id && resuming) {
+                        // the pool wouldn't take the old subscription, start over with a new session
+                        ESP_LOGW(TAG, "Pool refused to resume the session, reconnecting");
+                        free(session_id);
+                        session_id = NULL;
+                        stratum_close_connection(GLOBAL_STATE);
+                        break;
+                    }
                 }
             }
         }
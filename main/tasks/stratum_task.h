@@ -3,5 +3,11 @@
 
 void stratum_task(void *pvParameters);
 void stratum_close_connection(GlobalState * GLOBAL_STATE);
+void stratum_reset_uid(GlobalState * GLOBAL_STATE);
+void cleanQueue(GlobalState * GLOBAL_STATE);
+bool is_wifi_connected();
 
-#endif
\ No newline at end of file
+// hand a notify to the job creation task, dropping queued work first when clean_jobs is set
+void stratum_enqueue_work(GlobalState * GLOBAL_STATE, mining_notify * notify, bool clean_jobs);
+
+#endif
@@ -0,0 +1,326 @@
+#include <lwip/sockets.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "esp_app_desc.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "global_state.h"
+#include "mining.h"
+#include "pool_connect.h"
+#include "stratum_task.h"
+#include "stratum_v2_api.h"
+#include "stratum_v2_task.h"
+#include "system.h"
+#include "utils.h"
+
+#define MAX_RETRY_ATTEMPTS 3
+
+// certificates are only checked against the clock once it has been set from a notify, 2023-11-14
+#define MIN_VALID_UNIX_TIME 1700000000
+
+static const char * TAG = "stratum_v2_task";
+
+static stratum_v2_client client;
+
+static uint8_t send_buffer[STRATUM_V2_SEND_BUFFER_SIZE];
+static uint8_t recv_buffer[STRATUM_V2_MAX_PAYLOAD + SV2_NOISE_MAC_LEN];
+static uint8_t payload[STRATUM_V2_MAX_PAYLOAD];
+
+static struct timeval v2_snd_timeout = {
+    .tv_sec = 5,
+    .tv_usec = 0
+};
+
+static struct timeval v2_rcv_timeout = {
+    .tv_sec = 60 * 10,
+    .tv_usec = 0
+};
+
+static bool send_all(int sock, const uint8_t * buf, size_t len)
+{
+    size_t sent = 0;
+    while (sent < len) {
+        int ret = write(sock, buf + sent, len - sent);
+        if (ret < 0) {
+            ESP_LOGE(TAG, "Unable to write to socket (errno %d: %s)", errno, strerror(errno));
+            return false;
+        }
+        sent += ret;
+    }
+    return true;
+}
+
+static bool recv_all(int sock, uint8_t * buf, size_t len)
+{
+    size_t received = 0;
+    while (received < len) {
+        int ret = recv(sock, buf + received, len - received, 0);
+        if (ret <= 0) {
+            ESP_LOGE(TAG, "Unable to read from socket (ret %d, errno %d: %s)", ret, errno, strerror(errno));
+            return false;
+        }
+        received += ret;
+    }
+    return true;
+}
+
+// no key leaves the pool unauthenticated, anything but 64 hex digits is refused rather than ignored
+static bool parse_authority_key(const char * hex, uint8_t key[32], bool * has_key)
+{
+    *has_key = hex != NULL && hex[0] != '\0';
+    if (!*has_key) {
+        return true;
+    }
+    if (strlen(hex) != 64 || strspn(hex, "0123456789abcdefABCDEF") != 64) {
+        ESP_LOGE(TAG, "Authority key must be 64 hex digits, not connecting: %s", hex);
+        return false;
+    }
+    return hex2bin(hex, key, 32) == 32;
+}
+
+static int track_request(GlobalState * GLOBAL_STATE)
+{
+    int id = GLOBAL_STATE->send_uid++;
+    request_tracker_add(&GLOBAL_STATE->request_tracker, id, NULL, 0, GLOBAL_STATE->SYSTEM_MODULE.pool_index,
+                        esp_timer_get_time());
+    return id;
+}
+
+static bool complete_request(GlobalState * GLOBAL_STATE, int id, bool success, int64_t received_us, tracked_request * request)
+{
+    if (!request_tracker_complete(&GLOBAL_STATE->request_tracker, id, success, received_us, request)) {
+        return false;
+    }
+    GLOBAL_STATE->SYSTEM_MODULE.response_time = (received_us - request->sent_us) / 1000.0;
+    return true;
+}
+
+static int connect_to_pool(const char * url, uint16_t port)
+{
+    char host_ip[INET6_ADDRSTRLEN];
+
+    int sock = pool_connect(url, port, host_ip, sizeof(host_ip), NULL);
+    if (sock < 0) {
+        ESP_LOGE(TAG, "Unable to connect to %s:%d", url, port);
+        return -1;
+    }
+    ESP_LOGI(TAG, "Connected to: stratum2+tcp://%s:%d (%s)", url, port, host_ip);
+
+    if (setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &v2_snd_timeout, sizeof(v2_snd_timeout)) != 0) {
+        ESP_LOGE(TAG, "Fail to setsockopt SO_SNDTIMEO");
+    }
+    if (setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &v2_rcv_timeout, sizeof(v2_rcv_timeout)) != 0) {
+        ESP_LOGE(TAG, "Fail to setsockopt SO_RCVTIMEO");
+    }
+
+    return sock;
+}
+
+// Noise handshake followed by SetupConnection
+static bool start_session(GlobalState * GLOBAL_STATE, const char * url, uint16_t port, const uint8_t * authority_key)
+{
+    uint8_t act1[SV2_NOISE_ACT1_LEN];
+    uint8_t act2[SV2_NOISE_ACT2_LEN];
+
+    if (STRATUM_V2_handshake_start(&client, act1) != 0 || !send_all(GLOBAL_STATE->sock, act1, sizeof(act1))) {
+        return false;
+    }
+    if (!recv_all(GLOBAL_STATE->sock, act2, sizeof(act2))) {
+        return false;
+    }
+
+    time_t now = time(NULL);
+    if (STRATUM_V2_handshake_finish(&client, act2, authority_key, now > MIN_VALID_UNIX_TIME ? now : 0) != 0) {
+        ESP_LOGE(TAG, "Noise handshake with %s failed", url);
+        return false;
+    }
+    ESP_LOGI(TAG, "Encrypted session established%s", authority_key != NULL ? ", pool key signed by the configured authority" : "");
+
+    sv2_setup_connection setup = {
+        .endpoint_host = url,
+        .endpoint_port = port,
+        .vendor = "bitaxe",
+        .hardware_version = GLOBAL_STATE->DEVICE_CONFIG.family.asic.name,
+        .firmware = esp_app_get_description()->version,
+        .device_id = GLOBAL_STATE->DEVICE_CONFIG.family.name,
+    };
+    int len = STRATUM_V2_setup_connection(&client, send_buffer, sizeof(send_buffer), &setup);
+    return len > 0 && send_all(GLOBAL_STATE->sock, send_buffer, len);
+}
+
+static bool receive_frame(GlobalState * GLOBAL_STATE, sv2_frame_header * header)
+{
+    if (!recv_all(GLOBAL_STATE->sock, recv_buffer, SV2_ENCRYPTED_HEADER_LEN) ||
+        STRATUM_V2_decrypt_header(&client, recv_buffer, header) != 0) {
+        return false;
+    }
+    if (header->length > STRATUM_V2_MAX_PAYLOAD) {
+        ESP_LOGE(TAG, "Frame of %lu bytes is larger than any message a standard channel expects", (unsigned long) header->length);
+        return false;
+    }
+    return recv_all(GLOBAL_STATE->sock, recv_buffer, STRATUM_V2_payload_wire_len(header)) &&
+           STRATUM_V2_decrypt_payload(&client, recv_buffer, header, payload) == 0;
+}
+
+int stratum_v2_format_submit(uint8_t * buf, size_t size, uint32_t sequence_number, const share_submission * share)
+{
+    return STRATUM_V2_submit_share(&client, buf, size, sequence_number, strtoul(share->jobid, NULL, 10), share->nonce,
+                                   share->ntime, share->version);
+}
+
+void stratum_v2_task(void * pvParameters)
+{
+    GlobalState * GLOBAL_STATE = (GlobalState *) pvParameters;
+    SystemModule * module = &GLOBAL_STATE->SYSTEM_MODULE;
+    int retry_attempts = 0;
+
+    STRATUM_V2_init(&client);
+
+    while (1) {
+        if (!is_wifi_connected()) {
+            ESP_LOGI(TAG, "WiFi disconnected, attempting to reconnect...");
+            vTaskDelay(10000 / portTICK_PERIOD_MS);
+            continue;
+        }
+
+        if (retry_attempts >= MAX_RETRY_ATTEMPTS) {
+            retry_attempts = 0;
+            if (module->pool_count > 1) {
+                module->pool_index = pool_selector_next(&GLOBAL_STATE->pool_selector, module->pool_index);
+                ESP_LOGI(TAG, "Switching target due to too many failures");
+            }
+        }
+
+        StratumPool * pool = &module->pools[module->pool_index];
+        const char * url = pool->url;
+        uint16_t port = pool->port;
+        const char * user = pool->user;
+        uint8_t authority_key[32];
+        bool has_authority;
+
+        if (!parse_authority_key(pool->authority_key, authority_key, &has_authority)) {
+            retry_attempts++;
+            vTaskDelay(5000 / portTICK_PERIOD_MS);
+            continue;
+        }
+        if (!has_authority) {
+            ESP_LOGE(TAG, "No authority key configured for %s, the pool is not authenticated and anyone in the path can impersonate it",
+                     url);
+        }
+
+        GLOBAL_STATE->sock = connect_to_pool(url, port);
+        if (GLOBAL_STATE->sock < 0) {
+            pool_selector_report(&GLOBAL_STATE->pool_selector, module->pool_index, false, 0, 0);
+            retry_attempts++;
+            vTaskDelay(5000 / portTICK_PERIOD_MS);
+            continue;
+        }
+
+        stratum_reset_uid(GLOBAL_STATE);
+        cleanQueue(GLOBAL_STATE);
+        STRATUM_V2_reset(&client);
+
+        int setup_id = track_request(GLOBAL_STATE);
+        if (!start_session(GLOBAL_STATE, url, port, has_authority ? authority_key : NULL)) {
+            retry_attempts++;
+            stratum_close_connection(GLOBAL_STATE);
+            continue;
+        }
+
+        int open_channel_id = 0;
+        // every share up to this sequence number has been answered
+        uint32_t acknowledged = 0;
+
+        while (1) {
+            sv2_frame_header header;
+            if (!receive_frame(GLOBAL_STATE, &header)) {
+                ESP_LOGE(TAG, "Failed to receive frame, reconnecting...");
+                retry_attempts++;
+                stratum_close_connection(GLOBAL_STATE);
+                break;
+            }
+            int64_t received_us = esp_timer_get_time();
+
+            stratum_v2_event event;
+            tracked_request request;
+            STRATUM_V2_handle_frame(&client, &header, payload, &event);
+
+            if (event.type == STRATUM_V2_SETUP_SUCCESS) {
+                complete_request(GLOBAL_STATE, setup_id, true, received_us, &request);
+                // nominal hash rate in H/s, the pool starts the channel target from it
+                float hashrate = GLOBAL_STATE->POWER_MANAGEMENT_MODULE.frequency_value * GLOBAL_STATE->DEVICE_CONFIG.family.asic.small_core_count *
+                                 GLOBAL_STATE->DEVICE_CONFIG.family.asic_count * 1e6f;
+                // the share submit task takes its sequence numbers from send_uid too
+                pthread_mutex_lock(&GLOBAL_STATE->send_lock);
+                open_channel_id = track_request(GLOBAL_STATE);
+                int len = STRATUM_V2_open_channel(&client, send_buffer, sizeof(send_buffer), open_channel_id, user, hashrate);
+                bool sent = len > 0 && send_all(GLOBAL_STATE->sock, send_buffer, len);
+                pthread_mutex_unlock(&GLOBAL_STATE->send_lock);
+                if (!sent) {
+                    stratum_close_connection(GLOBAL_STATE);
+                    break;
+                }
+            } else if (event.type == STRATUM_V2_SETUP_ERROR || event.type == STRATUM_V2_CHANNEL_ERROR) {
+                ESP_LOGE(TAG, "%s rejected: %s", event.type == STRATUM_V2_SETUP_ERROR ? "SetupConnection" : "OpenStandardMiningChannel",
+                         event.error);
+                retry_attempts++;
+                stratum_close_connection(GLOBAL_STATE);
+                break;
+            } else if (event.type == STRATUM_V2_CHANNEL_OPENED) {
+                complete_request(GLOBAL_STATE, open_channel_id, true, received_us, &request);
+                retry_attempts = 0;
+                acknowledged = GLOBAL_STATE->send_uid - 1;
+                ESP_LOGI(TAG, "Standard channel %lu open, difficulty %lu", client.channel_id, event.difficulty);
+
+                // header-only jobs: no extranonce to roll, the BIP320 version bits instead
+                char * old_extranonce_str = GLOBAL_STATE->extranonce_str;
+                GLOBAL_STATE->extranonce_str = strdup("");
+                GLOBAL_STATE->extranonce_2_len = 0;
+                free(old_extranonce_str);
+                GLOBAL_STATE->version_mask = STRATUM_DEFAULT_VERSION_MASK;
+                GLOBAL_STATE->new_stratum_version_rolling_msg = true;
+                GLOBAL_STATE->stratum_difficulty = event.difficulty;
+                GLOBAL_STATE->new_set_mining_difficulty_msg = true;
+                GLOBAL_STATE->abandon_work = 0;
+            } else if (event.type == STRATUM_V2_NEW_WORK) {
+                event.mining_notification->received_us = received_us;
+                stratum_enqueue_work(GLOBAL_STATE, event.mining_notification, event.mining_notification->clean_jobs);
+            } else if (event.type == STRATUM_V2_SET_TARGET) {
+                ESP_LOGI(TAG, "Set channel difficulty: %lu", event.difficulty);
+                GLOBAL_STATE->stratum_difficulty = event.difficulty;
+                GLOBAL_STATE->new_set_mining_difficulty_msg = true;
+            } else if (event.type == STRATUM_V2_SHARES_ACCEPTED) {
+                // one SubmitShares.Success covers every share up to its sequence number,
+                // older ones than the tracker holds are long gone
+                uint32_t first = acknowledged + 1;
+                if ((int32_t)(event.sequence_number - first) >= REQUEST_TRACKER_SIZE) {
+                    first = event.sequence_number - REQUEST_TRACKER_SIZE + 1;
+                }
+                for (uint32_t seq = first; (int32_t)(event.sequence_number - seq) >= 0; seq++) {
+                    if (complete_request(GLOBAL_STATE, seq, true, received_us, &request) && request.difficulty > 0) {
+                        ESP_LOGI(TAG, "share for job %s accepted at diff %lu", request.jobid, request.difficulty);
+                        SYSTEM_notify_accepted_share(GLOBAL_STATE);
+                    }
+                }
+                if ((int32_t)(event.sequence_number - acknowledged) > 0) {
+                    acknowledged = event.sequence_number;
+                }
+            } else if (event.type == STRATUM_V2_SHARE_REJECTED) {
+                if (complete_request(GLOBAL_STATE, event.sequence_number, false, received_us, &request) && request.difficulty > 0) {
+                    ESP_LOGW(TAG, "share for job %s rejected at diff %lu: %s", request.jobid, request.difficulty, event.error);
+                } else {
+                    ESP_LOGW(TAG, "share %lu rejected: %s", event.sequence_number, event.error);
+                }
+                SYSTEM_notify_rejected_share(GLOBAL_STATE, (char *) event.error);
+            } else if (event.type == STRATUM_V2_RECONNECT) {
+                ESP_LOGW(TAG, "Pool requested reconnect%s%s", event.new_host[0] != '\0' ? " to " : "", event.new_host);
+                stratum_close_connection(GLOBAL_STATE);
+                break;
+            }
+        }
+    }
+    vTaskDelete(NULL);
+}
@@ -0,0 +1,11 @@
+#ifndef STRATUM_V2_TASK_H_
+#define STRATUM_V2_TASK_H_
+
+#include "share_queue.h"
+
+void stratum_v2_task(void *pvParameters);
+
+// encrypt a SubmitSharesStandard for the open channel into buf, returns its length or -1
+int stratum_v2_format_submit(uint8_t *buf, size_t size, uint32_t sequence_number, const share_submission *share);
+
+#endif
@@ -3,80 +3,169 @@
 
 void queue_init(work_queue *queue)
 {
-    queue->head = 0;
-    queue->tail = 0;
-    queue->count = 0;
-    pthread_mutex_init(&queue->lock, NULL);
-    pthread_cond_init(&queue->not_empty, NULL);
-    pthread_cond_init(&queue->not_full, NULL);
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->tail, 0);
+    atomic_init(&queue->front, NULL);
+    atomic_init(&queue->waiting_consumer, NULL);
+    atomic_init(&queue->waiting_producer, NULL);
 }
 
-void queue_enqueue(work_queue *queue, void *new_work)
+// a waiter stores its handle before checking the queue again, the other side publishes its
+// change before loading the handle, so one of the two always sees the other
+static void wake(_Atomic(TaskHandle_t) *waiting)
 {
-    pthread_mutex_lock(&queue->lock);
-
-    while (queue->count == QUEUE_SIZE)
+    TaskHandle_t task = atomic_exchange(waiting, NULL);
+    if (task != NULL)
     {
-        pthread_cond_wait(&queue->not_full, &queue->lock);
+        xTaskNotifyGive(task);
     }
+}
 
-    queue->buffer[queue->tail] = new_work;
-    queue->tail = (queue->tail + 1) % QUEUE_SIZE;
-    queue->count++;
-
-    pthread_cond_signal(&queue->not_empty);
-    pthread_mutex_unlock(&queue->lock);
+static unsigned ring_count(work_queue *queue)
+{
+    return atomic_load(&queue->tail) - atomic_load(&queue->head);
 }
 
-void *queue_dequeue(work_queue *queue)
+static bool ring_push(work_queue *queue, void *new_work)
 {
-    pthread_mutex_lock(&queue->lock);
+    unsigned tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    if (tail - atomic_load(&queue->head) == QUEUE_SIZE)
+    {
+        return false;
+    }
+    queue->buffer[tail & (QUEUE_SIZE - 1)] = new_work;
+    atomic_store(&queue->tail, tail + 1);
+    return true;
+}
 
-    while (queue->count == 0)
+void queue_enqueue(work_queue *queue, void *new_work)
+{
+    while (!ring_push(queue, new_work))
     {
-        pthread_cond_wait(&queue->not_empty, &queue->lock);
+        atomic_store(&queue->waiting_producer, xTaskGetCurrentTaskHandle());
+        if (ring_push(queue, new_work))
+        {
+            atomic_store(&queue->waiting_producer, NULL);
+            break;
+        }
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
     }
+    wake(&queue->waiting_consumer);
+}
 
-    void *next_work = queue->buffer[queue->head];
-    queue->head = (queue->head + 1) % QUEUE_SIZE;
-    queue->count--;
+void queue_enqueue_front(work_queue *queue, void *new_work)
+{
+    // head never moves back, work still waiting in front goes to the back instead
+    void *previous = atomic_exchange(&queue->front, new_work);
+    if (previous != NULL)
+    {
+        queue_enqueue(queue, previous);
+        return;
+    }
+    wake(&queue->waiting_consumer);
+}
 
-    pthread_cond_signal(&queue->not_full);
-    pthread_mutex_unlock(&queue->lock);
+void *queue_try_dequeue(work_queue *queue)
+{
+    void *next_work = atomic_exchange(&queue->front, NULL);
+    if (next_work != NULL)
+    {
+        return next_work;
+    }
 
+    unsigned head = atomic_load(&queue->head);
+    do
+    {
+        if (head == atomic_load(&queue->tail))
+        {
+            return NULL;
+        }
+        next_work = queue->buffer[head & (QUEUE_SIZE - 1)];
+        // the slot belongs to the producer again once head moved past it
+    } while (!atomic_compare_exchange_weak(&queue->head, &head, head + 1));
+
+    wake(&queue->waiting_producer);
     return next_work;
 }
 
-void queue_clear(work_queue *queue)
+void *queue_dequeue(work_queue *queue)
 {
-    pthread_mutex_lock(&queue->lock);
-
-    while (queue->count > 0)
+    void *next_work;
+    while ((next_work = queue_try_dequeue(queue)) == NULL)
     {
-        mining_notify *next_work = queue->buffer[queue->head];
-        STRATUM_V1_free_mining_notify(next_work);
-        queue->head = (queue->head + 1) % QUEUE_SIZE;
-        queue->count--;
+        atomic_store(&queue->waiting_consumer, xTaskGetCurrentTaskHandle());
+        if ((next_work = queue_try_dequeue(queue)) != NULL)
+        {
+            atomic_store(&queue->waiting_consumer, NULL);
+            break;
+        }
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
     }
+    return next_work;
+}
 
-    pthread_cond_signal(&queue->not_full);
-    pthread_mutex_unlock(&queue->lock);
+unsigned queue_count(work_queue *queue)
+{
+    return ring_count(queue) + (atomic_load(&queue->front) != NULL);
 }
 
-void ASIC_jobs_queue_clear(work_queue *queue)
+void queue_drain(work_queue *queue, void (*free_work)(void *))
 {
-    pthread_mutex_lock(&queue->lock);
+    void *drained[QUEUE_SIZE];
+    unsigned count;
+
+    void *front = atomic_exchange(&queue->front, NULL);
+    if (front != NULL)
+    {
+        free_work(front);
+    }
 
-    while (queue->count > 0)
+    // take the whole ring in one step, a dequeue in between makes it start over
+    unsigned head = atomic_load(&queue->head);
+    while (1)
     {
-        bm_job *next_work = queue->buffer[queue->head];
-        free(next_work->jobid);
-        free(next_work->extranonce2);
-        free(next_work);
-        queue->head = (queue->head + 1) % QUEUE_SIZE;
-        queue->count--;
+        unsigned tail = atomic_load(&queue->tail);
+        count = tail - head;
+        if (count > QUEUE_SIZE)
+        {
+            // head moved on and the producer refilled the ring since head was loaded
+            head = atomic_load(&queue->head);
+            continue;
+        }
+        for (unsigned i = 0; i < count; i++)
+        {
+            drained[i] = queue->buffer[(head + i) & (QUEUE_SIZE - 1)];
+        }
+        if (atomic_compare_exchange_weak(&queue->head, &head, tail))
+        {
+            break;
+        }
     }
 
-    pthread_cond_signal(&queue->not_full);
-    pthread_mutex_unlock(&queue->lock);
+    wake(&queue->waiting_producer);
+
+    for (unsigned i = 0; i < count; i++)
+    {
+        free_work(drained[i]);
+    }
+}
+
+static void free_mining_notify(void *work)
+{
+    STRATUM_V1_free_mining_notify(work);
+}
+
+static void free_job(void *work)
+{
+    free_bm_job(work);
+}
+
+void queue_clear(work_queue *queue)
+{
+    queue_drain(queue, free_mining_notify);
+}
+
+void ASIC_jobs_queue_clear(work_queue *queue)
+{
+    queue_drain(queue, free_job);
 }
@@ -1,26 +1,46 @@
 #ifndef WORK_QUEUE_H
 #define WORK_QUEUE_H
 
-#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include "mining.h"
 
-#define QUEUE_SIZE 12
+// a power of two, head and tail run freely and wrap around
+#define QUEUE_SIZE 16
 
+// Single producer, single consumer ring without a lock. Only the producer moves tail. head moves
+// forward with a compare and swap, so the queue can also be drained or trimmed from another task.
+// A waiting producer or consumer blocks on its task notification.
 typedef struct
 {
     void *buffer[QUEUE_SIZE];
-    int head;
-    int tail;
-    int count;
-    pthread_mutex_t lock;
-    pthread_cond_t not_empty;
-    pthread_cond_t not_full;
+    atomic_uint head;
+    atomic_uint tail;
+    // queue_enqueue_front() work, dequeued before the ring
+    _Atomic(void *) front;
+    _Atomic(TaskHandle_t) waiting_consumer;
+    _Atomic(TaskHandle_t) waiting_producer;
 } work_queue;
 
 void queue_init(work_queue *queue);
+
+// producer only, blocks while the queue is full
 void queue_enqueue(work_queue *queue, void *new_work);
-void ASIC_jobs_queue_clear(work_queue *queue);
+// producer only, new_work is dequeued next
+void queue_enqueue_front(work_queue *queue, void *new_work);
+
+// consumer only, blocks while the queue is empty
 void *queue_dequeue(work_queue *queue);
+// oldest work or NULL when empty, from any task
+void *queue_try_dequeue(work_queue *queue);
+
+unsigned queue_count(work_queue *queue);
+
+// frees everything queued with free_work, from any task
+void queue_drain(work_queue *queue, void (*free_work)(void *));
 void queue_clear(work_queue *queue);
+void ASIC_jobs_queue_clear(work_queue *queue);
 
-#endif // WORK_QUEUE_H
\ No newline at end of file
+#endif // WORK_QUEUE_H